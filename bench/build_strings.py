@@ -0,0 +1,20 @@
+# Build a large document out of many short pieces, the way a report or a
+# serializer would. None of the intermediate strings is ever used as a key.
+import time
+
+count = 200000
+
+def build():
+    lines = []
+    for i in range(count):
+        line = '<row id="' + str(i) + '">' + 'x' * (i % 16) + '</row>'
+        lines.append(line)
+    document = '\n'.join(lines)
+    text = ''
+    for i in range(2000):
+        text += lines[i]
+    return len(document) + len(text)
+
+before = time.time()
+size = build()
+print(time.time() - before, size)
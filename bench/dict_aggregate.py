@@ -0,0 +1,24 @@
+# Group and count records by compound keys, the way a report or log
+# aggregation does: mostly lookups of keys that compare by value.
+import time
+
+count = 300000
+
+def aggregate():
+    byPair = {}
+    byName = {}
+    names = ['n' + str(i) for i in range(500)]
+    for i in range(count):
+        key = (i % 97, i % 89)
+        byPair[key] = byPair.get(key, 0) + 1
+        name = names[(i * 7) % 500]
+        byName[name] = byName.get(name, 0) + i
+    misses = 0
+    for i in range(count):
+        if (i, -i) not in byPair:
+            misses += 1
+    return len(byPair) + len(byName) + misses
+
+before = time.time()
+result = aggregate()
+print(time.time() - before, result)
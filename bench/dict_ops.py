@@ -0,0 +1,28 @@
+# Build many small dicts, fill a large one, iterate over it and delete
+# from it. Small dicts are where the table layout decides memory use.
+import time
+import sys
+
+count = 200000
+
+def build():
+    small = []
+    for i in range(count):
+        small.append({'id': i, 'name': 'x', 'parent': None})
+    big = {}
+    for i in range(count):
+        big[i] = i
+    total = 0
+    for i in range(10):
+        for k, v in big.items():
+            total += v
+    for i in range(0, count, 2):
+        del big[i]
+    for i in range(count):
+        if i in big:
+            total += 1
+    return total + len(small) + sys.getsizeof(small[0]) + sys.getsizeof(big)
+
+before = time.time()
+result = build()
+print(time.time() - before, result)
@@ -0,0 +1,53 @@
+# Echo server and clients in one process: many connections open at once,
+# each sending messages and waiting for them to come back.
+import asyncio
+import socket
+import time
+
+CLIENTS = 2000
+MESSAGES = 20
+
+async def handle(loop, conn):
+    while True:
+        data = await loop.sock_recv(conn, 4096)
+        if not data:
+            break
+        await loop.sock_sendall(conn, data)
+    conn.close()
+
+async def serve(loop, server):
+    for i in range(CLIENTS):
+        conn, addr = await loop.sock_accept(server)
+        conn.setblocking(False)
+        loop.create_task(handle(loop, conn))
+
+async def client(loop, port):
+    s = socket.socket()
+    s.setblocking(False)
+    await loop.sock_connect(s, ('127.0.0.1', port))
+    message = b'x' * 64
+    for i in range(MESSAGES):
+        await loop.sock_sendall(s, message)
+        got = 0
+        while got < len(message):
+            got += len(await loop.sock_recv(s, 4096))
+    s.close()
+
+async def main():
+    loop = asyncio.get_running_loop()
+    server = socket.socket()
+    server.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    server.bind(('127.0.0.1', 0))
+    server.listen(4096)
+    server.setblocking(False)
+    port = server.getsockname()[1]
+    serving = loop.create_task(serve(loop, server))
+    clients = [loop.create_task(client(loop, port)) for i in range(CLIENTS)]
+    for c in clients:
+        await c
+    await serving
+    server.close()
+
+before = time.time()
+asyncio.run(main())
+print(time.time() - before, CLIENTS * MESSAGES)
@@ -0,0 +1,23 @@
+# Pull values through a chain of generators, each of which keeps a few
+# locals live across its yields, so every value resumes every stage.
+import time
+
+def source(n):
+    for i in range(n):
+        yield i
+
+def stage(it, k):
+    a, b, c, d = k, k * 2, k * 3, k * 4
+    seen = 0
+    for v in it:
+        seen += 1
+        yield v + a - b + c - d + k * 2
+
+before = time.time()
+it = source(20000)
+for k in range(20):
+    it = stage(it, k)
+total = 0
+for v in it:
+    total += v
+print(time.time() - before, total)
@@ -0,0 +1,23 @@
+# Fill a dict with keys chosen to share a hash. Integers that differ only
+# above their low 32 bits all used to hash alike, as did floats that
+# differed only in their fractions; with keyed hashing they are spread
+# out like any other keys.
+import time
+
+count = 20000
+
+def flood():
+    d = {}
+    for i in range(count):
+        d[i << 32] = i
+    for i in range(count):
+        d[i / count] = i
+    found = 0
+    for i in range(count):
+        if (i << 32) in d:
+            found += 1
+    return found + len(d)
+
+before = time.time()
+result = flood()
+print(time.time() - before, result)
@@ -0,0 +1,17 @@
+# Make many new strings of a few sizes by slicing, each of which has to
+# be hashed to be looked up in the string table.
+import time
+
+text = ''.join([chr(97 + (i * 7) % 26) for i in range(4096)])
+
+def slices(size):
+    total = 0
+    for i in range(200000):
+        start = (i * 13) % (4096 - size)
+        total += len(text[start:start + size])
+    return total
+
+for size in [4, 16, 64, 512]:
+    before = time.time()
+    total = slices(size)
+    print(size, time.time() - before, total)
@@ -0,0 +1,31 @@
+# Allocate many small, short-lived objects from several threads at once.
+# Every allocation adds an object to the collector's object list and
+# counts its bytes toward the next collection.
+from threading import Thread
+import time
+
+count = 100000
+
+class Point:
+    def __init__(self, x, y):
+        self.x = x
+        self.y = y
+
+class Allocator(Thread):
+    def __init__(self):
+        super().__init__()
+        self.total = 0
+    def run(self):
+        for i in range(count):
+            p = Point(i, [i, (i, i)])
+            self.total += p.x
+
+def allocate(threadcount):
+    threads = [Allocator() for n in range(threadcount)]
+    before = time.time()
+    for thread in threads: thread.start()
+    for thread in threads: thread.join()
+    return time.time() - before
+
+for threadcount in [1, 2, 4, 8]:
+    print(min(allocate(threadcount) for x in range(3)), threadcount, "threads")
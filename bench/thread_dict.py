@@ -0,0 +1,37 @@
+# Several threads share one dict and one set: mostly lookups, with one write
+# for every eight reads, so writers keep growing and changing both tables
+# while other threads read them.
+from threading import Thread
+import time
+
+count = 40000
+
+class Worker(Thread):
+    def __init__(self, n, table, members):
+        super().__init__()
+        self.n = n
+        self.table = table
+        self.members = members
+        self.hits = 0
+    def run(self):
+        base = self.n * count
+        for i in range(count):
+            if i % 8 == 0:
+                self.table[base + i] = i
+                self.members.add(base + i)
+            if (i >> 1) in self.table:
+                self.hits += 1
+            if i in self.members:
+                self.hits += 1
+
+def share(threadcount):
+    table = {}
+    members = set()
+    threads = [Worker(n, table, members) for n in range(threadcount)]
+    before = time.time()
+    for thread in threads: thread.start()
+    for thread in threads: thread.join()
+    return time.time() - before
+
+for threadcount in [1, 2, 4, 8]:
+    print(min(share(threadcount) for x in range(3)), threadcount, "threads")
@@ -0,0 +1,28 @@
+# Build new strings from several threads at once. The numbers are short and
+# interned, so they are looked up in, and usually added to, the shared string
+# table; the concatenations are not.
+from threading import Thread
+import time
+
+count = 50000
+
+class Builder(Thread):
+    def __init__(self, n):
+        super().__init__()
+        self.n = n
+        self.total = 0
+    def run(self):
+        prefix = '{"worker": ' + str(self.n) + ', "item": '
+        for i in range(count):
+            line = prefix + str(i) + ', "tag": "' + str(i * 7) + '"}'
+            self.total += len(line)
+
+def build(threadcount):
+    threads = [Builder(n) for n in range(threadcount)]
+    before = time.time()
+    for thread in threads: thread.start()
+    for thread in threads: thread.join()
+    return time.time() - before
+
+for threadcount in [1, 2, 4, 8, 16]:
+    print(min(build(threadcount) for x in range(3)), threadcount, "threads")
@@ -22,6 +22,7 @@ KrkValue krk_dirObject(int argc, const KrkValue argv[], int hasKw) {
 	if (IS_INSTANCE(argv[0])) {
 		/* Obtain self-reference */
 		KrkInstance * self = AS_INSTANCE(argv[0]);
+		krk_tableDictionaryMode(&self->fields);
 		for (size_t i = 0; i < self->fields.capacity; ++i) {
 			if (!IS_KWARGS(self->fields.entries[i].key)) {
 				krk_writeValueArray(AS_LIST(myList),
@@ -309,6 +310,7 @@ KRK_Function(dir) {
 
 		/* Put all the keys from the globals table in it */
 		KrkTable * globals = krk_currentThread.frames[krk_currentThread.frameCount-1].globals;
+		krk_tableDictionaryMode(globals);
 		for (size_t i = 0; i < globals->capacity; ++i) {
 			KrkTableEntry * entry = &globals->entries[i];
 			if (IS_KWARGS(entry->key)) continue;
@@ -383,10 +385,9 @@ int krk_unpackIterable(KrkValue iterable, void * context, int callback(void *, c
 	} else if (IS_list(iterable)) {
 		if (callback(context, AS_LIST(iterable)->values, AS_LIST(iterable)->count)) return 1;
 	} else if (IS_dict(iterable)) {
-		for (size_t i = 0; i < AS_DICT(iterable)->capacity; ++i) {
-			if (!IS_KWARGS(AS_DICT(iterable)->entries[i].key)) {
-				if (callback(context, &AS_DICT(iterable)->entries[i].key, 1)) return 1;
-			}
+		KrkTableEntry entry;
+		for (size_t i = 0; krk_tableNextEntry(AS_DICT(iterable), &i, &entry);) {
+			if (callback(context, &entry.key, 1)) return 1;
 		}
 	} else if (IS_STRING(iterable)) {
 		krk_unicodeString(AS_STRING(iterable));
@@ -891,6 +892,7 @@ KRK_Function(locals) {
 	}
 
 	KrkCallFrame * frame = &krk_currentThread.frames[krk_currentThread.frameCount-index];
+	KrkValue * stack = krk_stackOfFrame(krk_currentThread.frameCount-index);
 	KrkCodeObject * func = frame->closure->function;
 	size_t offset = frame->ip - func->chunk.code;
 
@@ -899,25 +901,25 @@ KRK_Function(locals) {
 	for (short int i = 0; i < func->potentialPositionals; ++i) {
 		krk_tableSet(AS_DICT(dict),
 			func->positionalArgNames.values[i],
-			krk_currentThread.stack[frame->slots + slot]);
+			stack[frame->slots + slot]);
 		slot++;
 	}
 	if (func->obj.flags & KRK_OBJ_FLAGS_CODEOBJECT_COLLECTS_ARGS) {
 		krk_tableSet(AS_DICT(dict),
 			func->positionalArgNames.values[func->potentialPositionals],
-			krk_currentThread.stack[frame->slots + slot]);
+			stack[frame->slots + slot]);
 		slot++;
 	}
 	for (short int i = 0; i < func->keywordArgs; ++i) {
 		krk_tableSet(AS_DICT(dict),
 			func->keywordArgNames.values[i],
-			krk_currentThread.stack[frame->slots + slot]);
+			stack[frame->slots + slot]);
 		slot++;
 	}
 	if (func->obj.flags & KRK_OBJ_FLAGS_CODEOBJECT_COLLECTS_KWS) {
 		krk_tableSet(AS_DICT(dict),
 			func->keywordArgNames.values[func->keywordArgs],
-			krk_currentThread.stack[frame->slots + slot]);
+			stack[frame->slots + slot]);
 		slot++;
 	}
 	/* Now we need to find out what non-argument locals are valid... */
@@ -926,7 +928,7 @@ KRK_Function(locals) {
 			func->localNames[i].deathday >= offset) {
 			krk_tableSet(AS_DICT(dict),
 				OBJECT_VAL(func->localNames[i].name),
-				krk_currentThread.stack[frame->slots + func->localNames[i].id]);
+				stack[frame->slots + func->localNames[i].id]);
 		}
 	}
 
@@ -1365,7 +1367,7 @@ KRK_StaticMethod(Cell,__new__) {
 	return OBJECT_VAL(out);
 }
 
-#define UPVALUE_LOCATION(upvalue) (upvalue->location == -1 ? &upvalue->closed : &upvalue->owner->stack[upvalue->location])
+#define UPVALUE_LOCATION(upvalue) (upvalue->location == -1 ? &upvalue->closed : &(*upvalue->stack)[upvalue->location])
 KRK_Method(Cell,__repr__) {
 	struct StringBuilder sb = {0};
 
@@ -1388,6 +1390,7 @@ _error:
 KRK_Method(Cell,cell_contents) {
 	if (argc > 1) {
 		*UPVALUE_LOCATION(self) = argv[1];
+		if (self->location != -1 && self->segmentOwner) krk_gcWriteBarrier(self->segmentOwner);
 	}
 	return *UPVALUE_LOCATION(self);
 }
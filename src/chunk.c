@@ -47,6 +47,8 @@ void krk_freeChunk(KrkChunk * chunk) {
 }
 
 size_t krk_addConstant(KrkChunk * chunk, KrkValue value) {
+	/* Names and keys are looked up by identity, so string constants are interned */
+	if (IS_STRING(value)) value = OBJECT_VAL(krk_internString(AS_STRING(value)));
 	krk_push(value);
 	krk_writeValueArray(&chunk->constants, value);
 	krk_pop();
@@ -284,7 +284,12 @@ static void _GlobalState_gcscan(KrkInstance * _self) {
 	struct GlobalState * self = (void*)_self;
 	Compiler * compiler = self->current;
 	while (compiler != NULL) {
-		if (compiler->enclosed && compiler->enclosed->codeobject) krk_markObject((KrkObj*)compiler->enclosed->codeobject);
+		/* Code objects are filled in without write barriers while they are compiled. */
+		if (compiler->enclosed && compiler->enclosed->codeobject) {
+			krk_gcWriteBarrier((KrkObj*)compiler->enclosed->codeobject);
+			krk_markObject((KrkObj*)compiler->enclosed->codeobject);
+		}
+		if (compiler->codeobject) krk_gcWriteBarrier((KrkObj*)compiler->codeobject);
 		krk_markObject((KrkObj*)compiler->codeobject);
 		compiler = compiler->enclosing;
 	}
@@ -296,8 +301,15 @@ static void _GlobalState_gcsweep(KrkInstance * _self) {
 
 #define currentChunk() (&state->current->codeobject->chunk)
 
+/**
+ * Instructions that look up a name at runtime (see @ref hasInlineCache) are
+ * followed by a two-byte index into the code object's inline cache array.
+ * Slots are handed out in emission order; if a rewind discards an instruction
+ * its slot simply goes unused.
+ */
 #define EMIT_OPERAND_OP(opc, arg) do { if (arg < 256) { emitBytes(opc, arg); } \
-	else { emitBytes(opc ## _LONG, arg >> 16); emitBytes(arg >> 8, arg); } } while (0)
+	else { emitBytes(opc ## _LONG, arg >> 16); emitBytes(arg >> 8, arg); } \
+	if (hasInlineCache(opc)) emitCacheSlot(state); } while (0)
 
 static int isMethod(int type) {
 	return type == TYPE_METHOD || type == TYPE_INIT || type == TYPE_COROUTINE_METHOD;
@@ -557,6 +569,17 @@ static void _emitBytes(struct GlobalState * state, uint8_t byte1, uint8_t byte2)
 
 #define emitBytes(a,b) _emitBytes(state,a,b)
 
+static inline int hasInlineCache(int opcode) {
+	return opcode == OP_GET_PROPERTY || opcode == OP_GET_METHOD || opcode == OP_GET_GLOBAL;
+}
+
+static void emitCacheSlot(struct GlobalState * state) {
+	KrkCodeObject * function = state->current->codeobject;
+	size_t slot = KRK_INLINE_CACHE_NONE;
+	if (function->cacheCount < KRK_INLINE_CACHE_NONE) slot = function->cacheCount++;
+	emitBytes(slot >> 8, slot);
+}
+
 static void emitReturn(struct GlobalState * state) {
 	if (state->current->type != TYPE_LAMBDA && state->current->type != TYPE_CLASS) {
 		emitByte(OP_NONE);
@@ -564,6 +587,190 @@ static void emitReturn(struct GlobalState * state) {
 	emitByte(OP_RETURN);
 }
 
+/**
+ * Superinstructions
+ *
+ * Once a function is complete, short runs of instructions that show up in
+ * most loops are fused by replacing the opcode of the first instruction in
+ * the run with a superinstruction that does the work of the whole run. The
+ * rest of the run is left in place; the superinstruction reads operands from
+ * where they already are and then skips over them. Nothing moves, so jump
+ * offsets, the line map, local name lifetimes and inline cache slots stay as
+ * they were, and the disassembler still shows the original instructions
+ * after the fused one.
+ *
+ * A run is only fused if nothing jumps into the middle of it and it does not
+ * span more than one line, so tracebacks from the last instruction in the
+ * run point at the same line they would have.
+ */
+static size_t closureUpvaluesSize(KrkChunk * chunk, size_t offset, size_t size) {
+	size_t constant = size == 2 ? chunk->code[offset + 1] :
+		(size_t)((chunk->code[offset + 1] << 16) | (chunk->code[offset + 2] << 8) | chunk->code[offset + 3]);
+	KrkCodeObject * function = AS_codeobject(chunk->constants.values[constant]);
+	size_t extra = 0;
+	for (size_t j = 0; j < function->upvalueCount; ++j) {
+		extra += (chunk->code[offset + size + extra] & 2) ? 4 : 2;
+	}
+	return extra;
+}
+
+static size_t instructionSize(KrkChunk * chunk, size_t offset) {
+	size_t size = 0;
+	switch (chunk->code[offset]) {
+#define SIMPLE(opc) case opc: size = 1; break;
+#define OPERANDB(opc,more) case opc: size = 2; break;
+#define LOCALS(opc) case opc: size = 3; break;
+#define CONSTANT(opc,more) case opc: size = 2; more; break; \
+	case opc ## _LONG: size = 4; more; break;
+#define OPERAND(opc,more) case opc: size = 2; break; \
+	case opc ## _LONG: size = 4; break;
+#define JUMP(opc,sign) case opc: size = 3; break;
+#define CLOSURE_MORE size += closureUpvaluesSize(chunk, offset, size);
+#define CACHE_MORE size += 2;
+#define NOOP
+#include "opcodes.h"
+#undef SIMPLE
+#undef OPERANDB
+#undef LOCALS
+#undef OPERAND
+#undef CONSTANT
+#undef JUMP
+#undef CLOSURE_MORE
+#undef CACHE_MORE
+#undef NOOP
+	}
+	return size;
+}
+
+static uint8_t * findJumpTargets(KrkChunk * chunk) {
+	uint8_t * targets = calloc(chunk->count + 1, 1);
+	for (size_t offset = 0; offset < chunk->count;) {
+		size_t size = instructionSize(chunk, offset);
+		switch (chunk->code[offset]) {
+#define SIMPLE(opc)
+#define OPERANDB(opc,more)
+#define LOCALS(opc)
+#define CONSTANT(opc,more)
+#define OPERAND(opc,more)
+#define JUMP(opc,sign) case opc: { \
+	size_t target = offset + 3 sign ((chunk->code[offset + 1] << 8) | chunk->code[offset + 2]); \
+	if (target <= chunk->count) targets[target] = 1; \
+	break; }
+#include "opcodes.h"
+#undef SIMPLE
+#undef OPERANDB
+#undef LOCALS
+#undef OPERAND
+#undef CONSTANT
+#undef JUMP
+			/* Loop exits resume at the instruction after them. */
+			case OP_EXIT_LOOP:
+			case OP_EXIT_LOOP_LONG:
+				targets[offset + size] = 1;
+				break;
+		}
+		if (!size) break;
+		offset += size;
+	}
+	return targets;
+}
+
+static int isFusable(KrkChunk * chunk, uint8_t * targets, size_t offset, size_t size) {
+	if (offset + size > chunk->count) return 0;
+	for (size_t i = offset + 1; i < offset + size; ++i) {
+		if (targets[i]) return 0;
+	}
+	/* Line map entries are in increasing offset order. */
+	for (size_t i = 0; i < chunk->linesCount; ++i) {
+		if (chunk->lines[i].startOffset >= offset + size) break;
+		if (chunk->lines[i].startOffset > offset) return 0;
+	}
+	return 1;
+}
+
+static int isFusedComparison(uint8_t opcode) {
+	return opcode == OP_LESS || opcode == OP_LESS_EQUAL || opcode == OP_GREATER ||
+	       opcode == OP_GREATER_EQUAL || opcode == OP_EQUAL;
+}
+
+static int isFusedBranch(uint8_t opcode) {
+	return opcode == OP_POP_JUMP_IF_FALSE || opcode == OP_JUMP_IF_FALSE_OR_POP;
+}
+
+/* Returns the superinstruction for the run starting at @p offset, or 0, and its length in @p size. */
+static uint8_t matchFusion(KrkChunk * chunk, size_t offset, size_t * size) {
+	uint8_t * code = chunk->code + offset;
+	size_t remaining = chunk->count - offset;
+#define AT(n) (n < remaining ? code[n] : 0)
+	switch (code[0]) {
+		case OP_GET_LOCAL:
+			if (AT(2) != OP_GET_LOCAL && AT(2) != OP_CONSTANT) return 0;
+			if (AT(2) == OP_CONSTANT && isFusedComparison(AT(4)) && isFusedBranch(AT(5))) {
+				*size = 8;
+				return OP_GET_LOCAL_CONSTANT_COMPARE_JUMP;
+			}
+			*size = 4;
+			return AT(2) == OP_GET_LOCAL ? OP_GET_LOCAL_GET_LOCAL : OP_GET_LOCAL_CONSTANT;
+		case OP_ADD_LOCALS:
+		case OP_SUBTRACT_LOCALS:
+		case OP_MULTIPLY_LOCALS:
+			if (AT(3) != OP_SET_LOCAL || AT(5) != OP_POP) return 0;
+			*size = 6;
+			switch (code[0]) {
+				case OP_ADD_LOCALS:      return OP_ADD_LOCALS_SET_LOCAL_POP;
+				case OP_SUBTRACT_LOCALS: return OP_SUBTRACT_LOCALS_SET_LOCAL_POP;
+				case OP_MULTIPLY_LOCALS: return OP_MULTIPLY_LOCALS_SET_LOCAL_POP;
+			}
+			return 0;
+		case OP_LESS_LOCALS:
+		case OP_LESS_EQUAL_LOCALS:
+		case OP_GREATER_LOCALS:
+		case OP_GREATER_EQUAL_LOCALS:
+		case OP_EQUAL_LOCALS:
+			if (!isFusedBranch(AT(3))) return 0;
+			*size = 6;
+			switch (code[0]) {
+				case OP_LESS_LOCALS:          return OP_LESS_LOCALS_JUMP;
+				case OP_LESS_EQUAL_LOCALS:    return OP_LESS_EQUAL_LOCALS_JUMP;
+				case OP_GREATER_LOCALS:       return OP_GREATER_LOCALS_JUMP;
+				case OP_GREATER_EQUAL_LOCALS: return OP_GREATER_EQUAL_LOCALS_JUMP;
+				case OP_EQUAL_LOCALS:         return OP_EQUAL_LOCALS_JUMP;
+			}
+			return 0;
+		case OP_ADD:
+		case OP_SUBTRACT:
+		case OP_INPLACE_ADD:
+		case OP_INPLACE_SUBTRACT:
+			if (AT(1) != OP_SET_LOCAL || AT(3) != OP_POP) return 0;
+			*size = 4;
+			switch (code[0]) {
+				case OP_ADD:              return OP_ADD_SET_LOCAL_POP;
+				case OP_SUBTRACT:         return OP_SUBTRACT_SET_LOCAL_POP;
+				case OP_INPLACE_ADD:      return OP_INPLACE_ADD_SET_LOCAL_POP;
+				case OP_INPLACE_SUBTRACT: return OP_INPLACE_SUBTRACT_SET_LOCAL_POP;
+			}
+	}
+#undef AT
+	return 0;
+}
+
+static void fuseInstructions(KrkChunk * chunk) {
+	uint8_t * targets = findJumpTargets(chunk);
+	for (size_t offset = 0; offset < chunk->count;) {
+		size_t size = 0;
+		uint8_t fused = matchFusion(chunk, offset, &size);
+		if (fused && isFusable(chunk, targets, offset, size)) {
+			chunk->code[offset] = fused;
+			offset += size;
+			continue;
+		}
+		size = instructionSize(chunk, offset);
+		if (!size) break;
+		offset += size;
+	}
+	free(targets);
+}
+
 static KrkCodeObject * endCompiler(struct GlobalState * state) {
 	KrkCodeObject * function = state->current->codeobject;
 
@@ -621,6 +828,13 @@ static KrkCodeObject * endCompiler(struct GlobalState * state) {
 
 	function->totalArguments = function->potentialPositionals + function->keywordArgs + !!(function->obj.flags & KRK_OBJ_FLAGS_CODEOBJECT_COLLECTS_ARGS) + !!(function->obj.flags & KRK_OBJ_FLAGS_CODEOBJECT_COLLECTS_KWS);
 
+	if (!state->parser.hadError) fuseInstructions(&function->chunk);
+
+	if (function->cacheCount) {
+		function->caches = ALLOCATE(KrkInlineCache, function->cacheCount);
+		memset(function->caches, 0, sizeof(KrkInlineCache) * function->cacheCount);
+	}
+
 #ifndef KRK_NO_DISASSEMBLY
 	if ((krk_currentThread.flags & KRK_THREAD_ENABLE_DISASSEMBLY) && !state->parser.hadError) {
 		krk_disassembleCodeObject(stderr, function, function->name ? function->name->chars : "(module)");
@@ -821,7 +1035,44 @@ static void _patchJump(struct GlobalState * state, int offset) {
 
 #define patchJump(o) _patchJump(state,o)
 
-static void compareChained(struct GlobalState * state, int inner) {
+static uint8_t localsOpcode(uint8_t opcode) {
+	switch (opcode) {
+		case OP_ADD:           return OP_ADD_LOCALS;
+		case OP_SUBTRACT:      return OP_SUBTRACT_LOCALS;
+		case OP_MULTIPLY:      return OP_MULTIPLY_LOCALS;
+		case OP_LESS:          return OP_LESS_LOCALS;
+		case OP_LESS_EQUAL:    return OP_LESS_EQUAL_LOCALS;
+		case OP_GREATER:       return OP_GREATER_LOCALS;
+		case OP_GREATER_EQUAL: return OP_GREATER_EQUAL_LOCALS;
+		case OP_EQUAL:         return OP_EQUAL_LOCALS;
+	}
+	return 0;
+}
+
+/**
+ * Emit a binary operator whose left operand started at @p left.
+ *
+ * If both operands were plain locals, the two GET_LOCALs are replaced
+ * with a single LOCALS instruction that reads them from their slots.
+ * They must be on the same line as each other, as the replacement only
+ * gets one line map entry.
+ */
+static void _emitOperator(struct GlobalState * state, ChunkRecorder * left, uint8_t opcode) {
+	KrkChunk * chunk = currentChunk();
+	uint8_t locals = localsOpcode(opcode);
+	if (left && locals && chunk->count == left->count + 4 &&
+		chunk->code[left->count] == OP_GET_LOCAL && chunk->code[left->count + 2] == OP_GET_LOCAL &&
+		!(chunk->linesCount && chunk->lines[chunk->linesCount-1].startOffset > left->count)) {
+		chunk->code[left->count] = locals;
+		chunk->code[left->count + 2] = chunk->code[left->count + 3];
+		chunk->count--;
+		return;
+	}
+	emitByte(opcode);
+}
+#define emitOperator(l,o) _emitOperator(state,l,o)
+
+static void compareChained(struct GlobalState * state, int inner, ChunkRecorder * left) {
 	KrkTokenType operatorType = state->parser.previous.type;
 	if (operatorType == TOKEN_NOT) consume(TOKEN_IN, "'in' must follow infix 'not'");
 	int invert = (operatorType == TOKEN_IS && match(TOKEN_NOT));
@@ -832,15 +1083,16 @@ static void compareChained(struct GlobalState * state, int inner) {
 	if (getRule(state->parser.current.type)->precedence == PREC_COMPARISON) {
 		emitByte(OP_SWAP);
 		emitBytes(OP_DUP, 1);
+		left = NULL;
 	}
 
 	switch (operatorType) {
-		case TOKEN_BANG_EQUAL:    emitBytes(OP_EQUAL, OP_NOT); break;
-		case TOKEN_EQUAL_EQUAL:   emitByte(OP_EQUAL); break;
-		case TOKEN_GREATER:       emitByte(OP_GREATER); break;
-		case TOKEN_GREATER_EQUAL: emitByte(OP_GREATER_EQUAL); break;
-		case TOKEN_LESS:          emitByte(OP_LESS); break;
-		case TOKEN_LESS_EQUAL:    emitByte(OP_LESS_EQUAL); break;
+		case TOKEN_BANG_EQUAL:    emitOperator(left, OP_EQUAL); emitByte(OP_NOT); break;
+		case TOKEN_EQUAL_EQUAL:   emitOperator(left, OP_EQUAL); break;
+		case TOKEN_GREATER:       emitOperator(left, OP_GREATER); break;
+		case TOKEN_GREATER_EQUAL: emitOperator(left, OP_GREATER_EQUAL); break;
+		case TOKEN_LESS:          emitOperator(left, OP_LESS); break;
+		case TOKEN_LESS_EQUAL:    emitOperator(left, OP_LESS_EQUAL); break;
 
 		case TOKEN_IS: emitByte(OP_IS); if (invert) emitByte(OP_NOT); break;
 
@@ -853,7 +1105,7 @@ static void compareChained(struct GlobalState * state, int inner) {
 	if (getRule(state->parser.current.type)->precedence == PREC_COMPARISON) {
 		size_t exitJump = emitJump(OP_JUMP_IF_FALSE_OR_POP);
 		advance();
-		compareChained(state, 1);
+		compareChained(state, 1, NULL);
 		patchJump(exitJump);
 		if (getRule(state->parser.current.type)->precedence != PREC_COMPARISON) {
 			if (!inner) {
@@ -867,7 +1119,7 @@ static void compareChained(struct GlobalState * state, int inner) {
 }
 
 static void compare(struct GlobalState * state, int exprType, RewindState *rewind) {
-	compareChained(state, 0);
+	compareChained(state, 0, &rewind->before);
 	invalidTarget(state, exprType, "operator");
 }
 
@@ -884,9 +1136,9 @@ static void binary(struct GlobalState * state, int exprType, RewindState *rewind
 		case TOKEN_LEFT_SHIFT:  emitByte(OP_SHIFTLEFT); break;
 		case TOKEN_RIGHT_SHIFT: emitByte(OP_SHIFTRIGHT); break;
 
-		case TOKEN_PLUS:     emitByte(OP_ADD); break;
-		case TOKEN_MINUS:    emitByte(OP_SUBTRACT); break;
-		case TOKEN_ASTERISK: emitByte(OP_MULTIPLY); break;
+		case TOKEN_PLUS:     emitOperator(&rewind->before, OP_ADD); break;
+		case TOKEN_MINUS:    emitOperator(&rewind->before, OP_SUBTRACT); break;
+		case TOKEN_ASTERISK: emitOperator(&rewind->before, OP_MULTIPLY); break;
 		case TOKEN_POW:      emitByte(OP_POW); break;
 		case TOKEN_SOLIDUS:  emitByte(OP_DIVIDE); break;
 		case TOKEN_DOUBLE_SOLIDUS: emitByte(OP_FLOORDIV); break;
@@ -101,6 +101,7 @@ static int isJumpTarget(KrkCodeObject * func, size_t startPoint) {
 #define OPERANDB(opc,more) case opc: { size = 2; more; break; }
 #define OPERAND(opc,more) OPERANDB(opc,more) \
 	case opc ## _LONG: { size = 4; more; break; }
+#define LOCALS(opc) case opc: size = 3; break;
 #define JUMP(opc,sign) case opc: { uint16_t jump = (chunk->code[offset + 1] << 8) | (chunk->code[offset + 2]); \
 	if ((size_t)(offset + 3 sign jump) == startPoint) return 1; \
 	size = 3; break; }
@@ -116,6 +117,7 @@ static int isJumpTarget(KrkCodeObject * func, size_t startPoint) {
 #define EXPAND_ARGS_MORE
 #define LOCAL_MORE
 #define FORMAT_VALUE_MORE
+#define CACHE_MORE size += 2;
 
 	while (offset < chunk->count) {
 		uint8_t opcode = chunk->code[offset];
@@ -128,11 +130,13 @@ static int isJumpTarget(KrkCodeObject * func, size_t startPoint) {
 	return 0;
 #undef SIMPLE
 #undef OPERANDB
+#undef LOCALS
 #undef OPERAND
 #undef CONSTANT
 #undef JUMP
 #undef CLOSURE_MORE
 #undef LOCAL_MORE
+#undef CACHE_MORE
 #undef EXPAND_ARGS_MORE
 #undef FORMAT_VALUE_MORE
 }
@@ -179,6 +183,8 @@ static void _jump(OPARGS, int sign) {
 #define SIMPLE(opc) case opc: _simple(f,#opc,&size,&offset,func,chunk); break;
 #define CONSTANT(opc,more) case opc: _constant(f,#opc,&size,&offset,func,chunk,0,more); break; \
 	case opc ## _LONG: _constant(f,#opc "_LONG",&size,&offset,func,chunk,1,more); break;
+#define OPERANDB(opc,more) case opc: _operand(f,#opc,&size,&offset,func,chunk,0,more); break;
+#define LOCALS(opc) case opc: _locals(f,#opc,&size,&offset,func,chunk); break;
 #define OPERAND(opc,more) case opc: _operand(f,#opc,&size,&offset,func,chunk,0,more); break; \
 	case opc ## _LONG: _operand(f,#opc "_LONG",&size,&offset,func,chunk,1,more); break;
 #define JUMP(opc,sign) case opc: _jump(f,#opc,&size,&offset,func,chunk,sign 1); break;
@@ -229,6 +235,13 @@ static void _format_value_more(OPARGS, size_t operand) {
 	}
 }
 
+#define CACHE_MORE _cache_more
+static void _cache_more(OPARGS, size_t constant) {
+	size_t slot = (chunk->code[*offset + *size] << 8) | chunk->code[*offset + *size + 1];
+	if (slot != KRK_INLINE_CACHE_NONE) fprintf(f, " (cache %zu)", slot);
+	*size += 2;
+}
+
 #define LOCAL_MORE _local_more
 static void _local_more(OPARGS, size_t operand) {
 	for (size_t i = 0; i < func->localNameCount; ++i) {
@@ -245,6 +258,14 @@ static void _local_more(OPARGS, size_t operand) {
 	}
 }
 
+static void _locals(OPARGS) {
+	_print_opcode(OPARG_VALS);
+	fprintf(f, "%4d %d", (int)chunk->code[*offset + 1], (int)chunk->code[*offset + 2]);
+	_local_more(OPARG_VALS, chunk->code[*offset + 1]);
+	_local_more(OPARG_VALS, chunk->code[*offset + 2]);
+	*size = 3;
+}
+
 size_t krk_disassembleInstruction(FILE * f, KrkCodeObject * func, size_t offset) {
 	KrkChunk * chunk = &func->chunk;
 	if (offset > 0 && krk_lineNumber(chunk, offset) == krk_lineNumber(chunk, offset - 1)) {
@@ -288,11 +309,13 @@ size_t krk_disassembleInstruction(FILE * f, KrkCodeObject * func, size_t offset)
 }
 #undef SIMPLE
 #undef OPERANDB
+#undef LOCALS
 #undef OPERAND
 #undef CONSTANT
 #undef JUMP
 #undef CLOSURE_MORE
 #undef LOCAL_MORE
+#undef CACHE_MORE
 #undef EXPAND_ARGS_MORE
 #undef FORMAT_VALUE_MORE
 #undef NOOP
@@ -351,6 +374,7 @@ int krk_debug_addBreakpointFileLine(KrkString * filename, size_t line, int flags
 
 	/* Examine all code objects to find one that matches the requested
 	 * filename and line number... */
+	krk_gcGatherObjects();
 	KrkObj * object = vm.objects;
 	while (object) {
 		if (object->type == KRK_OBJ_CODEOBJECT) {
@@ -680,6 +704,8 @@ KRK_Function(build) {
 #define CONSTANT(opc,more) case opc: { constant = chunk->code[offset + 1]; size = 2; more; break; } \
 	case opc ## _LONG: { constant = (chunk->code[offset + 1] << 16) | \
 	(chunk->code[offset + 2] << 8) | (chunk->code[offset + 3]); size = 4; more; break; }
+#define OPERANDB(opc,more) case opc: { operand = chunk->code[offset + 1]; size = 2; more; break; }
+#define LOCALS(opc) case opc: { operand = chunk->code[offset + 1]; local = operand; size = 3; break; }
 #define OPERAND(opc,more) case opc: { operand = chunk->code[offset + 1]; size = 2; more; break; } \
 	case opc ## _LONG: { operand = (chunk->code[offset + 1] << 16) | \
 	(chunk->code[offset + 2] << 8) | (chunk->code[offset + 3]); size = 4; more; break; }
@@ -699,6 +725,7 @@ KRK_Function(build) {
 #define EXPAND_ARGS_MORE
 #define FORMAT_VALUE_MORE
 #define LOCAL_MORE local = operand;
+#define CACHE_MORE size += 2;
 static KrkValue _examineInternal(KrkCodeObject* func) {
 	KrkValue output = krk_list_of(0,NULL,0);
 	krk_push(output);
@@ -757,11 +784,13 @@ KRK_Function(examine) {
 
 #undef SIMPLE
 #undef OPERANDB
+#undef LOCALS
 #undef OPERAND
 #undef CONSTANT
 #undef JUMP
 #undef CLOSURE_MORE
 #undef LOCAL_MORE
+#undef CACHE_MORE
 #undef EXPAND_ARGS_MORE
 #undef FORMAT_VALUE_MORE
 
@@ -838,12 +867,15 @@ void krk_module_init_dis(void) {
 
 #define OPCODE(opc) krk_attachNamedValue(&module->fields, #opc, INTEGER_VAL(opc));
 #define SIMPLE(opc) OPCODE(opc)
+#define OPERANDB(opc,more) OPCODE(opc)
+#define LOCALS(opc) OPCODE(opc)
 #define CONSTANT(opc,more) OPCODE(opc) OPCODE(opc ## _LONG)
 #define OPERAND(opc,more) OPCODE(opc) OPCODE(opc ## _LONG)
 #define JUMP(opc,sign) OPCODE(opc)
 #include "opcodes.h"
 #undef SIMPLE
 #undef OPERANDB
+#undef LOCALS
 #undef OPERAND
 #undef CONSTANT
 #undef JUMP
@@ -372,13 +372,30 @@ static void attachTraceback(void) {
 		/* Build the traceback object */
 		if (krk_currentThread.frameCount) {
 
-			/* Go up until we get to the exit frame */
+			/* Go up until we get to the exit frame, continuing into the stacks
+			 * set aside by running generators if their own has no handler. */
 			size_t frameOffset = 0;
-			if (krk_currentThread.stackTop > krk_currentThread.stack) {
-				size_t stackOffset = krk_currentThread.stackTop - krk_currentThread.stack - 1;
-				while (stackOffset > 0 && !IS_HANDLER_TYPE(krk_currentThread.stack[stackOffset], OP_PUSH_TRY)) stackOffset--;
-				frameOffset = krk_currentThread.frameCount - 1;
-				while (frameOffset > 0 && krk_currentThread.frames[frameOffset].slots > stackOffset) frameOffset--;
+			size_t frameLimit = krk_currentThread.frameCount;
+			KrkValue * stack = krk_currentThread.stack;
+			KrkValue * stackTop = krk_currentThread.stackTop;
+			KrkStackSegment * segment = krk_currentThread.outerStacks;
+			while (1) {
+				size_t frameBase = segment ? segment->frames : 0;
+				if (stackTop > stack) {
+					size_t stackOffset = stackTop - stack - 1;
+					while (stackOffset > 0 && !IS_HANDLER_TYPE(stack[stackOffset], OP_PUSH_TRY)) stackOffset--;
+					if (segment && !IS_HANDLER_TYPE(stack[stackOffset], OP_PUSH_TRY)) goto _nextSegment;
+					frameOffset = frameLimit > frameBase ? frameLimit - 1 : frameBase;
+					while (frameOffset > frameBase && krk_currentThread.frames[frameOffset].slots > stackOffset) frameOffset--;
+					break;
+				} else if (!segment) {
+					break;
+				}
+_nextSegment:
+				frameLimit = frameBase;
+				stack = segment->stack;
+				stackTop = segment->stackTop;
+				segment = segment->prev;
 			}
 
 			for (size_t i = frameOffset; i < krk_currentThread.frameCount; i++) {
@@ -399,6 +416,7 @@ static void attachTraceback(void) {
 			}
 		}
 
+		krk_gcWriteBarrier((KrkObj*)theException);
 		krk_attachNamedValue(&theException->fields, "traceback", tracebackList);
 		krk_pop();
 		krk_pop();
@@ -412,6 +430,7 @@ void krk_attachInnerException(KrkValue innerException) {
 			/* re-raised? */
 			return;
 		} else {
+			krk_gcWriteBarrier((KrkObj*)theException);
 			krk_attachNamedValue(&theException->fields, "__context__", innerException);
 		}
 	}
@@ -430,6 +449,7 @@ void krk_raiseException(KrkValue base, KrkValue cause) {
 		if (krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION) return;
 	}
 	if (IS_INSTANCE(krk_currentThread.currentException) && !IS_NONE(cause)) {
+		krk_gcWriteBarrierValue(krk_currentThread.currentException);
 		krk_attachNamedValue(&AS_INSTANCE(krk_currentThread.currentException)->fields,
 			"__cause__", cause);
 	}
@@ -115,6 +115,7 @@ KRK_Method(File,readline) {
 	size_t spaceAvailable = 0;
 	char * buffer = NULL;
 
+	krk_gcBlockingBegin();
 	do {
 		if (spaceAvailable < sizeRead + BLOCK_SIZE) {
 			spaceAvailable = (spaceAvailable ? spaceAvailable * 2 : (2 * BLOCK_SIZE));
@@ -134,7 +135,8 @@ KRK_Method(File,readline) {
 		if (krk_currentThread.flags & KRK_THREAD_SIGNALLED) break;
 	} while (!feof(file));
 
-_finish_line: (void)0;
+_finish_line:
+	krk_gcBlockingEnd();
 	if (sizeRead == 0) {
 		free(buffer);
 		return NONE_VAL();
@@ -187,6 +189,7 @@ KRK_Method(File,read) {
 	size_t spaceAvailable = 0;
 	char * buffer = NULL;
 
+	krk_gcBlockingBegin();
 	if (sizeToRead == -1) {
 		do {
 			if (spaceAvailable < sizeRead + BLOCK_SIZE) {
@@ -200,6 +203,7 @@ KRK_Method(File,read) {
 
 			if (newlyRead < BLOCK_SIZE) {
 				if (ferror(file)) {
+					krk_gcBlockingEnd();
 					free(buffer);
 					return krk_runtimeError(vm.exceptions->ioError, "Read error.");
 				}
@@ -212,6 +216,7 @@ KRK_Method(File,read) {
 		buffer = realloc(buffer, spaceAvailable);
 		sizeRead = fread(buffer, 1, sizeToRead, file);
 	}
+	krk_gcBlockingEnd();
 
 	/* Make a new string to fit our output. */
 	KrkString * out = krk_copyString(buffer,sizeRead);
@@ -290,6 +295,7 @@ KRK_Method(BinaryFile,readline) {
 	size_t spaceAvailable = 0;
 	char * buffer = NULL;
 
+	krk_gcBlockingBegin();
 	do {
 		if (spaceAvailable < sizeRead + BLOCK_SIZE) {
 			spaceAvailable = (spaceAvailable ? spaceAvailable * 2 : (2 * BLOCK_SIZE));
@@ -309,7 +315,8 @@ KRK_Method(BinaryFile,readline) {
 		if (krk_currentThread.flags & KRK_THREAD_SIGNALLED) break;
 	} while (!feof(file));
 
-_finish_line: (void)0;
+_finish_line:
+	krk_gcBlockingEnd();
 	if (sizeRead == 0) {
 		free(buffer);
 		return NONE_VAL();
@@ -362,6 +369,7 @@ KRK_Method(BinaryFile,read) {
 	size_t spaceAvailable = 0;
 	char * buffer = NULL;
 
+	krk_gcBlockingBegin();
 	if (sizeToRead == -1) {
 		do {
 			if (spaceAvailable < sizeRead + BLOCK_SIZE) {
@@ -376,6 +384,7 @@ KRK_Method(BinaryFile,read) {
 
 			if (newlyRead < BLOCK_SIZE) {
 				if (ferror(file)) {
+					krk_gcBlockingEnd();
 					free(buffer);
 					return krk_runtimeError(vm.exceptions->ioError, "Read error.");
 				}
@@ -388,6 +397,7 @@ KRK_Method(BinaryFile,read) {
 		buffer = realloc(buffer, spaceAvailable);
 		sizeRead = fread(buffer, 1, sizeToRead, file);
 	}
+	krk_gcBlockingEnd();
 
 	/* Make a new string to fit our output. */
 	KrkBytes * out = krk_newBytes(sizeRead, (unsigned char*)buffer);
@@ -59,7 +59,12 @@ static int doRead(char * buf, size_t bufSize) {
 		return rline(buf, bufSize);
 	else
 #endif
-		return read(STDIN_FILENO, buf, bufSize);
+	{
+		krk_gcBlockingBegin();
+		int result = read(STDIN_FILENO, buf, bufSize);
+		krk_gcBlockingEnd();
+		return result;
+	}
 }
 
 static KrkValue readLine(char * prompt, int promptWidth, char * syntaxHighlighter) {
@@ -761,12 +766,18 @@ int main(int argc, char * argv[]) {
 #endif
 	char * runCmd = NULL;
 	int flags = 0;
+	char * hashSeed = getenv("KUROKO_HASHSEED");
+	if (hashSeed && *hashSeed) krk_setHashSeed(strtoull(hashSeed, NULL, 0));
 	int moduleAsMain = 0;
 	int inspectAfter = 0;
 	int opt;
 	int maxDepth = -1;
-	while ((opt = getopt(argc, argv, "+:c:C:dgGim:rR:tTMSV-:")) != -1) {
+	while ((opt = getopt(argc, argv, "+:Bc:C:dgGim:NrR:tTMSV-:")) != -1) {
 		switch (opt) {
+			case 'B':
+				/* Do not read or write cached bytecode for imports. */
+				flags |= KRK_GLOBAL_NO_BYTECODE_CACHE;
+				break;
 			case 'c':
 				runCmd = optarg;
 				goto _finishArgs;
@@ -781,6 +792,10 @@ int main(int argc, char * argv[]) {
 			case 'G':
 				flags |= KRK_GLOBAL_REPORT_GC_COLLECTS;
 				break;
+			case 'N':
+				/* Collect young objects separately from old ones. */
+				flags |= KRK_GLOBAL_GENERATIONAL_GC;
+				break;
 			case 'S':
 				flags |= KRK_THREAD_SINGLE_STEP;
 				break;
@@ -830,11 +845,13 @@ int main(int argc, char * argv[]) {
 					fprintf(stderr,"usage: %s [flags] [FILE...]\n"
 						"\n"
 						"Interpreter options:\n"
+						" -B          Do not read or write cached bytecode for imports.\n"
 						" -d          Debug output from the bytecode compiler.\n"
 						" -g          Collect garbage on every allocation.\n"
 						" -G          Report GC collections.\n"
 						" -i          Enter repl after a running -c, -m, or FILE.\n"
 						" -m mod      Run a module as a script.\n"
+						" -N          Use generational garbage collection.\n"
 						" -r          Disable complex line editing in the REPL.\n"
 						" -R depth    Set maximum recursion depth.\n"
 						" -t          Disassemble instructions as they are exceuted.\n"
@@ -847,7 +864,8 @@ int main(int argc, char * argv[]) {
 						" --version   Print version information.\n"
 						" --help      Show this help text.\n"
 						"\n"
-						"If no files are provided, the interactive REPL will run.\n",
+						"If no files are provided, the interactive REPL will run.\n"
+						"Set KUROKO_HASHSEED to a number to make hashes repeatable.\n",
 						argv[0]);
 #endif
 					return 0;
@@ -1061,7 +1079,9 @@ _finishArgs:
 					}
 				} else {
 #endif
+					krk_gcBlockingBegin();
 					char * out = fgets(buf, 4096, stdin);
+					krk_gcBlockingEnd();
 					if (krk_currentThread.flags & KRK_THREAD_SIGNALLED) {
 						fprintf(stdout, "\n");
 					} else if ((!out || !strlen(buf))) {
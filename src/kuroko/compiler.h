@@ -16,3 +16,34 @@
  */
 extern KrkCodeObject * krk_compile(const char * src, char * fileName);
 
+
+/**
+ * @brief Load the cached bytecode for a source file.
+ *
+ * Looks for a cache file next to @p fileName, with a @c b appended to its
+ * name (@c foo.krk becomes @c foo.krkb), and loads it if it was written
+ * for the current contents of the source file by a compatible interpreter.
+ *
+ * The returned code object is not referenced from anywhere; the caller
+ * must keep it alive, eg. by pushing it to the stack, before allocating.
+ *
+ * @param fileName Path of the source file.
+ * @return The module's code object, or NULL if there is no usable cache.
+ */
+extern KrkCodeObject * krk_loadBytecode(const char * fileName);
+
+/**
+ * @brief Write the cached bytecode for a source file.
+ *
+ * Writes @p code, which should be the result of compiling @p source
+ * from @p fileName, to the cache file used by @ref krk_loadBytecode.
+ * Nothing is written if the code object has constants that can not be
+ * cached, or if the file is no longer the same size as @p source.
+ *
+ * @param code     Code object compiled from @p source.
+ * @param fileName Path of the source file.
+ * @param source   Source code that was compiled.
+ * @param length   Length of @p source.
+ * @return 1 if a cache file was written, 0 otherwise.
+ */
+extern int krk_saveBytecode(KrkCodeObject * code, const char * fileName, const char * source, size_t length);
@@ -15,6 +15,8 @@
 
 #define ALLOCATE(type, count) (type*)krk_reallocate(NULL,0,sizeof(type)*(count))
 
+#define FREE_OBJECT(t,p) krk_slabFree(p,sizeof(t))
+
 /**
  * @brief Resize an allocated heap object.
  *
@@ -29,6 +31,28 @@
  */
 extern void * krk_reallocate(void * ptr, size_t old, size_t new);
 
+/**
+ * @brief Allocate space for a heap object.
+ *
+ * Like @c krk_reallocate with no existing pointer, but sizes up to
+ * @c KRK_SLAB_MAX are served from the current thread's slab free lists.
+ * Memory obtained this way must only be released with @c krk_slabFree.
+ *
+ * @param size Size of the object.
+ * @return Pointer to uninitialized space for the object.
+ */
+extern void * krk_slabAllocate(size_t size);
+
+/**
+ * @brief Release space obtained from krk_slabAllocate.
+ *
+ * The slot goes back on the current thread's free list for its size class.
+ *
+ * @param ptr  Object to release.
+ * @param size The size that was passed to krk_slabAllocate.
+ */
+extern void krk_slabFree(void * ptr, size_t size);
+
 /**
  * @brief Release all objects.
  *
@@ -48,6 +72,105 @@ extern void krk_freeObjects(void);
  */
 extern size_t krk_collectGarbage(void);
 
+/**
+ * @brief Collect young objects.
+ *
+ * In generational mode, marks and sweeps only the objects allocated since
+ * the last collection, promoting those that survive. Old objects are not
+ * traced, except for those in the remembered set.
+ *
+ * @return The number of objects released by this collection cycle.
+ */
+extern size_t krk_collectYoung(void);
+
+/**
+ * @brief Add an old object to the remembered set.
+ *
+ * Use @ref krk_gcWriteBarrier instead of calling this directly.
+ */
+extern void krk_gcRemember(KrkObj * object);
+
+/**
+ * @brief Note that a reference is being stored into @p object.
+ *
+ * In generational mode, minor collections do not trace through old
+ * objects, so a young object referenced only from an old one would be
+ * released. C code that stores references into an object must call this,
+ * unless the object is one of the arguments to the native function doing
+ * the store, or was created by it - those are already taken care of.
+ */
+static inline void krk_gcWriteBarrier(KrkObj * object) {
+	if ((object->flags & (KRK_OBJ_FLAGS_IS_OLD | KRK_OBJ_FLAGS_REMEMBERED)) == KRK_OBJ_FLAGS_IS_OLD) {
+		krk_gcRemember(object);
+	}
+}
+
+/**
+ * @brief Same as @ref krk_gcWriteBarrier, for a value that may not be an object.
+ */
+static inline void krk_gcWriteBarrierValue(KrkValue value) {
+	if (IS_OBJECT(value)) krk_gcWriteBarrier(AS_OBJECT(value));
+}
+
+/**
+ * @brief Enable or disable generational collection.
+ *
+ * Disabling it returns all old objects to the young generation.
+ */
+extern void krk_gcSetGenerational(int enabled);
+
+/**
+ * @brief Set the number of helper threads used by full collections.
+ *
+ * Returns non-zero if @p count is more than this build supports.
+ */
+extern int krk_gcSetHelpers(size_t count);
+
+/**
+ * @brief Finish sweeping after the last collection.
+ *
+ * Collections started by allocation may leave unreachable objects to be
+ * swept by later allocations.
+ */
+extern void krk_gcFinishSweep(void);
+
+/**
+ * @brief Put every object on the object list so it can be walked.
+ *
+ * Finishes any sweep in progress and moves the objects each thread has
+ * allocated since the last collection onto @c vm.objects.
+ */
+extern void krk_gcGatherObjects(void);
+
+/**
+ * @brief Stop here if another thread is waiting to collect garbage.
+ *
+ * When threads are in use, a collection waits until every other thread
+ * has stopped at a safepoint. The interpreter loop and allocations are
+ * safepoints; this is called from them and rarely needs to be called
+ * directly. Everything the calling thread needs kept alive must be
+ * reachable from its stack.
+ */
+extern void krk_gcSafepoint(void);
+
+/**
+ * @brief Mark the start of a call that may block without touching the heap.
+ *
+ * Native functions that wait on I/O, sleep, or another thread should
+ * wrap the blocking part with this and @c krk_gcBlockingEnd, so that
+ * other threads can collect garbage in the meantime. Between the two
+ * calls, the thread must not allocate or access any objects that are
+ * not reachable from its stack.
+ */
+extern void krk_gcBlockingBegin(void);
+
+/**
+ * @brief Mark the end of a blocking call.
+ *
+ * If a collection is in progress, waits for it to finish.
+ */
+extern void krk_gcBlockingEnd(void);
+
 /**
  * @brief During a GC scan cycle, mark a value as used.
  *
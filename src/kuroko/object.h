@@ -50,11 +50,14 @@ typedef struct KrkObj {
 #define KRK_OBJ_FLAGS_STRING_UCS1   0x0001
 #define KRK_OBJ_FLAGS_STRING_UCS2   0x0002
 #define KRK_OBJ_FLAGS_STRING_UCS4   0x0003
+#define KRK_OBJ_FLAGS_STRING_UNINTERNED 0x0004
 
 #define KRK_OBJ_FLAGS_CODEOBJECT_COLLECTS_ARGS 0x0001
 #define KRK_OBJ_FLAGS_CODEOBJECT_COLLECTS_KWS  0x0002
 #define KRK_OBJ_FLAGS_CODEOBJECT_IS_GENERATOR  0x0004
 #define KRK_OBJ_FLAGS_CODEOBJECT_IS_COROUTINE  0x0008
+#define KRK_OBJ_FLAGS_CODEOBJECT_MAPPED        0x1000 /**< Bytecode and line map are in a bytecode image, not owned */
+#define KRK_OBJ_FLAGS_CODEOBJECT_UNVERIFIED    0x2000 /**< Mapped bytecode has not been checked against @c mappedHash yet */
 
 #define KRK_OBJ_FLAGS_FUNCTION_MASK                0x0003
 #define KRK_OBJ_FLAGS_FUNCTION_IS_CLASS_METHOD     0x0001
@@ -66,6 +69,8 @@ typedef struct KrkObj {
 #define KRK_OBJ_FLAGS_IN_REPR       0x0020
 #define KRK_OBJ_FLAGS_IMMORTAL      0x0040
 #define KRK_OBJ_FLAGS_VALID_HASH    0x0080
+#define KRK_OBJ_FLAGS_IS_OLD        0x0400
+#define KRK_OBJ_FLAGS_REMEMBERED    0x0800
 
 
 /**
@@ -117,7 +122,8 @@ typedef struct KrkUpvalue {
 	int location;                  /**< @brief Stack offset or -1 if closed */
 	KrkValue   closed;             /**< @brief Heap storage for closed value */
 	struct KrkUpvalue * next;      /**< @brief Invasive linked list pointer to next upvalue */
-	struct KrkThreadState * owner; /**< @brief The thread that owns the stack this upvalue belongs in */
+	KrkValue ** stack;             /**< @brief Where the base of the stack segment this upvalue belongs in is kept */
+	KrkObj * segmentOwner;         /**< @brief Object owning that segment, kept alive while the upvalue is open; NULL for a thread's own stack */
 } KrkUpvalue;
 
 /**
@@ -134,6 +140,40 @@ typedef struct {
 } KrkLocalEntry;
 
 struct KrkInstance;
+struct KrkClass;
+
+#define KRK_INLINE_CACHE_EMPTY   0
+#define KRK_INLINE_CACHE_FIELD   1
+#define KRK_INLINE_CACHE_METHOD  2
+#define KRK_INLINE_CACHE_GLOBAL  3
+#define KRK_INLINE_CACHE_BUILTIN 4
+#define KRK_INLINE_CACHE_NONE    0xFFFF
+
+/**
+ * @brief Per-instruction lookup cache.
+ *
+ * Each GET_PROPERTY, GET_METHOD and GET_GLOBAL instruction carries an index
+ * into its code object's cache array. For attribute loads, a cache entry
+ * remembers the type of the last receiver seen by that instruction and where
+ * the attribute was found; it is only valid while @c version matches the
+ * type's @c cacheIndex, which is reset whenever the type or one of its bases
+ * is modified. For global loads, it remembers the slot the name was found in,
+ * valid while the versions of the tables involved are unchanged.
+ *
+ * Entries are shared by every thread running the code object, so they are
+ * written between two increments of @c sequence, and readers only use a copy
+ * taken while it was even and unchanged.
+ */
+typedef struct {
+	size_t sequence;        /**< @brief Odd while the entry is being written */
+	struct KrkClass * type; /**< @brief Receiver type this entry was filled for */
+	size_t version;         /**< @brief Value of the type's @c cacheIndex when filled */
+	size_t kind;            /**< @brief One of the KRK_INLINE_CACHE_ kinds */
+	size_t layout;          /**< @brief Version of the receiver's fields, or of the globals, when filled */
+	size_t builtins;        /**< @brief Version of the builtins table, for builtins */
+	size_t slot;            /**< @brief Slot of the field or global, from @ref krk_tableSlot */
+	KrkValue value;         /**< @brief Unbound method, for methods */
+} KrkInlineCache;
 
 /**
  * @brief Code object.
@@ -157,6 +197,10 @@ typedef struct {
 	size_t localNameCount;                 /**< @brief Number of entries in @ref localNames */
 	KrkLocalEntry * localNames;            /**< @brief Stores the names of local variables used in the function, for debugging */
 	KrkString * qualname;                  /**< @brief The dotted name of the function */
+	size_t cacheCount;                     /**< @brief Number of entries in @ref caches */
+	KrkInlineCache * caches;               /**< @brief Inline caches for attribute lookup instructions */
+	uint16_t * counters;                   /**< @brief Quickening counters by instruction offset, allocated on first use */
+	uint64_t mappedHash;                   /**< @brief Expected hash of mapped bytecode and line map, checked before the first call */
 } KrkCodeObject;
 
 
@@ -323,6 +367,9 @@ typedef struct {
 typedef struct {
 	KrkInstance inst;  /**< @protected @brief Base */
 	KrkTable entries;  /**< @brief The actual table of values in the dict */
+#ifndef KRK_DISABLE_THREADS
+	KrkTableLock lock; /**< @brief Taken while changing @c entries */
+#endif
 } KrkDict;
 
 /**
@@ -410,6 +457,35 @@ extern KrkString * krk_takeString(char * chars, size_t length);
  */
 extern KrkString * krk_takeStringVetted(char * chars, size_t length, size_t codesLength, KrkStringType type, uint32_t hash);
 
+/**
+ * @brief Like @ref krk_takeStringVetted but the result is not interned.
+ * @memberof KrkString
+ *
+ * Strings made by joining, repeating, or formatting other strings are often
+ * printed or written and then thrown away, so they skip the string table and
+ * are not hashed. An uninterned string is equal to, and has the same hash as,
+ * the interned string with the same contents, but is not the same object.
+ * It is interned when it is used as a key in a table or as an attribute name.
+ *
+ * @param chars C string to take ownership of, allocated with @c ALLOCATE.
+ * @param length Length of the C string.
+ * @param codesLength Length of the expected resulting KrkString in codepoints.
+ * @param type Compact type of the string, eg. UCS1, UCS2, UCS4... @see KrkStringType
+ */
+extern KrkString * krk_takeStringUninterned(char * chars, size_t length, size_t codesLength, KrkStringType type);
+
+/**
+ * @brief Get the interned string with the same contents as @p string.
+ * @memberof KrkString
+ *
+ * Interned strings are returned as they are. An uninterned string becomes
+ * the interned string if there is not one already.
+ *
+ * @param string String to intern.
+ * @return The interned string.
+ */
+extern KrkString * krk_internString(KrkString * string);
+
 /**
  * @brief Obtain a string object representation of the given C string.
  * @memberof KrkString
@@ -417,6 +493,8 @@ extern KrkString * krk_takeStringVetted(char * chars, size_t length, size_t code
  * Converts the C string 'chars' into a string object by checking the
  * string table for it. If the string table does not have an equivalent
  * string, a new one will be created by copying 'chars'.
+ * Strings longer than KRK_STRING_INTERN_MAX bytes are always copied and
+ * are not interned; see @ref krk_takeStringUninterned.
  *
  * 'chars' must be a nil-terminated C string representing a UTF-8
  * character sequence.
@@ -10,6 +10,7 @@
  */
 
 #include <stdlib.h>
+#include <sys/types.h>
 #include "kuroko.h"
 #include "value.h"
 #include "threads.h"
@@ -22,15 +23,47 @@ typedef struct {
 	KrkValue value;
 } KrkTableEntry;
 
+struct KrkShape;
+struct KrkString;
+
 /**
  * @brief Simple hash table of arbitrary keys to values.
+ *
+ * Ordinary tables keep their entries in a dense array in the order the keys
+ * were added, behind an index that is used for lookups. Only the first @c used
+ * entries have ever been filled; removed entries, and the unused ones up to
+ * @c capacity, have keyword-argument markers as their keys, so code walking
+ * @c entries should skip entries for which @c IS_KWARGS(key) is true.
+ *
+ * Tables initialized with @ref krk_initShapedTable start out in "shape mode":
+ * instead of owning a hash table they point to a @c KrkShape shared with other
+ * tables that added the same string keys in the same order, and keep only a
+ * dense array of values. In that mode @c capacity is always 0 and @c entries
+ * is NULL, so code that walks @c entries directly must first switch the table
+ * to dictionary mode with @ref krk_tableDictionaryMode.
  */
 typedef struct {
-	size_t count;
-	size_t capacity;
+	size_t count;    /**< @brief Number of keys in the table */
+	size_t used;     /**< @brief Number of entries filled, including removed ones */
+	size_t capacity; /**< @brief Size of the entry array */
 	KrkTableEntry * entries;
+	struct KrkShape * shape; /**< @brief Shared key layout, or NULL for an ordinary hash table */
+	union {
+		KrkValue * values;   /**< @brief Values indexed by shape slot, when @c shape is set */
+		size_t version;      /**< @brief Without a shape: if non-zero, changes whenever entries are added, removed or moved */
+	};
 } KrkTable;
 
+/**
+ * @brief Lock taken by threads changing a table that other threads can see.
+ *
+ * Only writers take the lock; lookups and iteration never wait for it.
+ */
+typedef struct {
+	void * owner;  /**< @brief State of the thread holding the lock, or NULL */
+	size_t depth;  /**< @brief Number of times the owner has taken the lock */
+} KrkTableLock;
+
 /**
  * @brief Initialize a hash table.
  * @memberof KrkTable
@@ -43,6 +76,69 @@ typedef struct {
  */
 extern void krk_initTable(KrkTable * table);
 
+/**
+ * @brief Initialize a table that stores string keys in a shared shape.
+ * @memberof KrkTable
+ *
+ * Used for instance attribute tables. The table behaves like any other
+ * table through the krk_table* functions, but objects that gain the same
+ * attributes in the same order share one key layout. The table falls back
+ * to dictionary mode automatically when a key is deleted, a non-string key
+ * is stored, or it grows too large.
+ *
+ * @param table Hash table to initialize.
+ */
+extern void krk_initShapedTable(KrkTable * table);
+
+/**
+ * @brief Convert a shaped table to an ordinary hash table.
+ * @memberof KrkTable
+ *
+ * Must be called before iterating over @c entries of a table that may
+ * have been initialized with @ref krk_initShapedTable. Does nothing if
+ * the table is already in dictionary mode.
+ *
+ * @param table Table to convert.
+ */
+extern void krk_tableDictionaryMode(KrkTable * table);
+
+/**
+ * @brief Get a value identifying the current layout of a table.
+ * @memberof KrkTable
+ *
+ * As long as the version of a table does not change, no keys have been
+ * added to or removed from it and every existing key stays in the same
+ * slot, so a slot found by @ref krk_tableSlot can be read directly.
+ * Ordinary hash tables only start tracking their version once this has
+ * been called on them. Versions are unique across all tables, but tables
+ * sharing a shape share its version.
+ *
+ * @param table Table to examine.
+ * @return The table's version, never 0.
+ */
+extern size_t krk_tableVersion(KrkTable * table);
+
+/**
+ * @brief Find the slot for a key in a table.
+ * @memberof KrkTable
+ *
+ * The slot can be passed to @ref krk_tableSlotValue for as long as
+ * @ref krk_tableVersion returns the same result.
+ *
+ * @param table Table to search.
+ * @param str   Interned string key.
+ * @return Slot index for @p str, or -1 if it is not in the table.
+ */
+extern ssize_t krk_tableSlot(KrkTable * table, struct KrkString * str);
+
+/**
+ * @brief Get the storage for a slot found by @ref krk_tableSlot.
+ * @memberof KrkTable
+ */
+static inline KrkValue * krk_tableSlotValue(KrkTable * table, size_t slot) {
+	return table->shape ? &table->values[slot] : &table->entries[slot].value;
+}
+
 /**
  * @brief Release resources associated with a hash table.
  * @memberof KrkTable
@@ -53,6 +149,33 @@ extern void krk_initTable(KrkTable * table);
  */
 extern void krk_freeTable(KrkTable * table);
 
+/**
+ * @brief Remove every key from a table that may still be in use.
+ * @memberof KrkTable
+ *
+ * Unlike @ref krk_freeTable, other threads may be reading the table.
+ *
+ * @param table Table to empty.
+ */
+extern void krk_tableClear(KrkTable * table);
+
+/**
+ * @brief Copy out the next entry of a table.
+ * @memberof KrkTable
+ *
+ * Finds the first entry at or after position @p *index and advances
+ * @p *index past it. Safe to use on tables that other threads are
+ * changing, and while running code that may change the table itself;
+ * entries added meanwhile are seen, and entries removed are skipped.
+ * The table must not be in shape mode.
+ *
+ * @param table Table to walk.
+ * @param index Position to continue from; start at 0.
+ * @param out   Output pointer for a copy of the entry.
+ * @return 1 if an entry was found, 0 at the end of the table.
+ */
+extern int krk_tableNextEntry(KrkTable * table, size_t * index, KrkTableEntry * out);
+
 /**
  * @brief Add all key-value pairs from 'from' into 'to'.
  * @memberof KrkTable
@@ -67,14 +190,15 @@ extern void krk_freeTable(KrkTable * table);
 extern void krk_tableAddAll(KrkTable * from, KrkTable * to);
 
 /**
- * @brief Find a character sequence in the string interning table.
+ * @brief Find a character sequence among the string keys of a table.
  * @memberof KrkTable
  *
- * Scans through the entries in a given table - usually vm.strings - to find
- * an entry equivalent to the string specified by the 'chars' and 'length'
- * parameters, using the 'hash' parameter to speed up lookup.
+ * Scans through the entries in a given table to find an entry equivalent
+ * to the string specified by the 'chars' and 'length' parameters, using
+ * the 'hash' parameter to speed up lookup. The table must only have string
+ * keys. Interned strings are kept in a separate table; see krk_copyString.
  *
- * @param table   Should always be @c &vm.strings
+ * @param table   Table with string keys.
  * @param chars   C array of chars representing the string.
  * @param length  Length of the string.
  * @param hash    Precalculated hash value for the string.
@@ -154,19 +278,36 @@ extern int krk_tableDelete(KrkTable * table, KrkValue key);
 extern int krk_tableDeleteExact(KrkTable * table, KrkValue key);
 
 /**
- * @brief Internal table scan function.
+ * @brief Find the entry for a key in a table.
  * @memberof KrkTable
  *
- * Scans through the the entry array 'entries' to find the appropriate entry
- * for 'key', return a pointer to the entry, which may be or may not have
- * an associated pair.
+ * The table must not be in shape mode. Raises an exception if @p key
+ * is not hashable.
+ *
+ * @note This used to take an entry array and its capacity, and return the
+ *       slot a missing key would be stored in. Tables no longer have such
+ *       slots; keys are added with @ref krk_tableSet.
  *
- * @param entries  Table entry array to scan.
- * @param capacity Size of the table entry array, in entries.
- * @param key      Key to locate.
- * @return A pointer to the entry for 'key'.
+ * @param table Table to search.
+ * @param key   Key to locate.
+ * @return A pointer to the entry for @p key, or NULL if it is not in the table.
  */
-extern KrkTableEntry * krk_findEntry(KrkTableEntry * entries, size_t capacity, KrkValue key);
+extern KrkTableEntry * krk_findEntry(KrkTable * table, KrkValue key);
+
+/**
+ * @brief Find the entry for a key in a table, comparing keys by identity.
+ * @memberof KrkTable
+ *
+ * Like @ref krk_findEntry, but keys only match if they are the same value,
+ * without calling @c __eq__.
+ *
+ * @note This also used to take an entry array and its capacity; see @ref krk_findEntry.
+ *
+ * @param table Table to search.
+ * @param key   Key to locate.
+ * @return A pointer to the entry for @p key, or NULL if it is not in the table.
+ */
+extern KrkTableEntry * krk_findEntryExact(KrkTable * table, KrkValue key);
 
 /**
  * @brief Calculate the hash for a value.
@@ -184,13 +325,19 @@ extern int krk_hashValue(KrkValue value, uint32_t *hashOut);
  * @brief Preset the size of a table.
  * @memberof KrkTable
  *
- * Reserves space for a large table.
+ * Reserves space for a large table, switching it to dictionary mode.
  *
  * @param table Table to resize.
- * @param capacity Target capacity.
+ * @param capacity Number of keys to make room for.
  */
 extern void krk_tableAdjustCapacity(KrkTable * table, size_t capacity);
 
+/**
+ * @brief Get the number of bytes allocated for a table's entries and index.
+ * @memberof KrkTable
+ */
+extern size_t krk_tableAllocationSize(KrkTable * table);
+
 /**
  * @brief Update the value of a table entry only if it is found.
  * @memberof KrkTable
@@ -175,9 +175,10 @@ void krk_pushStringBuilderStr(struct StringBuilder * sb, const char *str, size_t
 /**
  * @brief Finalize a string builder into a string object.
  *
- * Creates a string object from the contents of the string builder and
- * frees the space allocated for the builder, returning a value representing
- * the newly created string object.
+ * Creates a string object from the contents of the string builder,
+ * which takes over the space allocated for the builder, returning a value
+ * representing the newly created string object. The string is not interned;
+ * see @ref krk_takeStringUninterned.
  *
  * @param sb String builder to finalize.
  * @return A value representing a string object.
@@ -31,6 +31,54 @@
  */
 #define KRK_THREAD_SCRATCH_SIZE 3
 
+/**
+ * @def KRK_NURSERY_SIZE
+ * @brief Bytes allocated between minor collections in generational mode.
+ */
+#ifndef KRK_NURSERY_SIZE
+#define KRK_NURSERY_SIZE (4 * 1024 * 1024)
+#endif
+
+/**
+ * @def KRK_SLAB_MAX
+ * @brief Largest object size served by the slab allocator.
+ *
+ * Objects up to this size are carved out of shared chunks, in size classes
+ * @c KRK_SLAB_GRANULE bytes apart, and recycled through per-thread free lists.
+ * Larger objects come from the system allocator.
+ */
+#ifndef KRK_SLAB_MAX
+#define KRK_SLAB_MAX 256
+#endif
+#define KRK_SLAB_GRANULE 16
+#define KRK_SLAB_CLASSES (KRK_SLAB_MAX / KRK_SLAB_GRANULE)
+
+/**
+ * @brief Free slots of one slab size class.
+ *
+ * Slots are linked through their first word.
+ */
+typedef struct KrkSlabList {
+	void * head;  /**< @brief Next slot to hand out */
+	void * tail;  /**< @brief Last slot, so the list can be spliced onto another in one step */
+	size_t count; /**< @brief Number of slots in the list */
+} KrkSlabList;
+
+/**
+ * @brief Objects allocated by one thread since the last collection.
+ *
+ * Objects are linked through their @c next pointers, newest first. The
+ * collector splices the whole list onto @c vm.objects in one step.
+ */
+typedef struct KrkObjectList {
+	KrkObj * head;       /**< @brief Newest object */
+	KrkObj * tail;       /**< @brief Oldest object */
+	size_t count;        /**< @brief Number of objects in the list */
+	KrkObj ** marks;     /**< @brief Objects that start sweep segments, oldest first, for parallel sweeps */
+	size_t markCount;
+	size_t markCapacity;
+} KrkObjectList;
+
 /**
  * @brief Represents a managed call state in a VM thread.
  *
@@ -55,6 +103,26 @@ typedef struct {
 #endif
 } KrkCallFrame;
 
+/**
+ * @brief A stack segment set aside while another is current.
+ *
+ * Generators run on a stack segment of their own, which the thread switches
+ * to when one is resumed. The segment it was resumed from is kept here, on
+ * the C stack of the resuming call, so its values remain reachable and
+ * tracebacks can continue into the frames that use it.
+ */
+typedef struct KrkStackSegment {
+	struct KrkStackSegment * prev; /**< The segment this one was resumed from, if it too was set aside. */
+	size_t frames;             /**< Frames below this index run on this segment or an earlier one. */
+	size_t stackSize;          /**< Size of the allocated stack space. */
+	KrkValue * stack;          /**< Bottom of the segment. */
+	KrkValue * stackTop;       /**< Top of the segment when it was set aside. */
+	KrkValue * stackMax;       /**< End of allocated stack space. */
+	KrkValue ** stackHome;     /**< Where the base of this segment is kept for upvalues into it. */
+	KrkObj * stackOwner;       /**< Object owning this segment, or NULL for the thread's own stack. */
+	KrkUpvalue * openUpvalues; /**< Open upvalues into this segment. */
+} KrkStackSegment;
+
 /**
  * @brief Table of basic exception types.
  *
@@ -173,8 +241,17 @@ typedef struct KrkThreadState {
 	KrkValue currentException; /**< When an exception is thrown, it is stored here. */
 	int flags;                 /**< Thread-local VM flags; each thread inherits the low byte of the global VM flags. */
 	KrkValue * stackMax;       /**< End of allocated stack space. */
+	KrkSlabList slabs[KRK_SLAB_CLASSES]; /**< Free object slots owned by this thread, by size class. */
+	volatile int parked;       /**< Set while stopped for a collection, or in a blocking call that does not touch the heap. */
+	int heldLocks;             /**< Internal locks held that prevent this thread from stopping for a collection. */
+	KrkObjectList objects;     /**< Objects allocated by this thread since the last collection. */
+	ssize_t allocated;         /**< Bytes this thread has allocated, less what it has freed, not yet added to vm.bytesAllocated. */
 
 	KrkValue scratchSpace[KRK_THREAD_SCRATCH_SIZE]; /**< A place to store a few values to keep them from being prematurely GC'd. */
+	KrkValue ** stackHome;     /**< Where the base of the current stack segment is kept; upvalues into the segment find it through here. */
+	KrkValue * ownStack;       /**< Base of the thread's own stack segment, which is @ref stack unless a generator is running. */
+	KrkObj * stackOwner;       /**< Object owning the current stack segment, or NULL for the thread's own stack. */
+	KrkStackSegment * outerStacks; /**< Segments set aside by running generators, innermost first. */
 } KrkThreadState;
 
 /**
@@ -188,7 +265,6 @@ typedef struct KrkThreadState {
 typedef struct KrkVM {
 	int globalFlags;                  /**< Global VM state flags */
 	char * binpath;                   /**< A string representing the name of the interpreter binary. */
-	KrkTable strings;                 /**< Strings table */
 	KrkTable modules;                 /**< Module cache */
 	KrkInstance * builtins;           /**< '\__builtins__' module */
 	KrkInstance * system;             /**< 'kuroko' module */
@@ -203,6 +279,14 @@ typedef struct KrkVM {
 	size_t grayCount;                 /**< Count of objects marked by scan. */
 	size_t grayCapacity;              /**< How many objects we can fit in the scan list. */
 	KrkObj** grayStack;               /**< Scan list */
+	KrkObj * oldObjects;              /**< Objects that survived a collection, in generational mode */
+	size_t nextMinorGC;               /**< Point at which we should collect young objects, in generational mode */
+	size_t rememberedCount;           /**< Count of old objects to scan in the next minor collection. */
+	size_t rememberedCapacity;        /**< How many objects we can fit in the remembered set. */
+	KrkObj** remembered;              /**< Old objects that may reference young objects */
+	struct KrkSlabChunk * slabChunks; /**< All chunks carved up by the slab allocator */
+	KrkSlabList slabPool[KRK_SLAB_CLASSES]; /**< Free slots handed back by threads, by size class */
+	size_t slabChunkCount[KRK_SLAB_CLASSES]; /**< Chunks allocated for each size class */
 
 	KrkThreadState * threads;         /**< Invasive linked list of all VM threads. */
 	FILE * callgrindFile;             /**< File to write unprocessed callgrind data to. */
@@ -218,6 +302,9 @@ typedef struct KrkVM {
 #define KRK_THREAD_SINGLE_STEP         (1 << 4)
 #define KRK_THREAD_SIGNALLED           (1 << 5)
 #define KRK_THREAD_DEFER_STACK_FREE    (1 << 6)
+#define KRK_THREAD_PROFILE_SAMPLE      (1 << 7)
+/* Set by other threads, so never part of the flags passed to krk_initVM */
+#define KRK_THREAD_GC_REQUESTED        (1 << 16)
 
 /* Global flags */
 #define KRK_GLOBAL_ENABLE_STRESS_GC    (1 << 8)
@@ -227,6 +314,8 @@ typedef struct KrkVM {
 #define KRK_GLOBAL_REPORT_GC_COLLECTS  (1 << 12)
 #define KRK_GLOBAL_THREADS             (1 << 13)
 #define KRK_GLOBAL_NO_DEFAULT_MODULES  (1 << 14)
+#define KRK_GLOBAL_GENERATIONAL_GC     (1 << 15)
+#define KRK_GLOBAL_NO_BYTECODE_CACHE   (1 << 17)
 
 #ifndef KRK_DISABLE_THREADS
 #  define threadLocal __thread
@@ -280,6 +369,19 @@ extern KrkVM krk_vm;
  */
 extern void krk_initVM(int flags);
 
+/**
+ * @brief Fix the key used to hash strings, bytes, and numbers.
+ * @memberof KrkVM
+ *
+ * By default, krk_initVM picks a random key, so hashes differ from
+ * one run to the next and can not be predicted to fill a table with
+ * colliding keys. Calling this before krk_initVM derives the key from
+ * @p seed instead, making hashes repeatable.
+ *
+ * @param seed Value to derive the hash key from.
+ */
+extern void krk_setHashSeed(uint64_t seed);
+
 /**
  * @brief Release resources from the VM.
  * @memberof KrkVM
@@ -995,6 +1097,14 @@ extern int krk_delAttribute(KrkString * name);
  */
 extern void krk_module_init_kuroko(void);
 
+/**
+ * @brief Initialize the built-in 'kuroko.profiler' module.
+ *
+ * Must be called after @ref krk_module_init_kuroko, as it is
+ * attached to the 'kuroko' module.
+ */
+extern void krk_module_init_profiler(void);
+
 /**
  * @brief Initialize the built-in 'gc' module.
  */
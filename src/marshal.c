@@ -0,0 +1,867 @@
+/**
+ * @file marshal.c
+ * @brief Cached bytecode images for imported modules.
+ *
+ * When a module is imported from @c foo.krk, the compiled code object tree
+ * is written next to it as @c foo.krkb, and later imports load that instead
+ * of compiling the source again. A cache file is only used if it was written
+ * by an interpreter with the same bytecode format and for the same source:
+ *
+ * - The header starts with the magic @c KRKB, a format number that must be
+ *   bumped whenever the compiler's output changes in a way the opcode list
+ *   does not show, and a fingerprint of the opcode list and build options.
+ * - It records the size, modification time, and a 64-bit FNV-1a hash of the
+ *   source. If the size and time still match, the cache is used as is. If
+ *   only the time differs (eg. the file was touched or checked out again),
+ *   the source is read and its hash is compared instead.
+ * - A hash of the code object records and strings catches damaged caches
+ *   while they are loaded. Each code object's bytecode and line map have a
+ *   hash of their own in its record, which is checked just before the code
+ *   object is first called, so loading does not have to read them all. If
+ *   that check fails, the source is compiled again and the damaged code
+ *   object takes the bytecode of its fresh counterpart.
+ *
+ * Any failure to read a cache, for any reason, just means the source is
+ * compiled again; any failure to write one is ignored.
+ *
+ * A cache file is an image with four parts, located by offsets in the header
+ * so nothing in it depends on where it is loaded:
+ *
+ * - The header.
+ * - Code object records, the module's first. Records refer to strings and
+ *   to other code objects by index, and to their bytecode and line maps by
+ *   offset into the data section. Values in constant tables are written with
+ *   a one-byte tag. Code objects with constants that can not be represented -
+ *   long integers, or the objects baked in by @c compile_time_builtins - are
+ *   not cached.
+ * - The string table.
+ * - The data section: bytecode, and line maps laid out as @c KrkLineMap arrays.
+ *
+ * The image is mapped privately rather than read, and code objects loaded from
+ * it point at their bytecode and line maps in the mapping instead of copying
+ * them. Loading only reads the records and strings, and the module's own
+ * bytecode; the rest is paged in as functions are first called. Unmodified
+ * bytecode pages are shared with every other process that maps the same file.
+ * Instructions rewritten at runtime (quickening, breakpoints) make private
+ * copies of their pages.
+ * Mappings are kept until the VM is freed, as their code objects may live on
+ * after their module is unloaded. Cache files are replaced by renaming a new
+ * file over them, which leaves existing mappings of the old one intact; they
+ * must never be rewritten in place.
+ *
+ * Everything is written in the host's byte order; the fingerprint covers that.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#endif
+
+#include <kuroko/vm.h>
+#include <kuroko/memory.h>
+#include <kuroko/compiler.h>
+#include <kuroko/object.h>
+#include <kuroko/util.h>
+#include <kuroko/threads.h>
+
+#include "private.h"
+
+#ifndef KRK_NO_FILESYSTEM
+
+/**
+ * Bump this when the compiler changes what it emits for the same opcodes,
+ * or when the layout below changes.
+ */
+#define KRKB_FORMAT 4
+
+#define KRKB_NO_STRING UINT32_MAX
+
+/* The data section, and line maps within it, are aligned to this. */
+#define KRKB_ALIGN 16
+
+struct ImageHeader {
+	char     magic[4];
+	uint32_t format;
+	uint64_t fingerprint;
+	uint64_t sourceSize;
+	int64_t  sourceMtime;
+	uint32_t sourceMtimeNsec;
+	uint32_t codeCount;
+	uint64_t sourceHash;
+	uint32_t stringCount;
+	uint32_t reserved;
+	uint64_t stringsOffset; /**< Offset of the string table; code object records come right after the header */
+	uint64_t dataOffset;    /**< Offset of the data section, which runs to the end of the file */
+	uint64_t fileLength;
+	uint64_t recordsHash;   /**< Hash of the code object records and the string table */
+};
+
+#define TAG_NONE    'n'
+#define TAG_TRUE    't'
+#define TAG_FALSE   'f'
+#define TAG_INTEGER 'i'
+#define TAG_FLOAT   'd'
+#define TAG_STRING  's'
+#define TAG_BYTES   'b'
+#define TAG_CODE    'c'
+#define TAG_KWARGS  'k'
+
+static const char opcodeList[] =
+#define SIMPLE(opc)         #opc ";"
+#define OPERANDB(opc,more)  #opc ",b;"
+#define LOCALS(opc)         #opc ",l;"
+#define CONSTANT(opc,more)  #opc ",c," #more ";"
+#define OPERAND(opc,more)   #opc ",o," #more ";"
+#define JUMP(opc,sign)      #opc ",j" #sign ";"
+#include "opcodes.h"
+#undef SIMPLE
+#undef OPERANDB
+#undef LOCALS
+#undef CONSTANT
+#undef OPERAND
+#undef JUMP
+#ifdef KRK_NO_DOCUMENTATION
+	"nodoc;"
+#endif
+	;
+
+static uint64_t fnv1a(uint64_t hash, const void * data, size_t length) {
+	const uint8_t * bytes = data;
+	for (size_t i = 0; i < length; ++i) {
+		hash ^= bytes[i];
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+
+static uint64_t fingerprint(void) {
+	uint32_t sizes[] = {
+		KRKB_FORMAT, 0x01020304, sizeof(KrkValue), sizeof(size_t),
+	};
+	uint64_t hash = fnv1a(FNV_OFFSET, sizes, sizeof(sizes));
+	return fnv1a(hash, opcodeList, sizeof(opcodeList) - 1);
+}
+
+struct SourceStamp {
+	uint64_t size;
+	int64_t  mtime;
+	uint32_t mtimeNsec;
+};
+
+static void stampOf(struct stat * statbuf, struct SourceStamp * stamp) {
+	stamp->size  = statbuf->st_size;
+	stamp->mtime = statbuf->st_mtime;
+#if defined(__linux__)
+	stamp->mtimeNsec = statbuf->st_mtim.tv_nsec;
+#elif defined(__APPLE__)
+	stamp->mtimeNsec = statbuf->st_mtimespec.tv_nsec;
+#else
+	stamp->mtimeNsec = 0;
+#endif
+}
+
+static char * cachePath(const char * fileName) {
+	size_t len = strlen(fileName);
+	char * out = malloc(len + 2);
+	memcpy(out, fileName, len);
+	out[len] = 'b';
+	out[len+1] = '\0';
+	return out;
+}
+
+static char * readWhole(const char * fileName, size_t * sizeOut) {
+	FILE * f = fopen(fileName, "rb");
+	if (!f) return NULL;
+	fseek(f, 0, SEEK_END);
+	long size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	if (size < 0) {
+		fclose(f);
+		return NULL;
+	}
+	char * buf = malloc(size + 1);
+	if (fread(buf, 1, size, f) != (size_t)size) {
+		free(buf);
+		fclose(f);
+		return NULL;
+	}
+	fclose(f);
+	buf[size] = '\0';
+	*sizeOut = size;
+	return buf;
+}
+
+/* Writing */
+
+struct Writer {
+	uint8_t * data;
+	size_t length;
+	size_t capacity;
+	int failed;
+};
+
+static void put(struct Writer * w, const void * data, size_t length) {
+	if (!length) return;
+	if (w->length + length > w->capacity) {
+		while (w->length + length > w->capacity) w->capacity = w->capacity ? w->capacity * 2 : 4096;
+		w->data = realloc(w->data, w->capacity);
+	}
+	memcpy(w->data + w->length, data, length);
+	w->length += length;
+}
+
+static void put8(struct Writer * w, uint8_t v)   { put(w, &v, sizeof(v)); }
+static void put16(struct Writer * w, uint16_t v) { put(w, &v, sizeof(v)); }
+static void put32(struct Writer * w, uint32_t v) { put(w, &v, sizeof(v)); }
+static void put64(struct Writer * w, uint64_t v) { put(w, &v, sizeof(v)); }
+
+/**
+ * Maps object pointers to the order they were first seen in, for both the
+ * string table and the code object table.
+ */
+struct ObjectIndex {
+	KrkObj ** objects;
+	size_t count;
+	size_t * slots;
+	size_t capacity;
+};
+
+static size_t slotFor(struct ObjectIndex * index, KrkObj * obj) {
+	size_t mask = index->capacity - 1;
+	size_t i = ((uintptr_t)obj >> 4) & mask;
+	while (index->slots[i] && index->objects[index->slots[i]-1] != obj) i = (i + 1) & mask;
+	return i;
+}
+
+static uint32_t indexOf(struct ObjectIndex * index, KrkObj * obj) {
+	if ((index->count + 1) * 2 > index->capacity) {
+		size_t * old = index->slots;
+		size_t oldCapacity = index->capacity;
+		index->capacity = oldCapacity ? oldCapacity * 2 : 64;
+		index->slots = calloc(index->capacity, sizeof(size_t));
+		index->objects = realloc(index->objects, sizeof(KrkObj*) * index->capacity / 2);
+		for (size_t i = 0; i < oldCapacity; ++i) {
+			if (old[i]) index->slots[slotFor(index, index->objects[old[i]-1])] = old[i];
+		}
+		free(old);
+	}
+	size_t slot = slotFor(index, obj);
+	if (!index->slots[slot]) {
+		index->objects[index->count++] = obj;
+		index->slots[slot] = index->count;
+	}
+	return index->slots[slot] - 1;
+}
+
+static void freeIndex(struct ObjectIndex * index) {
+	free(index->objects);
+	free(index->slots);
+}
+
+struct Marshal {
+	struct Writer records;
+	struct Writer data;
+	struct ObjectIndex strings;
+	struct ObjectIndex codes;
+};
+
+static const uint8_t zeroes[KRKB_ALIGN] = {0};
+
+static void align(struct Writer * w, size_t alignment) {
+	if (w->length % alignment) put(w, zeroes, alignment - w->length % alignment);
+}
+
+static void putString(struct Marshal * m, KrkString * s) {
+	put32(&m->records, s ? indexOf(&m->strings, (KrkObj*)s) : KRKB_NO_STRING);
+}
+
+static void putValue(struct Marshal * m, KrkValue value) {
+	struct Writer * w = &m->records;
+	if (IS_NONE(value)) {
+		put8(w, TAG_NONE);
+	} else if (IS_BOOLEAN(value)) {
+		put8(w, AS_BOOLEAN(value) ? TAG_TRUE : TAG_FALSE);
+	} else if (IS_INTEGER(value)) {
+		put8(w, TAG_INTEGER);
+		put64(w, (uint64_t)AS_INTEGER(value));
+	} else if (IS_KWARGS(value)) {
+		put8(w, TAG_KWARGS);
+		put32(w, (uint32_t)value);
+	} else if (IS_FLOATING(value)) {
+		double d = AS_FLOATING(value);
+		put8(w, TAG_FLOAT);
+		put(w, &d, sizeof(double));
+	} else if (IS_STRING(value)) {
+		put8(w, TAG_STRING);
+		putString(m, AS_STRING(value));
+	} else if (IS_BYTES(value)) {
+		put8(w, TAG_BYTES);
+		put32(w, AS_BYTES(value)->length);
+		put(w, AS_BYTES(value)->bytes, AS_BYTES(value)->length);
+	} else if (IS_codeobject(value)) {
+		put8(w, TAG_CODE);
+		put32(w, indexOf(&m->codes, AS_OBJECT(value)));
+	} else {
+		w->failed = 1;
+	}
+}
+
+static void putValueArray(struct Marshal * m, KrkValueArray * array) {
+	put32(&m->records, array->count);
+	for (size_t i = 0; i < array->count; ++i) putValue(m, array->values[i]);
+}
+
+static void putCodeObject(struct Marshal * m, KrkCodeObject * code) {
+	struct Writer * w = &m->records;
+	putString(m, code->name);
+	putString(m, code->docstring);
+	putString(m, code->qualname);
+	put16(w, code->requiredArgs);
+	put16(w, code->keywordArgs);
+	put16(w, code->potentialPositionals);
+	put16(w, code->totalArguments);
+	put8(w, code->obj.flags & 0xFF);
+	put32(w, code->upvalueCount);
+	putValueArray(m, &code->positionalArgNames);
+	putValueArray(m, &code->keywordArgNames);
+
+	size_t start = m->data.length;
+	put64(w, start);
+	put32(w, code->chunk.count);
+	put(&m->data, code->chunk.code, code->chunk.count);
+
+	align(&m->data, KRKB_ALIGN);
+	put64(w, m->data.length);
+	put32(w, code->chunk.linesCount);
+	put(&m->data, code->chunk.lines, sizeof(KrkLineMap) * code->chunk.linesCount);
+	put64(w, fnv1a(FNV_OFFSET, m->data.data + start, m->data.length - start));
+
+	put32(w, code->localNameCount);
+	for (size_t i = 0; i < code->localNameCount; ++i) {
+		put32(w, code->localNames[i].id);
+		put32(w, code->localNames[i].birthday);
+		put32(w, code->localNames[i].deathday);
+		putString(m, code->localNames[i].name);
+	}
+
+	put32(w, code->cacheCount);
+	putValueArray(m, &code->chunk.constants);
+}
+
+int krk_saveBytecode(KrkCodeObject * code, const char * fileName, const char * source, size_t length) {
+	if (vm.globalFlags & KRK_GLOBAL_NO_BYTECODE_CACHE) return 0;
+
+	struct stat statbuf;
+	if (stat(fileName, &statbuf) != 0 || (uint64_t)statbuf.st_size != length) return 0;
+	struct SourceStamp stamp;
+	stampOf(&statbuf, &stamp);
+
+	/*
+	 * Code objects are written in the order they are found in constant
+	 * tables, so the module is first. The strings they use are collected
+	 * along the way and written after them.
+	 */
+	struct Marshal m = {0};
+	struct ImageHeader header = {{'K','R','K','B'}, KRKB_FORMAT, fingerprint(), 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+	put(&m.records, &header, sizeof(header));
+	indexOf(&m.codes, (KrkObj*)code);
+	for (size_t i = 0; i < m.codes.count && !m.records.failed; ++i) {
+		putCodeObject(&m, (KrkCodeObject*)m.codes.objects[i]);
+	}
+
+	int written = 0;
+	if (!m.records.failed) {
+		header.stringsOffset = m.records.length;
+		for (size_t i = 0; i < m.strings.count; ++i) {
+			KrkString * s = (KrkString*)m.strings.objects[i];
+			put8(&m.records, !(s->obj.flags & KRK_OBJ_FLAGS_STRING_UNINTERNED));
+			put32(&m.records, s->length);
+			put(&m.records, s->chars, s->length);
+		}
+		align(&m.records, KRKB_ALIGN);
+
+		header.sourceSize = stamp.size;
+		header.sourceMtime = stamp.mtime;
+		header.sourceMtimeNsec = stamp.mtimeNsec;
+		header.sourceHash = fnv1a(FNV_OFFSET, source, length);
+		header.codeCount = m.codes.count;
+		header.stringCount = m.strings.count;
+		header.dataOffset = m.records.length;
+		header.fileLength = m.records.length + m.data.length;
+		header.recordsHash = fnv1a(FNV_OFFSET, m.records.data + sizeof(header), header.dataOffset - sizeof(header));
+		memcpy(m.records.data, &header, sizeof(header));
+
+		/* Write somewhere private and rename, so readers never see half a file. */
+		char * path = cachePath(fileName);
+		char * tmp = malloc(strlen(path) + 32);
+		snprintf(tmp, strlen(path) + 32, "%s.%ld.tmp", path, (long)getpid());
+		FILE * f = fopen(tmp, "wb");
+		if (f) {
+			int ok = fwrite(m.records.data, 1, m.records.length, f) == m.records.length &&
+			         fwrite(m.data.data, 1, m.data.length, f) == m.data.length;
+			if (fclose(f) == 0 && ok) {
+				remove(path);
+				written = rename(tmp, path) == 0;
+			}
+			if (!written) remove(tmp);
+		}
+		free(tmp);
+		free(path);
+	}
+
+	free(m.records.data);
+	free(m.data.data);
+	freeIndex(&m.strings);
+	freeIndex(&m.codes);
+	return written;
+}
+
+/* Reading */
+
+struct Image {
+	struct Image * next;
+	uint8_t * base;
+	size_t length;
+	int mapped;
+};
+
+static struct Image * images = NULL;
+
+static struct Image * openImage(const char * path) {
+	struct Image * image = calloc(1, sizeof(struct Image));
+#ifndef _WIN32
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) goto _fail;
+	struct stat statbuf;
+	if (fstat(fd, &statbuf) != 0 || statbuf.st_size < (off_t)sizeof(struct ImageHeader)) {
+		close(fd);
+		goto _fail;
+	}
+	/* Private and writable, so instructions can still be rewritten in place. */
+	void * base = mmap(NULL, statbuf.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (base != MAP_FAILED) {
+		image->base = base;
+		image->length = statbuf.st_size;
+		image->mapped = 1;
+		return image;
+	}
+#endif
+	image->base = (uint8_t*)readWhole(path, &image->length);
+	if (image->base) return image;
+_fail:
+	free(image);
+	return NULL;
+}
+
+static void closeImage(struct Image * image) {
+#ifndef _WIN32
+	if (image->mapped) munmap(image->base, image->length);
+	else
+#endif
+	free(image->base);
+	free(image);
+}
+
+/* Code objects now point into the image, so it has to stay around. */
+static void keepImage(struct Image * image) {
+	image->next = __atomic_load_n(&images, __ATOMIC_RELAXED);
+	while (!__atomic_compare_exchange_n(&images, &image->next, image, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+void krk_freeBytecodeImages(void) {
+	struct Image * image = __atomic_exchange_n(&images, NULL, __ATOMIC_ACQUIRE);
+	while (image) {
+		struct Image * next = image->next;
+		closeImage(image);
+		image = next;
+	}
+}
+
+struct Reader {
+	const uint8_t * data;
+	size_t length;
+	size_t offset;
+	int failed;
+};
+
+static const void * get(struct Reader * r, size_t length) {
+	if (r->failed || length > r->length - r->offset) {
+		r->failed = 1;
+		return NULL;
+	}
+	const void * out = r->data + r->offset;
+	r->offset += length;
+	return out;
+}
+
+#define GETTER(name,type) \
+	static type name(struct Reader * r) { \
+		type out = 0; \
+		const void * in = get(r, sizeof(type)); \
+		if (in) memcpy(&out, in, sizeof(type)); \
+		return out; \
+	}
+GETTER(get8,uint8_t)
+GETTER(get16,uint16_t)
+GETTER(get32,uint32_t)
+GETTER(get64,uint64_t)
+#undef GETTER
+
+struct Unmarshal {
+	struct Reader in;
+	uint8_t * data;
+	size_t dataLength;
+	KrkValueArray * strings;
+	KrkValueArray * codes;
+};
+
+static KrkString * getString(struct Unmarshal * u) {
+	uint32_t i = get32(&u->in);
+	if (i == KRKB_NO_STRING) return NULL;
+	if (i >= u->strings->count) {
+		u->in.failed = 1;
+		return NULL;
+	}
+	return AS_STRING(u->strings->values[i]);
+}
+
+static KrkValue getValue(struct Unmarshal * u) {
+	switch (get8(&u->in)) {
+		case TAG_NONE:    return NONE_VAL();
+		case TAG_TRUE:    return BOOLEAN_VAL(1);
+		case TAG_FALSE:   return BOOLEAN_VAL(0);
+		case TAG_INTEGER: return INTEGER_VAL((krk_integer_type)(int64_t)get64(&u->in));
+		case TAG_KWARGS:  return KWARGS_VAL(get32(&u->in));
+		case TAG_FLOAT: {
+			double d = 0;
+			const void * in = get(&u->in, sizeof(double));
+			if (in) memcpy(&d, in, sizeof(double));
+			return FLOATING_VAL(d);
+		}
+		case TAG_STRING: {
+			KrkString * s = getString(u);
+			return s ? OBJECT_VAL(s) : NONE_VAL();
+		}
+		case TAG_BYTES: {
+			uint32_t length = get32(&u->in);
+			const void * in = get(&u->in, length);
+			return in ? OBJECT_VAL(krk_newBytes(length, (uint8_t*)in)) : NONE_VAL();
+		}
+		case TAG_CODE: {
+			uint32_t i = get32(&u->in);
+			if (i < u->codes->count) return u->codes->values[i];
+			break;
+		}
+	}
+	u->in.failed = 1;
+	return NONE_VAL();
+}
+
+static void getValueArray(struct Unmarshal * u, KrkCodeObject * code, KrkValueArray * array) {
+	uint32_t count = get32(&u->in);
+	for (uint32_t i = 0; i < count && !u->in.failed; ++i) {
+		KrkValue value = getValue(u);
+		krk_push(value);
+		krk_writeValueArray(array, value);
+		krk_gcWriteBarrier((KrkObj*)code);
+		krk_pop();
+	}
+}
+
+/* Find @p count elements of @p size bytes at an offset read from the record, within the data section. */
+static void * getData(struct Unmarshal * u, size_t size, uint32_t * countOut) {
+	uint64_t offset = get64(&u->in);
+	uint32_t count = get32(&u->in);
+	if (u->in.failed || offset > u->dataLength || count > (u->dataLength - offset) / size || offset % (size > 1 ? KRKB_ALIGN : 1)) {
+		u->in.failed = 1;
+		return NULL;
+	}
+	*countOut = count;
+	return u->data + offset;
+}
+
+static void getCodeObject(struct Unmarshal * u, KrkCodeObject * code, KrkString * filename) {
+	struct Reader * r = &u->in;
+	code->name = getString(u);
+	code->docstring = getString(u);
+	code->qualname = getString(u);
+	code->chunk.filename = filename;
+	code->requiredArgs = get16(r);
+	code->keywordArgs = get16(r);
+	code->potentialPositionals = get16(r);
+	code->totalArguments = get16(r);
+	code->obj.flags |= get8(r) & (KRK_OBJ_FLAGS_CODEOBJECT_COLLECTS_ARGS | KRK_OBJ_FLAGS_CODEOBJECT_COLLECTS_KWS |
+		KRK_OBJ_FLAGS_CODEOBJECT_IS_GENERATOR | KRK_OBJ_FLAGS_CODEOBJECT_IS_COROUTINE);
+	code->upvalueCount = get32(r);
+	krk_gcWriteBarrier((KrkObj*)code);
+	getValueArray(u, code, &code->positionalArgNames);
+	getValueArray(u, code, &code->keywordArgNames);
+
+	/*
+	 * The bytecode and line map stay in the image; the chunk must not free them.
+	 * They are checked against their hash when the code object is first called.
+	 */
+	uint32_t codeSize, linesCount;
+	uint8_t * bytes = getData(u, 1, &codeSize);
+	KrkLineMap * lines = getData(u, sizeof(KrkLineMap), &linesCount);
+	code->mappedHash = get64(r);
+	if (r->failed) return;
+	size_t end = bytes - u->data + codeSize;
+	if ((uint8_t*)lines != bytes + codeSize + (KRKB_ALIGN - end % KRKB_ALIGN) % KRKB_ALIGN) {
+		r->failed = 1;
+		return;
+	}
+	code->obj.flags |= KRK_OBJ_FLAGS_CODEOBJECT_MAPPED | KRK_OBJ_FLAGS_CODEOBJECT_UNVERIFIED;
+	code->chunk.code = bytes;
+	code->chunk.capacity = codeSize;
+	code->chunk.count = codeSize;
+	code->chunk.lines = lines;
+	code->chunk.linesCapacity = linesCount;
+	code->chunk.linesCount = linesCount;
+
+	/* The local names array's count is only set once it is filled, as a collection may happen while filling it. */
+	uint32_t localNameCount = get32(r);
+	if (localNameCount > (r->length - r->offset) / 16) {
+		r->failed = 1;
+		return;
+	}
+	KrkLocalEntry * localNames = ALLOCATE(KrkLocalEntry, localNameCount);
+	for (uint32_t i = 0; i < localNameCount; ++i) {
+		localNames[i].id = get32(r);
+		localNames[i].birthday = get32(r);
+		localNames[i].deathday = get32(r);
+		localNames[i].name = getString(u);
+	}
+	code->localNames = localNames;
+	code->localNameCapacity = localNameCount;
+	code->localNameCount = localNameCount;
+
+	uint32_t cacheCount = get32(r);
+	if (cacheCount > KRK_INLINE_CACHE_NONE) {
+		r->failed = 1;
+		return;
+	}
+	if (cacheCount) {
+		code->caches = ALLOCATE(KrkInlineCache, cacheCount);
+		memset(code->caches, 0, sizeof(KrkInlineCache) * cacheCount);
+		code->cacheCount = cacheCount;
+	}
+
+	getValueArray(u, code, &code->chunk.constants);
+	krk_gcWriteBarrier((KrkObj*)code);
+}
+
+/* Bytecode, the padding after it, and the line map, as they are laid out in the data section. */
+static uint64_t chunkHash(KrkChunk * chunk, const uint8_t * padding, size_t paddingLength) {
+	uint64_t hash = fnv1a(FNV_OFFSET, chunk->code, chunk->count);
+	hash = fnv1a(hash, padding, paddingLength);
+	return fnv1a(hash, chunk->lines, sizeof(KrkLineMap) * chunk->linesCount);
+}
+
+static size_t mappedPadding(KrkCodeObject * code) {
+	return (uint8_t*)code->chunk.lines - (code->chunk.code + code->chunk.count);
+}
+
+static int mappedMatches(KrkCodeObject * code) {
+	return chunkHash(&code->chunk, code->chunk.code + code->chunk.count, mappedPadding(code)) == code->mappedHash;
+}
+
+static int sourceMatches(const char * fileName, struct ImageHeader * header) {
+	struct stat statbuf;
+	if (stat(fileName, &statbuf) != 0) return 0;
+	struct SourceStamp stamp;
+	stampOf(&statbuf, &stamp);
+
+	if (header->sourceSize != stamp.size) return 0;
+	if (header->sourceMtime == stamp.mtime && header->sourceMtimeNsec == stamp.mtimeNsec) return 1;
+
+	size_t length;
+	char * source = readWhole(fileName, &length);
+	if (!source) return 0;
+	int matches = length == header->sourceSize && fnv1a(FNV_OFFSET, source, length) == header->sourceHash;
+	free(source);
+	return matches;
+}
+
+KrkCodeObject * krk_loadBytecode(const char * fileName) {
+	if (vm.globalFlags & KRK_GLOBAL_NO_BYTECODE_CACHE) return NULL;
+	/* The disassembly is printed by the compiler, so let it run. */
+	if (krk_currentThread.flags & KRK_THREAD_ENABLE_DISASSEMBLY) return NULL;
+
+	char * path = cachePath(fileName);
+	struct Image * image = openImage(path);
+	free(path);
+	if (!image) return NULL;
+
+	struct ImageHeader header;
+	if (image->length < sizeof(header)) goto _reject;
+	memcpy(&header, image->base, sizeof(header));
+	if (memcmp(header.magic, "KRKB", 4) || header.format != KRKB_FORMAT || header.fingerprint != fingerprint()) goto _reject;
+	if (header.fileLength != image->length || header.dataOffset > header.fileLength || header.dataOffset % KRKB_ALIGN ||
+		header.stringsOffset < sizeof(header) || header.stringsOffset > header.dataOffset || !header.codeCount ||
+		header.codeCount > header.stringsOffset || header.stringCount > header.dataOffset - header.stringsOffset) goto _reject;
+	if (!sourceMatches(fileName, &header)) goto _reject;
+	if (fnv1a(FNV_OFFSET, image->base + sizeof(header), header.dataOffset - sizeof(header)) != header.recordsHash) goto _reject;
+
+	struct Unmarshal u = {{image->base, header.dataOffset, header.stringsOffset, 0},
+		image->base + header.dataOffset, header.fileLength - header.dataOffset, NULL, NULL};
+	struct Reader * r = &u.in;
+	KrkCodeObject * result = NULL;
+
+	/* Strings and code objects are kept in lists on the stack until everything refers to them. */
+	size_t stackBefore = krk_currentThread.stackTop - krk_currentThread.stack;
+	KrkValue strings = krk_list_of(0, NULL, 0);
+	krk_push(strings);
+	KrkValue codes = krk_list_of(0, NULL, 0);
+	krk_push(codes);
+	u.strings = AS_LIST(strings);
+	u.codes = AS_LIST(codes);
+
+	for (uint32_t i = 0; i < header.stringCount && !r->failed; ++i) {
+		int interned = get8(r);
+		uint32_t length = get32(r);
+		const char * chars = get(r, length);
+		if (!chars) break;
+		KrkString * s = krk_copyString(chars, length);
+		if (interned) s = krk_internString(s);
+		krk_push(OBJECT_VAL(s));
+		krk_writeValueArray(u.strings, OBJECT_VAL(s));
+		krk_gcWriteBarrier(AS_OBJECT(strings));
+		krk_pop();
+	}
+	if (krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION) r->failed = 1;
+
+	for (uint32_t i = 0; i < header.codeCount && !r->failed; ++i) {
+		KrkCodeObject * code = krk_newCodeObject();
+		krk_push(OBJECT_VAL(code));
+		krk_writeValueArray(u.codes, OBJECT_VAL(code));
+		krk_gcWriteBarrier(AS_OBJECT(codes));
+		krk_pop();
+	}
+
+	KrkString * filename = NULL;
+	if (!r->failed) {
+		filename = krk_copyString(fileName, strlen(fileName));
+		krk_push(OBJECT_VAL(filename));
+	}
+
+	/* Code object records run from the end of the header to the string table. */
+	r->offset = sizeof(header);
+	r->length = header.stringsOffset;
+	for (uint32_t i = 0; i < header.codeCount && !r->failed; ++i) {
+		getCodeObject(&u, AS_codeobject(u.codes->values[i]), filename);
+	}
+
+	/* The module is about to run, so its own bytecode is checked now, while it can still be recompiled quietly. */
+	if (!r->failed && r->offset == r->length && mappedMatches(AS_codeobject(u.codes->values[0]))) {
+		result = AS_codeobject(u.codes->values[0]);
+		result->obj.flags &= ~KRK_OBJ_FLAGS_CODEOBJECT_UNVERIFIED;
+	}
+
+	if (krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION) {
+		krk_currentThread.flags &= ~KRK_THREAD_HAS_EXCEPTION;
+		krk_currentThread.currentException = NONE_VAL();
+		result = NULL;
+	}
+	krk_currentThread.stackTop = krk_currentThread.stack + stackBefore;
+
+	/*
+	 * Code objects that were made before a failure may point into the image,
+	 * so it is kept even then; a failure here means the file is damaged,
+	 * and it is about to be replaced anyway.
+	 */
+	keepImage(image);
+	return result;
+
+_reject:
+	closeImage(image);
+	return NULL;
+}
+
+#ifndef KRK_DISABLE_THREADS
+static pthread_rwlock_t _verifyLock = PTHREAD_RWLOCK_INITIALIZER;
+#endif
+
+/* Find the code object in a fresh compilation that has the bytecode @p damaged should have had. */
+static KrkCodeObject * findCounterpart(KrkCodeObject * code, KrkCodeObject * damaged, size_t paddingLength) {
+	if (code->chunk.count == damaged->chunk.count && code->chunk.linesCount == damaged->chunk.linesCount &&
+	    chunkHash(&code->chunk, zeroes, paddingLength) == damaged->mappedHash) return code;
+	for (size_t i = 0; i < code->chunk.constants.count; ++i) {
+		if (!IS_codeobject(code->chunk.constants.values[i])) continue;
+		KrkCodeObject * found = findCounterpart(AS_codeobject(code->chunk.constants.values[i]), damaged, paddingLength);
+		if (found) return found;
+	}
+	return NULL;
+}
+
+/*
+ * Compile the source again and take the bytecode and line map of the damaged
+ * code object's counterpart, which also gets a new cache file written. This
+ * only works if the source has not changed since the cache was loaded; the
+ * hash tells us whether it has.
+ */
+static int replaceDamaged(KrkCodeObject * code) {
+	if (!code->chunk.filename) return 0;
+	size_t length;
+	char * source = readWhole(code->chunk.filename->chars, &length);
+	if (!source) return 0;
+
+	size_t stackBefore = krk_currentThread.stackTop - krk_currentThread.stack;
+	KrkCodeObject * fresh = krk_compile(source, code->chunk.filename->chars);
+	KrkCodeObject * counterpart = NULL;
+	if (fresh) {
+		krk_push(OBJECT_VAL(fresh));
+		counterpart = findCounterpart(fresh, code, mappedPadding(code));
+	}
+	if (counterpart) {
+		krk_saveBytecode(fresh, code->chunk.filename->chars, source, length);
+		code->chunk.code = counterpart->chunk.code;
+		code->chunk.capacity = counterpart->chunk.capacity;
+		code->chunk.lines = counterpart->chunk.lines;
+		code->chunk.linesCapacity = counterpart->chunk.linesCapacity;
+		counterpart->chunk.code = NULL;
+		counterpart->chunk.capacity = 0;
+		counterpart->chunk.lines = NULL;
+		counterpart->chunk.linesCapacity = 0;
+		counterpart->chunk.count = 0;
+		counterpart->chunk.linesCount = 0;
+	}
+	free(source);
+
+	if (krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION) {
+		krk_currentThread.flags &= ~KRK_THREAD_HAS_EXCEPTION;
+		krk_currentThread.currentException = NONE_VAL();
+	}
+	krk_currentThread.stackTop = krk_currentThread.stack + stackBefore;
+	return counterpart != NULL;
+}
+
+int krk_verifyBytecode(KrkCodeObject * code) {
+	/* Another thread may be checking or replacing the same code object; the first one to get here does it. */
+	_obtain_write_lock(&_verifyLock);
+	int ok = 1;
+	if (code->obj.flags & KRK_OBJ_FLAGS_CODEOBJECT_UNVERIFIED) {
+		uint16_t clear = 0;
+		if (mappedMatches(code)) {
+			clear = KRK_OBJ_FLAGS_CODEOBJECT_UNVERIFIED;
+		} else if (replaceDamaged(code)) {
+			/* The chunk now owns what it points to. */
+			clear = KRK_OBJ_FLAGS_CODEOBJECT_UNVERIFIED | KRK_OBJ_FLAGS_CODEOBJECT_MAPPED;
+		} else {
+			ok = 0;
+		}
+		__atomic_and_fetch(&code->obj.flags, (uint16_t)~clear, __ATOMIC_RELEASE);
+	}
+	pthread_rwlock_unlock(&_verifyLock);
+	if (!ok) krk_runtimeError(vm.exceptions->importError, "bytecode cache for '%S' is damaged", code->chunk.filename);
+	return ok;
+}
+
+#endif
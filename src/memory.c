@@ -1,3 +1,5 @@
+#include <signal.h>
+
 #include <kuroko/vm.h>
 #include <kuroko/memory.h>
 #include <kuroko/object.h>
@@ -143,29 +145,244 @@ static int _debug_mem_has(const void *ptr) {
 }
 #endif
 
+/* Threads count their own allocations and add them to the total in batches; see "Thread object lists" */
+#ifndef KRK_ALLOCATION_BATCH
+#define KRK_ALLOCATION_BATCH 65536
+#endif
+
+static inline void addAllocated(KrkThreadState * thread) {
+	__atomic_add_fetch(&vm.bytesAllocated, thread->allocated, __ATOMIC_RELAXED);
+	thread->allocated = 0;
+}
+
+static inline void countAllocated(ssize_t bytes) {
+	krk_currentThread.allocated += bytes;
+	if (!(vm.globalFlags & KRK_GLOBAL_THREADS) ||
+	    krk_currentThread.allocated >= KRK_ALLOCATION_BATCH || krk_currentThread.allocated <= -KRK_ALLOCATION_BATCH) {
+		addAllocated(&krk_currentThread);
+	}
+}
+
 void krk_gcTakeBytes(const void * ptr, size_t size) {
 #if defined(KRK_EXTENSIVE_MEMORY_DEBUGGING)
 	_debug_mem_set(ptr, size);
 #endif
 
-	vm.bytesAllocated += size;
+	countAllocated(size);
 }
 
-void * krk_reallocate(void * ptr, size_t old, size_t new) {
+/**
+ * Stopping the world
+ *
+ * When threads are in use, any thread may need to collect garbage, and no
+ * other thread may run while it does. The collecting thread sets
+ * _worldStopping, flags every other thread with KRK_THREAD_GC_REQUESTED,
+ * and waits until all of them are parked. The interpreter loop checks that
+ * flag before each instruction, and allocations check _worldStopping,
+ * and both park the thread in krk_gcSafepoint until the collection ends.
+ *
+ * A thread that is blocked in a system call can not get to a safepoint,
+ * so natives that block mark themselves as parked around the call with
+ * krk_gcBlockingBegin/End. Leaving that state waits for any collection
+ * in progress. Threads holding internal spin locks that guard allocations,
+ * like the locks of the string table, neither park nor start a collection, so
+ * that the threads waiting for those locks can always get through them.
+ *
+ * Setting the requested flag can race with a thread updating its own flags,
+ * so the collector sets it again each time it wakes up to check.
+ */
+static void takeObjects(KrkThreadState * thread);
+
+#ifndef KRK_DISABLE_THREADS
+static pthread_mutex_t _worldLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t _worldParked = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t _worldResumed = PTHREAD_COND_INITIALIZER;
+static volatile int _worldStopping = 0;
+static int _worldOwned = 0;
+static size_t _stoppedThreads = 0;
+static struct timespec _stopRequested;
+static struct timespec _worldStopped;
+
+/* Called with _worldLock held */
+static void parkLocked(void) {
+	while (_worldStopping) {
+		__atomic_store_n(&krk_currentThread.parked, 1, __ATOMIC_SEQ_CST);
+		pthread_cond_signal(&_worldParked);
+		pthread_cond_wait(&_worldResumed, &_worldLock);
+	}
+	__atomic_store_n(&krk_currentThread.parked, 0, __ATOMIC_SEQ_CST);
+}
+
+void krk_gcSafepoint(void) {
+	krk_currentThread.flags &= ~(KRK_THREAD_GC_REQUESTED);
+	if (!__atomic_load_n(&_worldStopping, __ATOMIC_SEQ_CST) || krk_currentThread.heldLocks) return;
+	pthread_mutex_lock(&_worldLock);
+	parkLocked();
+	pthread_mutex_unlock(&_worldLock);
+}
+
+void krk_gcBlockingBegin(void) {
+	if (!(vm.globalFlags & KRK_GLOBAL_THREADS)) return;
+	__atomic_store_n(&krk_currentThread.parked, 1, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&_worldStopping, __ATOMIC_SEQ_CST)) {
+		pthread_mutex_lock(&_worldLock);
+		pthread_cond_signal(&_worldParked);
+		pthread_mutex_unlock(&_worldLock);
+	}
+}
+
+void krk_gcBlockingEnd(void) {
+	if (!krk_currentThread.parked) return;
+	/* Either the collector sees that we are running again, or we see that it is collecting. */
+	__atomic_store_n(&krk_currentThread.parked, 0, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&_worldStopping, __ATOMIC_SEQ_CST)) {
+		pthread_mutex_lock(&_worldLock);
+		parkLocked();
+		pthread_mutex_unlock(&_worldLock);
+	}
+}
+
+void krk_gcAttachThread(void) {
+	pthread_mutex_lock(&_worldLock);
+	while (_worldStopping) pthread_cond_wait(&_worldResumed, &_worldLock);
+	krk_currentThread.next = vm.threads->next;
+	vm.threads->next = &krk_currentThread;
+	pthread_mutex_unlock(&_worldLock);
+}
+
+void krk_gcDetachThread(void) {
+	pthread_mutex_lock(&_worldLock);
+	parkLocked();
+	KrkThreadState * previous = vm.threads;
+	while (previous) {
+		if (previous->next == &krk_currentThread) {
+			previous->next = krk_currentThread.next;
+			break;
+		}
+		previous = previous->next;
+	}
+	/* No collection can run while we hold the lock, and none will look at this thread again. */
+	FREE_ARRAY(size_t, krk_currentThread.stack, krk_currentThread.stackSize);
+	krk_currentThread.stack = NULL;
+	takeObjects(&krk_currentThread);
+	free(krk_currentThread.objects.marks);
+	pthread_mutex_unlock(&_worldLock);
+}
+
+static void addMillisecond(struct timespec * t) {
+	t->tv_nsec += 1000000L;
+	if (t->tv_nsec >= 1000000000L) {
+		t->tv_sec++;
+		t->tv_nsec -= 1000000000L;
+	}
+}
+
+/**
+ * Returns 0 if another thread was already collecting, in which
+ * case we waited for it to finish and should not collect now.
+ */
+static int stopWorld(void) {
+	if (!(vm.globalFlags & KRK_GLOBAL_THREADS)) return 1;
+	pthread_mutex_lock(&_worldLock);
+	if (_worldStopping) {
+		parkLocked();
+		pthread_mutex_unlock(&_worldLock);
+		return 0;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &_stopRequested);
+	__atomic_store_n(&_worldStopping, 1, __ATOMIC_SEQ_CST);
+	while (1) {
+		size_t running = 0;
+		_stoppedThreads = 0;
+		for (KrkThreadState * thread = vm.threads; thread; thread = thread->next) {
+			if (thread == &krk_currentThread) continue;
+			if (__atomic_load_n(&thread->parked, __ATOMIC_SEQ_CST)) {
+				_stoppedThreads++;
+			} else {
+				__atomic_fetch_or(&thread->flags, KRK_THREAD_GC_REQUESTED, __ATOMIC_SEQ_CST);
+				running++;
+			}
+		}
+		if (!running) break;
+		struct timespec deadline;
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		addMillisecond(&deadline);
+		pthread_cond_timedwait(&_worldParked, &_worldLock, &deadline);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &_worldStopped);
+	_worldOwned = 1;
+	return 1;
+}
+
+static void resumeWorld(void) {
+	if (!_worldOwned) return;
+	_worldOwned = 0;
+
+#ifndef KRK_NO_GC_TRACING
+	if (vm.globalFlags & KRK_GLOBAL_REPORT_GC_COLLECTS) {
+		struct timespec resumed;
+		clock_gettime(CLOCK_MONOTONIC, &resumed);
+		long long toStop = (_worldStopped.tv_sec - _stopRequested.tv_sec) * 1000000000LL + (_worldStopped.tv_nsec - _stopRequested.tv_nsec);
+		long long paused = (resumed.tv_sec - _stopRequested.tv_sec) * 1000000000LL + (resumed.tv_nsec - _stopRequested.tv_nsec);
+		fprintf(stderr, "[gc] resumed %zu threads; paused %lld.%.9llds, of which %lld.%.9llds waiting for them to stop\n",
+			_stoppedThreads, paused / 1000000000LL, paused % 1000000000LL, toStop / 1000000000LL, toStop % 1000000000LL);
+	}
+#endif
+
+	__atomic_store_n(&_worldStopping, 0, __ATOMIC_SEQ_CST);
+	pthread_cond_broadcast(&_worldResumed);
+	pthread_mutex_unlock(&_worldLock);
+}
+#else
+void krk_gcSafepoint(void) { }
+void krk_gcBlockingBegin(void) { }
+void krk_gcBlockingEnd(void) { }
+static int stopWorld(void) { return 1; }
+static void resumeWorld(void) { }
+#endif
+
+/* Lazy sweeping, described further below */
+#ifndef KRK_LAZY_SWEEP_STEP
+#define KRK_LAZY_SWEEP_STEP 64
+#endif
+static int _sweeping = 0;
+static int _sweepBusy = 0;
+static KrkObj * _objectsTail = NULL;
+static int _recordClasses = 0;
+static void sweepLazily(size_t budget);
+static void collectLazily(void);
+static void recordClass(KrkClass * _class);
+
+static void accountAllocation(void * ptr, size_t old, size_t new) {
+	countAllocated((ssize_t)new - (ssize_t)old);
 
-	vm.bytesAllocated -= old;
-	vm.bytesAllocated += new;
+	if (new > old && _sweeping) sweepLazily(KRK_LAZY_SWEEP_STEP);
 
-	if (new > old && ptr != krk_currentThread.stack && &krk_currentThread == vm.threads && !(vm.globalFlags & KRK_GLOBAL_GC_PAUSED)) {
+	if (new > old && ptr != krk_currentThread.stack && !(vm.globalFlags & KRK_GLOBAL_GC_PAUSED) && !_sweepBusy) {
+#ifndef KRK_DISABLE_THREADS
+		if (vm.globalFlags & KRK_GLOBAL_THREADS) {
+			if (krk_currentThread.heldLocks) return;
+			if (_worldStopping) krk_gcSafepoint();
+		}
+#endif
 #ifndef KRK_NO_STRESS_GC
 		if (vm.globalFlags & KRK_GLOBAL_ENABLE_STRESS_GC) {
-			krk_collectGarbage();
+			if (vm.globalFlags & KRK_GLOBAL_GENERATIONAL_GC) krk_collectYoung();
+			else collectLazily();
 		}
 #endif
-		if (vm.bytesAllocated > vm.nextGC) {
-			krk_collectGarbage();
+		size_t allocated = __atomic_load_n(&vm.bytesAllocated, __ATOMIC_RELAXED);
+		if (allocated > vm.nextGC) {
+			collectLazily();
+		} else if ((vm.globalFlags & KRK_GLOBAL_GENERATIONAL_GC) && allocated > vm.nextMinorGC) {
+			krk_collectYoung();
 		}
 	}
+}
+
+void * krk_reallocate(void * ptr, size_t old, size_t new) {
+	accountAllocation(ptr, old, new);
 
 	void * out;
 	if (new == 0) {
@@ -198,38 +415,191 @@ void * krk_reallocate(void * ptr, size_t old, size_t new) {
 	return out;
 }
 
+/**
+ * Slab allocator
+ *
+ * Most objects are a few dozen bytes and live briefly, so rather than going
+ * to malloc for each one, object headers up to KRK_SLAB_MAX bytes are carved
+ * out of larger chunks. Each chunk serves one size class, and the slots of a
+ * class are recycled through a free list. Array storage owned by objects,
+ * such as string characters and table entries, still comes from realloc.
+ *
+ * Each thread allocates from and frees to its own lists without locking.
+ * Threads only take the lock to get a new chunk, to take the slots in the
+ * shared pool, or to hand slots to the pool. The collector frees objects
+ * allocated by every thread, so when threads are in use a list that has
+ * grown past a couple of chunks is given back to the pool, where threads
+ * that run out will find it. Exiting threads give back all of their slots.
+ *
+ * Chunks are never returned to the system until the VM is destroyed.
+ *
+ * The allocator is bypassed when building with the memory debugger or with
+ * AddressSanitizer, so that those can see each object separately.
+ */
+#if defined(KRK_EXTENSIVE_MEMORY_DEBUGGING) || defined(__SANITIZE_ADDRESS__)
+# define KRK_NO_SLAB_ALLOCATOR
+#elif defined(__has_feature)
+# if __has_feature(address_sanitizer)
+#  define KRK_NO_SLAB_ALLOCATOR
+# endif
+#endif
+
+#define SLAB_CHUNK_SIZE (32 * 1024)
+
+struct KrkSlabChunk {
+	struct KrkSlabChunk * next;
+	size_t sizeClass;
+};
+
+#define SLAB_SLOT_SIZE(c) (((c) + 1) * KRK_SLAB_GRANULE)
+#define SLAB_SLOTS(c) ((SLAB_CHUNK_SIZE - sizeof(struct KrkSlabChunk)) / SLAB_SLOT_SIZE(c))
+
+#ifndef KRK_DISABLE_THREADS
+static volatile int _slabLock = 0;
+#endif
+
+static void slabSplice(KrkSlabList * to, KrkSlabList * from) {
+	if (!from->head) return;
+	*(void**)from->tail = to->head;
+	if (!to->head) to->tail = from->tail;
+	to->head = from->head;
+	to->count += from->count;
+	from->head = NULL;
+	from->tail = NULL;
+	from->count = 0;
+}
+
+#ifndef KRK_NO_SLAB_ALLOCATOR
+static void slabPush(KrkSlabList * list, void * slot) {
+	*(void**)slot = list->head;
+	if (!list->head) list->tail = slot;
+	list->head = slot;
+	list->count++;
+}
+
+static void slabRefill(size_t sizeClass) {
+	KrkSlabList * list = &krk_currentThread.slabs[sizeClass];
+
+	_obtain_lock(_slabLock);
+	slabSplice(list, &vm.slabPool[sizeClass]);
+	_release_lock(_slabLock);
+	if (list->head) return;
+
+	struct KrkSlabChunk * chunk = malloc(SLAB_CHUNK_SIZE);
+	if (!chunk) {
+		fprintf(stderr, "Out of memory allocating object slab.\n");
+		abort();
+	}
+	chunk->sizeClass = sizeClass;
+
+	char * slots = (char*)(chunk + 1);
+	for (size_t i = SLAB_SLOTS(sizeClass); i > 0; --i) {
+		slabPush(list, slots + (i - 1) * SLAB_SLOT_SIZE(sizeClass));
+	}
+
+	_obtain_lock(_slabLock);
+	chunk->next = vm.slabChunks;
+	vm.slabChunks = chunk;
+	vm.slabChunkCount[sizeClass]++;
+	_release_lock(_slabLock);
+}
+#endif
+
+void * krk_slabAllocate(size_t size) {
+#ifndef KRK_NO_SLAB_ALLOCATOR
+	if (size && size <= KRK_SLAB_MAX) {
+		accountAllocation(NULL, 0, size);
+		size_t sizeClass = (size - 1) / KRK_SLAB_GRANULE;
+		KrkSlabList * list = &krk_currentThread.slabs[sizeClass];
+		if (!list->head) slabRefill(sizeClass);
+		void * slot = list->head;
+		list->head = *(void**)slot;
+		if (!list->head) list->tail = NULL;
+		list->count--;
+		return slot;
+	}
+#endif
+	return krk_reallocate(NULL, 0, size);
+}
+
+void krk_slabFree(void * ptr, size_t size) {
+#ifndef KRK_NO_SLAB_ALLOCATOR
+	if (size && size <= KRK_SLAB_MAX) {
+		countAllocated(-(ssize_t)size);
+		size_t sizeClass = (size - 1) / KRK_SLAB_GRANULE;
+		KrkSlabList * list = &krk_currentThread.slabs[sizeClass];
+		slabPush(list, ptr);
+		if ((vm.globalFlags & KRK_GLOBAL_THREADS) && list->count >= 2 * SLAB_SLOTS(sizeClass)) {
+			_obtain_lock(_slabLock);
+			slabSplice(&vm.slabPool[sizeClass], list);
+			_release_lock(_slabLock);
+		}
+		return;
+	}
+#endif
+	krk_reallocate(ptr, size, 0);
+}
+
+void krk_slabReleaseThread(void) {
+	_obtain_lock(_slabLock);
+	for (size_t i = 0; i < KRK_SLAB_CLASSES; ++i) {
+		slabSplice(&vm.slabPool[i], &krk_currentThread.slabs[i]);
+	}
+	_release_lock(_slabLock);
+}
+
+void krk_freeSlabs(void) {
+	while (vm.slabChunks) {
+		struct KrkSlabChunk * next = vm.slabChunks->next;
+		free(vm.slabChunks);
+		vm.slabChunks = next;
+	}
+	for (size_t i = 0; i < KRK_SLAB_CLASSES; ++i) {
+		vm.slabChunkCount[i] = 0;
+		vm.slabPool[i] = (KrkSlabList){0};
+		krk_currentThread.slabs[i] = (KrkSlabList){0};
+	}
+}
+
 static void freeObject(KrkObj * object) {
 	switch (object->type) {
 		case KRK_OBJ_STRING: {
 			KrkString * string = (KrkString*)object;
 			FREE_ARRAY(char, string->chars, string->length + 1);
 			if (string->codes && string->codes != string->chars) free(string->codes);
-			FREE(KrkString, object);
+			FREE_OBJECT(KrkString, object);
 			break;
 		}
 		case KRK_OBJ_CODEOBJECT: {
 			KrkCodeObject * function = (KrkCodeObject*)object;
-			krk_freeChunk(&function->chunk);
+			if (object->flags & KRK_OBJ_FLAGS_CODEOBJECT_MAPPED) {
+				krk_freeValueArray(&function->chunk.constants);
+			} else {
+				krk_freeChunk(&function->chunk);
+			}
 			krk_freeValueArray(&function->positionalArgNames);
 			krk_freeValueArray(&function->keywordArgNames);
 			FREE_ARRAY(KrkLocalEntry, function->localNames, function->localNameCount);
 			function->localNameCount = 0;
-			FREE(KrkCodeObject, object);
+			if (function->caches) FREE_ARRAY(KrkInlineCache, function->caches, function->cacheCount);
+			free(function->counters);
+			function->cacheCount = 0;
+			FREE_OBJECT(KrkCodeObject, object);
 			break;
 		}
 		case KRK_OBJ_NATIVE: {
-			FREE(KrkNative, object);
+			FREE_OBJECT(KrkNative, object);
 			break;
 		}
 		case KRK_OBJ_CLOSURE: {
 			KrkClosure * closure = (KrkClosure*)object;
 			FREE_ARRAY(KrkUpvalue*,closure->upvalues,closure->upvalueCount);
 			krk_freeTable(&closure->fields);
-			FREE(KrkClosure, object);
+			FREE_OBJECT(KrkClosure, object);
 			break;
 		}
 		case KRK_OBJ_UPVALUE: {
-			FREE(KrkUpvalue, object);
+			FREE_OBJECT(KrkUpvalue, object);
 			break;
 		}
 		case KRK_OBJ_CLASS: {
@@ -239,7 +609,7 @@ static void freeObject(KrkObj * object) {
 			if (_class->base) {
 				krk_tableDeleteExact(&_class->base->subclasses, OBJECT_VAL(object));
 			}
-			FREE(KrkClass, object);
+			FREE_OBJECT(KrkClass, object);
 			break;
 		}
 		case KRK_OBJ_INSTANCE: {
@@ -248,42 +618,72 @@ static void freeObject(KrkObj * object) {
 				inst->_class->_ongcsweep(inst);
 			}
 			krk_freeTable(&inst->fields);
-			krk_reallocate(object,inst->_class->allocSize,0);
+			krk_slabFree(object,inst->_class->allocSize);
 			break;
 		}
 		case KRK_OBJ_BOUND_METHOD:
-			FREE(KrkBoundMethod, object);
+			FREE_OBJECT(KrkBoundMethod, object);
 			break;
 		case KRK_OBJ_TUPLE: {
 			KrkTuple * tuple = (KrkTuple*)object;
 			krk_freeValueArray(&tuple->values);
-			FREE(KrkTuple, object);
+			FREE_OBJECT(KrkTuple, object);
 			break;
 		}
 		case KRK_OBJ_BYTES: {
 			KrkBytes * bytes = (KrkBytes*)object;
 			FREE_ARRAY(uint8_t, bytes->bytes, bytes->length);
-			FREE(KrkBytes, bytes);
+			FREE_OBJECT(KrkBytes, bytes);
 			break;
 		}
 	}
 }
 
+static size_t _helperCount = 0;
+static void forgetSweepMarks(void);
+
 void krk_freeObjects() {
+	krk_gcFinishSweep();
+	for (KrkThreadState * thread = vm.threads; thread; thread = thread->next) {
+		takeObjects(thread);
+		free(thread->objects.marks);
+		thread->objects = (KrkObjectList){0};
+	}
+	_helperCount = 0;
+	forgetSweepMarks();
+
+	while (vm.oldObjects) {
+		KrkObj * next = vm.oldObjects->next;
+		vm.oldObjects->next = vm.objects;
+		vm.objects = vm.oldObjects;
+		vm.oldObjects = next;
+	}
+
 	KrkObj * object = vm.objects;
 	KrkObj * other = NULL;
+	KrkObj * modules = NULL;
 
 	while (object) {
 		KrkObj * next = object->next;
-		if (object->type == KRK_OBJ_INSTANCE) {
-			freeObject(object);
-		} else {
+		if (object->type != KRK_OBJ_INSTANCE) {
 			object->next = other;
 			other = object;
+		} else if (krk_isInstanceOf(OBJECT_VAL(object), vm.baseClasses->moduleClass)) {
+			object->next = modules;
+			modules = object;
+		} else {
+			freeObject(object);
 		}
 		object = next;
 	}
 
+	/* Freeing a module may unload its library, which the instances of its types needed to sweep them. */
+	while (modules) {
+		KrkObj * next = modules->next;
+		freeObject(modules);
+		modules = next;
+	}
+
 	while (other) {
 		KrkObj * next = other->next;
 		if (other->type == KRK_OBJ_CLASS) {
@@ -294,6 +694,7 @@ void krk_freeObjects() {
 	}
 
 	free(vm.grayStack);
+	free(vm.remembered);
 }
 
 void krk_freeMemoryDebugger(void) {
@@ -313,11 +714,55 @@ void krk_freeMemoryDebugger(void) {
 #endif
 }
 
-void krk_markObject(KrkObj * object) {
-	if (!object) return;
-	if (object->flags & KRK_OBJ_FLAGS_IS_MARKED) return;
-	object->flags |= KRK_OBJ_FLAGS_IS_MARKED;
+/**
+ * Generational collection
+ *
+ * When KRK_GLOBAL_GENERATIONAL_GC is set, objects that survive a collection
+ * are promoted: they are moved from vm.objects to vm.oldObjects and flagged
+ * as old. Minor collections, run every KRK_NURSERY_SIZE bytes of allocation,
+ * do not mark through old objects and only sweep vm.objects, so their cost
+ * depends on the young objects rather than the whole heap. Full collections
+ * still mark and sweep everything, and are scheduled by vm.nextGC as before.
+ *
+ * A young object referenced only by an old object must still be found by a
+ * minor collection, so old objects that may reference young ones are kept in
+ * the remembered set and scanned as roots by the next minor collection. An
+ * old object is remembered when:
+ *
+ * - A reference is stored into it through krk_gcWriteBarrier, which the VM
+ *   calls when setting attributes, globals and closed upvalues, and on the
+ *   arguments of every native function call - which covers the methods of
+ *   the built-in collection types.
+ * - A root refers to it directly, such as a value on a thread's stack. C
+ *   code can store into such objects without a barrier, so they stay in the
+ *   set through the next collection.
+ * - It was promoted by this collection. It may still be being filled in by
+ *   the C code that created it.
+ */
+static int _collectingYoung = 0;
+static int _markingRoots = 0;
+
+#ifndef KRK_DISABLE_THREADS
+static volatile int _rememberLock = 0;
+#endif
 
+/* Strings, bytes and natives never reference other objects. */
+static inline int holdsReferences(KrkObj * object) {
+	return object->type != KRK_OBJ_STRING && object->type != KRK_OBJ_BYTES && object->type != KRK_OBJ_NATIVE;
+}
+
+static void rememberObject(KrkObj * object) {
+	/* Atomic, as helper threads may be setting the mark bit of the same object. */
+	__atomic_fetch_or(&object->flags, KRK_OBJ_FLAGS_REMEMBERED, __ATOMIC_RELAXED);
+	if (vm.rememberedCapacity < vm.rememberedCount + 1) {
+		vm.rememberedCapacity = GROW_CAPACITY(vm.rememberedCapacity);
+		vm.remembered = realloc(vm.remembered, sizeof(KrkObj*) * vm.rememberedCapacity);
+		if (!vm.remembered) exit(1);
+	}
+	vm.remembered[vm.rememberedCount++] = object;
+}
+
+static void pushGray(KrkObj * object) {
 	if (vm.grayCapacity < vm.grayCount + 1) {
 		vm.grayCapacity = GROW_CAPACITY(vm.grayCapacity);
 		vm.grayStack = realloc(vm.grayStack, sizeof(KrkObj*) * vm.grayCapacity);
@@ -326,6 +771,83 @@ void krk_markObject(KrkObj * object) {
 	vm.grayStack[vm.grayCount++] = object;
 }
 
+#ifndef KRK_DISABLE_THREADS
+/**
+ * Gray objects of one thread taking part in a parallel mark. Objects are
+ * pushed to and popped from @c local without locking. Batches are moved
+ * to @c shared when other markers are out of work, and can be taken from
+ * there by any marker while holding @c lock.
+ */
+struct GcMarker {
+	KrkObj ** local;
+	size_t localCount;
+	size_t localCapacity;
+	volatile int lock;
+	KrkObj ** shared;
+	size_t sharedCount;
+	size_t sharedCapacity;
+};
+
+/* The marker of the current thread, while it takes part in a parallel mark. */
+static threadLocal struct GcMarker * _marker = NULL;
+
+static void growGrayStack(KrkObj *** stack, size_t * capacity, size_t needed) {
+	if (*capacity >= needed) return;
+	while (*capacity < needed) *capacity = GROW_CAPACITY(*capacity);
+	*stack = realloc(*stack, sizeof(KrkObj*) * *capacity);
+	if (!*stack) exit(1);
+}
+
+static void markerPush(struct GcMarker * marker, KrkObj * object) {
+	growGrayStack(&marker->local, &marker->localCapacity, marker->localCount + 1);
+	marker->local[marker->localCount++] = object;
+}
+#endif
+
+/**
+ * Objects passed to the write barrier by an _ongcscan callback during a
+ * minor collection are also scanned by that collection. This is for objects
+ * that C code keeps filling in, like the code objects held by the compiler.
+ */
+void krk_gcRemember(KrkObj * object) {
+	_obtain_lock(_rememberLock);
+	if (!(object->flags & KRK_OBJ_FLAGS_REMEMBERED)) {
+		rememberObject(object);
+		if (_collectingYoung) pushGray(object);
+	}
+	_release_lock(_rememberLock);
+}
+
+static void forgetRemembered(void) {
+	for (size_t i = 0; i < vm.rememberedCount; ++i) {
+		vm.remembered[i]->flags &= ~(KRK_OBJ_FLAGS_REMEMBERED);
+	}
+	vm.rememberedCount = 0;
+}
+
+void krk_markObject(KrkObj * object) {
+	if (!object) return;
+#ifndef KRK_DISABLE_THREADS
+	/* Parallel marks are only done by full collections, once roots are marked. */
+	if (_marker) {
+		if (__atomic_load_n(&object->flags, __ATOMIC_RELAXED) & KRK_OBJ_FLAGS_IS_MARKED) return;
+		if (__atomic_fetch_or(&object->flags, KRK_OBJ_FLAGS_IS_MARKED, __ATOMIC_RELAXED) & KRK_OBJ_FLAGS_IS_MARKED) return;
+		markerPush(_marker, object);
+		return;
+	}
+#endif
+	if (unlikely(object->flags & KRK_OBJ_FLAGS_IS_OLD)) {
+		if (_markingRoots && !(object->flags & KRK_OBJ_FLAGS_REMEMBERED) && holdsReferences(object)) {
+			rememberObject(object);
+			if (_collectingYoung) pushGray(object);
+		}
+		if (_collectingYoung) return;
+	}
+	if (object->flags & KRK_OBJ_FLAGS_IS_MARKED) return;
+	object->flags |= KRK_OBJ_FLAGS_IS_MARKED;
+	pushGray(object);
+}
+
 void krk_markValue(KrkValue value) {
 	if (!IS_OBJECT(value)) return;
 	krk_markObject(AS_OBJECT(value));
@@ -366,6 +888,7 @@ static void blackenObject(KrkObj * object) {
 		}
 		case KRK_OBJ_UPVALUE:
 			krk_markValue(((KrkUpvalue*)object)->closed);
+			if (((KrkUpvalue*)object)->location != -1) krk_markObject(((KrkUpvalue*)object)->segmentOwner);
 			break;
 		case KRK_OBJ_CLASS: {
 			KrkClass * _class = (KrkClass *)object;
@@ -374,6 +897,7 @@ static void blackenObject(KrkObj * object) {
 			krk_markObject((KrkObj*)_class->base);
 			krk_markObject((KrkObj*)_class->_class);
 			krk_markTable(&_class->methods);
+			if (_recordClasses && _class->subclasses.count) recordClass(_class);
 			break;
 		}
 		case KRK_OBJ_INSTANCE: {
@@ -407,9 +931,9 @@ static void traceReferences(void) {
 	}
 }
 
-static size_t sweep(void) {
+static size_t sweep(KrkObj ** list) {
 	KrkObj * previous = NULL;
-	KrkObj * object = vm.objects;
+	KrkObj * object = *list;
 	size_t count = 0;
 	while (object) {
 		if (object->flags & (KRK_OBJ_FLAGS_IMMORTAL | KRK_OBJ_FLAGS_IS_MARKED)) {
@@ -422,7 +946,7 @@ static size_t sweep(void) {
 			if (previous != NULL) {
 				previous->next = object;
 			} else {
-				vm.objects = object;
+				*list = object;
 			}
 			freeObject(unreached);
 			count++;
@@ -435,20 +959,442 @@ static size_t sweep(void) {
 	return count;
 }
 
-void krk_markTable(KrkTable * table) {
-	for (size_t i = 0; i < table->capacity; ++i) {
-		KrkTableEntry * entry = &table->entries[i];
-		krk_markValue(entry->key);
-		krk_markValue(entry->value);
+/**
+ * Parallel collection
+ *
+ * With gc.helpers() set to more than zero, full collections of heaps larger
+ * than KRK_PARALLEL_GC_MIN share their mark and sweep phases with that many
+ * helper threads. Helpers are created the first time they are needed and
+ * then wait for work; they are not interpreter threads and never run code.
+ *
+ * Roots are still marked by the collecting thread. The gray objects it found
+ * are then split between the markers, each of which traces from its own
+ * stack. Mark bits are set atomically, so an object reachable from several
+ * markers is only scanned by one of them. A marker that runs out of objects
+ * takes half of a batch another marker has shared; the mark ends when all
+ * of them are out of objects at the same time.
+ *
+ * The list being swept is split into segments at objects recorded as it
+ * grows: every KRK_SWEEP_SEGMENT-th object allocated, or promoted in
+ * generational mode, and every KRK_SWEEP_SEGMENT-th object kept by the
+ * previous sweep. Objects are only removed from the list by a sweep, so
+ * these are still in it, and in the same order. Each segment is unlinked
+ * into a list of survivors and a list of objects to free; the collecting
+ * thread then joins the survivors back up and frees the rest, since
+ * freeing objects may run finalizers and touch shared tables.
+ */
+#ifndef KRK_PARALLEL_GC_MIN
+#define KRK_PARALLEL_GC_MIN (1024 * 1024)
+#endif
+#define KRK_SWEEP_SEGMENT 4096
+#define MARK_BATCH 64
+#ifndef KRK_DISABLE_THREADS
+#define KRK_GC_MAX_HELPERS 64
+#else
+#define KRK_GC_MAX_HELPERS 0
+#endif
+
+#ifndef KRK_DISABLE_THREADS
+struct SweepMarks {
+	KrkObj ** objects;
+	size_t count;
+	size_t capacity;
+};
+
+static struct SweepMarks _headMarks;     /**< Objects added to the head of the swept list, newest last */
+static struct SweepMarks _listMarks;     /**< Segment boundaries left by the last sweep, in list order */
+static size_t _headAdded = 0;
+
+static void addSweepMark(struct SweepMarks * marks, KrkObj * object) {
+	growGrayStack(&marks->objects, &marks->capacity, marks->count + 1);
+	marks->objects[marks->count++] = object;
+}
+
+static void noteHeadObject(KrkObj * object) {
+	if (++_headAdded % KRK_SWEEP_SEGMENT == 0) addSweepMark(&_headMarks, object);
+}
+
+static void forgetSweepMarks(void) {
+	_headMarks.count = 0;
+	_listMarks.count = 0;
+	_headAdded = 0;
+	for (KrkThreadState * thread = vm.threads; thread; thread = thread->next) {
+		thread->objects.markCount = 0;
 	}
 }
 
-static void tableRemoveWhite(KrkTable * table) {
-	for (size_t i = 0; i < table->capacity; ++i) {
-		KrkTableEntry * entry = &table->entries[i];
-		if (IS_OBJECT(entry->key) && !((AS_OBJECT(entry->key))->flags & KRK_OBJ_FLAGS_IS_MARKED)) {
-			krk_tableDeleteExact(table, entry->key);
+static void noteAllocation(KrkObjectList * list, KrkObj * object) {
+	if (!_helperCount || (vm.globalFlags & KRK_GLOBAL_GENERATIONAL_GC)) return;
+	if (list->count % KRK_SWEEP_SEGMENT == 0) {
+		growGrayStack(&list->marks, &list->markCapacity, list->markCount + 1);
+		list->marks[list->markCount++] = list->head;
+	}
+}
+
+/* The list was put at the head of vm.objects, so its marks come after the ones already there. */
+static void takeSweepMarks(KrkObjectList * list) {
+	for (size_t i = 0; i < list->markCount; ++i) addSweepMark(&_headMarks, list->marks[i]);
+	list->markCount = 0;
+}
+
+static pthread_mutex_t _helperLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t _helperWake = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t _helperDone = PTHREAD_COND_INITIALIZER;
+static size_t _helperThreads = 0;      /**< Helpers created so far */
+static size_t _helperRound = 0;        /**< Bumped to wake the helpers */
+static size_t _helperFinished = 0;
+static size_t _participants = 1;       /**< Threads taking part in this round, including the collector */
+static void (*_helperTask)(size_t);
+
+static struct GcMarker * _markers = NULL;
+static size_t _markerCapacity = 0;
+static size_t _idleMarkers = 0;
+
+static void * helperThread(void * arg) {
+	size_t index = (size_t)(uintptr_t)arg;
+	size_t round = 0;
+	pthread_mutex_lock(&_helperLock);
+	while (1) {
+		while (round == _helperRound) pthread_cond_wait(&_helperWake, &_helperLock);
+		round = _helperRound;
+		if (index >= _participants) continue;
+		void (*task)(size_t) = _helperTask;
+		pthread_mutex_unlock(&_helperLock);
+		task(index);
+		pthread_mutex_lock(&_helperLock);
+		if (++_helperFinished == _participants - 1) pthread_cond_signal(&_helperDone);
+	}
+	return NULL;
+}
+
+/**
+ * How many threads, including this one, should take part in
+ * this collection; helpers are started here if needed.
+ */
+static size_t gcParticipants(void) {
+	if (!_helperCount || vm.bytesAllocated < KRK_PARALLEL_GC_MIN) return 1;
+	if (_helperThreads < _helperCount) {
+		/* Helpers should never take signals meant for the interpreter. */
+		sigset_t all, previous;
+		sigfillset(&all);
+		pthread_sigmask(SIG_SETMASK, &all, &previous);
+		while (_helperThreads < _helperCount) {
+			pthread_t thread;
+			if (pthread_create(&thread, NULL, helperThread, (void*)(uintptr_t)(_helperThreads + 1))) break;
+			pthread_detach(thread);
+			_helperThreads++;
 		}
+		pthread_sigmask(SIG_SETMASK, &previous, NULL);
+	}
+	return 1 + (_helperThreads < _helperCount ? _helperThreads : _helperCount);
+}
+
+/* Run @p task on this thread as index 0 and on helpers as 1 through participants-1. */
+static void runOnHelpers(void (*task)(size_t), size_t participants) {
+	pthread_mutex_lock(&_helperLock);
+	_helperTask = task;
+	_participants = participants;
+	_helperFinished = 0;
+	_helperRound++;
+	pthread_cond_broadcast(&_helperWake);
+	pthread_mutex_unlock(&_helperLock);
+
+	task(0);
+
+	pthread_mutex_lock(&_helperLock);
+	while (_helperFinished < participants - 1) pthread_cond_wait(&_helperDone, &_helperLock);
+	pthread_mutex_unlock(&_helperLock);
+}
+
+static void markerShare(struct GcMarker * marker) {
+	_obtain_lock(marker->lock);
+	growGrayStack(&marker->shared, &marker->sharedCapacity, marker->sharedCount + MARK_BATCH);
+	marker->localCount -= MARK_BATCH;
+	memcpy(&marker->shared[marker->sharedCount], &marker->local[marker->localCount], sizeof(KrkObj*) * MARK_BATCH);
+	__atomic_store_n(&marker->sharedCount, marker->sharedCount + MARK_BATCH, __ATOMIC_RELAXED);
+	_release_lock(marker->lock);
+}
+
+/* Take back all of our own shared objects, or half of another marker's. */
+static int markerTake(struct GcMarker * marker, struct GcMarker * from) {
+	if (!__atomic_load_n(&from->sharedCount, __ATOMIC_RELAXED)) return 0;
+	_obtain_lock(from->lock);
+	size_t count = from == marker ? from->sharedCount : (from->sharedCount + 1) / 2;
+	if (count) {
+		__atomic_store_n(&from->sharedCount, from->sharedCount - count, __ATOMIC_RELAXED);
+		growGrayStack(&marker->local, &marker->localCapacity, marker->localCount + count);
+		memcpy(&marker->local[marker->localCount], &from->shared[from->sharedCount], sizeof(KrkObj*) * count);
+		marker->localCount += count;
+	}
+	_release_lock(from->lock);
+	return count != 0;
+}
+
+static int markerFindWork(size_t index) {
+	for (size_t i = 0; i < _participants; ++i) {
+		if (markerTake(&_markers[index], &_markers[(index + i) % _participants])) return 1;
+	}
+	return 0;
+}
+
+static int markerSeesWork(void) {
+	for (size_t i = 0; i < _participants; ++i) {
+		if (__atomic_load_n(&_markers[i].sharedCount, __ATOMIC_RELAXED)) return 1;
+	}
+	return 0;
+}
+
+static void markTask(size_t index) {
+	struct GcMarker * self = &_markers[index];
+	_marker = self;
+	while (1) {
+		while (self->localCount) {
+			KrkObj * object = self->local[--self->localCount];
+			blackenObject(object);
+			if (self->localCount >= MARK_BATCH * 2 && __atomic_load_n(&_idleMarkers, __ATOMIC_RELAXED)) {
+				markerShare(self);
+			}
+		}
+		if (markerFindWork(index)) continue;
+
+		/* Only idle markers have nothing shared, so once all of them are idle, nothing is left. */
+		size_t idle = __atomic_add_fetch(&_idleMarkers, 1, __ATOMIC_SEQ_CST);
+		while (idle < _participants) {
+			if (markerSeesWork()) {
+				__atomic_sub_fetch(&_idleMarkers, 1, __ATOMIC_SEQ_CST);
+				if (markerFindWork(index)) break;
+				__atomic_add_fetch(&_idleMarkers, 1, __ATOMIC_SEQ_CST);
+			}
+			sched_yield();
+			idle = __atomic_load_n(&_idleMarkers, __ATOMIC_SEQ_CST);
+		}
+		if (idle >= _participants) break;
+	}
+	_marker = NULL;
+}
+
+static void traceParallel(size_t participants) {
+	for (size_t i = 0; i < vm.grayCount; ++i) {
+		struct GcMarker * marker = &_markers[i % participants];
+		growGrayStack(&marker->shared, &marker->sharedCapacity, marker->sharedCount + 1);
+		marker->shared[marker->sharedCount++] = vm.grayStack[i];
+	}
+	vm.grayCount = 0;
+	_idleMarkers = 0;
+	runOnHelpers(markTask, participants);
+}
+
+struct SweepSegment {
+	KrkObj * first;          /**< First object in the segment */
+	KrkObj * end;            /**< First object of the next segment, or NULL */
+	KrkObj * head;           /**< Kept objects, relinked */
+	KrkObj * tail;
+	KrkObj * dead;           /**< Objects to free, linked through next */
+	size_t kept;
+	struct SweepMarks marks; /**< Every KRK_SWEEP_SEGMENT-th kept object, starting from the first */
+};
+
+static struct SweepSegment * _segments = NULL;
+static size_t _segmentCount = 0;
+static size_t _nextSegment = 0;
+
+static void sweepSegment(struct SweepSegment * segment) {
+	KrkObj ** link = &segment->head;
+	KrkObj * object = segment->first;
+	while (object != segment->end) {
+		KrkObj * next = object->next;
+		if (!(object->flags & (KRK_OBJ_FLAGS_IMMORTAL | KRK_OBJ_FLAGS_IS_MARKED)) && (object->flags & KRK_OBJ_FLAGS_SECOND_CHANCE)) {
+			object->next = segment->dead;
+			segment->dead = object;
+		} else {
+			if (object->flags & (KRK_OBJ_FLAGS_IMMORTAL | KRK_OBJ_FLAGS_IS_MARKED)) {
+				object->flags &= ~(KRK_OBJ_FLAGS_IS_MARKED | KRK_OBJ_FLAGS_SECOND_CHANCE);
+			} else {
+				object->flags |= KRK_OBJ_FLAGS_SECOND_CHANCE;
+			}
+			if (segment->kept++ % KRK_SWEEP_SEGMENT == 0) addSweepMark(&segment->marks, object);
+			*link = object;
+			link = &object->next;
+			segment->tail = object;
+		}
+		object = next;
+	}
+	*link = NULL;
+}
+
+static void sweepTask(size_t index) {
+	size_t i;
+	while ((i = __atomic_fetch_add(&_nextSegment, 1, __ATOMIC_RELAXED)) < _segmentCount) {
+		sweepSegment(&_segments[i]);
+	}
+}
+
+static size_t sweepParallel(KrkObj ** list, size_t participants) {
+	/* Head marks were recorded oldest first, so they are in reverse list order. */
+	_segmentCount = 1 + _headMarks.count + _listMarks.count;
+	_segments = realloc(_segments, sizeof(struct SweepSegment) * _segmentCount);
+	if (!_segments) exit(1);
+	KrkObj * start = *list;
+	for (size_t i = 0; i < _segmentCount; ++i) {
+		KrkObj * end = NULL;
+		if (i < _headMarks.count) end = _headMarks.objects[_headMarks.count - 1 - i];
+		else if (i - _headMarks.count < _listMarks.count) end = _listMarks.objects[i - _headMarks.count];
+		_segments[i] = (struct SweepSegment){start, end, NULL, NULL, NULL, 0, {NULL,0,0}};
+		start = end;
+	}
+	_nextSegment = 0;
+	if (participants > 1) runOnHelpers(sweepTask, participants);
+	else sweepTask(0);
+
+	/* Join the segments, free what they dropped, and pick boundaries for next time. */
+	size_t count = 0;
+	size_t sinceMark = 0;
+	KrkObj ** link = list;
+	_listMarks.count = 0;
+	for (size_t i = 0; i < _segmentCount; ++i) {
+		struct SweepSegment * segment = &_segments[i];
+		if (segment->head) {
+			*link = segment->head;
+			link = &segment->tail->next;
+		}
+		for (size_t j = 0; j < segment->marks.count; ++j) {
+			if (j) sinceMark += KRK_SWEEP_SEGMENT;
+			if (sinceMark >= KRK_SWEEP_SEGMENT) {
+				addSweepMark(&_listMarks, segment->marks.objects[j]);
+				sinceMark = 0;
+			}
+		}
+		sinceMark += segment->kept - (segment->marks.count ? (segment->marks.count - 1) * KRK_SWEEP_SEGMENT : 0);
+		free(segment->marks.objects);
+		while (segment->dead) {
+			KrkObj * next = segment->dead->next;
+			freeObject(segment->dead);
+			segment->dead = next;
+			count++;
+		}
+	}
+	*link = NULL;
+	_headMarks.count = 0;
+	_headAdded = 0;
+	return count;
+}
+
+static size_t sweepList(KrkObj ** list, size_t participants) {
+	if (!_helperCount) return sweep(list);
+	return sweepParallel(list, participants);
+}
+
+static void trace(size_t participants) {
+	if (participants > 1) traceParallel(participants);
+	else traceReferences();
+}
+#else
+static void noteAllocation(KrkObjectList * list, KrkObj * object) { }
+static void takeSweepMarks(KrkObjectList * list) { }
+static void noteHeadObject(KrkObj * object) { }
+static void forgetSweepMarks(void) { }
+static size_t gcParticipants(void) { return 1; }
+static size_t sweepList(KrkObj ** list, size_t participants) { return sweep(list); }
+static void trace(size_t participants) { traceReferences(); }
+#endif
+
+/**
+ * Thread object lists
+ *
+ * Each thread links the objects it allocates onto its own list and keeps
+ * its own count of bytes allocated and freed, so allocating takes no lock.
+ * Before a collection looks at either, with every other thread stopped,
+ * the lists are spliced onto the front of vm.objects and the counts are
+ * added to vm.bytesAllocated. A thread also adds its count to the total
+ * whenever it passes KRK_ALLOCATION_BATCH in either direction, so that
+ * collections still start on time; without threads, every change is added
+ * as it is made. Threads that exit hand over their list and count first.
+ */
+void krk_gcAddObject(KrkObj * object) {
+	KrkObjectList * list = &krk_currentThread.objects;
+	if (!list->head) list->tail = object;
+	object->next = list->head;
+	list->head = object;
+	list->count++;
+	noteAllocation(list, object);
+}
+
+static void takeObjects(KrkThreadState * thread) {
+	KrkObjectList * list = &thread->objects;
+	if (list->head) {
+		/* After a lazy sweep takes vm.objects, the first list added holds the oldest objects. */
+		if (!vm.objects) _objectsTail = list->tail;
+		list->tail->next = vm.objects;
+		vm.objects = list->head;
+		list->head = NULL;
+		list->tail = NULL;
+		list->count = 0;
+	}
+	takeSweepMarks(list);
+	addAllocated(thread);
+}
+
+static void takeAllObjects(void) {
+	for (KrkThreadState * thread = vm.threads; thread; thread = thread->next) takeObjects(thread);
+}
+
+/**
+ * Sweep the young generation, promoting survivors. Minor collections
+ * don't scan the whole strings table for unmarked strings, so those
+ * are removed from it here instead.
+ */
+static size_t sweepYoung(size_t * promoted) {
+	KrkObj * previous = NULL;
+	KrkObj * object = vm.objects;
+	size_t count = 0;
+	while (object) {
+		KrkObj * next = object->next;
+		if (object->flags & (KRK_OBJ_FLAGS_IMMORTAL | KRK_OBJ_FLAGS_IS_MARKED)) {
+			if (previous != NULL) {
+				previous->next = next;
+			} else {
+				vm.objects = next;
+			}
+			object->flags &= ~(KRK_OBJ_FLAGS_IS_MARKED | KRK_OBJ_FLAGS_SECOND_CHANCE);
+			object->flags |= KRK_OBJ_FLAGS_IS_OLD;
+			object->next = vm.oldObjects;
+			vm.oldObjects = object;
+			if (_helperCount) noteHeadObject(object);
+			if (holdsReferences(object) && !(object->flags & KRK_OBJ_FLAGS_REMEMBERED)) rememberObject(object);
+			(*promoted)++;
+		} else {
+			if (_collectingYoung && object->type == KRK_OBJ_STRING) {
+				krk_internRemove((KrkString*)object);
+			}
+			if (object->flags & KRK_OBJ_FLAGS_SECOND_CHANCE) {
+				if (previous != NULL) {
+					previous->next = next;
+				} else {
+					vm.objects = next;
+				}
+				freeObject(object);
+				count++;
+			} else {
+				object->flags |= KRK_OBJ_FLAGS_SECOND_CHANCE;
+				previous = object;
+			}
+		}
+		object = next;
+	}
+	return count;
+}
+
+void krk_markTable(KrkTable * table) {
+	if (table->shape) {
+		for (size_t i = 0; i < table->count; ++i) {
+			krk_markValue(table->values[i]);
+		}
+		return;
+	}
+	for (size_t i = 0; i < table->used; ++i) {
+		KrkTableEntry * entry = &table->entries[i];
+		krk_markValue(entry->key);
+		krk_markValue(entry->value);
 	}
 }
 
@@ -459,6 +1405,14 @@ static void markThreadRoots(KrkThreadState * thread) {
 	for (KrkUpvalue * upvalue = thread->openUpvalues; upvalue; upvalue = upvalue->next) {
 		krk_markObject((KrkObj*)upvalue);
 	}
+	for (KrkStackSegment * segment = thread->outerStacks; segment; segment = segment->prev) {
+		for (KrkValue * slot = segment->stack; slot && slot < segment->stackTop; ++slot) {
+			krk_markValue(*slot);
+		}
+		for (KrkUpvalue * upvalue = segment->openUpvalues; upvalue; upvalue = upvalue->next) {
+			krk_markObject((KrkObj*)upvalue);
+		}
+	}
 	krk_markValue(thread->currentException);
 
 	if (thread->module)  krk_markObject((KrkObj*)thread->module);
@@ -477,6 +1431,8 @@ static void markRoots(void) {
 
 	krk_markObject((KrkObj*)vm.builtins);
 	krk_markTable(&vm.modules);
+	krk_markShapes();
+	krk_markProfilerSamples();
 
 	if (vm.specialMethodNames) {
 		for (int i = 0; i < METHOD__MAX; ++i) {
@@ -505,22 +1461,38 @@ static int smartSize(char _out[100], size_t s) {
 }
 #endif
 
-size_t krk_collectGarbage(void) {
 #ifndef KRK_NO_GC_TRACING
-	struct timespec outTime, inTime;
+static void reportCollection(const char * kind, struct timespec * inTime, size_t bytesBefore, size_t freed, size_t promoted, size_t remembered) {
+	struct timespec outTime;
+	clock_gettime(CLOCK_MONOTONIC, &outTime);
+	struct timespec diff;
+	diff.tv_sec  = outTime.tv_sec  - inTime->tv_sec;
+	diff.tv_nsec = outTime.tv_nsec - inTime->tv_nsec;
+	if (diff.tv_nsec < 0) { diff.tv_sec--; diff.tv_nsec += 1000000000L; }
 
-	if (vm.globalFlags & KRK_GLOBAL_REPORT_GC_COLLECTS) {
-		clock_gettime(CLOCK_MONOTONIC, &inTime);
-	}
+	char smartBefore[100];
+	smartSize(smartBefore, bytesBefore);
+	char smartAfter[100];
+	smartSize(smartAfter, vm.bytesAllocated);
+	char smartFreed[100];
+	smartSize(smartFreed, bytesBefore - vm.bytesAllocated);
+	char smartNext[100];
+	smartSize(smartNext, vm.nextGC);
 
-	size_t bytesBefore = vm.bytesAllocated;
+	if (!kind) {
+		fprintf(stderr, "[gc] %lld.%.9lds %s before; %s after; freed %s in %llu objects; next collection at %s\n",
+			(long long)diff.tv_sec, diff.tv_nsec,
+			smartBefore,smartAfter,smartFreed,(unsigned long long)freed, smartNext);
+	} else {
+		fprintf(stderr, "[gc] %s %lld.%.9lds %s before; %s after; freed %s in %llu objects; promoted %llu; remembered %llu; next full collection at %s\n",
+			kind, (long long)diff.tv_sec, diff.tv_nsec,
+			smartBefore,smartAfter,smartFreed,(unsigned long long)freed,
+			(unsigned long long)promoted, (unsigned long long)remembered, smartNext);
+	}
+}
 #endif
 
-	markRoots();
-	traceReferences();
-	tableRemoveWhite(&vm.strings);
-	size_t out = sweep();
-
+static void scheduleCollections(int generational) {
 	/**
 	 * The GC scheduling is in need of some improvement. The strategy at the moment
 	 * is to schedule the next collect at double the current post-collection byte
@@ -530,45 +1502,387 @@ size_t krk_collectGarbage(void) {
 	 * Previously, we always doubled as that was what Lox did, but this rather
 	 * quickly runs into issues when memory allocation climbs into the GiB range.
 	 * 64MiB seems to be a good switchover point.
+	 *
+	 * In generational mode, the nursery is on top of that, so that full
+	 * collections are only reached by the growth of the old generation.
 	 */
 	if (vm.bytesAllocated < 0x4000000) {
 		vm.nextGC = vm.bytesAllocated * 2;
 	} else {
 		vm.nextGC = vm.bytesAllocated + 0x4000000;
 	}
+	if (generational) vm.nextGC += KRK_NURSERY_SIZE;
+	vm.nextMinorGC = vm.bytesAllocated + KRK_NURSERY_SIZE;
+}
+
+/**
+ * Lazy sweeping
+ *
+ * Collections started by allocation in a program that has not started any
+ * threads return once marking is done. The object list is taken as it was
+ * then, and each allocation after that sweeps the next KRK_LAZY_SWEEP_STEP
+ * objects from it, so the pause depends on the live objects and not on the
+ * size of the heap. Objects allocated in the meantime go on a new list, and
+ * the survivors are put back after them once the sweep is done, which is
+ * when the next collection is scheduled. Anything that needs the complete
+ * list, including the next collection, finishes the sweep first.
+ *
+ * Garbage that is still waiting to be swept must not be found again, so
+ * before the pause ends, classes about to be freed are taken out of the
+ * subclass tables of the classes that survive, and strings are taken out
+ * of the string table as they are freed. A lookup that finds a string that
+ * may not have been swept yet marks it, which keeps it.
+ *
+ * With threads, objects could be found through those tables while they are
+ * being freed, and flags are updated without atomics, so collections then
+ * sweep everything before returning, as before. Starting the first thread
+ * finishes any sweep in progress.
+ */
+static KrkObj * _sweepList = NULL;   /**< Objects the sweep has yet to look at */
+static KrkObj * _sweptHead = NULL;   /**< Objects it kept, in their original order */
+static KrkObj * _sweptTail = NULL;
+static size_t _sweepFreed = 0;
+static KrkClass ** _liveClasses = NULL;
+static size_t _liveClassCount = 0;
+static size_t _liveClassCapacity = 0;
+
+static void recordClass(KrkClass * _class) {
+	if (_liveClassCapacity < _liveClassCount + 1) {
+		_liveClassCapacity = GROW_CAPACITY(_liveClassCapacity);
+		_liveClasses = realloc(_liveClasses, sizeof(KrkClass*) * _liveClassCapacity);
+		if (!_liveClasses) exit(1);
+	}
+	_liveClasses[_liveClassCount++] = _class;
+}
+
+/**
+ * Remove subclasses that will be freed by this sweep. Subclasses that
+ * were not marked but are not being freed yet may still be found, so
+ * their subclasses are checked too. Freed classes have their base
+ * cleared, so freeing them no longer touches any other class.
+ */
+static void pruneSubclasses(KrkClass * _class) {
+	for (size_t i = 0; i < _class->subclasses.capacity; ++i) {
+		KrkTableEntry * entry = &_class->subclasses.entries[i];
+		if (IS_KWARGS(entry->key)) continue;
+		KrkClass * subclass = AS_CLASS(entry->key);
+		if (subclass->obj.flags & (KRK_OBJ_FLAGS_IMMORTAL | KRK_OBJ_FLAGS_IS_MARKED)) continue;
+		if (subclass->obj.flags & KRK_OBJ_FLAGS_SECOND_CHANCE) {
+			subclass->base = NULL;
+			krk_tableDeleteExact(&_class->subclasses, entry->key);
+		} else {
+			pruneSubclasses(subclass);
+		}
+	}
+}
+
+void krk_gcFoundString(KrkString * string) {
+	if (_sweeping) string->obj.flags |= KRK_OBJ_FLAGS_IS_MARKED;
+}
+
+static void keepSwept(KrkObj * object) {
+	object->next = NULL;
+	if (_sweptTail) _sweptTail->next = object;
+	else _sweptHead = object;
+	_sweptTail = object;
+}
+
+static void finishLazySweep(void) {
+	/* Survivors are older than anything allocated during the sweep. */
+	takeAllObjects();
+	if (_sweptHead) {
+		if (vm.objects) _objectsTail->next = _sweptHead;
+		else vm.objects = _sweptHead;
+	}
+	_sweptHead = NULL;
+	_sweptTail = NULL;
+	_sweeping = 0;
+	krk_sweepShapes();
+	scheduleCollections(0);
 
 #ifndef KRK_NO_GC_TRACING
 	if (vm.globalFlags & KRK_GLOBAL_REPORT_GC_COLLECTS) {
-		clock_gettime(CLOCK_MONOTONIC, &outTime);
-		struct timespec diff;
-		diff.tv_sec  = outTime.tv_sec  - inTime.tv_sec;
-		diff.tv_nsec = outTime.tv_nsec - inTime.tv_nsec;
-		if (diff.tv_nsec < 0) { diff.tv_sec--; diff.tv_nsec += 1000000000L; }
-
-		char smartBefore[100];
-		smartSize(smartBefore, bytesBefore);
 		char smartAfter[100];
 		smartSize(smartAfter, vm.bytesAllocated);
-		char smartFreed[100];
-		smartSize(smartFreed, bytesBefore - vm.bytesAllocated);
 		char smartNext[100];
 		smartSize(smartNext, vm.nextGC);
+		fprintf(stderr, "[gc] swept %llu objects lazily; %s after; next collection at %s\n",
+			(unsigned long long)_sweepFreed, smartAfter, smartNext);
+	}
+#endif
+}
 
-		fprintf(stderr, "[gc] %lld.%.9lds %s before; %s after; freed %s in %llu objects; next collection at %s\n",
-			(long long)diff.tv_sec, diff.tv_nsec,
-			smartBefore,smartAfter,smartFreed,(unsigned long long)out, smartNext);
+static void sweepLazily(size_t budget) {
+	if (_sweepBusy) return;
+	_sweepBusy = 1;
+	while (_sweepList && budget) {
+		KrkObj * object = _sweepList;
+		_sweepList = object->next;
+		budget--;
+		if (object->flags & (KRK_OBJ_FLAGS_IMMORTAL | KRK_OBJ_FLAGS_IS_MARKED)) {
+			object->flags &= ~(KRK_OBJ_FLAGS_IS_MARKED | KRK_OBJ_FLAGS_SECOND_CHANCE);
+			keepSwept(object);
+		} else if (object->flags & KRK_OBJ_FLAGS_SECOND_CHANCE) {
+			if (object->type == KRK_OBJ_STRING) krk_internRemove((KrkString*)object);
+			freeObject(object);
+			_sweepFreed++;
+		} else {
+			object->flags |= KRK_OBJ_FLAGS_SECOND_CHANCE;
+			keepSwept(object);
+		}
+	}
+	if (!_sweepList) finishLazySweep();
+	_sweepBusy = 0;
+}
+
+void krk_gcFinishSweep(void) {
+	if (_sweeping) sweepLazily(SIZE_MAX);
+}
+
+void krk_gcGatherObjects(void) {
+	while (!stopWorld());
+	krk_gcFinishSweep();
+	takeAllObjects();
+	resumeWorld();
+}
+
+static size_t collectGarbage(int lazy) {
+#ifndef KRK_NO_GC_TRACING
+	struct timespec inTime;
+
+	if (vm.globalFlags & KRK_GLOBAL_REPORT_GC_COLLECTS) {
+		clock_gettime(CLOCK_MONOTONIC, &inTime);
+	}
+#endif
+
+	krk_gcFinishSweep();
+	krk_internReclaim();
+	krk_tableReclaim();
+	takeAllObjects();
+
+#ifndef KRK_NO_GC_TRACING
+	size_t bytesBefore = vm.bytesAllocated;
+#endif
+
+	int generational = !!(vm.globalFlags & KRK_GLOBAL_GENERATIONAL_GC);
+	size_t promoted = 0;
+	size_t participants = gcParticipants();
+	lazy = lazy && !generational && !_helperCount && !(vm.globalFlags & KRK_GLOBAL_THREADS);
+
+	/* Everything is marked, so the remembered set is rebuilt from scratch. */
+	forgetRemembered();
+
+	_recordClasses = lazy;
+	_markingRoots = 1;
+	markRoots();
+	_markingRoots = 0;
+	trace(participants);
+	_recordClasses = 0;
+
+	if (lazy) {
+		for (size_t i = 0; i < _liveClassCount; ++i) pruneSubclasses(_liveClasses[i]);
+		_liveClassCount = 0;
+		_sweepList = vm.objects;
+		_sweepFreed = 0;
+		_sweeping = 1;
+		vm.objects = NULL;
+		vm.nextGC = SIZE_MAX;
+#ifndef KRK_NO_GC_TRACING
+		if (vm.globalFlags & KRK_GLOBAL_REPORT_GC_COLLECTS) {
+			struct timespec outTime;
+			clock_gettime(CLOCK_MONOTONIC, &outTime);
+			long long elapsed = (outTime.tv_sec - inTime.tv_sec) * 1000000000LL + (outTime.tv_nsec - inTime.tv_nsec);
+			char smartBefore[100];
+			smartSize(smartBefore, bytesBefore);
+			fprintf(stderr, "[gc] %lld.%.9llds %s before; marked, sweeping lazily\n",
+				elapsed / 1000000000LL, elapsed % 1000000000LL, smartBefore);
+		}
+#endif
+		return 0;
+	}
+
+	krk_internRemoveWhite();
+	size_t out;
+	if (generational) {
+		out = sweepYoung(&promoted) + sweepList(&vm.oldObjects, participants);
+	} else {
+		out = sweepList(&vm.objects, participants);
+	}
+	krk_sweepShapes();
+	addAllocated(&krk_currentThread);
+	scheduleCollections(generational);
+
+#ifndef KRK_NO_GC_TRACING
+	if (vm.globalFlags & KRK_GLOBAL_REPORT_GC_COLLECTS) {
+		reportCollection(generational ? "full" : NULL, &inTime, bytesBefore, out, promoted, vm.rememberedCount);
 	}
 #endif
 	return out;
 }
 
+static size_t collectYoung(void) {
+#ifndef KRK_NO_GC_TRACING
+	struct timespec inTime;
+
+	if (vm.globalFlags & KRK_GLOBAL_REPORT_GC_COLLECTS) {
+		clock_gettime(CLOCK_MONOTONIC, &inTime);
+	}
+#endif
+
+	krk_internReclaim();
+	krk_tableReclaim();
+	takeAllObjects();
+
+#ifndef KRK_NO_GC_TRACING
+	size_t bytesBefore = vm.bytesAllocated;
+#endif
+
+	/* Take the remembered set for this collection; a new one is built for the next. */
+	KrkObj ** remembered = vm.remembered;
+	size_t rememberedCount = vm.rememberedCount;
+	vm.remembered = NULL;
+	vm.rememberedCount = 0;
+	vm.rememberedCapacity = 0;
+	for (size_t i = 0; i < rememberedCount; ++i) {
+		remembered[i]->flags &= ~(KRK_OBJ_FLAGS_REMEMBERED);
+	}
+
+	_collectingYoung = 1;
+	_markingRoots = 1;
+	markRoots();
+	_markingRoots = 0;
+	for (size_t i = 0; i < rememberedCount; ++i) {
+		blackenObject(remembered[i]);
+	}
+	free(remembered);
+	traceReferences();
+	size_t promoted = 0;
+	size_t out = sweepYoung(&promoted);
+	_collectingYoung = 0;
+	krk_sweepShapes();
+
+	addAllocated(&krk_currentThread);
+	vm.nextMinorGC = vm.bytesAllocated + KRK_NURSERY_SIZE;
+
+#ifndef KRK_NO_GC_TRACING
+	if (vm.globalFlags & KRK_GLOBAL_REPORT_GC_COLLECTS) {
+		reportCollection("minor", &inTime, bytesBefore, out, promoted, rememberedCount);
+	}
+#endif
+	return out;
+}
+
+size_t krk_collectGarbage(void) {
+	if (!stopWorld()) return 0;
+	size_t out = collectGarbage(0);
+	resumeWorld();
+	return out;
+}
+
+static void collectLazily(void) {
+	if (!stopWorld()) return;
+	collectGarbage(1);
+	resumeWorld();
+}
+
+size_t krk_collectYoung(void) {
+	if (!stopWorld()) return 0;
+	size_t out = collectYoung();
+	resumeWorld();
+	return out;
+}
+
+void krk_gcSetGenerational(int enabled) {
+	while (!stopWorld());
+	krk_gcFinishSweep();
+	takeAllObjects();
+	if (enabled) {
+		vm.globalFlags |= KRK_GLOBAL_GENERATIONAL_GC;
+		vm.nextMinorGC = vm.bytesAllocated + KRK_NURSERY_SIZE;
+	} else {
+		vm.globalFlags &= ~(KRK_GLOBAL_GENERATIONAL_GC);
+		while (vm.oldObjects) {
+			KrkObj * object = vm.oldObjects;
+			vm.oldObjects = object->next;
+			object->flags &= ~(KRK_OBJ_FLAGS_IS_OLD | KRK_OBJ_FLAGS_REMEMBERED);
+			object->next = vm.objects;
+			vm.objects = object;
+		}
+		vm.rememberedCount = 0;
+	}
+	/* Objects move between the lists, so sweep segments have to be found again. */
+	forgetSweepMarks();
+	resumeWorld();
+}
+
+int krk_gcSetHelpers(size_t count) {
+	if (count > KRK_GC_MAX_HELPERS) return 1;
+#ifndef KRK_DISABLE_THREADS
+	while (!stopWorld());
+	krk_gcFinishSweep();
+	if (_markerCapacity < count + 1) {
+		_markers = realloc(_markers, sizeof(struct GcMarker) * (count + 1));
+		if (!_markers) exit(1);
+		memset(&_markers[_markerCapacity], 0, sizeof(struct GcMarker) * (count + 1 - _markerCapacity));
+		_markerCapacity = count + 1;
+	}
+	_helperCount = count;
+	forgetSweepMarks();
+	resumeWorld();
+#endif
+	return 0;
+}
+
 #ifndef KRK_NO_SYSTEM_MODULES
 KRK_Function(collect) {
-	FUNCTION_TAKES_NONE();
-	if (&krk_currentThread != vm.threads) return krk_runtimeError(vm.exceptions->valueError, "only the main thread can do that");
+	int generation = 1;
+	if (!krk_parseArgs("|i", (const char*[]){"generation"}, &generation)) return NONE_VAL();
+	if (generation == 0 && (vm.globalFlags & KRK_GLOBAL_GENERATIONAL_GC)) return INTEGER_VAL(krk_collectYoung());
 	return INTEGER_VAL(krk_collectGarbage());
 }
 
+KRK_Function(generational) {
+	int hasEnabled = 0, enabled = 0;
+	if (!krk_parseArgs("|p?", (const char*[]){"enabled"}, &hasEnabled, &enabled)) return NONE_VAL();
+	int previous = !!(vm.globalFlags & KRK_GLOBAL_GENERATIONAL_GC);
+	if (hasEnabled) krk_gcSetGenerational(enabled);
+	return BOOLEAN_VAL(previous);
+}
+
+KRK_Function(helpers) {
+	int hasCount = 0;
+	size_t count = 0;
+	if (!krk_parseArgs("|N?", (const char*[]){"count"}, &hasCount, &count)) return NONE_VAL();
+	size_t previous = _helperCount;
+	if (hasCount && krk_gcSetHelpers(count)) {
+		return krk_runtimeError(vm.exceptions->valueError, "count must be at most %d", KRK_GC_MAX_HELPERS);
+	}
+	return INTEGER_VAL(previous);
+}
+
+KRK_Function(slab_stats) {
+	FUNCTION_TAKES_NONE();
+	KrkValue result = krk_list_of(0,NULL,0);
+	krk_push(result);
+#ifndef KRK_NO_SLAB_ALLOCATOR
+	for (size_t i = 0; i < KRK_SLAB_CLASSES; ++i) {
+		_obtain_lock(_slabLock);
+		size_t chunks = vm.slabChunkCount[i];
+		size_t available = vm.slabPool[i].count + krk_currentThread.slabs[i].count;
+		_release_lock(_slabLock);
+		KrkValue entry = krk_dict_of(0,NULL,0);
+		krk_push(entry);
+		krk_attachNamedValue(AS_DICT(entry), "size",   INTEGER_VAL(SLAB_SLOT_SIZE(i)));
+		krk_attachNamedValue(AS_DICT(entry), "chunks", INTEGER_VAL(chunks));
+		krk_attachNamedValue(AS_DICT(entry), "slots",  INTEGER_VAL(chunks * SLAB_SLOTS(i)));
+		krk_attachNamedValue(AS_DICT(entry), "free",   INTEGER_VAL(available));
+		krk_writeValueArray(AS_LIST(result), entry);
+		krk_pop();
+	}
+#endif
+	return krk_pop();
+}
+
 KRK_Function(pause) {
 	FUNCTION_TAKES_NONE();
 	vm.globalFlags |= (KRK_GLOBAL_GC_PAUSED);
@@ -594,7 +1908,28 @@ void krk_module_init_gc(void) {
 	KRK_DOC(gcModule, "@brief Namespace containing methods for controlling the garbage collector.");
 
 	KRK_DOC(BIND_FUNC(gcModule,collect),
-		"@brief Triggers one cycle of garbage collection.");
+		"@brief Triggers one cycle of garbage collection.\n"
+		"@arguments generation=1\n\n"
+		"In generational mode, a @p generation of 0 collects only young objects. "
+		"Other threads are stopped until the collection finishes.");
+	KRK_DOC(BIND_FUNC(gcModule,generational),
+		"@brief Enable or disable generational collection.\n"
+		"@arguments enabled=None\n\n"
+		"In generational mode, objects that survive a collection are only examined again "
+		"by full collections, which become less frequent. Returns whether it was enabled "
+		"before the call.");
+	KRK_DOC(BIND_FUNC(gcModule,helpers),
+		"@brief Set the number of helper threads for full collections.\n"
+		"@arguments count=None\n\n"
+		"Full collections of large heaps mark and sweep in parallel across @p count helper "
+		"threads and the thread that is collecting. Zero, the default, collects on one thread. "
+		"Returns the number of helpers before the call.");
+	KRK_DOC(BIND_FUNC(gcModule,slab_stats),
+		"@brief Get statistics for the slab allocator.\n\n"
+		"Returns a list with a dict for each object size class, giving the slot @c size in bytes, "
+		"the number of @c chunks allocated for it, the number of @c slots they hold, "
+		"and how many of those are @c free. Free slots held by other threads are counted as in use. "
+		"The list is empty if the slab allocator was disabled at build time.");
 	KRK_DOC(BIND_FUNC(gcModule,pause),
 		"@brief Disables automatic garbage collection until @ref resume is called.");
 	KRK_DOC(BIND_FUNC(gcModule,resume),
@@ -0,0 +1,1237 @@
+/**
+ * @file    module_asyncio.c
+ * @brief   Event loop for running coroutines.
+ *
+ * An @c EventLoop keeps a queue of tasks that are ready to run, a heap
+ * of timers, and the futures of tasks waiting on file descriptors. Each
+ * pass runs the ready tasks once, then waits for the next timer or for a
+ * descriptor to become ready - with @c epoll where it is available, or
+ * with @c poll otherwise.
+ *
+ * A task drives a coroutine by calling it: an @c await on a @c Future
+ * that is not done yields the future up to the task, which waits on it
+ * and is queued to run again when it completes.
+ */
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#else
+#include <poll.h>
+#endif
+
+#include <kuroko/vm.h>
+#include <kuroko/memory.h>
+#include <kuroko/util.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+static KrkClass * Future = NULL;
+static KrkClass * FutureIter = NULL;
+static KrkClass * Task = NULL;
+static KrkClass * EventLoop = NULL;
+static KrkClass * IoOp = NULL;
+static KrkClass * InvalidStateError = NULL;
+
+enum {
+	FUTURE_PENDING = 0,
+	FUTURE_DONE,
+	FUTURE_FAILED,
+};
+
+struct Future {
+	KrkInstance inst;
+	int state;
+	KrkValue result;        /**< The result, or the exception when failed */
+	KrkValueArray waiters;  /**< Tasks to schedule when this completes */
+};
+
+struct FutureIter {
+	KrkInstance inst;
+	KrkValue future;
+};
+
+struct Task {
+	struct Future future;
+	KrkValue coro;
+	KrkValue loop;
+};
+
+struct Timer {
+	double when;
+	size_t seq;
+	KrkValue future;
+	KrkValue result;
+};
+
+struct EventLoop {
+	KrkInstance inst;
+	int open;
+	int running;
+	KrkValueArray ready;     /**< Tasks to run on the next pass */
+	KrkValueArray runQueue;  /**< Tasks being run on this pass */
+	struct Timer * timers;   /**< Min-heap ordered by time, then by order of scheduling */
+	size_t timerCount;
+	size_t timerSpace;
+	size_t timerSeq;
+	KrkValue * readers;      /**< Future for each descriptor waited on for reading */
+	KrkValue * writers;      /**< Future for each descriptor waited on for writing */
+	uint8_t * registered;    /**< Whether each descriptor has been added to the epoll set */
+	size_t fdSpace;
+	size_t waiting;
+	int epfd;
+};
+
+#define IS_Future(o) (krk_isInstanceOf(o,Future))
+#define AS_Future(o) ((struct Future*)AS_OBJECT(o))
+#define IS_FutureIter(o) (krk_isInstanceOf(o,FutureIter))
+#define AS_FutureIter(o) ((struct FutureIter*)AS_OBJECT(o))
+#define IS_Task(o) (krk_isInstanceOf(o,Task))
+#define AS_Task(o) ((struct Task*)AS_OBJECT(o))
+#define IS_EventLoop(o) (krk_isInstanceOf(o,EventLoop))
+#define AS_EventLoop(o) ((struct EventLoop*)AS_OBJECT(o))
+#define IS_IoOp(o) (krk_isInstanceOf(o,IoOp))
+#define AS_IoOp(o) ((struct IoOp*)AS_OBJECT(o))
+
+/** The loop running in this thread, if any. It is also on the stack of its @c run_until_complete call. */
+static threadLocal struct EventLoop * runningLoop = NULL;
+
+static double monotonicTime(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1000000000.0;
+}
+
+static KrkValue osError(int err) {
+	return krk_runtimeError(KRK_EXC(OSError), "%s", strerror(err));
+}
+
+static void clearException(void) {
+	krk_currentThread.flags &= ~KRK_THREAD_HAS_EXCEPTION;
+	krk_currentThread.currentException = NONE_VAL();
+}
+
+/**
+ * If the current exception carries an @c errno attribute, as a SocketError
+ * does, return it.
+ */
+static int exceptionErrno(void) {
+	KrkValue exc = krk_currentThread.currentException;
+	KrkValue err = NONE_VAL();
+	if (IS_INSTANCE(exc) && krk_tableGet(&AS_INSTANCE(exc)->fields, OBJECT_VAL(S("errno")), &err) && IS_INTEGER(err)) {
+		return AS_INTEGER(err);
+	}
+	return 0;
+}
+
+static int getFileno(KrkValue value) {
+	if (IS_INTEGER(value)) {
+		if (AS_INTEGER(value) < 0 || AS_INTEGER(value) > INT_MAX) {
+			krk_runtimeError(vm.exceptions->valueError, "invalid file descriptor %d", (int)AS_INTEGER(value));
+			return -1;
+		}
+		return AS_INTEGER(value);
+	}
+	KrkValue method = krk_valueGetAttribute_default(value, "fileno", NONE_VAL());
+	if (IS_NONE(method)) {
+		krk_runtimeError(vm.exceptions->typeError, "expected a file descriptor or an object with fileno(), not '%T'", value);
+		return -1;
+	}
+	krk_push(method);
+	KrkValue result = krk_callStack(0);
+	if (krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION) return -1;
+	if (!IS_INTEGER(result)) {
+		krk_runtimeError(vm.exceptions->typeError, "fileno() returned '%T', not int", result);
+		return -1;
+	}
+	return getFileno(result);
+}
+
+/*
+ * Futures
+ */
+
+static void initFuture(struct Future * self) {
+	self->state = FUTURE_PENDING;
+	self->result = NONE_VAL();
+	krk_initValueArray(&self->waiters);
+}
+
+static void _future_gcscan(KrkInstance * _self) {
+	struct Future * self = (struct Future*)_self;
+	krk_markValue(self->result);
+	for (size_t i = 0; i < self->waiters.count; ++i) {
+		krk_markValue(self->waiters.values[i]);
+	}
+}
+
+static void _future_gcsweep(KrkInstance * _self) {
+	struct Future * self = (struct Future*)_self;
+	krk_freeValueArray(&self->waiters);
+}
+
+static struct Future * newFuture(void) {
+	struct Future * self = (struct Future*)krk_newInstance(Future);
+	initFuture(self);
+	return self;
+}
+
+static void scheduleTask(struct Task * task) {
+	struct EventLoop * loop = AS_EventLoop(task->loop);
+	krk_gcWriteBarrier((KrkObj*)loop);
+	krk_writeValueArray(&loop->ready, OBJECT_VAL(task));
+}
+
+/**
+ * Complete a future and queue the tasks waiting on it. The caller must
+ * hold a reference to it, as queueing can collect garbage.
+ */
+static void finishFuture(struct Future * self, int state, KrkValue result) {
+	krk_gcWriteBarrier((KrkObj*)self);
+	self->state = state;
+	self->result = result;
+	for (size_t i = 0; i < self->waiters.count; ++i) {
+		scheduleTask(AS_Task(self->waiters.values[i]));
+	}
+	krk_freeValueArray(&self->waiters);
+}
+
+#define CURRENT_CTYPE struct Future *
+#define CURRENT_NAME  self
+
+KRK_Method(Future,__init__) {
+	METHOD_TAKES_NONE();
+	initFuture(self);
+	return NONE_VAL();
+}
+
+KRK_Method(Future,__repr__) {
+	METHOD_TAKES_NONE();
+	const char * state = self->state == FUTURE_PENDING ? "pending" : self->state == FUTURE_DONE ? "finished" : "failed";
+	return krk_stringFromFormat("<%T %s>", argv[0], state);
+}
+
+KRK_Method(Future,done) {
+	METHOD_TAKES_NONE();
+	return BOOLEAN_VAL(self->state != FUTURE_PENDING);
+}
+
+KRK_Method(Future,result) {
+	METHOD_TAKES_NONE();
+	if (self->state == FUTURE_PENDING) {
+		return krk_runtimeError(InvalidStateError, "result is not set");
+	} else if (self->state == FUTURE_FAILED) {
+		krk_raiseException(self->result, NONE_VAL());
+		return NONE_VAL();
+	}
+	return self->result;
+}
+
+KRK_Method(Future,exception) {
+	METHOD_TAKES_NONE();
+	if (self->state == FUTURE_PENDING) {
+		return krk_runtimeError(InvalidStateError, "exception is not set");
+	}
+	return self->state == FUTURE_FAILED ? self->result : NONE_VAL();
+}
+
+KRK_Method(Future,set_result) {
+	METHOD_TAKES_EXACTLY(1);
+	if (self->state != FUTURE_PENDING) {
+		return krk_runtimeError(InvalidStateError, "%T is already done", argv[0]);
+	}
+	finishFuture(self, FUTURE_DONE, argv[1]);
+	return NONE_VAL();
+}
+
+KRK_Method(Future,set_exception) {
+	METHOD_TAKES_EXACTLY(1);
+	if (self->state != FUTURE_PENDING) {
+		return krk_runtimeError(InvalidStateError, "%T is already done", argv[0]);
+	}
+	KrkValue exc = argv[1];
+	if (IS_CLASS(exc)) {
+		krk_push(exc);
+		exc = krk_callStack(0);
+		if (krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION) return NONE_VAL();
+	}
+	if (!krk_isInstanceOf(exc, vm.exceptions->baseException)) {
+		return TYPE_ERROR(exception,exc);
+	}
+	krk_push(exc);
+	finishFuture(self, FUTURE_FAILED, exc);
+	krk_pop();
+	return NONE_VAL();
+}
+
+KRK_Method(Future,__await__) {
+	METHOD_TAKES_NONE();
+	struct FutureIter * iter = (struct FutureIter*)krk_newInstance(FutureIter);
+	iter->future = argv[0];
+	return OBJECT_VAL(iter);
+}
+
+#undef CURRENT_CTYPE
+#define CURRENT_CTYPE struct FutureIter *
+
+static void _futureiter_gcscan(KrkInstance * _self) {
+	krk_markValue(((struct FutureIter*)_self)->future);
+}
+
+KRK_Method(FutureIter,__iter__) {
+	METHOD_TAKES_NONE();
+	return argv[0];
+}
+
+KRK_Method(FutureIter,__call__) {
+	METHOD_TAKES_AT_MOST(1);
+	if (!IS_Future(self->future)) return krk_runtimeError(InvalidStateError, "not awaiting a future");
+	/* Yield the future to the task until it is done */
+	if (AS_Future(self->future)->state == FUTURE_PENDING) return self->future;
+	return argv[0];
+}
+
+KRK_Method(FutureIter,send) {
+	METHOD_TAKES_EXACTLY(1);
+	return FUNC_NAME(FutureIter,__call__)(argc,argv,hasKw);
+}
+
+KRK_Method(FutureIter,__finish__) {
+	METHOD_TAKES_NONE();
+	if (!IS_Future(self->future)) return krk_runtimeError(InvalidStateError, "not awaiting a future");
+	KrkValue myArgs[] = {self->future};
+	return FUNC_NAME(Future,result)(1,myArgs,0);
+}
+
+/*
+ * Tasks
+ */
+
+static void _task_gcscan(KrkInstance * _self) {
+	struct Task * self = (struct Task*)_self;
+	_future_gcscan(_self);
+	krk_markValue(self->coro);
+	krk_markValue(self->loop);
+}
+
+static int startTask(struct Task * self, struct EventLoop * loop, KrkValue coro) {
+	/* Coroutines are their own iterators; anything else is asked for one */
+	krk_push(coro);
+	if (!krk_getAwaitable()) {
+		krk_pop();
+		return 0;
+	}
+	initFuture(&self->future);
+	self->coro = krk_pop();
+	self->loop = OBJECT_VAL(loop);
+	scheduleTask(self);
+	return 1;
+}
+
+static struct Task * newTask(struct EventLoop * loop, KrkValue coro) {
+	struct Task * self = (struct Task*)krk_newInstance(Task);
+	krk_push(OBJECT_VAL(self));
+	int started = startTask(self, loop, coro);
+	krk_pop();
+	return started ? self : NULL;
+}
+
+/**
+ * Run a task until it next waits, or finishes.
+ *
+ * Exceptions raised by the coroutine fail the task, except for those that
+ * do not derive from Exception, such as KeyboardInterrupt, which are left
+ * set for the loop to stop on.
+ *
+ * @return 0 if the loop should stop because of an exception.
+ */
+static int stepTask(struct Task * self) {
+	KrkValue coro = self->coro;
+	krk_push(OBJECT_VAL(self));
+	krk_push(coro);
+	KrkValue result = krk_callStack(0);
+
+	if (!(krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION)) {
+		if (krk_valuesSame(result, coro)) {
+			/* Finished; collect its return value */
+			KrkValue method = krk_valueGetAttribute_default(coro, "__finish__", NONE_VAL());
+			if (!IS_NONE(method)) {
+				krk_push(method);
+				result = krk_callStack(0);
+			} else {
+				result = NONE_VAL();
+			}
+			if (!(krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION)) {
+				krk_push(result);
+				finishFuture(&self->future, FUTURE_DONE, result);
+				krk_pop();
+			}
+		} else if (IS_Future(result)) {
+			struct Future * future = AS_Future(result);
+			if (future->state != FUTURE_PENDING) {
+				scheduleTask(self);
+			} else {
+				krk_gcWriteBarrier((KrkObj*)future);
+				krk_writeValueArray(&future->waiters, OBJECT_VAL(self));
+			}
+		} else if (IS_NONE(result)) {
+			/* A bare yield gives the other tasks a turn */
+			scheduleTask(self);
+		} else {
+			krk_runtimeError(vm.exceptions->typeError, "task got bad yield: '%T'", result);
+		}
+	}
+
+	int status = 1;
+	if (krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION) {
+		KrkValue exc = krk_currentThread.currentException;
+		krk_push(exc);
+		if (krk_isInstanceOf(exc, vm.exceptions->Exception)) {
+			clearException();
+		} else {
+			status = 0;
+		}
+		finishFuture(&self->future, FUTURE_FAILED, exc);
+		krk_pop();
+	}
+
+	krk_pop();
+	return status;
+}
+
+#undef CURRENT_CTYPE
+#define CURRENT_CTYPE struct Task *
+
+static struct EventLoop * getRunningLoop(void) {
+	if (!runningLoop) {
+		krk_runtimeError(InvalidStateError, "no running event loop");
+	}
+	return runningLoop;
+}
+
+KRK_Method(Task,__init__) {
+	KrkValue coro, loop = NONE_VAL();
+	if (!krk_parseArgs(".V|V", (const char*[]){"coro","loop"}, &coro, &loop)) return NONE_VAL();
+	if (IS_NONE(loop)) {
+		if (!getRunningLoop()) return NONE_VAL();
+		loop = OBJECT_VAL(runningLoop);
+	} else if (!IS_EventLoop(loop)) {
+		return TYPE_ERROR(EventLoop,loop);
+	}
+	startTask(self, AS_EventLoop(loop), coro);
+	return NONE_VAL();
+}
+
+KRK_Method(Task,get_coro) {
+	METHOD_TAKES_NONE();
+	return self->coro;
+}
+
+/*
+ * Event loops
+ */
+
+static void _loop_gcscan(KrkInstance * _self) {
+	struct EventLoop * self = (struct EventLoop*)_self;
+	for (size_t i = 0; i < self->ready.count; ++i) {
+		krk_markValue(self->ready.values[i]);
+	}
+	for (size_t i = 0; i < self->runQueue.count; ++i) {
+		krk_markValue(self->runQueue.values[i]);
+	}
+	for (size_t i = 0; i < self->timerCount; ++i) {
+		krk_markValue(self->timers[i].future);
+		krk_markValue(self->timers[i].result);
+	}
+	for (size_t i = 0; i < self->fdSpace; ++i) {
+		krk_markValue(self->readers[i]);
+		krk_markValue(self->writers[i]);
+	}
+}
+
+static void closeLoop(struct EventLoop * self) {
+	if (!self->open) return;
+	self->open = 0;
+#ifdef __linux__
+	close(self->epfd);
+#endif
+	krk_freeValueArray(&self->ready);
+	krk_freeValueArray(&self->runQueue);
+	FREE_ARRAY(struct Timer, self->timers, self->timerSpace);
+	FREE_ARRAY(KrkValue, self->readers, self->fdSpace);
+	FREE_ARRAY(KrkValue, self->writers, self->fdSpace);
+	FREE_ARRAY(uint8_t, self->registered, self->fdSpace);
+	self->timers = NULL;
+	self->timerCount = self->timerSpace = 0;
+	self->readers = self->writers = NULL;
+	self->registered = NULL;
+	self->fdSpace = 0;
+	self->waiting = 0;
+}
+
+static void _loop_gcsweep(KrkInstance * _self) {
+	closeLoop((struct EventLoop*)_self);
+}
+
+static int checkOpen(struct EventLoop * self) {
+	if (!self->open) {
+		krk_runtimeError(InvalidStateError, "event loop is closed");
+		return 0;
+	}
+	return 1;
+}
+
+static int timerBefore(struct Timer * a, struct Timer * b) {
+	return a->when < b->when || (a->when == b->when && a->seq < b->seq);
+}
+
+static void pushTimer(struct EventLoop * self, double when, KrkValue future, KrkValue result) {
+	if (self->timerCount == self->timerSpace) {
+		size_t old = self->timerSpace;
+		size_t space = GROW_CAPACITY(old);
+		self->timers = GROW_ARRAY(struct Timer, self->timers, old, space);
+		self->timerSpace = space;
+	}
+	krk_gcWriteBarrier((KrkObj*)self);
+	size_t i = self->timerCount++;
+	self->timers[i] = (struct Timer){when, self->timerSeq++, future, result};
+	while (i > 0) {
+		size_t parent = (i - 1) / 2;
+		if (!timerBefore(&self->timers[i], &self->timers[parent])) break;
+		struct Timer tmp = self->timers[i];
+		self->timers[i] = self->timers[parent];
+		self->timers[parent] = tmp;
+		i = parent;
+	}
+}
+
+static struct Timer popTimer(struct EventLoop * self) {
+	struct Timer out = self->timers[0];
+	self->timers[0] = self->timers[--self->timerCount];
+	size_t i = 0;
+	while (1) {
+		size_t least = i;
+		size_t left = 2 * i + 1, right = 2 * i + 2;
+		if (left < self->timerCount && timerBefore(&self->timers[left], &self->timers[least])) least = left;
+		if (right < self->timerCount && timerBefore(&self->timers[right], &self->timers[least])) least = right;
+		if (least == i) break;
+		struct Timer tmp = self->timers[i];
+		self->timers[i] = self->timers[least];
+		self->timers[least] = tmp;
+		i = least;
+	}
+	return out;
+}
+
+static void reserveFd(struct EventLoop * self, int fd) {
+	if ((size_t)fd < self->fdSpace) return;
+	size_t old = self->fdSpace;
+	size_t space = GROW_CAPACITY(old);
+	while (space <= (size_t)fd) space *= 2;
+	self->readers = GROW_ARRAY(KrkValue, self->readers, old, space);
+	for (size_t i = old; i < space; ++i) self->readers[i] = NONE_VAL();
+	self->writers = GROW_ARRAY(KrkValue, self->writers, old, space);
+	for (size_t i = old; i < space; ++i) self->writers[i] = NONE_VAL();
+	self->registered = GROW_ARRAY(uint8_t, self->registered, old, space);
+	memset(self->registered + old, 0, space - old);
+	self->fdSpace = space;
+}
+
+/**
+ * Ask to be told when a descriptor with waiting futures is ready.
+ *
+ * Descriptors are added with @c EPOLLONESHOT, so a wakeup disarms them
+ * and each wait re-arms with one call. A descriptor stays in the set until
+ * it is closed, which removes it; if its number is reused by then, the
+ * re-arm fails and it is added again.
+ */
+static int armFd(struct EventLoop * self, int fd) {
+#ifdef __linux__
+	uint32_t events = (IS_NONE(self->readers[fd]) ? 0 : EPOLLIN) | (IS_NONE(self->writers[fd]) ? 0 : EPOLLOUT);
+	if (!events) return 0;
+	struct epoll_event ev = {.events = events | EPOLLONESHOT, .data.fd = fd};
+	int op = self->registered[fd] ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+	if (epoll_ctl(self->epfd, op, fd, &ev) < 0) {
+		if (op == EPOLL_CTL_MOD && errno == ENOENT) op = EPOLL_CTL_ADD;
+		else if (op == EPOLL_CTL_ADD && errno == EEXIST) op = EPOLL_CTL_MOD;
+		else return -1;
+		if (epoll_ctl(self->epfd, op, fd, &ev) < 0) return -1;
+	}
+	self->registered[fd] = 1;
+#endif
+	return 0;
+}
+
+/**
+ * Get a future that completes when @p fd is ready for reading, or writing.
+ */
+static KrkValue waitFd(struct EventLoop * self, int fd, int forWriting) {
+	if (!checkOpen(self)) return NONE_VAL();
+	reserveFd(self, fd);
+	KrkValue * slot = forWriting ? &self->writers[fd] : &self->readers[fd];
+	if (!IS_NONE(*slot)) {
+		return krk_runtimeError(InvalidStateError, "file descriptor %d is already being waited on for %s",
+			fd, forWriting ? "writing" : "reading");
+	}
+	struct Future * future = newFuture();
+	krk_gcWriteBarrier((KrkObj*)self);
+	*slot = OBJECT_VAL(future);
+	if (armFd(self, fd) < 0) {
+		int err = errno;
+		*slot = NONE_VAL();
+		return osError(err);
+	}
+	self->waiting++;
+	return OBJECT_VAL(future);
+}
+
+static void wakeFd(struct EventLoop * self, int fd, int readable, int writable) {
+	KrkValue * slots[] = {readable ? &self->readers[fd] : NULL, writable ? &self->writers[fd] : NULL};
+	for (int i = 0; i < 2; ++i) {
+		if (!slots[i] || IS_NONE(*slots[i])) continue;
+		KrkValue future = *slots[i];
+		*slots[i] = NONE_VAL();
+		self->waiting--;
+		krk_push(future);
+		finishFuture(AS_Future(future), FUTURE_DONE, NONE_VAL());
+		krk_pop();
+	}
+}
+
+/**
+ * Wait up to @p timeout seconds, or forever if it is negative, for any
+ * descriptor with waiting futures to be ready, and complete their futures.
+ *
+ * @return 0 on failure with an exception set.
+ */
+static int pollFds(struct EventLoop * self, double timeout) {
+	int ms = -1;
+	if (timeout >= 0) {
+		double limit = timeout * 1000.0;
+		ms = limit >= INT_MAX ? INT_MAX : (int)limit;
+		if (ms < limit) ms++;
+	}
+
+#ifdef __linux__
+	struct epoll_event events[64];
+	krk_gcBlockingBegin();
+	int count = epoll_wait(self->epfd, events, 64, ms);
+	int err = errno;
+	krk_gcBlockingEnd();
+#else
+	struct pollfd * fds = malloc(sizeof(struct pollfd) * (self->waiting ? self->waiting : 1));
+	nfds_t nfds = 0;
+	for (size_t fd = 0; fd < self->fdSpace && nfds < self->waiting; ++fd) {
+		short events = (IS_NONE(self->readers[fd]) ? 0 : POLLIN) | (IS_NONE(self->writers[fd]) ? 0 : POLLOUT);
+		if (events) fds[nfds++] = (struct pollfd){.fd = fd, .events = events};
+	}
+	krk_gcBlockingBegin();
+	int count = poll(fds, nfds, ms);
+	int err = errno;
+	krk_gcBlockingEnd();
+#endif
+
+	if (count < 0) {
+#ifndef __linux__
+		free(fds);
+#endif
+		if (err != EINTR) {
+			osError(err);
+			return 0;
+		}
+		if (krk_currentThread.flags & KRK_THREAD_SIGNALLED) {
+			krk_currentThread.flags &= ~(KRK_THREAD_SIGNALLED);
+			krk_runtimeError(vm.exceptions->keyboardInterrupt, "Keyboard interrupt.");
+			return 0;
+		}
+		return 1;
+	}
+
+#ifdef __linux__
+	for (int i = 0; i < count; ++i) {
+		int fd = events[i].data.fd;
+		uint32_t got = events[i].events;
+		int failed = !!(got & (EPOLLERR | EPOLLHUP));
+		wakeFd(self, fd, failed || (got & EPOLLIN), failed || (got & EPOLLOUT));
+		/* The other direction may still be waited on */
+		if (armFd(self, fd) < 0) {
+			osError(errno);
+			return 0;
+		}
+	}
+#else
+	for (nfds_t i = 0; i < nfds && count; ++i) {
+		short got = fds[i].revents;
+		if (!got) continue;
+		count--;
+		int failed = !!(got & (POLLERR | POLLHUP | POLLNVAL));
+		wakeFd(self, fds[i].fd, failed || (got & POLLIN), failed || (got & POLLOUT));
+	}
+	free(fds);
+#endif
+	return 1;
+}
+
+/**
+ * Run one pass of the loop: wait for timers and descriptors, then run
+ * each task that was ready.
+ *
+ * @return 0 if the loop should stop because of an exception.
+ */
+static int runOnce(struct EventLoop * self) {
+	double timeout = -1;
+	if (self->ready.count) {
+		timeout = 0;
+	} else if (self->timerCount) {
+		timeout = self->timers[0].when - monotonicTime();
+		if (timeout < 0) timeout = 0;
+	} else if (!self->waiting) {
+		krk_runtimeError(InvalidStateError, "no tasks are ready to run and nothing is being waited on");
+		return 0;
+	}
+
+	if (self->waiting || timeout > 0) {
+		if (!pollFds(self, timeout)) return 0;
+	}
+
+	if (self->timerCount) {
+		double now = monotonicTime();
+		while (self->timerCount && self->timers[0].when <= now) {
+			struct Timer timer = popTimer(self);
+			krk_push(timer.future);
+			krk_push(timer.result);
+			if (AS_Future(timer.future)->state == FUTURE_PENDING) {
+				finishFuture(AS_Future(timer.future), FUTURE_DONE, timer.result);
+			}
+			krk_pop();
+			krk_pop();
+		}
+	}
+
+	/* Tasks made ready while these run wait for the next pass */
+	KrkValueArray tmp = self->runQueue;
+	self->runQueue = self->ready;
+	self->ready = tmp;
+
+	for (size_t i = 0; i < self->runQueue.count; ++i) {
+		if (!stepTask(AS_Task(self->runQueue.values[i]))) {
+			/* Keep the rest for if the loop is run again */
+			krk_gcWriteBarrier((KrkObj*)self);
+			for (size_t j = i + 1; j < self->runQueue.count; ++j) {
+				krk_writeValueArray(&self->ready, self->runQueue.values[j]);
+			}
+			self->runQueue.count = 0;
+			return 0;
+		}
+	}
+	self->runQueue.count = 0;
+	return 1;
+}
+
+#undef CURRENT_CTYPE
+#define CURRENT_CTYPE struct EventLoop *
+
+KRK_Method(EventLoop,__init__) {
+	METHOD_TAKES_NONE();
+	if (self->open) return NONE_VAL();
+#ifdef __linux__
+	self->epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (self->epfd < 0) return osError(errno);
+#endif
+	krk_initValueArray(&self->ready);
+	krk_initValueArray(&self->runQueue);
+	self->open = 1;
+	return NONE_VAL();
+}
+
+KRK_Method(EventLoop,__repr__) {
+	METHOD_TAKES_NONE();
+	const char * state = self->running ? "running" : self->open ? "idle" : "closed";
+	return krk_stringFromFormat("<%T %s>", argv[0], state);
+}
+
+KRK_Method(EventLoop,run_until_complete) {
+	METHOD_TAKES_EXACTLY(1);
+	if (!checkOpen(self)) return NONE_VAL();
+	if (self->running || runningLoop) {
+		return krk_runtimeError(InvalidStateError, "an event loop is already running in this thread");
+	}
+
+	KrkValue future = argv[1];
+	if (!IS_Future(future)) {
+		struct Task * task = newTask(self, future);
+		if (!task) return NONE_VAL();
+		future = OBJECT_VAL(task);
+	}
+	krk_push(future);
+
+	self->running = 1;
+	runningLoop = self;
+	int status = 1;
+	while (AS_Future(future)->state == FUTURE_PENDING && (status = runOnce(self)));
+	runningLoop = NULL;
+	self->running = 0;
+
+	struct Future * result = AS_Future(krk_pop());
+	if (!status) return NONE_VAL();
+
+	if (result->state == FUTURE_FAILED) {
+		/* Its traceback already reaches out through this call */
+		krk_currentThread.currentException = result->result;
+		krk_currentThread.flags |= KRK_THREAD_HAS_EXCEPTION;
+		return NONE_VAL();
+	}
+	return result->result;
+}
+
+KRK_Method(EventLoop,create_task) {
+	METHOD_TAKES_EXACTLY(1);
+	if (!checkOpen(self)) return NONE_VAL();
+	struct Task * task = newTask(self, argv[1]);
+	return task ? OBJECT_VAL(task) : NONE_VAL();
+}
+
+KRK_Method(EventLoop,create_future) {
+	METHOD_TAKES_NONE();
+	return OBJECT_VAL(newFuture());
+}
+
+KRK_Method(EventLoop,time) {
+	METHOD_TAKES_NONE();
+	return FLOATING_VAL(monotonicTime());
+}
+
+KRK_Method(EventLoop,call_later) {
+	double delay;
+	KrkValue future, result = NONE_VAL();
+	if (!krk_parseArgs(".dV!|V", (const char*[]){"delay","future","result"}, &delay, Future, &future, &result)) return NONE_VAL();
+	if (!checkOpen(self)) return NONE_VAL();
+	pushTimer(self, monotonicTime() + delay, future, result);
+	return NONE_VAL();
+}
+
+KRK_Method(EventLoop,is_running) {
+	METHOD_TAKES_NONE();
+	return BOOLEAN_VAL(self->running);
+}
+
+KRK_Method(EventLoop,is_closed) {
+	METHOD_TAKES_NONE();
+	return BOOLEAN_VAL(!self->open);
+}
+
+KRK_Method(EventLoop,close) {
+	METHOD_TAKES_NONE();
+	if (self->running) return krk_runtimeError(InvalidStateError, "can not close a running event loop");
+	closeLoop(self);
+	return NONE_VAL();
+}
+
+KRK_Method(EventLoop,wait_readable) {
+	METHOD_TAKES_EXACTLY(1);
+	int fd = getFileno(argv[1]);
+	if (fd < 0) return NONE_VAL();
+	return waitFd(self, fd, 0);
+}
+
+KRK_Method(EventLoop,wait_writable) {
+	METHOD_TAKES_EXACTLY(1);
+	int fd = getFileno(argv[1]);
+	if (fd < 0) return NONE_VAL();
+	return waitFd(self, fd, 1);
+}
+
+/*
+ * Socket operations
+ */
+
+enum {
+	IO_RECV,
+	IO_SENDALL,
+	IO_ACCEPT,
+	IO_CONNECT,
+};
+
+enum {
+	IO_START = 0,
+	IO_WAITING,
+	IO_FINISHED,
+};
+
+/**
+ * An awaitable socket operation.
+ *
+ * Each time it is resumed, it tries the operation without blocking, and
+ * if the socket is not ready, yields a future for the loop to complete
+ * when it is.
+ */
+struct IoOp {
+	KrkInstance inst;
+	KrkValue loop;
+	KrkValue sock;
+	KrkValue data;    /**< Bytes to send, or address to connect to */
+	KrkValue result;
+	size_t size;      /**< Bytes to receive, or bytes sent so far */
+	int fd;
+	int kind;
+	int state;
+};
+
+static void _ioop_gcscan(KrkInstance * _self) {
+	struct IoOp * self = (struct IoOp*)_self;
+	krk_markValue(self->loop);
+	krk_markValue(self->sock);
+	krk_markValue(self->data);
+	krk_markValue(self->result);
+}
+
+static KrkValue newIoOp(struct EventLoop * loop, int kind, KrkValue sock, KrkValue data, size_t size) {
+	if (!checkOpen(loop)) return NONE_VAL();
+	int fd = getFileno(sock);
+	if (fd < 0) return NONE_VAL();
+	struct IoOp * self = (struct IoOp*)krk_newInstance(IoOp);
+	self->loop = OBJECT_VAL(loop);
+	self->sock = sock;
+	self->data = data;
+	self->result = NONE_VAL();
+	self->size = size;
+	self->fd = fd;
+	self->kind = kind;
+	return OBJECT_VAL(self);
+}
+
+/**
+ * Call a method of the socket with its descriptor set to not block,
+ * leaving the socket as it was afterwards.
+ */
+static KrkValue callNonBlocking(struct IoOp * self, char * name, int argc) {
+	int flags = fcntl(self->fd, F_GETFL);
+	if (flags < 0 || fcntl(self->fd, F_SETFL, flags | O_NONBLOCK) < 0) return osError(errno);
+	krk_push(krk_valueGetAttribute(self->sock, name));
+	if (argc) krk_push(self->data);
+	KrkValue result = NONE_VAL();
+	if (!(krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION)) {
+		result = krk_callStack(argc);
+	}
+	fcntl(self->fd, F_SETFL, flags);
+	return result;
+}
+
+#undef CURRENT_CTYPE
+#define CURRENT_CTYPE struct IoOp *
+
+KRK_Method(IoOp,__iter__) {
+	METHOD_TAKES_NONE();
+	return argv[0];
+}
+
+KRK_Method(IoOp,__call__) {
+	METHOD_TAKES_AT_MOST(1);
+	if (self->state == IO_FINISHED) return argv[0];
+
+	int wait = 0;
+	int forWriting = 0;
+
+	switch (self->kind) {
+		case IO_RECV: {
+			uint8_t * buf = malloc(self->size ? self->size : 1);
+			ssize_t result;
+			do {
+				result = recv(self->fd, buf, self->size, MSG_DONTWAIT);
+			} while (result < 0 && errno == EINTR);
+			int err = errno;
+			if (result >= 0) {
+				self->result = OBJECT_VAL(krk_newBytes(result, result ? buf : NULL));
+			}
+			free(buf);
+			if (result < 0) {
+				if (err != EAGAIN && err != EWOULDBLOCK) return osError(err);
+				wait = 1;
+			}
+			break;
+		}
+		case IO_SENDALL: {
+			KrkBytes * data = AS_BYTES(self->data);
+			while (self->size < data->length) {
+				ssize_t result = send(self->fd, data->bytes + self->size, data->length - self->size, MSG_DONTWAIT | MSG_NOSIGNAL);
+				if (result < 0) {
+					if (errno == EINTR) continue;
+					if (errno != EAGAIN && errno != EWOULDBLOCK) return osError(errno);
+					wait = forWriting = 1;
+					break;
+				}
+				self->size += result;
+			}
+			break;
+		}
+		case IO_ACCEPT: {
+			KrkValue result = callNonBlocking(self, "accept", 0);
+			if (krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION) {
+				int err = exceptionErrno();
+				if (err != EAGAIN && err != EWOULDBLOCK) return NONE_VAL();
+				clearException();
+				wait = 1;
+			} else {
+				self->result = result;
+			}
+			break;
+		}
+		case IO_CONNECT: {
+			if (self->state == IO_WAITING) {
+				int err = 0;
+				socklen_t len = sizeof(err);
+				if (getsockopt(self->fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0) err = errno;
+				if (err) return osError(err);
+				break;
+			}
+			callNonBlocking(self, "connect", 1);
+			if (krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION) {
+				int err = exceptionErrno();
+				if (err != EINPROGRESS && err != EAGAIN) return NONE_VAL();
+				clearException();
+				wait = forWriting = 1;
+			}
+			break;
+		}
+	}
+
+	if (wait) {
+		self->state = IO_WAITING;
+		return waitFd(AS_EventLoop(self->loop), self->fd, forWriting);
+	}
+
+	self->state = IO_FINISHED;
+	return argv[0];
+}
+
+KRK_Method(IoOp,send) {
+	METHOD_TAKES_EXACTLY(1);
+	return FUNC_NAME(IoOp,__call__)(argc,argv,hasKw);
+}
+
+KRK_Method(IoOp,__finish__) {
+	METHOD_TAKES_NONE();
+	return self->result;
+}
+
+#undef CURRENT_CTYPE
+#define CURRENT_CTYPE struct EventLoop *
+
+KRK_Method(EventLoop,sock_recv) {
+	METHOD_TAKES_EXACTLY(2);
+	CHECK_ARG(2,int,krk_integer_type,bufsize);
+	if (bufsize < 0) return krk_runtimeError(vm.exceptions->valueError, "negative buffer size");
+	return newIoOp(self, IO_RECV, argv[1], NONE_VAL(), bufsize);
+}
+
+KRK_Method(EventLoop,sock_sendall) {
+	METHOD_TAKES_EXACTLY(2);
+	if (!IS_BYTES(argv[2])) return TYPE_ERROR(bytes,argv[2]);
+	return newIoOp(self, IO_SENDALL, argv[1], argv[2], 0);
+}
+
+KRK_Method(EventLoop,sock_accept) {
+	METHOD_TAKES_EXACTLY(1);
+	return newIoOp(self, IO_ACCEPT, argv[1], NONE_VAL(), 0);
+}
+
+KRK_Method(EventLoop,sock_connect) {
+	METHOD_TAKES_EXACTLY(2);
+	return newIoOp(self, IO_CONNECT, argv[1], argv[2], 0);
+}
+
+/*
+ * Module functions
+ */
+
+KRK_Function(get_running_loop) {
+	FUNCTION_TAKES_NONE();
+	struct EventLoop * loop = getRunningLoop();
+	return loop ? OBJECT_VAL(loop) : NONE_VAL();
+}
+
+KRK_Function(create_task) {
+	FUNCTION_TAKES_EXACTLY(1);
+	struct EventLoop * loop = getRunningLoop();
+	if (!loop) return NONE_VAL();
+	struct Task * task = newTask(loop, argv[0]);
+	return task ? OBJECT_VAL(task) : NONE_VAL();
+}
+
+KRK_Function(sleep) {
+	double delay;
+	KrkValue result = NONE_VAL();
+	if (!krk_parseArgs("d|V", (const char*[]){"delay","result"}, &delay, &result)) return NONE_VAL();
+	struct EventLoop * loop = getRunningLoop();
+	if (!loop) return NONE_VAL();
+	struct Future * future = newFuture();
+	krk_push(OBJECT_VAL(future));
+	pushTimer(loop, monotonicTime() + delay, OBJECT_VAL(future), result);
+	return krk_pop();
+}
+
+KRK_Function(run) {
+	FUNCTION_TAKES_EXACTLY(1);
+	struct EventLoop * loop = (struct EventLoop*)krk_newInstance(EventLoop);
+	krk_push(OBJECT_VAL(loop));
+	KrkValue myArgs[] = {OBJECT_VAL(loop), argv[0]};
+	FUNC_NAME(EventLoop,__init__)(1,myArgs,0);
+	if (krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION) return NONE_VAL();
+	KrkValue result = FUNC_NAME(EventLoop,run_until_complete)(2,myArgs,0);
+	closeLoop(loop);
+	krk_pop();
+	return result;
+}
+
+KrkValue krk_module_onload_asyncio(void) {
+	KrkInstance * module = krk_newInstance(vm.baseClasses->moduleClass);
+	krk_push(OBJECT_VAL(module));
+
+	KRK_DOC(module, "@brief Event loop for running coroutines.\n\n"
+		"Runs many coroutines in one thread, switching between them when they wait "
+		"on timers, futures, or file descriptors.");
+
+	krk_makeClass(module, &InvalidStateError, "InvalidStateError", vm.exceptions->Exception);
+	KRK_DOC(InvalidStateError, "Raised when a future or event loop is not in a state that allows an operation.");
+	krk_finalizeClass(InvalidStateError);
+
+	krk_makeClass(module, &Future, "Future", vm.baseClasses->objectClass);
+	Future->allocSize = sizeof(struct Future);
+	Future->_ongcscan = _future_gcscan;
+	Future->_ongcsweep = _future_gcsweep;
+	KRK_DOC(Future, "A result that will be available later.\n\n"
+		"Awaiting a future that is not done suspends the awaiting task until it is.");
+	KRK_DOC(BIND_METHOD(Future,__init__), "@brief Create a pending future.");
+	BIND_METHOD(Future,__repr__);
+	KRK_DOC(BIND_METHOD(Future,done), "@brief Whether the future has a result or an exception.");
+	KRK_DOC(BIND_METHOD(Future,result),
+		"@brief Get the result of the future.\n\n"
+		"If the future failed, its exception is raised. Raises @ref InvalidStateError if it is pending.");
+	KRK_DOC(BIND_METHOD(Future,exception),
+		"@brief Get the exception the future failed with, or @c None if it succeeded.");
+	KRK_DOC(BIND_METHOD(Future,set_result),
+		"@brief Complete the future with a result.\n"
+		"@arguments result\n\n"
+		"Tasks awaiting the future are scheduled to run.");
+	KRK_DOC(BIND_METHOD(Future,set_exception),
+		"@brief Fail the future with an exception.\n"
+		"@arguments exception\n\n"
+		"Tasks awaiting the future are scheduled to run, and raise @p exception.");
+	BIND_METHOD(Future,__await__);
+	krk_defineNative(&Future->methods, "__str__", FUNC_NAME(Future,__repr__));
+	krk_finalizeClass(Future);
+
+	krk_makeClass(module, &FutureIter, "FutureIter", vm.baseClasses->objectClass);
+	FutureIter->allocSize = sizeof(struct FutureIter);
+	FutureIter->_ongcscan = _futureiter_gcscan;
+	FutureIter->obj.flags |= KRK_OBJ_FLAGS_NO_INHERIT;
+	BIND_METHOD(FutureIter,__iter__);
+	BIND_METHOD(FutureIter,__call__);
+	BIND_METHOD(FutureIter,send);
+	BIND_METHOD(FutureIter,__finish__);
+	krk_finalizeClass(FutureIter);
+
+	krk_makeClass(module, &Task, "Task", Future);
+	Task->allocSize = sizeof(struct Task);
+	Task->_ongcscan = _task_gcscan;
+	KRK_DOC(Task, "A future that runs a coroutine on an event loop.\n\n"
+		"The result of the task is the return value of the coroutine.");
+	KRK_DOC(BIND_METHOD(Task,__init__),
+		"@brief Schedule a coroutine to run.\n"
+		"@arguments coro,loop=None\n\n"
+		"If @p loop is not given, the running loop is used.");
+	KRK_DOC(BIND_METHOD(Task,get_coro), "@brief Get the coroutine the task runs.");
+	krk_finalizeClass(Task);
+
+	krk_makeClass(module, &EventLoop, "EventLoop", vm.baseClasses->objectClass);
+	EventLoop->allocSize = sizeof(struct EventLoop);
+	EventLoop->_ongcscan = _loop_gcscan;
+	EventLoop->_ongcsweep = _loop_gcsweep;
+	KRK_DOC(EventLoop, "Runs tasks, and waits on timers and file descriptors for them.");
+	KRK_DOC(BIND_METHOD(EventLoop,__init__), "@brief Create an event loop.");
+	BIND_METHOD(EventLoop,__repr__);
+	KRK_DOC(BIND_METHOD(EventLoop,run_until_complete),
+		"@brief Run the loop until a future is done.\n"
+		"@arguments future\n\n"
+		"A coroutine is wrapped in a @ref Task first. Returns the result of the future, "
+		"or raises its exception.");
+	KRK_DOC(BIND_METHOD(EventLoop,create_task),
+		"@brief Schedule a coroutine to run on this loop.\n"
+		"@arguments coro\n\n"
+		"Returns a @ref Task.");
+	KRK_DOC(BIND_METHOD(EventLoop,create_future), "@brief Create a pending @ref Future.");
+	KRK_DOC(BIND_METHOD(EventLoop,time), "@brief Get the time of the loop's monotonic clock, in seconds.");
+	KRK_DOC(BIND_METHOD(EventLoop,call_later),
+		"@brief Complete a future after a delay.\n"
+		"@arguments delay,future,result=None\n\n"
+		"After @p delay seconds, if @p future is still pending, sets its result to @p result.");
+	KRK_DOC(BIND_METHOD(EventLoop,is_running), "@brief Whether the loop is running.");
+	KRK_DOC(BIND_METHOD(EventLoop,is_closed), "@brief Whether the loop has been closed.");
+	KRK_DOC(BIND_METHOD(EventLoop,close),
+		"@brief Close the loop.\n\n"
+		"Tasks that have not finished are abandoned.");
+	KRK_DOC(BIND_METHOD(EventLoop,wait_readable),
+		"@brief Wait for a file descriptor to be readable.\n"
+		"@arguments fd\n\n"
+		"@p fd may be an integer or an object with a @c fileno method. Returns a @ref Future "
+		"that completes when a read would not block.");
+	KRK_DOC(BIND_METHOD(EventLoop,wait_writable),
+		"@brief Wait for a file descriptor to be writable.\n"
+		"@arguments fd\n\n"
+		"As with @ref EventLoop_wait_readable, for writing.");
+	KRK_DOC(BIND_METHOD(EventLoop,sock_recv),
+		"@brief Receive data from a socket.\n"
+		"@arguments sock,bufsize\n\n"
+		"Awaitable. Returns up to @p bufsize bytes, or empty @ref bytes at the end of the stream.");
+	KRK_DOC(BIND_METHOD(EventLoop,sock_sendall),
+		"@brief Send all of the data to a socket.\n"
+		"@arguments sock,data\n\n"
+		"Awaitable. Completes when all of the @ref bytes object @p data has been sent.");
+	KRK_DOC(BIND_METHOD(EventLoop,sock_accept),
+		"@brief Accept a connection on a listening socket.\n"
+		"@arguments sock\n\n"
+		"Awaitable. Returns the same as @c socket.accept would.");
+	KRK_DOC(BIND_METHOD(EventLoop,sock_connect),
+		"@brief Connect a socket to a remote address.\n"
+		"@arguments sock,address\n\n"
+		"Awaitable. Completes when the connection has been made.");
+	krk_defineNative(&EventLoop->methods, "__str__", FUNC_NAME(EventLoop,__repr__));
+	krk_finalizeClass(EventLoop);
+
+	krk_makeClass(module, &IoOp, "IoOp", vm.baseClasses->objectClass);
+	IoOp->allocSize = sizeof(struct IoOp);
+	IoOp->_ongcscan = _ioop_gcscan;
+	IoOp->obj.flags |= KRK_OBJ_FLAGS_NO_INHERIT;
+	BIND_METHOD(IoOp,__iter__);
+	BIND_METHOD(IoOp,__call__);
+	BIND_METHOD(IoOp,send);
+	BIND_METHOD(IoOp,__finish__);
+	krk_defineNative(&IoOp->methods, "__await__", FUNC_NAME(IoOp,__iter__));
+	krk_finalizeClass(IoOp);
+
+	KRK_DOC(BIND_FUNC(module,run),
+		"@brief Run a coroutine on a new event loop.\n"
+		"@arguments coro\n\n"
+		"Closes the loop when the coroutine finishes, and returns its result.");
+	KRK_DOC(BIND_FUNC(module,sleep),
+		"@brief Suspend the calling task.\n"
+		"@arguments delay,result=None\n\n"
+		"Awaitable. Completes with @p result after @p delay seconds.");
+	KRK_DOC(BIND_FUNC(module,create_task),
+		"@brief Schedule a coroutine to run on the running loop.\n"
+		"@arguments coro\n\n"
+		"Returns a @ref Task.");
+	KRK_DOC(BIND_FUNC(module,get_running_loop),
+		"@brief Get the event loop running in this thread.\n\n"
+		"Raises @ref InvalidStateError if there is none.");
+
+	return krk_pop();
+}
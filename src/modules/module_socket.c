@@ -13,6 +13,8 @@
 #include <sys/socket.h>
 #include <arpa/inet.h>
 #include <netdb.h>
+#include <fcntl.h>
+#include <unistd.h>
 #endif
 #include <errno.h>
 
@@ -36,6 +38,16 @@ struct socket {
 #define CURRENT_CTYPE struct socket *
 #define CURRENT_NAME  self
 
+/**
+ * Raise a SocketError for a failed call, with the error number in its
+ * @c errno attribute so callers can tell conditions like @c EAGAIN apart.
+ */
+static KrkValue socketError(int err) {
+	krk_runtimeError(SocketError, "Socket error: %s", strerror(err));
+	krk_attachNamedValue(&AS_INSTANCE(krk_currentThread.currentException)->fields, "errno", INTEGER_VAL(err));
+	return NONE_VAL();
+}
+
 KRK_Method(socket,__init__) {
 	METHOD_TAKES_AT_MOST(3);
 
@@ -52,7 +64,7 @@ KRK_Method(socket,__init__) {
 	int result = socket(family,type,proto);
 
 	if (result < 0) {
-		return krk_runtimeError(SocketError, "Socket error: %s", strerror(errno));
+		return socketError(errno);
 	}
 
 	self->sockfd = result;
@@ -187,7 +199,7 @@ KRK_Method(socket,connect) {
 	int result = connect(self->sockfd, (struct sockaddr*)&sock_addr, sock_size);
 
 	if (result < 0) {
-		return krk_runtimeError(SocketError, "Socket error: %s", strerror(errno));
+		return socketError(errno);
 	}
 
 	return NONE_VAL();
@@ -210,7 +222,7 @@ KRK_Method(socket,bind) {
 	int result = bind(self->sockfd, (struct sockaddr*)&sock_addr, sock_size);
 
 	if (result < 0) {
-		return krk_runtimeError(SocketError, "Socket error: %s", strerror(errno));
+		return socketError(errno);
 	}
 
 	return NONE_VAL();
@@ -226,7 +238,7 @@ KRK_Method(socket,listen) {
 
 	int result = listen(self->sockfd, backlog);
 	if (result < 0) {
-		return krk_runtimeError(SocketError, "Socket error: %s", strerror(errno));
+		return socketError(errno);
 	}
 
 	return NONE_VAL();
@@ -234,12 +246,12 @@ KRK_Method(socket,listen) {
 
 KRK_Method(socket,accept) {
 	struct sockaddr_storage addr;
-	socklen_t addrlen;
+	socklen_t addrlen = sizeof(addr);
 
 	int result = accept(self->sockfd, (struct sockaddr*)&addr, &addrlen);
 
 	if (result < 0) {
-		return krk_runtimeError(SocketError, "Socket error: %s", strerror(errno));
+		return socketError(errno);
 	}
 
 	KrkTuple * outTuple = krk_newTuple(2);
@@ -286,7 +298,7 @@ KRK_Method(socket,shutdown) {
 	int result = shutdown(self->sockfd, how);
 
 	if (result < 0) {
-		return krk_runtimeError(SocketError, "Socket error: %s", strerror(errno));
+		return socketError(errno);
 	}
 
 	return NONE_VAL();
@@ -306,7 +318,7 @@ KRK_Method(socket,recv) {
 	ssize_t result = recv(self->sockfd, buf, bufsize, flags);
 	if (result < 0) {
 		free(buf);
-		return krk_runtimeError(SocketError, "Socket error: %s", strerror(errno));
+		return socketError(errno);
 	}
 
 	KrkBytes * out = krk_newBytes(result,buf);
@@ -326,7 +338,7 @@ KRK_Method(socket,send) {
 
 	ssize_t result = send(self->sockfd, (void*)buf->bytes, buf->length, flags);
 	if (result < 0) {
-		return krk_runtimeError(SocketError, "Socket error: %s", strerror(errno));
+		return socketError(errno);
 	}
 
 	return INTEGER_VAL(result);
@@ -355,13 +367,70 @@ KRK_Method(socket,sendto) {
 
 	ssize_t result = sendto(self->sockfd, (void*)buf->bytes, buf->length, flags, (struct sockaddr*)&sock_addr, sock_size);
 	if (result < 0) {
-		return krk_runtimeError(SocketError, "Socket error: %s", strerror(errno));
+		return socketError(errno);
 	}
 
 	return INTEGER_VAL(result);
 }
 
 
+KRK_Method(socket,close) {
+	METHOD_TAKES_NONE();
+	if (self->sockfd < 0) return NONE_VAL();
+#ifdef _WIN32
+	int result = closesocket(self->sockfd);
+#else
+	int result = close(self->sockfd);
+#endif
+	self->sockfd = -1;
+	if (result < 0) {
+		return socketError(errno);
+	}
+	return NONE_VAL();
+}
+
+KRK_Method(socket,setblocking) {
+	METHOD_TAKES_EXACTLY(1);
+	int blocking = !krk_isFalsey(argv[1]);
+#ifdef _WIN32
+	u_long mode = !blocking;
+	if (ioctlsocket(self->sockfd, FIONBIO, &mode) != 0) {
+		return socketError(WSAGetLastError());
+	}
+#else
+	int flags = fcntl(self->sockfd, F_GETFL);
+	if (flags < 0 || fcntl(self->sockfd, F_SETFL, blocking ? (flags & ~O_NONBLOCK) : (flags | O_NONBLOCK)) < 0) {
+		return socketError(errno);
+	}
+#endif
+	return NONE_VAL();
+}
+
+KRK_Method(socket,getsockname) {
+	METHOD_TAKES_NONE();
+	struct sockaddr_storage addr;
+	socklen_t addrlen = sizeof(addr);
+
+	if (getsockname(self->sockfd, (struct sockaddr*)&addr, &addrlen) < 0) {
+		return socketError(errno);
+	}
+
+	if (self->family != AF_INET) {
+		return krk_runtimeError(vm.exceptions->notImplementedError, "Not implemented.");
+	}
+
+	char hostname[NI_MAXHOST] = "";
+	getnameinfo((struct sockaddr*)&addr, addrlen, hostname, NI_MAXHOST, NULL, 0, NI_NUMERICHOST);
+
+	KrkTuple * addrTuple = krk_newTuple(2);
+	krk_push(OBJECT_VAL(addrTuple));
+	addrTuple->values.values[0] = OBJECT_VAL(krk_copyString(hostname,strlen(hostname)));
+	addrTuple->values.count = 1;
+	addrTuple->values.values[1] = INTEGER_VAL(ntohs(((struct sockaddr_in*)&addr)->sin_port));
+	addrTuple->values.count = 2;
+	return krk_pop();
+}
+
 KRK_Method(socket,fileno) {
 	return INTEGER_VAL(self->sockfd);
 }
@@ -383,7 +452,7 @@ KRK_Method(socket,setsockopt) {
 	}
 
 	if (result < 0) {
-		return krk_runtimeError(SocketError, "Socket error: %s", strerror(errno));
+		return socketError(errno);
 	}
 
 	return NONE_VAL();
@@ -458,6 +527,18 @@ KrkValue krk_module_onload_socket(void) {
 		"@arguments buf,[flags],addr\n\n"
 		"Send the data in the @ref bytes object @p buf to the socket. Returns the number "
 		"of bytes written to the socket.");
+	KRK_DOC(BIND_METHOD(socket,close),
+		"@brief Close the socket.\n\n"
+		"Releases the underlying file descriptor. Closing a socket that is already closed does nothing.");
+	KRK_DOC(BIND_METHOD(socket,setblocking),
+		"@brief Set whether calls on the socket block.\n"
+		"@arguments flag\n\n"
+		"When @p flag is false, calls that would have to wait raise @ref SocketError with "
+		"an @c errno of @c EAGAIN or @c EWOULDBLOCK instead.");
+	KRK_DOC(BIND_METHOD(socket,getsockname),
+		"@brief Get the address the socket is bound to.\n\n"
+		"As with @ref socket_bind, the format of the address varies. Useful for finding the port "
+		"a socket bound to port 0 was given.");
 	KRK_DOC(BIND_METHOD(socket,fileno),
 		"@brief Get the file descriptor number for the underlying socket.");
 	KRK_DOC(BIND_METHOD(socket,setsockopt),
@@ -517,8 +598,12 @@ KrkValue krk_module_onload_socket(void) {
 
 	SOCK_CONST(SO_REUSEADDR);
 
+#ifdef MSG_DONTWAIT
+	SOCK_CONST(MSG_DONTWAIT);
+#endif
+
 	krk_makeClass(module, &SocketError, "SocketError", vm.exceptions->baseException);
-	KRK_DOC(SocketError, "Raised on faults from socket functions.");
+	KRK_DOC(SocketError, "Raised on faults from socket functions. The error number is in its @c errno attribute.");
 	krk_finalizeClass(SocketError);
 
 	return krk_pop();
@@ -159,7 +159,10 @@ KRK_Method(type,__subclasses__) {
 	for (size_t i = 0; i < self->subclasses.capacity; ++i) {
 		KrkTableEntry * entry = &self->subclasses.entries[i];
 		if (IS_KWARGS(entry->key)) continue;
-		krk_writeValueArray(AS_LIST(myList), entry->key);
+		/* The subclass table does not keep its entries alive; growing the list can collect. */
+		krk_push(entry->key);
+		krk_writeValueArray(AS_LIST(myList), krk_peek(0));
+		krk_pop();
 	}
 
 	return krk_pop();
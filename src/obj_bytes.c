@@ -59,13 +59,7 @@ KRK_StaticMethod(bytes,__new__) {
 
 KRK_Method(bytes,__hash__) {
 	METHOD_TAKES_NONE();
-	uint32_t hash = 0;
-	/* This is the so-called "sdbm" hash. It comes from a piece of
-	 * public domain code from a clone of ndbm. */
-	for (size_t i = 0; i < self->length; ++i) {
-		krk_hash_advance(hash,self->bytes[i]);
-	}
-	return INTEGER_VAL(hash);
+	return INTEGER_VAL(krk_hashBytes(self->bytes, self->length));
 }
 
 /* bytes objects are not interned; need to do this the old-fashioned way. */
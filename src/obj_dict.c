@@ -4,6 +4,8 @@
 #include <kuroko/memory.h>
 #include <kuroko/util.h>
 
+#include "private.h"
+
 /**
  * Exposed method called to produce dictionaries from `{expr: expr, ...}` sequences in managed code.
  * Expects arguments as `key,value,key,value`...
@@ -13,7 +15,7 @@ KrkValue krk_dict_of(int argc, const KrkValue argv[], int hasKw) {
 	KrkInstance * outDict = krk_newInstance(vm.baseClasses->dictClass);
 	krk_push(OBJECT_VAL(outDict));
 	krk_initTable(&((KrkDict*)outDict)->entries);
-	krk_tableAdjustCapacity(&((KrkDict*)outDict)->entries, argc);
+	if (argc) krk_tableAdjustCapacity(&((KrkDict*)outDict)->entries, argc / 2);
 	for (int ind = 0; ind < argc; ind += 2) {
 		krk_tableSet(&((KrkDict*)outDict)->entries, argv[ind], argv[ind+1]);
 	}
@@ -100,11 +102,11 @@ KRK_Method(dict,__eq__) {
 		return BOOLEAN_VAL(0);
 
 
-	for (unsigned int i = 0; i < self->entries.capacity; ++i) {
-		if (IS_KWARGS(self->entries.entries[i].key)) continue;
+	KrkTableEntry entry;
+	for (size_t i = 0; krk_tableNextEntry(&self->entries, &i, &entry);) {
 		KrkValue val;
-		if (!krk_tableGet(&them->entries, self->entries.entries[i].key, &val)) return BOOLEAN_VAL(0);
-		if (!krk_valuesSameOrEqual(self->entries.entries[i].value, val)) return BOOLEAN_VAL(0);
+		if (!krk_tableGet(&them->entries, entry.key, &val)) return BOOLEAN_VAL(0);
+		if (!krk_valuesSameOrEqual(entry.value, val)) return BOOLEAN_VAL(0);
 	}
 
 	return BOOLEAN_VAL(1);
@@ -123,7 +125,9 @@ KRK_Method(dict,__getitem__) {
 
 KRK_Method(dict,__setitem__) {
 	METHOD_TAKES_EXACTLY(2);
+	_obtain_table_lock(&self->lock);
 	krk_tableSet(&self->entries, argv[1], argv[2]);
+	_release_table_lock(&self->lock);
 	return argv[2];
 }
 
@@ -139,7 +143,10 @@ KRK_Method(dict,__or__) {
 
 KRK_Method(dict,__delitem__) {
 	METHOD_TAKES_EXACTLY(1);
-	if (!krk_tableDelete(&self->entries, argv[1])) {
+	_obtain_table_lock(&self->lock);
+	int deleted = krk_tableDelete(&self->entries, argv[1]);
+	_release_table_lock(&self->lock);
+	if (!deleted) {
 		if (!IS_NONE(krk_currentThread.currentException)) return NONE_VAL();
 		return krk_runtimeError(vm.exceptions->keyError, "%V", argv[1]);
 	}
@@ -170,18 +177,16 @@ KRK_Method(dict,__repr__) {
 	pushStringBuilder(&sb,'{');
 
 	size_t c = 0;
-	size_t len = self->entries.capacity;
-	for (size_t i = 0; i < len; ++i) {
-		KrkTableEntry * entry = &self->entries.entries[i];
-		if (IS_KWARGS(entry->key)) continue;
+	KrkTableEntry entry;
+	for (size_t i = 0; krk_tableNextEntry(&self->entries, &i, &entry);) {
 		if (c > 0) {
 			pushStringBuilderStr(&sb, ", ", 2);
 		}
 		c++;
 
 		{
-			KrkClass * type = krk_getType(entry->key);
-			krk_push(entry->key);
+			KrkClass * type = krk_getType(entry.key);
+			krk_push(entry.key);
 			KrkValue result = krk_callDirect(type->_reprer, 1);
 			if (IS_STRING(result)) {
 				pushStringBuilderStr(&sb, AS_CSTRING(result), AS_STRING(result)->length);
@@ -191,8 +196,8 @@ KRK_Method(dict,__repr__) {
 		pushStringBuilderStr(&sb, ": ", 2);
 
 		{
-			KrkClass * type = krk_getType(entry->value);
-			krk_push(entry->value);
+			KrkClass * type = krk_getType(entry.value);
+			krk_push(entry.value);
 			KrkValue result = krk_callDirect(type->_reprer, 1);
 			if (IS_STRING(result)) {
 				pushStringBuilderStr(&sb, AS_CSTRING(result), AS_STRING(result)->length);
@@ -215,7 +220,9 @@ KRK_Method(dict,copy) {
 
 KRK_Method(dict,clear) {
 	METHOD_TAKES_NONE();
-	krk_freeTable(&self->entries);
+	_obtain_table_lock(&self->lock);
+	krk_tableClear(&self->entries);
+	_release_table_lock(&self->lock);
 	return NONE_VAL();
 }
 
@@ -235,9 +242,11 @@ KRK_Method(dict,setdefault) {
 	if (argc > 2) out = argv[2];
 
 	/* TODO this is slow; use findEntry instead! */
+	_obtain_table_lock(&self->lock);
 	if (!krk_tableGet(&self->entries, argv[1], &out)) {
 		krk_tableSet(&self->entries, argv[1], out);
 	}
+	_release_table_lock(&self->lock);
 
 	return out;
 }
@@ -247,10 +256,14 @@ KRK_Method(dict,update) {
 	if (argc > 1) {
 		/* TODO sequence */
 		CHECK_ARG(1,dict,KrkDict*,other);
+		_obtain_table_lock(&self->lock);
 		krk_tableAddAll(&other->entries, &self->entries);
+		_release_table_lock(&self->lock);
 	}
 	if (hasKw) {
+		_obtain_table_lock(&self->lock);
 		krk_tableAddAll(AS_DICT(argv[argc]), &self->entries);
+		_release_table_lock(&self->lock);
 	}
 	return NONE_VAL();
 }
@@ -258,7 +271,9 @@ KRK_Method(dict,update) {
 KRK_Method(dict,__ior__) {
 	METHOD_TAKES_EXACTLY(1);
 	CHECK_ARG(1,dict,KrkDict*,other);
+	_obtain_table_lock(&self->lock);
 	krk_tableAddAll(&other->entries, &self->entries);
+	_release_table_lock(&self->lock);
 	return argv[0];
 }
 
@@ -327,19 +342,18 @@ KRK_Method(dictitems,__iter__) {
 }
 
 KRK_Method(dictitems,__call__) {
-	do {
-		if (self->i >= AS_DICT(self->dict)->capacity) return argv[0];
-		if (!IS_KWARGS(AS_DICT(self->dict)->entries[self->i].key)) {
-			KrkTuple * outValue = krk_newTuple(2);
-			krk_push(OBJECT_VAL(outValue));
-			outValue->values.values[0] = AS_DICT(self->dict)->entries[self->i].key;
-			outValue->values.values[1] = AS_DICT(self->dict)->entries[self->i].value;
-			outValue->values.count = 2;
-			self->i++;
-			return krk_pop();
-		}
-		self->i++;
-	} while (1);
+	KrkTableEntry entry;
+	if (!krk_tableNextEntry(AS_DICT(self->dict), &self->i, &entry)) return argv[0];
+	/* Another thread may remove the entry while we allocate. */
+	krk_push(entry.key);
+	krk_push(entry.value);
+	KrkTuple * outValue = krk_newTuple(2);
+	outValue->values.values[0] = entry.key;
+	outValue->values.values[1] = entry.value;
+	outValue->values.count = 2;
+	krk_pop();
+	krk_pop();
+	return OBJECT_VAL(outValue);
 }
 
 KRK_Method(dictitems,__repr__) {
@@ -350,10 +364,8 @@ KRK_Method(dictitems,__repr__) {
 	pushStringBuilderStr(&sb,"dictitems([",11);
 
 	size_t c = 0;
-	size_t len = AS_DICT(self->dict)->capacity;
-	for (size_t i = 0; i < len; ++i) {
-		KrkTableEntry * entry = &AS_DICT(self->dict)->entries[i];
-		if (IS_KWARGS(entry->key)) continue;
+	KrkTableEntry entry;
+	for (size_t i = 0; krk_tableNextEntry(AS_DICT(self->dict), &i, &entry);) {
 		if (c > 0) {
 			pushStringBuilderStr(&sb, ", ", 2);
 		}
@@ -362,8 +374,8 @@ KRK_Method(dictitems,__repr__) {
 		pushStringBuilder(&sb,'(');
 
 		{
-			KrkClass * type = krk_getType(entry->key);
-			krk_push(entry->key);
+			KrkClass * type = krk_getType(entry.key);
+			krk_push(entry.key);
 			KrkValue result = krk_callDirect(type->_reprer, 1);
 			if (IS_STRING(result)) {
 				pushStringBuilderStr(&sb, AS_CSTRING(result), AS_STRING(result)->length);
@@ -373,8 +385,8 @@ KRK_Method(dictitems,__repr__) {
 		pushStringBuilderStr(&sb, ", ", 2);
 
 		{
-			KrkClass * type = krk_getType(entry->value);
-			krk_push(entry->value);
+			KrkClass * type = krk_getType(entry.value);
+			krk_push(entry.value);
 			KrkValue result = krk_callDirect(type->_reprer, 1);
 			if (IS_STRING(result)) {
 				pushStringBuilderStr(&sb, AS_CSTRING(result), AS_STRING(result)->length);
@@ -412,15 +424,9 @@ KRK_Method(dictkeys,__iter__) {
 
 KRK_Method(dictkeys,__call__) {
 	METHOD_TAKES_NONE();
-	do {
-		if (self->i >= AS_DICT(self->dict)->capacity) return argv[0];
-		if (!IS_KWARGS(AS_DICT(self->dict)->entries[self->i].key)) {
-			krk_push(AS_DICT(self->dict)->entries[self->i].key);
-			self->i++;
-			return krk_pop();
-		}
-		self->i++;
-	} while (1);
+	KrkTableEntry entry;
+	if (!krk_tableNextEntry(AS_DICT(self->dict), &self->i, &entry)) return argv[0];
+	return entry.key;
 }
 
 KRK_Method(dictkeys,__repr__) {
@@ -431,18 +437,16 @@ KRK_Method(dictkeys,__repr__) {
 	pushStringBuilderStr(&sb,"dictkeys([",10);
 
 	size_t c = 0;
-	size_t len = AS_DICT(self->dict)->capacity;
-	for (size_t i = 0; i < len; ++i) {
-		KrkTableEntry * entry = &AS_DICT(self->dict)->entries[i];
-		if (IS_KWARGS(entry->key)) continue;
+	KrkTableEntry entry;
+	for (size_t i = 0; krk_tableNextEntry(AS_DICT(self->dict), &i, &entry);) {
 		if (c > 0) {
 			pushStringBuilderStr(&sb, ", ", 2);
 		}
 		c++;
 
 		{
-			KrkClass * type = krk_getType(entry->key);
-			krk_push(entry->key);
+			KrkClass * type = krk_getType(entry.key);
+			krk_push(entry.key);
 			KrkValue result = krk_callDirect(type->_reprer, 1);
 			if (IS_STRING(result)) {
 				pushStringBuilderStr(&sb, AS_CSTRING(result), AS_STRING(result)->length);
@@ -478,15 +482,9 @@ KRK_Method(dictvalues,__iter__) {
 
 KRK_Method(dictvalues,__call__) {
 	METHOD_TAKES_NONE();
-	do {
-		if (self->i >= AS_DICT(self->dict)->capacity) return argv[0];
-		if (!IS_KWARGS(AS_DICT(self->dict)->entries[self->i].key)) {
-			krk_push(AS_DICT(self->dict)->entries[self->i].value);
-			self->i++;
-			return krk_pop();
-		}
-		self->i++;
-	} while (1);
+	KrkTableEntry entry;
+	if (!krk_tableNextEntry(AS_DICT(self->dict), &self->i, &entry)) return argv[0];
+	return entry.value;
 }
 
 KRK_Method(dictvalues,__repr__) {
@@ -497,18 +495,16 @@ KRK_Method(dictvalues,__repr__) {
 	pushStringBuilderStr(&sb,"dictvalues([",12);
 
 	size_t c = 0;
-	size_t len = AS_DICT(self->dict)->capacity;
-	for (size_t i = 0; i < len; ++i) {
-		KrkTableEntry * entry = &AS_DICT(self->dict)->entries[i];
-		if (IS_KWARGS(entry->key)) continue;
+	KrkTableEntry entry;
+	for (size_t i = 0; krk_tableNextEntry(AS_DICT(self->dict), &i, &entry);) {
 		if (c > 0) {
 			pushStringBuilderStr(&sb, ", ", 2);
 		}
 		c++;
 
 		{
-			KrkClass * type = krk_getType(entry->value);
-			krk_push(entry->value);
+			KrkClass * type = krk_getType(entry.value);
+			krk_push(entry.value);
 			KrkValue result = krk_callDirect(type->_reprer, 1);
 			if (IS_STRING(result)) {
 				pushStringBuilderStr(&sb, AS_CSTRING(result), AS_STRING(result)->length);
@@ -16,19 +16,23 @@
 /**
  * @brief Generator object implementation.
  * @extends KrkInstance
+ *
+ * A generator's frame runs on a stack segment of its own. Resuming it
+ * switches the thread to that segment and yielding switches back, so
+ * neither copies the frame's values.
  */
 struct generator {
 	KrkInstance inst;
 	KrkClosure * closure;
-	KrkValue * args;
-	size_t argCount;
+	KrkValue * stack;
+	size_t stackCount;
+	size_t stackSize;
 	uint8_t * ip;
 	int running;
 	int started;
 	KrkValue result;
 	int type;
-	KrkThreadState fakethread;
-	KrkUpvalue * capturedUpvalues;
+	KrkUpvalue * openUpvalues;
 };
 
 #define AS_generator(o) ((struct generator *)AS_OBJECT(o))
@@ -38,41 +42,50 @@ struct generator {
 #define CURRENT_NAME  self
 
 static void _generator_close_upvalues(struct generator * self) {
-	while (self->capturedUpvalues) {
-		KrkUpvalue * upvalue = self->capturedUpvalues;
-		upvalue->closed = self->args[upvalue->location];
+	while (self->openUpvalues) {
+		KrkUpvalue * upvalue = self->openUpvalues;
+		upvalue->closed = self->stack[upvalue->location];
 		upvalue->location = -1;
-		self->capturedUpvalues = upvalue->next;
+		self->openUpvalues = upvalue->next;
 	}
 }
 
 static void _generator_gcscan(KrkInstance * _self) {
 	struct generator * self = (struct generator*)_self;
 	krk_markObject((KrkObj*)self->closure);
-	for (size_t i = 0; i < self->argCount; ++i) {
-		krk_markValue(self->args[i]);
-	}
-	for (KrkUpvalue * upvalue = self->capturedUpvalues; upvalue; upvalue = upvalue->next) {
-		krk_markObject((KrkObj*)upvalue);
+	/* While running, the segment is the thread's current stack and is marked with it. */
+	if (!self->running) {
+		for (size_t i = 0; i < self->stackCount; ++i) {
+			krk_markValue(self->stack[i]);
+		}
+		for (KrkUpvalue * upvalue = self->openUpvalues; upvalue; upvalue = upvalue->next) {
+			krk_markObject((KrkObj*)upvalue);
+		}
 	}
 	krk_markValue(self->result);
 }
 
-static void _generator_gcsweep(KrkInstance * self) {
-	_generator_close_upvalues((struct generator*)self);
-	free(((struct generator*)self)->args);
+static void _generator_gcsweep(KrkInstance * _self) {
+	/* Open upvalues into our segment keep us alive, so any left are dead too. */
+	struct generator * self = (struct generator*)_self;
+	FREE_ARRAY(KrkValue, self->stack, self->stackSize);
 }
 
 static void _set_generator_done(struct generator * self) {
 	self->ip = NULL;
 	_generator_close_upvalues(self);
+	FREE_ARRAY(KrkValue, self->stack, self->stackSize);
+	self->stack = NULL;
+	self->stackCount = 0;
+	self->stackSize = 0;
 }
 
 /**
  * @brief Create a generator object from a closure and set of arguments.
  *
- * Initializes the generator object, attaches the argument list, and sets up
- * the execution state to point to the start of the function's code object.
+ * Initializes the generator object, gives it a stack segment holding the
+ * argument list, and sets up the execution state to point to the start of
+ * the function's code object.
  *
  * @param closure  Function object to transform.
  * @param argsIn   Array of arguments passed to the call.
@@ -80,14 +93,16 @@ static void _set_generator_done(struct generator * self) {
  * @return A @ref generator object.
  */
 KrkInstance * krk_buildGenerator(KrkClosure * closure, KrkValue * argsIn, size_t argCount) {
-	/* Copy the args */
-	KrkValue * args = malloc(sizeof(KrkValue) * (argCount));
-	memcpy(args, argsIn, sizeof(KrkValue) * argCount);
+	/* Copy the args into a new stack segment */
+	size_t stackSize = GROW_CAPACITY(argCount);
+	KrkValue * stack = GROW_ARRAY(KrkValue, NULL, 0, stackSize);
+	memcpy(stack, argsIn, sizeof(KrkValue) * argCount);
 
 	/* Create a generator object */
 	struct generator * self = (struct generator *)krk_newInstance(KRK_BASE_CLASS(generator));
-	self->args = args;
-	self->argCount = argCount;
+	self->stack = stack;
+	self->stackCount = argCount;
+	self->stackSize = stackSize;
 	self->closure = closure;
 	self->ip = self->closure->function->chunk.code;
 	self->result = NONE_VAL();
@@ -125,50 +140,70 @@ KRK_Method(generator,__call__) {
 	if (self->running) {
 		return krk_runtimeError(vm.exceptions->valueError, "generator already executing");
 	}
+
+	/* Set aside the stack we were called on */
+	KrkStackSegment outer = {
+		.prev = krk_currentThread.outerStacks,
+		.frames = krk_currentThread.frameCount,
+		.stackSize = krk_currentThread.stackSize,
+		.stack = krk_currentThread.stack,
+		.stackTop = krk_currentThread.stackTop,
+		.stackMax = krk_currentThread.stackMax,
+		.stackHome = krk_currentThread.stackHome,
+		.stackOwner = krk_currentThread.stackOwner,
+		.openUpvalues = krk_currentThread.openUpvalues,
+	};
+	int deferStackFree = krk_currentThread.flags & KRK_THREAD_DEFER_STACK_FREE;
+
+	/* Switch to ours; nothing else points into it, so it may move freely if it grows */
+	krk_currentThread.outerStacks = &outer;
+	krk_currentThread.stackSize = self->stackSize;
+	krk_currentThread.stack = self->stack;
+	krk_currentThread.stackTop = self->stack + self->stackCount;
+	krk_currentThread.stackMax = self->stack + self->stackSize;
+	krk_currentThread.stackHome = &self->stack;
+	krk_currentThread.stackOwner = (KrkObj*)self;
+	krk_currentThread.openUpvalues = self->openUpvalues;
+	krk_currentThread.flags &= ~KRK_THREAD_DEFER_STACK_FREE;
+
 	/* Prepare frame */
 	KrkCallFrame * frame = &krk_currentThread.frames[krk_currentThread.frameCount++];
 	frame->closure = self->closure;
 	frame->ip      = self->ip;
-	frame->slots   = krk_currentThread.stackTop - krk_currentThread.stack;
-	frame->outSlots = frame->slots;
+	frame->slots   = 0;
+	frame->outSlots = 0;
 	frame->globals = self->closure->globalsTable;
 	frame->globalsOwner = self->closure->globalsOwner;
 
-	/* Stick our stack on their stack */
-	for (size_t i = 0; i < self->argCount; ++i) {
-		krk_push(self->args[i]);
-	}
-
-	/* Point any of our captured upvalues back to their actual stack locations */
-	while (self->capturedUpvalues) {
-		KrkUpvalue * upvalue = self->capturedUpvalues;
-		upvalue->owner = &krk_currentThread;
-		upvalue->location = upvalue->location + frame->slots;
-		self->capturedUpvalues = upvalue->next;
-		upvalue->next = krk_currentThread.openUpvalues;
-		krk_currentThread.openUpvalues = upvalue;
-	}
-
+	/* The value we last yielded is where the sent value goes */
 	if (self->started) {
-		krk_pop();
-		if (argc > 1) {
-			krk_push(argv[1]);
-		} else {
-			krk_push(NONE_VAL());
-		}
+		krk_currentThread.stackTop[-1] = argc > 1 ? argv[1] : NONE_VAL();
 	}
 
 	/* Jump into the iterator */
 	self->running = 1;
-	size_t stackBefore = krk_currentThread.stackTop - krk_currentThread.stack;
 	KrkValue result = krk_runNext();
-	size_t stackAfter = krk_currentThread.stackTop - krk_currentThread.stack;
 	self->running = 0;
 
 	self->started = 1;
+	self->ip = krk_currentThread.frames[outer.frames].ip;
+
+	/* Switch back, keeping our segment where it was left */
+	self->stackSize = krk_currentThread.stackSize;
+	self->stackCount = krk_currentThread.stackTop - krk_currentThread.stack;
+	self->openUpvalues = krk_currentThread.openUpvalues;
+	krk_currentThread.outerStacks = outer.prev;
+	krk_currentThread.stackSize = outer.stackSize;
+	krk_currentThread.stack = outer.stack;
+	krk_currentThread.stackTop = outer.stackTop;
+	krk_currentThread.stackMax = outer.stackMax;
+	krk_currentThread.stackHome = outer.stackHome;
+	krk_currentThread.stackOwner = outer.stackOwner;
+	krk_currentThread.openUpvalues = outer.openUpvalues;
+	krk_currentThread.flags |= deferStackFree;
 
 	if (IS_KWARGS(result) && AS_INTEGER(result) == 0) {
-		self->result = krk_pop();
+		self->result = self->stack[--self->stackCount];
 		_set_generator_done(self);
 		return OBJECT_VAL(self);
 	}
@@ -176,38 +211,9 @@ KRK_Method(generator,__call__) {
 	/* Was there an exception? */
 	if (krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION) {
 		_set_generator_done(self);
-		krk_currentThread.stackTop = krk_currentThread.stack + frame->slots;
 		return NONE_VAL();
 	}
 
-	/* Redirect any remaining upvalues captured from us, and release them from the VM */
-	while (krk_currentThread.openUpvalues != NULL && krk_currentThread.openUpvalues->location >= (int)frame->slots) {
-		KrkUpvalue * upvalue = krk_currentThread.openUpvalues;
-		upvalue->location = upvalue->location - frame->slots;
-		upvalue->owner = &self->fakethread;
-		krk_currentThread.openUpvalues = upvalue->next;
-		upvalue->next = self->capturedUpvalues;
-		self->capturedUpvalues = upvalue;
-	}
-
-	/* Determine the stack state */
-	if (stackAfter > stackBefore) {
-		size_t newArgs = stackAfter - stackBefore;
-		self->args = realloc(self->args, sizeof(KrkValue) * (self->argCount + newArgs));
-		self->argCount += newArgs;
-	} else if (stackAfter < stackBefore) {
-		size_t deadArgs = stackBefore - stackAfter;
-		self->args = realloc(self->args, sizeof(KrkValue) * (self->argCount - deadArgs));
-		self->argCount -= deadArgs;
-	}
-
-	/* Save stack entries */
-	memcpy(self->args, krk_currentThread.stackTop - self->argCount, sizeof(KrkValue) * self->argCount);
-	self->ip      = frame->ip;
-	self->fakethread.stack = self->args;
-
-	krk_currentThread.stackTop = krk_currentThread.stack + frame->slots;
-
 	return result;
 }
 
@@ -5,6 +5,8 @@
 #include <kuroko/util.h>
 #include <kuroko/threads.h>
 
+#include "private.h"
+
 #define LIST_WRAP_INDEX() \
 	if (index < 0) index += self->values.count; \
 	if (unlikely(index < 0 || index >= (krk_integer_type)self->values.count)) return krk_runtimeError(vm.exceptions->indexError, "list index out of range: %zd", (ssize_t)index)
@@ -50,13 +52,13 @@ KRK_Method(list,__getitem__) {
 	METHOD_TAKES_EXACTLY(1);
 	if (IS_INTEGER(argv[1])) {
 		CHECK_ARG(1,int,krk_integer_type,index);
-		if (vm.globalFlags & KRK_GLOBAL_THREADS) pthread_rwlock_rdlock(&self->rwlock);
+		if (vm.globalFlags & KRK_GLOBAL_THREADS) _obtain_read_lock(&self->rwlock);
 		LIST_WRAP_INDEX();
 		KrkValue result = self->values.values[index];
 		if (vm.globalFlags & KRK_GLOBAL_THREADS) pthread_rwlock_unlock(&self->rwlock);
 		return result;
 	} else if (IS_slice(argv[1])) {
-		pthread_rwlock_rdlock(&self->rwlock);
+		_obtain_read_lock(&self->rwlock);
 
 		KRK_SLICER(argv[1],self->values.count) {
 			pthread_rwlock_unlock(&self->rwlock);
@@ -108,7 +110,7 @@ KRK_Method(list,__eq__) {
 
 KRK_Method(list,append) {
 	METHOD_TAKES_EXACTLY(1);
-	pthread_rwlock_wrlock(&self->rwlock);
+	_obtain_write_lock(&self->rwlock);
 	krk_writeValueArray(&self->values, argv[1]);
 	pthread_rwlock_unlock(&self->rwlock);
 	return NONE_VAL();
@@ -117,7 +119,7 @@ KRK_Method(list,append) {
 KRK_Method(list,insert) {
 	METHOD_TAKES_EXACTLY(2);
 	CHECK_ARG(1,int,krk_integer_type,index);
-	pthread_rwlock_wrlock(&self->rwlock);
+	_obtain_write_lock(&self->rwlock);
 	LIST_WRAP_SOFT(index);
 	krk_writeValueArray(&self->values, NONE_VAL());
 	memmove(
@@ -136,7 +138,7 @@ KRK_Method(list,__repr__) {
 	((KrkObj*)self)->flags |= KRK_OBJ_FLAGS_IN_REPR;
 	struct StringBuilder sb = {0};
 	pushStringBuilder(&sb, '[');
-	pthread_rwlock_rdlock(&self->rwlock);
+	_obtain_read_lock(&self->rwlock);
 	for (size_t i = 0; i < self->values.count; ++i) {
 		/* repr(self[i]) */
 		KrkClass * type = krk_getType(self->values.values[i]);
@@ -175,7 +177,7 @@ static int _list_extend_callback(void * context, const KrkValue * values, size_t
 
 KRK_Method(list,extend) {
 	METHOD_TAKES_EXACTLY(1);
-	pthread_rwlock_wrlock(&self->rwlock);
+	_obtain_write_lock(&self->rwlock);
 	KrkValueArray *  positionals = AS_LIST(argv[0]);
 	KrkValue other = argv[1];
 	if (krk_valuesSame(argv[0],other)) {
@@ -220,7 +222,7 @@ KRK_Method(list,__len__) {
 
 KRK_Method(list,__contains__) {
 	METHOD_TAKES_EXACTLY(1);
-	pthread_rwlock_rdlock(&self->rwlock);
+	_obtain_read_lock(&self->rwlock);
 	for (size_t i = 0; i < self->values.count; ++i) {
 		if (krk_valuesSameOrEqual(argv[1], self->values.values[i])) {
 			pthread_rwlock_unlock(&self->rwlock);
@@ -234,7 +236,7 @@ KRK_Method(list,__contains__) {
 
 KRK_Method(list,pop) {
 	METHOD_TAKES_AT_MOST(1);
-	pthread_rwlock_wrlock(&self->rwlock);
+	_obtain_write_lock(&self->rwlock);
 	krk_integer_type index = self->values.count - 1;
 	if (argc == 2) {
 		CHECK_ARG(1,int,krk_integer_type,ind);
@@ -261,7 +263,7 @@ KRK_Method(list,__setitem__) {
 	METHOD_TAKES_EXACTLY(2);
 	if (IS_INTEGER(argv[1])) {
 		CHECK_ARG(1,int,krk_integer_type,index);
-		if (vm.globalFlags & KRK_GLOBAL_THREADS) pthread_rwlock_rdlock(&self->rwlock);
+		if (vm.globalFlags & KRK_GLOBAL_THREADS) _obtain_read_lock(&self->rwlock);
 		LIST_WRAP_INDEX();
 		self->values.values[index] = argv[2];
 		if (vm.globalFlags & KRK_GLOBAL_THREADS) pthread_rwlock_unlock(&self->rwlock);
@@ -331,7 +333,7 @@ KRK_Method(list,__delitem__) {
 
 KRK_Method(list,remove) {
 	METHOD_TAKES_EXACTLY(1);
-	pthread_rwlock_wrlock(&self->rwlock);
+	_obtain_write_lock(&self->rwlock);
 	for (size_t i = 0; i < self->values.count; ++i) {
 		if (krk_valuesSameOrEqual(self->values.values[i], argv[1])) {
 			pthread_rwlock_unlock(&self->rwlock);
@@ -348,7 +350,7 @@ KRK_Method(list,remove) {
 
 KRK_Method(list,clear) {
 	METHOD_TAKES_NONE();
-	pthread_rwlock_wrlock(&self->rwlock);
+	_obtain_write_lock(&self->rwlock);
 	krk_freeValueArray(&self->values);
 	pthread_rwlock_unlock(&self->rwlock);
 	return NONE_VAL();
@@ -375,7 +377,7 @@ KRK_Method(list,index) {
 			return krk_runtimeError(vm.exceptions->typeError, "%s must be int, not '%T'", "max", argv[3]);
 	}
 
-	pthread_rwlock_rdlock(&self->rwlock);
+	_obtain_read_lock(&self->rwlock);
 	LIST_WRAP_SOFT(min);
 	LIST_WRAP_SOFT(max);
 
@@ -398,7 +400,7 @@ KRK_Method(list,count) {
 	METHOD_TAKES_EXACTLY(1);
 	krk_integer_type count = 0;
 
-	pthread_rwlock_rdlock(&self->rwlock);
+	_obtain_read_lock(&self->rwlock);
 	for (size_t i = 0; i < self->values.count; ++i) {
 		if (krk_valuesSameOrEqual(self->values.values[i], argv[1])) count++;
 		if (unlikely(krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION)) break;
@@ -410,7 +412,7 @@ KRK_Method(list,count) {
 
 KRK_Method(list,copy) {
 	METHOD_TAKES_NONE();
-	pthread_rwlock_rdlock(&self->rwlock);
+	_obtain_read_lock(&self->rwlock);
 	KrkValue result = krk_list_of(self->values.count, self->values.values, 0);
 	pthread_rwlock_unlock(&self->rwlock);
 	return result;
@@ -418,7 +420,7 @@ KRK_Method(list,copy) {
 
 KRK_Method(list,reverse) {
 	METHOD_TAKES_NONE();
-	pthread_rwlock_wrlock(&self->rwlock);
+	_obtain_write_lock(&self->rwlock);
 	for (size_t i = 0; i < (self->values.count) / 2; i++) {
 		KrkValue tmp = self->values.values[i];
 		self->values.values[i] = self->values.values[self->values.count-i-1];
@@ -444,7 +446,7 @@ static int _list_sorter(const void * _a, const void * _b) {
 KRK_Method(list,sort) {
 	METHOD_TAKES_NONE();
 
-	pthread_rwlock_wrlock(&self->rwlock);
+	_obtain_write_lock(&self->rwlock);
 	qsort(self->values.values, self->values.count, sizeof(KrkValue), _list_sorter);
 	pthread_rwlock_unlock(&self->rwlock);
 
@@ -455,7 +457,7 @@ KRK_Method(list,__add__) {
 	METHOD_TAKES_EXACTLY(1);
 	if (!IS_list(argv[1])) return TYPE_ERROR(list,argv[1]);
 
-	pthread_rwlock_rdlock(&self->rwlock);
+	_obtain_read_lock(&self->rwlock);
 	KrkValue outList = krk_list_of(self->values.count, self->values.values, 0); /* copy */
 	pthread_rwlock_unlock(&self->rwlock);
 	FUNC_NAME(list,extend)(2,(KrkValue[]){outList,argv[1]},0); /* extend */
@@ -1044,14 +1044,11 @@ static char * krk_long_to_str(const KrkLong * n, int _base, const char * prefix,
 
 	char * rev = malloc(len);
 	char * out = rev;
-	uint32_t hash = 0;
 	while (writer != tmp) {
-		*out = *--writer;
-		krk_hash_advance(hash,*out);
-		out++;
+		*out++ = *--writer;
 	}
 	*out = '\0';
-	*_hash = hash;
+	*_hash = krk_hashBytes(rev, out - rev);
 
 	free(tmp);
 
@@ -1410,7 +1407,15 @@ PRINTER(oct,8,"o0")
 PRINTER(bin,2,"b0")
 
 KRK_Method(long,__hash__) {
-	return INTEGER_VAL((uint32_t)(krk_long_medium(self->value)));
+	/* Values that fit in an int64 hash like one; wider ones hash all of their digits. */
+	KrkLong * value = self->value;
+	size_t width = value->width < 0 ? -value->width : value->width;
+	if (width < 3 || (width == 3 && value->digits[2] < 2)) {
+		uint64_t magnitude = 0;
+		for (size_t i = width; i > 0; --i) magnitude = (magnitude << 31) | value->digits[i-1];
+		return INTEGER_VAL(krk_hashInteger(value->width < 0 ? -(int64_t)magnitude : (int64_t)magnitude));
+	}
+	return INTEGER_VAL(krk_hashBytes(value->digits, width * sizeof(value->digits[0])) ^ (value->width < 0));
 }
 
 static KrkValue make_long_obj(KrkLong * val) {
@@ -89,7 +89,7 @@ KRK_Method(int,__eq__) {
 }
 
 KRK_Method(int,__hash__) {
-	return INTEGER_VAL((uint32_t)AS_INTEGER(argv[0]));
+	return INTEGER_VAL(krk_hashInteger(AS_INTEGER(argv[0])));
 }
 
 static inline int matches(char c, const char * options) {
@@ -645,7 +645,7 @@ KRK_Method(float,__eq__) {
 }
 
 KRK_Method(float,__hash__) {
-	return INTEGER_VAL((uint32_t)self);
+	return INTEGER_VAL(krk_hashFloat(self));
 }
 
 KRK_Method(float,__neg__) {
@@ -761,7 +761,7 @@ KRK_Method(NoneType,__str__) {
 }
 
 KRK_Method(NoneType,__hash__) {
-	return INTEGER_VAL((uint32_t)AS_INTEGER(argv[0]));
+	return INTEGER_VAL(krk_hashInteger(AS_INTEGER(argv[0])));
 }
 
 KRK_Method(NoneType,__eq__) {
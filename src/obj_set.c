@@ -4,6 +4,8 @@
 #include <kuroko/memory.h>
 #include <kuroko/util.h>
 
+#include "private.h"
+
 /**
  * @brief Mutable unordered set of values.
  * @extends KrkInstance
@@ -11,6 +13,9 @@
 struct Set {
 	KrkInstance inst;
 	KrkTable entries;
+#ifndef KRK_DISABLE_THREADS
+	KrkTableLock lock;
+#endif
 };
 
 #define IS_set(o) krk_isInstanceOf(o,KRK_BASE_CLASS(set))
@@ -76,17 +81,15 @@ KRK_Method(set,__repr__) {
 	pushStringBuilder(&sb,'{');
 
 	size_t c = 0;
-	size_t len = self->entries.capacity;
-	for (size_t i = 0; i < len; ++i) {
-		KrkTableEntry * entry = &self->entries.entries[i];
-		if (IS_KWARGS(entry->key)) continue;
+	KrkTableEntry entry;
+	for (size_t i = 0; krk_tableNextEntry(&self->entries, &i, &entry);) {
 		if (c > 0) {
 			pushStringBuilderStr(&sb, ", ", 2);
 		}
 		c++;
 
-		KrkClass * type = krk_getType(entry->key);
-		krk_push(entry->key);
+		KrkClass * type = krk_getType(entry.key);
+		krk_push(entry.key);
 		KrkValue result = krk_callDirect(type->_reprer, 1);
 		if (IS_STRING(result)) {
 			pushStringBuilderStr(&sb, AS_CSTRING(result), AS_STRING(result)->length);
@@ -110,16 +113,14 @@ KRK_Method(set,__and__) {
 	if (!type->_contains)
 		return krk_runtimeError(vm.exceptions->typeError, "unsupported operand types for %s: '%T' and '%T'", "&", argv[0], argv[1]);
 
-	for (size_t i = 0; i < self->entries.capacity; ++i) {
-		KrkTableEntry * entry = &self->entries.entries[i];
-		if (IS_KWARGS(entry->key)) continue;
-
+	KrkTableEntry entry;
+	for (size_t i = 0; krk_tableNextEntry(&self->entries, &i, &entry);) {
 		krk_push(argv[1]);
-		krk_push(entry->key);
+		krk_push(entry.key);
 		KrkValue result = krk_callDirect(type->_contains, 2);
 
 		if (IS_BOOLEAN(result) && AS_BOOLEAN(result)) {
-			krk_tableSet(&AS_set(outSet)->entries, entry->key, BOOLEAN_VAL(1));
+			krk_tableSet(&AS_set(outSet)->entries, entry.key, BOOLEAN_VAL(1));
 		}
 	}
 
@@ -138,32 +139,27 @@ KRK_Method(set,__xor__) {
 	if (!type->_contains)
 		return krk_runtimeError(vm.exceptions->typeError, "unsupported operand types for %s: '%T' and '%T'", "&", argv[0], argv[1]);
 
-	for (size_t i = 0; i < self->entries.capacity; ++i) {
-		KrkTableEntry * entry = &self->entries.entries[i];
-		if (IS_KWARGS(entry->key)) continue;
-
+	KrkTableEntry entry;
+	for (size_t i = 0; krk_tableNextEntry(&self->entries, &i, &entry);) {
 		krk_push(argv[1]);
-		krk_push(entry->key);
+		krk_push(entry.key);
 		KrkValue result = krk_callDirect(type->_contains, 2);
 
 		if (IS_BOOLEAN(result) && !AS_BOOLEAN(result)) {
-			krk_tableSet(&AS_set(outSet)->entries, entry->key, BOOLEAN_VAL(1));
+			krk_tableSet(&AS_set(outSet)->entries, entry.key, BOOLEAN_VAL(1));
 		}
 	}
 
 	/* Ours better have something... */
 	type = krk_getType(argv[0]);
 
-	for (size_t i = 0; i < them->entries.capacity; ++i) {
-		KrkTableEntry * entry = &them->entries.entries[i];
-		if (IS_KWARGS(entry->key)) continue;
-
+	for (size_t i = 0; krk_tableNextEntry(&them->entries, &i, &entry);) {
 		krk_push(argv[0]);
-		krk_push(entry->key);
+		krk_push(entry.key);
 		KrkValue result = krk_callDirect(type->_contains, 2);
 
 		if (IS_BOOLEAN(result) && !AS_BOOLEAN(result)) {
-			krk_tableSet(&AS_set(outSet)->entries, entry->key, BOOLEAN_VAL(1));
+			krk_tableSet(&AS_set(outSet)->entries, entry.key, BOOLEAN_VAL(1));
 		}
 	}
 
@@ -200,9 +196,9 @@ KRK_Method(set,__eq__) {
 
 	KrkValue _unused;
 
-	for (unsigned int i = 0; i < self->entries.capacity; ++i) {
-		if (IS_KWARGS(self->entries.entries[i].key)) continue;
-		if (!krk_tableGet(&them->entries, self->entries.entries[i].key, &_unused)) return BOOLEAN_VAL(0);
+	KrkTableEntry entry;
+	for (size_t i = 0; krk_tableNextEntry(&self->entries, &i, &entry);) {
+		if (!krk_tableGet(&them->entries, entry.key, &_unused)) return BOOLEAN_VAL(0);
 	}
 
 	return BOOLEAN_VAL(1);
@@ -217,9 +213,9 @@ KRK_Method(set,__lt__) {
 	if (self->entries.count == them->entries.count)
 		return BOOLEAN_VAL(0);
 	KrkValue _unused;
-	for (unsigned int i = 0; i < self->entries.capacity; ++i) {
-		if (IS_KWARGS(self->entries.entries[i].key)) continue;
-		if (!krk_tableGet(&them->entries, self->entries.entries[i].key, &_unused)) return BOOLEAN_VAL(0);
+	KrkTableEntry entry;
+	for (size_t i = 0; krk_tableNextEntry(&self->entries, &i, &entry);) {
+		if (!krk_tableGet(&them->entries, entry.key, &_unused)) return BOOLEAN_VAL(0);
 	}
 	return BOOLEAN_VAL(1);
 }
@@ -231,9 +227,9 @@ KRK_Method(set,__le__) {
 		return NOTIMPL_VAL();
 	struct Set * them = AS_set(argv[1]);
 	KrkValue _unused;
-	for (unsigned int i = 0; i < self->entries.capacity; ++i) {
-		if (IS_KWARGS(self->entries.entries[i].key)) continue;
-		if (!krk_tableGet(&them->entries, self->entries.entries[i].key, &_unused)) return BOOLEAN_VAL(0);
+	KrkTableEntry entry;
+	for (size_t i = 0; krk_tableNextEntry(&self->entries, &i, &entry);) {
+		if (!krk_tableGet(&them->entries, entry.key, &_unused)) return BOOLEAN_VAL(0);
 	}
 	return BOOLEAN_VAL(1);
 }
@@ -247,9 +243,9 @@ KRK_Method(set,__gt__) {
 	if (self->entries.count == them->entries.count)
 		return BOOLEAN_VAL(0);
 	KrkValue _unused;
-	for (unsigned int i = 0; i < them->entries.capacity; ++i) {
-		if (IS_KWARGS(them->entries.entries[i].key)) continue;
-		if (!krk_tableGet(&self->entries, them->entries.entries[i].key, &_unused)) return BOOLEAN_VAL(0);
+	KrkTableEntry entry;
+	for (size_t i = 0; krk_tableNextEntry(&them->entries, &i, &entry);) {
+		if (!krk_tableGet(&self->entries, entry.key, &_unused)) return BOOLEAN_VAL(0);
 	}
 	return BOOLEAN_VAL(1);
 }
@@ -260,9 +256,9 @@ KRK_Method(set,__ge__) {
 		return NOTIMPL_VAL();
 	struct Set * them = AS_set(argv[1]);
 	KrkValue _unused;
-	for (unsigned int i = 0; i < them->entries.capacity; ++i) {
-		if (IS_KWARGS(them->entries.entries[i].key)) continue;
-		if (!krk_tableGet(&self->entries, them->entries.entries[i].key, &_unused)) return BOOLEAN_VAL(0);
+	KrkTableEntry entry;
+	for (size_t i = 0; krk_tableNextEntry(&them->entries, &i, &entry);) {
+		if (!krk_tableGet(&self->entries, entry.key, &_unused)) return BOOLEAN_VAL(0);
 	}
 	return BOOLEAN_VAL(1);
 }
@@ -270,38 +266,48 @@ KRK_Method(set,__ge__) {
 
 KRK_Method(set,add) {
 	METHOD_TAKES_EXACTLY(1);
+	_obtain_table_lock(&self->lock);
 	krk_tableSet(&self->entries, argv[1], BOOLEAN_VAL(1));
+	_release_table_lock(&self->lock);
 	return NONE_VAL();
 }
 
 KRK_Method(set,remove) {
 	METHOD_TAKES_EXACTLY(1);
-	if (!krk_tableDelete(&self->entries, argv[1]))
+	_obtain_table_lock(&self->lock);
+	int deleted = krk_tableDelete(&self->entries, argv[1]);
+	_release_table_lock(&self->lock);
+	if (!deleted)
 		return krk_runtimeError(vm.exceptions->keyError, "key error");
 	return NONE_VAL();
 }
 
 KRK_Method(set,discard) {
 	METHOD_TAKES_EXACTLY(1);
+	_obtain_table_lock(&self->lock);
 	krk_tableDelete(&self->entries, argv[1]);
+	_release_table_lock(&self->lock);
 	return NONE_VAL();
 }
 
 KRK_Method(set,clear) {
 	METHOD_TAKES_NONE();
-	krk_freeTable(&self->entries);
-	krk_initTable(&self->entries);
+	_obtain_table_lock(&self->lock);
+	krk_tableClear(&self->entries);
+	_release_table_lock(&self->lock);
 	return NONE_VAL();
 }
 
 KRK_Method(set,update) {
 	METHOD_TAKES_AT_MOST(1);
 	if (argc > 1) {
+		_obtain_table_lock(&self->lock);
 		if (IS_set(argv[1])) {
 			krk_tableAddAll(&AS_set(argv[1])->entries, &self->entries);
 		} else {
-			if (krk_unpackIterable(argv[1], self, _set_init_callback)) return NONE_VAL();
+			krk_unpackIterable(argv[1], self, _set_init_callback);
 		}
+		_release_table_lock(&self->lock);
 	}
 	return NONE_VAL();
 }
@@ -332,15 +338,9 @@ KRK_Method(setiterator,__call__) {
 
 	if (unlikely(!IS_set(self->set))) return argv[0];
 
-	do {
-		if (self->i >= AS_set(self->set)->entries.capacity) return argv[0];
-		if (!IS_KWARGS(AS_set(self->set)->entries.entries[self->i].key)) {
-			krk_push(AS_set(self->set)->entries.entries[self->i].key);
-			self->i++;
-			return krk_pop();
-		}
-		self->i++;
-	} while (1);
+	KrkTableEntry entry;
+	if (!krk_tableNextEntry(&AS_set(self->set)->entries, &self->i, &entry)) return argv[0];
+	return entry.key;
 }
 
 KrkValue krk_set_of(int argc, const KrkValue argv[], int hasKw) {
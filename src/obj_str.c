@@ -68,19 +68,20 @@ KRK_Method(str,__add__) {
 
 	KrkStringType type = self_type > them_type ? self_type : them_type;
 
-	/* Hashes can be extended, which saves us calculating the whole thing */
-	uint32_t hash = self->obj.hash;
-	for (size_t i = 0; i < bl; ++i) {
-		krk_hash_advance(hash,b[i]);
-	}
-
-	KrkString * result = krk_takeStringVetted(chars, length, cpLength, type, hash);
+	/* Not hashed or interned until it is used as a key */
+	KrkString * result = krk_takeStringUninterned(chars, length, cpLength, type);
 	if (needsPop) krk_pop();
 	return OBJECT_VAL(result);
 }
 
 KRK_Method(str,__hash__) {
-	return INTEGER_VAL(self->obj.hash);
+	return INTEGER_VAL(krk_stringHash(self));
+}
+
+KRK_Method(str,__eq__) {
+	METHOD_TAKES_EXACTLY(1);
+	if (!IS_STRING(argv[1])) return NOTIMPL_VAL();
+	return BOOLEAN_VAL(krk_valuesEqual(argv[0], argv[1]));
 }
 
 KRK_Method(str,__len__) {
@@ -386,21 +387,16 @@ KRK_Method(str,__mul__) {
 	if (howMany < 0) howMany = 0;
 
 	size_t totalLength = self->length * howMany;
-	char * out = malloc(totalLength + 1);
+	char * out = ALLOCATE(char, totalLength + 1);
 	char * c = out;
 
-	uint32_t hash = 0;
-
 	for (krk_integer_type i = 0; i < howMany; ++i) {
-		for (size_t j = 0; j < self->length; ++j) {
-			*c = self->chars[j];
-			krk_hash_advance(hash, *c);
-			c++;
-		}
+		memcpy(c, self->chars, self->length);
+		c += self->length;
 	}
 
 	*c = '\0';
-	return OBJECT_VAL(krk_takeStringVetted(out, totalLength, self->codesLength * howMany, (self->obj.flags & KRK_OBJ_FLAGS_STRING_MASK), hash));
+	return OBJECT_VAL(krk_takeStringUninterned(out, totalLength, self->codesLength * howMany, (self->obj.flags & KRK_OBJ_FLAGS_STRING_MASK)));
 }
 
 KRK_Method(str,__rmul__) {
@@ -1077,9 +1073,14 @@ static void _freeStringBuilder(struct StringBuilder * sb) {
 	sb->capacity = 0;
 }
 KrkValue krk_finishStringBuilder(struct StringBuilder * sb) {
-	KrkValue out = OBJECT_VAL(krk_copyString(sb->bytes, sb->length));
-	_freeStringBuilder(sb);
-	return out;
+	/* The buffer becomes the new string, which is not interned. */
+	char * chars = GROW_ARRAY(char, sb->bytes, sb->capacity, sb->length + 1);
+	size_t length = sb->length;
+	chars[length] = '\0';
+	sb->bytes = NULL;
+	sb->length = 0;
+	sb->capacity = 0;
+	return OBJECT_VAL(krk_newUninternedString(chars, length));
 }
 
 KrkValue krk_finishStringBuilderBytes(struct StringBuilder * sb) {
@@ -1249,6 +1250,7 @@ void _createAndBind_strClass(void) {
 	BIND_METHOD(str,__iter__);
 	BIND_METHOD(str,__ord__);
 	BIND_METHOD(str,__int__);
+	BIND_METHOD(str,__eq__);
 	BIND_METHOD(str,__float__);
 	BIND_METHOD(str,__getitem__);
 	BIND_METHOD(str,__setitem__);
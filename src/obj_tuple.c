@@ -231,15 +231,17 @@ KRK_Method(tuple,__hash__) {
 	if (self->obj.flags & KRK_OBJ_FLAGS_VALID_HASH) {
 		return INTEGER_VAL(self->obj.hash);
 	}
-	uint32_t t = self->values.count;
-	uint32_t m = 0x3456;
+	/* Element hashes are combined the way xxHash combines lanes. */
+	uint32_t acc = 374761393U;
 	for (size_t i = 0; i < (size_t)self->values.count; ++i) {
-		uint32_t step = 0;
-		if (krk_hashValue(self->values.values[i], &step)) goto _unhashable;
-		t = (t ^ step) * m;
-		m += 2 * (self->values.count - i) + 82520;
+		uint32_t lane = 0;
+		if (krk_hashValue(self->values.values[i], &lane)) goto _unhashable;
+		acc += lane * 2246822519U;
+		acc = (acc << 13) | (acc >> 19);
+		acc *= 2654435761U;
 	}
-	self->obj.hash = t;
+	acc += self->values.count ^ (374761393U ^ 3527539U);
+	self->obj.hash = acc;
 	self->obj.flags |= KRK_OBJ_FLAGS_VALID_HASH;
 	return INTEGER_VAL(self->obj.hash);
 _unhashable:
@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <time.h>
 
 #include <kuroko/memory.h>
 #include <kuroko/object.h>
@@ -13,21 +14,190 @@
 #define ALLOCATE_OBJECT(type, objectType) \
 	(type*)allocateObject(sizeof(type), objectType)
 
+/**
+ * String table
+ *
+ * Strings up to KRK_STRING_INTERN_MAX bytes are interned, so every such
+ * string that is made is first looked up here. Longer strings, and strings
+ * built by joining or repeating others, are made without looking here and
+ * are interned later only if they are used as a key or an attribute name.
+ *
+ * The table is split into KRK_STRING_SHARDS shards by hash, each an
+ * open-addressed array of strings with its own lock. Lookups take no lock:
+ * a string is fully built before it is stored in a slot, and strings are
+ * only removed by the collector, while every other thread is stopped. A
+ * lookup that finds nothing takes the lock of its shard and looks again
+ * before adding a new string, so only threads making new strings with the
+ * same shard wait for each other.
+ *
+ * A shard that grows publishes its new array before its new capacity, so a
+ * reader never probes past the end of the array it loaded. Other threads may
+ * still be probing the old array, so it is kept until the next collection
+ * stops them.
+ */
+#ifndef KRK_STRING_SHARD_BITS
+#define KRK_STRING_SHARD_BITS 6
+#endif
+#define KRK_STRING_SHARDS (1 << KRK_STRING_SHARD_BITS)
+#ifndef KRK_STRING_INTERN_MAX
+#define KRK_STRING_INTERN_MAX 1024
+#endif
+#define TOMBSTONE ((KrkString*)1)
+
 #ifndef KRK_DISABLE_THREADS
-static volatile int _stringLock = 0;
-static volatile int _objectLock = 0;
+# define loadAcquire(ptr) __atomic_load_n(ptr, __ATOMIC_ACQUIRE)
+# define storeRelease(ptr,val) __atomic_store_n(ptr, val, __ATOMIC_RELEASE)
+#else
+# define loadAcquire(ptr) (*(ptr))
+# define storeRelease(ptr,val) (*(ptr) = (val))
 #endif
 
+struct RetiredStrings {
+	struct RetiredStrings * next;
+	KrkString ** entries;
+	size_t capacity;
+};
+
+static struct StringShard {
+	KrkString ** entries;
+	size_t capacity;
+	size_t count;   /**< Strings in the shard */
+	size_t used;    /**< Strings and tombstones */
+	struct RetiredStrings * retired;
+	volatile int lock;
+} __attribute__((aligned(64))) _strings[KRK_STRING_SHARDS];
+
+/* Allocations are made with a shard locked, so a thread must not stop for a collection while it holds one. */
+#define shardLock(shard)   do { (void)(shard); _obtain_lock((shard)->lock); krk_currentThread.heldLocks++; } while (0)
+#define shardUnlock(shard) do { krk_currentThread.heldLocks--; _release_lock((shard)->lock); } while (0)
+
+static inline struct StringShard * shardFor(uint32_t hash) {
+	/* Slots are picked by the low bits of the hash, so shards are picked by mixed high bits. */
+	return &_strings[(uint32_t)(hash * 0x9E3779B1U) >> (32 - KRK_STRING_SHARD_BITS)];
+}
+
+static KrkString * findInterned(const char * chars, size_t length, uint32_t hash) {
+	struct StringShard * shard = shardFor(hash);
+	size_t capacity = loadAcquire(&shard->capacity);
+	KrkString ** entries = loadAcquire(&shard->entries);
+	size_t index = hash & (capacity - 1);
+	for (size_t i = 0; i < capacity; ++i) {
+		KrkString * string = loadAcquire(&entries[index]);
+		if (!string) return NULL;
+		if (string != TOMBSTONE && string->obj.hash == hash && string->length == length &&
+		    memcmp(string->chars, chars, length) == 0) {
+			krk_gcFoundString(string);
+			return string;
+		}
+		index = (index + 1) & (capacity - 1);
+	}
+	return NULL;
+}
+
+static void shardResize(struct StringShard * shard) {
+	size_t capacity = shard->capacity < 8 ? 8 : shard->capacity;
+	if ((shard->count + 1) * 2 > capacity) capacity *= 2;
+
+	/* This can collect when no threads are running, which may remove strings from the old array. */
+	KrkString ** entries = ALLOCATE(KrkString*, capacity);
+	memset(entries, 0, sizeof(KrkString*) * capacity);
+	shard->used = 0;
+	for (size_t i = 0; i < shard->capacity; ++i) {
+		KrkString * string = shard->entries[i];
+		if (!string || string == TOMBSTONE) continue;
+		size_t index = string->obj.hash & (capacity - 1);
+		while (entries[index]) index = (index + 1) & (capacity - 1);
+		entries[index] = string;
+		shard->used++;
+	}
+
+	if (shard->entries && (vm.globalFlags & KRK_GLOBAL_THREADS)) {
+		struct RetiredStrings * retired = malloc(sizeof(struct RetiredStrings));
+		retired->next = shard->retired;
+		retired->entries = shard->entries;
+		retired->capacity = shard->capacity;
+		shard->retired = retired;
+	} else {
+		FREE_ARRAY(KrkString*, shard->entries, shard->capacity);
+	}
+	storeRelease(&shard->entries, entries);
+	storeRelease(&shard->capacity, capacity);
+}
+
+/* Called with the shard locked, after looking for the string again. */
+static void addInterned(struct StringShard * shard, KrkString * string) {
+	krk_push(OBJECT_VAL(string));
+	if ((shard->used + 1) * 4 > shard->capacity * 3) shardResize(shard);
+	krk_pop();
+	size_t index = string->obj.hash & (shard->capacity - 1);
+	while (shard->entries[index] && shard->entries[index] != TOMBSTONE) {
+		index = (index + 1) & (shard->capacity - 1);
+	}
+	if (!shard->entries[index]) shard->used++;
+	shard->count++;
+	storeRelease(&shard->entries[index], string);
+}
+
+void krk_internRemove(KrkString * string) {
+	if (string->obj.flags & KRK_OBJ_FLAGS_STRING_UNINTERNED) return;
+	struct StringShard * shard = shardFor(string->obj.hash);
+	if (!shard->count) return;
+	size_t index = string->obj.hash & (shard->capacity - 1);
+	while (shard->entries[index]) {
+		if (shard->entries[index] == string) {
+			shard->entries[index] = TOMBSTONE;
+			shard->count--;
+			return;
+		}
+		index = (index + 1) & (shard->capacity - 1);
+	}
+}
+
+void krk_internRemoveWhite(void) {
+	for (size_t i = 0; i < KRK_STRING_SHARDS; ++i) {
+		struct StringShard * shard = &_strings[i];
+		for (size_t j = 0; j < shard->capacity; ++j) {
+			KrkString * string = shard->entries[j];
+			if (!string || string == TOMBSTONE) continue;
+			if (!(string->obj.flags & KRK_OBJ_FLAGS_IS_MARKED)) {
+				shard->entries[j] = TOMBSTONE;
+				shard->count--;
+			}
+		}
+	}
+}
+
+void krk_internReclaim(void) {
+	for (size_t i = 0; i < KRK_STRING_SHARDS; ++i) {
+		struct StringShard * shard = &_strings[i];
+		while (shard->retired) {
+			struct RetiredStrings * retired = shard->retired;
+			shard->retired = retired->next;
+			FREE_ARRAY(KrkString*, retired->entries, retired->capacity);
+			free(retired);
+		}
+	}
+}
+
+void krk_internFree(void) {
+	krk_internReclaim();
+	for (size_t i = 0; i < KRK_STRING_SHARDS; ++i) {
+		struct StringShard * shard = &_strings[i];
+		FREE_ARRAY(KrkString*, shard->entries, shard->capacity);
+		shard->entries = NULL;
+		shard->capacity = 0;
+		shard->count = 0;
+		shard->used = 0;
+	}
+}
+
 static KrkObj * allocateObject(size_t size, KrkObjType type) {
-	KrkObj * object = (KrkObj*)krk_reallocate(NULL, 0, size);
+	KrkObj * object = (KrkObj*)krk_slabAllocate(size);
 	memset(object,0,size);
 	object->type = type;
 
-	_obtain_lock(_objectLock);
-	object->next = vm.objects;
 	krk_currentThread.scratchSpace[2] = OBJECT_VAL(object);
-	vm.objects = object;
-	_release_lock(_objectLock);
+	krk_gcAddObject(object);
 
 	object->hash = (uint32_t)((intptr_t)(object) >> 4 | ((intptr_t)object & 0xf) << 28);
 
@@ -112,8 +282,6 @@ static int checkString(const char * chars, size_t length, size_t *codepointCount
 			if (codepoint > maxCodepoint) maxCodepoint = codepoint;
 			(*codepointCount)++;
 		} else if (state == UTF8_REJECT) {
-			_release_lock(_stringLock);
-			krk_runtimeError(vm.exceptions->valueError, "Invalid UTF-8 sequence in string.");
 			*codepointCount = 0;
 			return -1;
 		}
@@ -171,44 +339,200 @@ uint32_t krk_unicodeCodepoint(KrkString * string, size_t index) {
 	}
 }
 
+static KrkString * newString(char * chars, size_t length, size_t codesLength, int type) {
+	KrkString * string = ALLOCATE_OBJECT(KrkString, KRK_OBJ_STRING);
+	string->length = length;
+	string->chars = chars;
+	string->obj.flags |= type;
+	string->codesLength = codesLength;
+	string->codes = NULL;
+	if (type == KRK_OBJ_FLAGS_STRING_ASCII) string->codes = string->chars;
+	return string;
+}
+
+/* Called with the shard for @p hash locked; unlocks it. */
 static KrkString * allocateString(char * chars, size_t length, uint32_t hash) {
+	struct StringShard * shard = shardFor(hash);
 	size_t codesLength = 0;
 	int type = checkString(chars,length,&codesLength);
 	if (type == -1) {
+		shardUnlock(shard);
+		krk_runtimeError(vm.exceptions->valueError, "Invalid UTF-8 sequence in string.");
 		return krk_copyString("",0);
 	}
-	KrkString * string = ALLOCATE_OBJECT(KrkString, KRK_OBJ_STRING);
-	string->length = length;
-	string->chars = chars;
+	KrkString * string = newString(chars, length, codesLength, type);
 	string->obj.hash = hash;
-	string->obj.flags |= KRK_OBJ_FLAGS_VALID_HASH | type;
-	string->codesLength = codesLength;
-	string->codes = NULL;
-	if (type == KRK_OBJ_FLAGS_STRING_ASCII) string->codes = string->chars;
-	krk_push(OBJECT_VAL(string));
-	krk_tableSet(&vm.strings, OBJECT_VAL(string), NONE_VAL());
-	krk_pop();
-	_release_lock(_stringLock);
+	string->obj.flags |= KRK_OBJ_FLAGS_VALID_HASH;
+	addInterned(shard, string);
+	shardUnlock(shard);
 	return string;
 }
 
-static uint32_t hashString(const char * key, size_t length) {
-	uint32_t hash = 0;
-	/* This is the so-called "sdbm" hash. It comes from a piece of
-	 * public domain code from a clone of ndbm. */
-	for (size_t i = 0; i < length; ++i) {
-		krk_hash_advance(hash,key[i]);
+/**
+ * Hashing
+ *
+ * Strings and bytes are hashed with SipHash-1-3, eight bytes per round,
+ * under a key picked when the VM starts, and numbers are run through a
+ * mixer that uses the same key. Which keys collide in a table can then
+ * not be worked out from outside the process, so a table can not be
+ * filled with colliding keys on purpose. Embedders that need repeatable
+ * hashes can pick the key with krk_setHashSeed before krk_initVM.
+ */
+uint64_t krk_hashKey[2];
+static int hashKeyFixed = 0;
+
+static uint64_t splitmix64(uint64_t * state) {
+	uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
+
+void krk_setHashSeed(uint64_t seed) {
+	krk_hashKey[0] = splitmix64(&seed);
+	krk_hashKey[1] = splitmix64(&seed);
+	hashKeyFixed = 1;
+}
+
+void krk_initHashKey(void) {
+	if (hashKeyFixed) return;
+	uint64_t seed = 0;
+	FILE * f = fopen("/dev/urandom", "rb");
+	if (f) {
+		if (fread(&seed, sizeof(seed), 1, f) != 1) seed = 0;
+		fclose(f);
+	}
+	/* Without a random source, make do with the time and where we were loaded. */
+	seed ^= (uint64_t)time(NULL) ^ ((uint64_t)clock() << 32) ^ (uint64_t)(uintptr_t)&hashKeyFixed;
+	krk_hashKey[0] = splitmix64(&seed);
+	krk_hashKey[1] = splitmix64(&seed);
+}
+
+#define ROTL64(x,b) (uint64_t)(((x) << (b)) | ((x) >> (64 - (b))))
+#define SIPROUND do { \
+	v0 += v1; v1 = ROTL64(v1,13); v1 ^= v0; v0 = ROTL64(v0,32); \
+	v2 += v3; v3 = ROTL64(v3,16); v3 ^= v2; \
+	v0 += v3; v3 = ROTL64(v3,21); v3 ^= v0; \
+	v2 += v1; v1 = ROTL64(v1,17); v1 ^= v2; v2 = ROTL64(v2,32); \
+} while (0)
+
+uint32_t krk_hashBytes(const void * bytes, size_t length) {
+	uint64_t v0 = 0x736f6d6570736575ULL ^ krk_hashKey[0];
+	uint64_t v1 = 0x646f72616e646f6dULL ^ krk_hashKey[1];
+	uint64_t v2 = 0x6c7967656e657261ULL ^ krk_hashKey[0];
+	uint64_t v3 = 0x7465646279746573ULL ^ krk_hashKey[1];
+	const uint8_t * in = bytes;
+	const uint8_t * end = in + (length & ~(size_t)7);
+
+	for (; in != end; in += 8) {
+		uint64_t m;
+		memcpy(&m, in, sizeof(m));
+		v3 ^= m;
+		SIPROUND;
+		v0 ^= m;
+	}
+
+	uint64_t last = (uint64_t)length << 56;
+	switch (length & 7) {
+		case 7: last |= (uint64_t)in[6] << 48; /* fallthrough */
+		case 6: last |= (uint64_t)in[5] << 40; /* fallthrough */
+		case 5: last |= (uint64_t)in[4] << 32; /* fallthrough */
+		case 4: last |= (uint64_t)in[3] << 24; /* fallthrough */
+		case 3: last |= (uint64_t)in[2] << 16; /* fallthrough */
+		case 2: last |= (uint64_t)in[1] << 8;  /* fallthrough */
+		case 1: last |= (uint64_t)in[0];
+	}
+	v3 ^= last;
+	SIPROUND;
+	v0 ^= last;
+
+	v2 ^= 0xff;
+	SIPROUND;
+	SIPROUND;
+	SIPROUND;
+	uint64_t hash = v0 ^ v1 ^ v2 ^ v3;
+	return (uint32_t)(hash ^ (hash >> 32));
+}
+
+#ifndef KRK_NO_FLOAT
+uint32_t krk_hashFloat(double value) {
+	/* Floats equal to an integer must hash like that integer. */
+	if (value >= -9.2e18 && value <= 9.2e18 && value == (double)(int64_t)value) {
+		return krk_hashInteger((int64_t)value);
+	}
+	uint64_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	return krk_hashInteger((int64_t)bits);
+}
+#endif
+
+static inline uint32_t hashString(const char * key, size_t length) {
+	return krk_hashBytes(key, length);
+}
+
+/* Look for a string, then take the lock of its shard and look again if it wasn't found. */
+static KrkString * findOrLock(const char * chars, size_t length, uint32_t hash) {
+	KrkString * interned = findInterned(chars, length, hash);
+	if (interned) return interned;
+	struct StringShard * shard = shardFor(hash);
+	shardLock(shard);
+	interned = findInterned(chars, length, hash);
+	if (interned) shardUnlock(shard);
+	return interned;
+}
+
+KrkString * krk_takeStringUninterned(char * chars, size_t length, size_t codesLength, KrkStringType type) {
+	KrkString * string = newString(chars, length, codesLength, type);
+	string->obj.flags |= KRK_OBJ_FLAGS_STRING_UNINTERNED;
+	return string;
+}
+
+KrkString * krk_newUninternedString(char * chars, size_t length) {
+	size_t codesLength = 0;
+	int type = checkString(chars,length,&codesLength);
+	if (type == -1) {
+		FREE_ARRAY(char, chars, length + 1);
+		krk_runtimeError(vm.exceptions->valueError, "Invalid UTF-8 sequence in string.");
+		return krk_copyString("",0);
+	}
+	return krk_takeStringUninterned(chars, length, codesLength, type);
+}
+
+uint32_t krk_stringHash(KrkString * string) {
+	if (!(string->obj.flags & KRK_OBJ_FLAGS_VALID_HASH)) {
+		string->obj.hash = hashString(string->chars, string->length);
+		string->obj.flags |= KRK_OBJ_FLAGS_VALID_HASH;
 	}
-	return hash;
+	return string->obj.hash;
+}
+
+KrkString * krk_internedString(KrkString * string) {
+	if (!(string->obj.flags & KRK_OBJ_FLAGS_STRING_UNINTERNED)) return string;
+	return findInterned(string->chars, string->length, krk_stringHash(string));
+}
+
+KrkString * krk_internString(KrkString * string) {
+	if (!(string->obj.flags & KRK_OBJ_FLAGS_STRING_UNINTERNED)) return string;
+	uint32_t hash = krk_stringHash(string);
+	KrkString * interned = findOrLock(string->chars, string->length, hash);
+	if (interned) return interned;
+	struct StringShard * shard = shardFor(hash);
+	string->obj.flags &= ~KRK_OBJ_FLAGS_STRING_UNINTERNED;
+	addInterned(shard, string);
+	shardUnlock(shard);
+	return string;
 }
 
 KrkString * krk_takeString(char * chars, size_t length) {
+	if (length > KRK_STRING_INTERN_MAX) {
+		krk_gcTakeBytes(chars, length + 1);
+		return krk_newUninternedString(chars, length);
+	}
+
 	uint32_t hash = hashString(chars, length);
-	_obtain_lock(_stringLock);
-	KrkString * interned = krk_tableFindString(&vm.strings, chars, length, hash);
+	KrkString * interned = findOrLock(chars, length, hash);
 	if (interned != NULL) {
 		free(chars); /* This string isn't owned by us yet, so free, not FREE_ARRAY */
-		_release_lock(_stringLock);
 		return interned;
 	}
 
@@ -219,11 +543,16 @@ KrkString * krk_takeString(char * chars, size_t length) {
 }
 
 KrkString * krk_copyString(const char * chars, size_t length) {
+	if (length > KRK_STRING_INTERN_MAX) {
+		char * heapChars = ALLOCATE(char, length + 1);
+		memcpy(heapChars, chars, length);
+		heapChars[length] = '\0';
+		return krk_newUninternedString(heapChars, length);
+	}
+
 	uint32_t hash = hashString(chars, length);
-	_obtain_lock(_stringLock);
-	KrkString * interned = krk_tableFindString(&vm.strings, chars ? chars : "", length, hash);
+	KrkString * interned = findOrLock(chars ? chars : "", length, hash);
 	if (interned) {
-		_release_lock(_stringLock);
 		return interned;
 	}
 	char * heapChars = ALLOCATE(char, length + 1);
@@ -231,30 +560,28 @@ KrkString * krk_copyString(const char * chars, size_t length) {
 	heapChars[length] = '\0';
 	KrkString * result = allocateString(heapChars, length, hash);
 	if (result->chars != heapChars) free(heapChars);
-	_release_lock(_stringLock);
 	return result;
 }
 
 KrkString * krk_takeStringVetted(char * chars, size_t length, size_t codesLength, KrkStringType type, uint32_t hash) {
-	_obtain_lock(_stringLock);
-	KrkString * interned = krk_tableFindString(&vm.strings, chars, length, hash);
+	if (length > KRK_STRING_INTERN_MAX) {
+		KrkString * string = krk_takeStringUninterned(chars, length, codesLength, type);
+		string->obj.hash = hash;
+		string->obj.flags |= KRK_OBJ_FLAGS_VALID_HASH;
+		return string;
+	}
+
+	KrkString * interned = findOrLock(chars, length, hash);
 	if (interned != NULL) {
 		FREE_ARRAY(char, chars, length + 1);
-		_release_lock(_stringLock);
 		return interned;
 	}
-	KrkString * string = ALLOCATE_OBJECT(KrkString, KRK_OBJ_STRING);
-	string->length = length;
-	string->chars = chars;
+	struct StringShard * shard = shardFor(hash);
+	KrkString * string = newString(chars, length, codesLength, type);
 	string->obj.hash = hash;
-	string->obj.flags |= KRK_OBJ_FLAGS_VALID_HASH | type;
-	string->codesLength = codesLength;
-	string->codes = NULL;
-	if (type == KRK_OBJ_FLAGS_STRING_ASCII) string->codes = string->chars;
-	krk_push(OBJECT_VAL(string));
-	krk_tableSet(&vm.strings, OBJECT_VAL(string), NONE_VAL());
-	krk_pop();
-	_release_lock(_stringLock);
+	string->obj.flags |= KRK_OBJ_FLAGS_VALID_HASH;
+	addInterned(shard, string);
+	shardUnlock(shard);
 	return string;
 }
 
@@ -268,6 +595,9 @@ KrkCodeObject * krk_newCodeObject(void) {
 	codeobject->docstring = NULL;
 	codeobject->localNameCount = 0;
 	codeobject->localNames = NULL;
+	codeobject->cacheCount = 0;
+	codeobject->caches = NULL;
+	codeobject->counters = NULL;
 	krk_initValueArray(&codeobject->positionalArgNames);
 	krk_initValueArray(&codeobject->keywordArgNames);
 	krk_initChunk(&codeobject->chunk);
@@ -292,7 +622,13 @@ KrkClosure * krk_newClosure(KrkCodeObject * function, KrkValue globals) {
 	closure->function = function;
 	closure->upvalues = upvalues;
 	closure->upvalueCount = function->upvalueCount;
+	closure->annotations = NONE_VAL();
+	closure->globalsOwner = NONE_VAL();
+	closure->globalsTable = NULL;
+	krk_initTable(&closure->fields);
+	krk_push(OBJECT_VAL(closure));
 	closure->annotations = krk_dict_of(0,NULL,0);
+	krk_pop();
 	closure->globalsOwner = globals;
 	if (IS_INSTANCE(globals)) {
 		if (AS_INSTANCE(globals)->_class == vm.baseClasses->dictClass) {
@@ -304,7 +640,6 @@ KrkClosure * krk_newClosure(KrkCodeObject * function, KrkValue globals) {
 		fprintf(stderr, "Invalid globals context: %s\n", krk_typeName(globals));
 		abort();
 	}
-	krk_initTable(&closure->fields);
 	return closure;
 }
 
@@ -313,7 +648,8 @@ KrkUpvalue * krk_newUpvalue(int slot) {
 	upvalue->location = slot;
 	upvalue->next = NULL;
 	upvalue->closed = NONE_VAL();
-	upvalue->owner = &krk_currentThread;
+	upvalue->stack = krk_currentThread.stackHome;
+	upvalue->segmentOwner = krk_currentThread.stackOwner;
 	return upvalue;
 }
 
@@ -339,7 +675,7 @@ KrkClass * krk_newClass(KrkString * name, KrkClass * baseClass) {
 KrkInstance * krk_newInstance(KrkClass * _class) {
 	KrkInstance * instance = (KrkInstance*)allocateObject(_class->allocSize, KRK_OBJ_INSTANCE);
 	instance->_class = _class;
-	krk_initTable(&instance->fields);
+	krk_initShapedTable(&instance->fields);
 	return instance;
 }
 
@@ -0,0 +1,23 @@
+/**
+ * @brief Jump table for threaded dispatch
+ *
+ * Expands to designated initializers mapping each opcode to the address of its
+ * handler label in the interpreter loop, for builds with KRK_THREADED_DISPATCH.
+ * Every opcode needs a matching TARGET() in run(). Unused values are left NULL,
+ * just as they have no case in the switch.
+ */
+#define OPCODE(opc)         [opc] = &&_op_ ## opc,
+#define SIMPLE(opc)         OPCODE(opc)
+#define OPERANDB(opc,more)  OPCODE(opc)
+#define LOCALS(opc)         OPCODE(opc)
+#define CONSTANT(opc,more)  OPCODE(opc) OPCODE(opc ## _LONG)
+#define OPERAND(opc,more)   OPCODE(opc) OPCODE(opc ## _LONG)
+#define JUMP(opc,sign)      OPCODE(opc)
+#include "opcodes.h"
+#undef SIMPLE
+#undef OPERANDB
+#undef LOCALS
+#undef OPERAND
+#undef CONSTANT
+#undef JUMP
+#undef OPCODE
@@ -18,10 +18,25 @@
  * it is recommended that this property remain true.
  *
  * 2-operand opcodes are generally jump instructions.
+ *
+ * 1-operand opcodes without a long form (OPERANDB) and the simple opcodes after
+ * them are superinstructions. The compiler writes them over the first
+ * instruction of a run it fuses, and they read the rest of the run in place.
+ *
+ * LOCALS opcodes take two 1-byte local slot operands and operate on those
+ * locals directly instead of on values pushed to the stack. The ones with
+ * a suffix are again superinstructions, fused with what follows them.
+ *
+ * The simple opcodes at the end of the table, named for the types they
+ * expect, are never emitted by the compiler. The interpreter writes them
+ * over generic instructions that keep seeing those types, and writes the
+ * generic instruction back if the types change.
  */
 typedef enum {
 #define OPCODE(opc)         opc,
 #define SIMPLE(opc)         OPCODE(opc)
+#define OPERANDB(opc,more)  OPCODE(opc)
+#define LOCALS(opc)         OPCODE(opc)
 #define CONSTANT(opc,more)  OPCODE(opc) OPCODE(opc ## _LONG)
 #define OPERAND(opc,more)   OPCODE(opc) OPCODE(opc ## _LONG)
 #define JUMP(opc,sign)      OPCODE(opc)
@@ -29,14 +44,17 @@ typedef enum {
 #define EXPAND_ARGS_MORE
 #define FORMAT_VALUE_MORE
 #define LOCAL_MORE
+#define CACHE_MORE
 #include "opcodes.h"
 #undef SIMPLE
 #undef OPERANDB
+#undef LOCALS
 #undef OPERAND
 #undef CONSTANT
 #undef JUMP
 #undef CLOSURE_MORE
 #undef LOCAL_MORE
+#undef CACHE_MORE
 #undef EXPAND_ARGS_MORE
 #undef FORMAT_VALUE_MORE
 #undef OPCODE
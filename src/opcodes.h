@@ -29,7 +29,7 @@ SIMPLE(OP_ADD)
 SIMPLE(OP_SUBTRACT)
 OPERAND(OP_CALL_METHOD, NOOP)
 SIMPLE(OP_BREAKPOINT)
-CONSTANT(OP_GET_GLOBAL,NOOP)
+CONSTANT(OP_GET_GLOBAL,CACHE_MORE)
 OPERAND(OP_SET_LOCAL_POP, LOCAL_MORE)
 SIMPLE(OP_NEGATE)
 SIMPLE(OP_INVOKE_ITER)
@@ -77,7 +77,7 @@ JUMP(OP_PUSH_WITH,+)
 SIMPLE(OP_GREATER_EQUAL)
 CONSTANT(OP_SET_NAME, NOOP)
 SIMPLE(OP_INPLACE_ADD)
-CONSTANT(OP_GET_METHOD, NOOP)
+CONSTANT(OP_GET_METHOD, CACHE_MORE)
 CONSTANT(OP_GET_NAME, NOOP)
 SIMPLE(OP_LESS_EQUAL)
 SIMPLE(OP_END_FINALLY)
@@ -90,7 +90,7 @@ CONSTANT(OP_DEL_GLOBAL,NOOP)
 SIMPLE(OP_INPLACE_SHIFTRIGHT)
 OPERAND(OP_UNPACK, NOOP)
 OPERAND(OP_REVERSE, NOOP)
-CONSTANT(OP_GET_PROPERTY, NOOP)
+CONSTANT(OP_GET_PROPERTY, CACHE_MORE)
 SIMPLE(OP_GREATER)
 SIMPLE(OP_FALSE)
 SIMPLE(OP_FLOORDIV)
@@ -120,3 +120,35 @@ SIMPLE(OP_SET_ADD_TOP)
 SIMPLE(OP_TUPLE_FROM_LIST)
 
 OPERAND(OP_UNPACK_EX,NOOP)
+
+OPERANDB(OP_GET_LOCAL_GET_LOCAL, LOCAL_MORE)
+OPERANDB(OP_GET_LOCAL_CONSTANT, LOCAL_MORE)
+OPERANDB(OP_GET_LOCAL_CONSTANT_COMPARE_JUMP, LOCAL_MORE)
+SIMPLE(OP_ADD_SET_LOCAL_POP)
+SIMPLE(OP_SUBTRACT_SET_LOCAL_POP)
+SIMPLE(OP_INPLACE_ADD_SET_LOCAL_POP)
+SIMPLE(OP_INPLACE_SUBTRACT_SET_LOCAL_POP)
+
+LOCALS(OP_ADD_LOCALS)
+LOCALS(OP_SUBTRACT_LOCALS)
+LOCALS(OP_MULTIPLY_LOCALS)
+LOCALS(OP_LESS_LOCALS)
+LOCALS(OP_LESS_EQUAL_LOCALS)
+LOCALS(OP_GREATER_LOCALS)
+LOCALS(OP_GREATER_EQUAL_LOCALS)
+LOCALS(OP_EQUAL_LOCALS)
+LOCALS(OP_ADD_LOCALS_SET_LOCAL_POP)
+LOCALS(OP_SUBTRACT_LOCALS_SET_LOCAL_POP)
+LOCALS(OP_MULTIPLY_LOCALS_SET_LOCAL_POP)
+LOCALS(OP_LESS_LOCALS_JUMP)
+LOCALS(OP_LESS_EQUAL_LOCALS_JUMP)
+LOCALS(OP_GREATER_LOCALS_JUMP)
+LOCALS(OP_GREATER_EQUAL_LOCALS_JUMP)
+LOCALS(OP_EQUAL_LOCALS_JUMP)
+
+SIMPLE(OP_ADD_FLOAT)
+SIMPLE(OP_SUBTRACT_FLOAT)
+SIMPLE(OP_MULTIPLY_FLOAT)
+SIMPLE(OP_ADD_STR)
+SIMPLE(OP_INVOKE_GETTER_LIST_INT)
+SIMPLE(OP_INVOKE_GETTER_DICT_STR)
@@ -18,6 +18,7 @@
 #include <kuroko/vm.h>
 #include <kuroko/value.h>
 #include <kuroko/object.h>
+#include <kuroko/memory.h>
 #include <kuroko/util.h>
 
 /* Did you know this is actually specified to not exist in a header? */
@@ -187,7 +188,10 @@ static void _loadEnviron(KrkInstance * module) {
 KRK_Function(system) {
 	const char * cmd;
 	if (!krk_parseArgs("s",(const char*[]){"command"},&cmd)) return NONE_VAL();
-	return INTEGER_VAL(system(cmd));
+	krk_gcBlockingBegin();
+	int result = system(cmd);
+	krk_gcBlockingEnd();
+	return INTEGER_VAL(result);
 }
 
 KRK_Function(getcwd) {
@@ -332,7 +336,9 @@ KRK_Function(read) {
 	if (!krk_parseArgs("in",(const char*[]){"fd","count"}, &fd, &count)) return NONE_VAL();
 
 	uint8_t * tmp = malloc(count);
+	krk_gcBlockingBegin();
 	ssize_t result = read(fd,tmp,count);
+	krk_gcBlockingEnd();
 	if (result == -1) {
 		free(tmp);
 		return krk_runtimeError(KRK_EXC(OSError), "%s", strerror(errno));
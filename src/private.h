@@ -6,6 +6,7 @@
  * They are used internally by the interpreter library.
  */
 #include "kuroko/kuroko.h"
+#include "kuroko/table.h"
 
 extern void _createAndBind_numericClasses(void);
 extern void _createAndBind_strClass(void);
@@ -63,7 +64,239 @@ struct ParsedFormatSpec {
 	int fillSize;
 };
 
-/* We inline hashing in a few places, so it's nice to have this in one place.
- * This is the "sdbm" hash. I've been using it in various places for many years,
- * and this specific version apparently traces to gawk. */
-#define krk_hash_advance(hash,c) do { hash = (int)(c) + (hash << 6) + (hash << 16) - hash; } while (0)
+/**
+ * @brief Key for hashing strings, bytes and numbers; see krk_setHashSeed.
+ */
+extern uint64_t krk_hashKey[2];
+
+/**
+ * @brief Pick a random hash key, unless one was set with krk_setHashSeed.
+ */
+extern void krk_initHashKey(void);
+
+/**
+ * @brief Hash a sequence of bytes, as for a @c str or @c bytes with that content.
+ */
+extern uint32_t krk_hashBytes(const void * bytes, size_t length);
+
+/**
+ * @brief Hash an integer.
+ *
+ * Every numeric type hashes values equal to an integer with this, so
+ * that equal numbers hash alike whatever their type.
+ */
+static inline uint32_t krk_hashInteger(int64_t value) {
+	uint64_t x = (uint64_t)value ^ krk_hashKey[0];
+	x = (x ^ (x >> 33)) * 0xFF51AFD7ED558CCDULL;
+	x = (x ^ (x >> 33)) * 0xC4CEB9FE1A85EC53ULL;
+	return (uint32_t)(x ^ (x >> 33));
+}
+
+#ifndef KRK_NO_FLOAT
+/**
+ * @brief Hash a float, like the integer it is equal to if there is one.
+ */
+extern uint32_t krk_hashFloat(double value);
+#endif
+
+
+/**
+ * @brief Shared key layout for shaped tables.
+ *
+ * Shapes form a transition tree rooted at an empty shape. A shape
+ * describes the keys of every table that reached it by adding the
+ * same keys in the same order; the key added by the transition from
+ * the parent is stored in slot @c count-1 of the table's values.
+ */
+typedef struct KrkShape {
+	struct KrkShape * parent;    /**< @brief Shape this one was reached from, NULL for the root */
+	struct KrkShape ** children; /**< @brief Shapes reached from this one by adding a key */
+	size_t childCount;           /**< @brief Number of entries in @c children */
+	size_t childCapacity;        /**< @brief Allocated size of @c children */
+	struct KrkString * key;      /**< @brief Key added by the transition from @c parent */
+	size_t count;                /**< @brief Number of keys (and value slots) in this shape */
+	size_t id;                   /**< @brief Unique identifier, never reused; used by inline caches */
+	size_t refs;                 /**< @brief Number of tables currently using this shape */
+	KrkTable lookup;             /**< @brief Key to slot index map, only built for larger shapes */
+} KrkShape;
+
+/**
+ * @brief Current version of a table, without starting to track it.
+ *
+ * Returns 0 for an ordinary hash table that has never had
+ * @ref krk_tableVersion called on it, which never matches a
+ * version recorded by a cache.
+ */
+static inline size_t krk_tableCurrentVersion(KrkTable * table) {
+	return table->shape ? table->shape->id : table->version;
+}
+
+/**
+ * @brief Mark the keys of all live shapes; called from markRoots.
+ */
+extern void krk_markShapes(void);
+
+/**
+ * @brief Release shapes no longer used by any table; called after sweeping.
+ */
+extern void krk_sweepShapes(void);
+
+/**
+ * @brief Release all shapes at VM teardown.
+ */
+extern void krk_freeShapes(void);
+
+/**
+ * Locks on lists may be held by threads that are stopped for a collection,
+ * so waiting for one that is taken counts as a blocking call.
+ */
+#ifndef KRK_DISABLE_THREADS
+#define _obtain_read_lock(l)  do { if (pthread_rwlock_tryrdlock(l)) { krk_gcBlockingBegin(); pthread_rwlock_rdlock(l); krk_gcBlockingEnd(); } } while (0)
+#define _obtain_write_lock(l) do { if (pthread_rwlock_trywrlock(l)) { krk_gcBlockingBegin(); pthread_rwlock_wrlock(l); krk_gcBlockingEnd(); } } while (0)
+#else
+#define _obtain_read_lock(l)  ((void)0)
+#define _obtain_write_lock(l) ((void)0)
+#endif
+
+/**
+ * Dicts and sets are locked only by writers, and only while threads are running.
+ */
+#ifndef KRK_DISABLE_THREADS
+extern void krk_tableLock(KrkTableLock * lock);
+extern void krk_tableUnlock(KrkTableLock * lock);
+#define _obtain_table_lock(l)  do { if (vm.globalFlags & KRK_GLOBAL_THREADS) krk_tableLock(l); } while (0)
+#define _release_table_lock(l) do { if (vm.globalFlags & KRK_GLOBAL_THREADS) krk_tableUnlock(l); } while (0)
+#else
+#define _obtain_table_lock(l)  ((void)0)
+#define _release_table_lock(l) ((void)0)
+#endif
+
+/**
+ * @brief Free table entries that other threads may have been reading
+ *        when they were replaced. Called once the world is stopped.
+ */
+extern void krk_tableReclaim(void);
+
+/**
+ * @brief Release the bytecode images that loaded code objects point into.
+ *        Called when the VM is freed, after all objects are.
+ */
+extern void krk_freeBytecodeImages(void);
+
+/**
+ * @brief Check the bytecode of a code object loaded from an image before it first runs.
+ *
+ * If the bytecode is damaged, it is replaced with freshly compiled bytecode
+ * from the source file. If that is not possible, an exception is raised.
+ *
+ * @return 1 if the code object can be run, 0 if an exception was raised.
+ */
+extern int krk_verifyBytecode(KrkCodeObject * code);
+
+/**
+ * @brief Add the current thread to the VM's thread list; called when a thread starts.
+ *
+ * Waits for any collection in progress, so a new thread never runs while the world is stopped.
+ */
+extern void krk_gcAttachThread(void);
+
+/**
+ * @brief Remove the current thread from the VM's thread list; called when a thread exits.
+ *
+ * Frees the thread's stack, and hands the objects and bytes it has allocated over to the VM.
+ */
+extern void krk_gcDetachThread(void);
+
+/**
+ * @brief Give the current thread's free object slots to the shared pool; called when a thread exits.
+ */
+extern void krk_slabReleaseThread(void);
+
+/**
+ * @brief Add a new object to the current thread's list of objects allocated since the last collection.
+ */
+extern void krk_gcAddObject(KrkObj * object);
+
+/**
+ * @brief Called when a lookup in the string table returns @p string, so that a lazy sweep keeps it.
+ */
+extern void krk_gcFoundString(KrkString * string);
+
+/**
+ * @brief Remove a string that is about to be freed from the string table.
+ *
+ * Only called by the collector, while no other thread is running.
+ */
+extern void krk_internRemove(KrkString * string);
+
+/**
+ * @brief Remove every string that was not marked from the string table.
+ */
+extern void krk_internRemoveWhite(void);
+
+/**
+ * @brief Free string table arrays that other threads may have been reading
+ *        when they were replaced. Called once the world is stopped.
+ */
+extern void krk_internReclaim(void);
+
+/**
+ * @brief Free the string table at VM teardown.
+ */
+extern void krk_internFree(void);
+
+/**
+ * @brief Make an uninterned string from @p chars, which must be allocated
+ *        with @c ALLOCATE, checking that it is valid UTF-8.
+ *
+ * On failure @p chars is freed and a @c ValueError is raised.
+ */
+extern KrkString * krk_newUninternedString(char * chars, size_t length);
+
+/**
+ * @brief Get the hash of a string, computing it if it is uninterned and
+ *        has not been hashed yet.
+ */
+extern uint32_t krk_stringHash(KrkString * string);
+
+/**
+ * @brief Get the interned string with the same contents as @p string
+ *        without interning it, or NULL if there is none.
+ */
+extern KrkString * krk_internedString(KrkString * string);
+
+/**
+ * @brief Release all slab chunks at VM teardown, after all objects are freed.
+ */
+extern void krk_freeSlabs(void);
+
+/**
+ * @brief Get counts of quickened instructions.
+ *
+ * Returns a dict mapping the name of each specialized opcode to a tuple of
+ * how many times an instruction was rewritten to it, and how many times
+ * it was rewritten back to the generic instruction.
+ */
+extern KrkValue krk_quickeningStats(void);
+
+/**
+ * @brief Record the current thread's call stack for the sampling profiler.
+ *
+ * Called from the interpreter loop when @c KRK_THREAD_PROFILE_SAMPLE is set.
+ */
+extern void krk_profilerSample(void);
+
+/**
+ * @brief Mark the code objects in recorded profiler samples; called from markRoots.
+ */
+extern void krk_markProfilerSamples(void);
+
+/**
+ * @brief Find the stack segment a call frame of the current thread runs on.
+ *
+ * Frames of running generators use the generator's own stack segment,
+ * and the frames that resumed them use the segments set aside for it.
+ *
+ * @param frame Index of the frame in the current thread's frame stack.
+ */
+extern KrkValue * krk_stackOfFrame(size_t frame);
@@ -0,0 +1,309 @@
+/**
+ * @file profiler.c
+ * @brief Sampling profiler.
+ *
+ * While the profiler is running, a CPU-time interval timer raises SIGPROF,
+ * and the handler flags whichever thread received it. The interpreter loop
+ * of a flagged thread checks the flag before its next instruction and
+ * records the code objects of its call frames into a ring buffer allocated
+ * when the profiler is started. The oldest samples are overwritten once the
+ * buffer is full.
+ *
+ * Samples can be turned into "collapsed stack" text, one line per distinct
+ * stack with frames separated by semicolons and followed by a count, which
+ * is the input format of most flame graph tools.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/time.h>
+
+#include <kuroko/vm.h>
+#include <kuroko/value.h>
+#include <kuroko/object.h>
+#include <kuroko/util.h>
+
+#include "private.h"
+
+#if !defined(_WIN32) && !defined(KRK_NO_SYSTEM_MODULES)
+
+/** Innermost frames kept per sample; deeper stacks are truncated at the root. */
+#define PROFILER_MAX_DEPTH 48
+
+struct ProfilerSample {
+	KrkThreadState * thread;
+	size_t depth;
+	int truncated;
+	KrkCodeObject * frames[PROFILER_MAX_DEPTH];
+};
+
+/** Samples copied out by @c dump, which must stay marked until it is done with them. */
+struct ProfilerCopy {
+	struct ProfilerSample * samples;
+	size_t count;
+	struct ProfilerCopy * next;
+};
+
+static struct {
+	int running;
+	size_t capacity;                 /**< Size of @c samples */
+	size_t count;                    /**< Samples recorded since the profiler was started */
+	struct ProfilerSample * samples; /**< Ring buffer, written at count % capacity */
+	struct ProfilerCopy * copies;    /**< Copies still being read by @c dump */
+	struct sigaction oldAction;
+} profiler;
+
+static volatile int _profilerLock = 0;
+
+static void handleSigprof(int sigNum) {
+	krk_currentThread.flags |= KRK_THREAD_PROFILE_SAMPLE;
+}
+
+void krk_profilerSample(void) {
+	_obtain_lock(_profilerLock);
+	if (profiler.running && krk_currentThread.frameCount) {
+		struct ProfilerSample * sample = &profiler.samples[profiler.count % profiler.capacity];
+		size_t first = 0;
+		if (krk_currentThread.frameCount > PROFILER_MAX_DEPTH) {
+			first = krk_currentThread.frameCount - PROFILER_MAX_DEPTH;
+		}
+		sample->thread = &krk_currentThread;
+		sample->depth = krk_currentThread.frameCount - first;
+		sample->truncated = first != 0;
+		for (size_t i = 0; i < sample->depth; ++i) {
+			sample->frames[i] = krk_currentThread.frames[first + i].closure->function;
+		}
+		profiler.count++;
+	}
+	_release_lock(_profilerLock);
+}
+
+static void markSamples(struct ProfilerSample * samples, size_t count) {
+	for (size_t i = 0; i < count; ++i) {
+		for (size_t j = 0; j < samples[i].depth; ++j) {
+			krk_markObject((KrkObj*)samples[i].frames[j]);
+		}
+	}
+}
+
+void krk_markProfilerSamples(void) {
+	if (profiler.samples) {
+		markSamples(profiler.samples, profiler.count < profiler.capacity ? profiler.count : profiler.capacity);
+	}
+	for (struct ProfilerCopy * copy = profiler.copies; copy; copy = copy->next) {
+		markSamples(copy->samples, copy->count);
+	}
+}
+
+static int setTimer(double interval) {
+	struct itimerval timer = {0};
+	timer.it_interval.tv_sec  = (time_t)interval;
+	timer.it_interval.tv_usec = (suseconds_t)((interval - (double)timer.it_interval.tv_sec) * 1000000.0);
+	timer.it_value = timer.it_interval;
+	return setitimer(ITIMER_PROF, &timer, NULL);
+}
+
+static void stopProfiler(void) {
+	if (!profiler.running) return;
+	setTimer(0);
+	sigaction(SIGPROF, &profiler.oldAction, NULL);
+	_obtain_lock(_profilerLock);
+	profiler.running = 0;
+	_release_lock(_profilerLock);
+}
+
+KRK_Function(start) {
+	double interval = 0.001;
+	size_t samples = 8192;
+	if (!krk_parseArgs("|dN", (const char*[]){"interval","samples"}, &interval, &samples)) return NONE_VAL();
+	if (!(interval >= 0.000001)) return krk_runtimeError(vm.exceptions->valueError, "interval must be at least one microsecond");
+	if (samples < 1) return krk_runtimeError(vm.exceptions->valueError, "samples must be positive");
+
+	stopProfiler();
+
+	struct ProfilerSample * buffer = calloc(samples, sizeof(struct ProfilerSample));
+	if (!buffer) return krk_runtimeError(vm.exceptions->valueError, "could not allocate %zu samples", samples);
+
+	_obtain_lock(_profilerLock);
+	free(profiler.samples);
+	profiler.samples  = buffer;
+	profiler.capacity = samples;
+	profiler.count    = 0;
+	profiler.running  = 1;
+	_release_lock(_profilerLock);
+
+	struct sigaction action;
+	action.sa_handler = handleSigprof;
+	sigemptyset(&action.sa_mask);
+	action.sa_flags = SA_RESTART;
+	sigaction(SIGPROF, &action, &profiler.oldAction);
+
+	if (setTimer(interval)) {
+		stopProfiler();
+		return krk_runtimeError(vm.exceptions->OSError, "setitimer: %s", strerror(errno));
+	}
+
+	return NONE_VAL();
+}
+
+KRK_Function(stop) {
+	FUNCTION_TAKES_NONE();
+	stopProfiler();
+	_obtain_lock(_profilerLock);
+	size_t count = profiler.count;
+	_release_lock(_profilerLock);
+	return INTEGER_VAL(count);
+}
+
+KRK_Function(running) {
+	FUNCTION_TAKES_NONE();
+	return BOOLEAN_VAL(profiler.running);
+}
+
+static void pushFrameName(struct StringBuilder * sb, KrkCodeObject * code) {
+	KrkString * name = code->qualname ? code->qualname : code->name;
+	if (name) pushStringBuilderStr(sb, name->chars, name->length);
+	else pushStringBuilderStr(sb, "<unnamed>", 9);
+	if (code->chunk.filename) {
+		pushStringBuilderStr(sb, " (", 2);
+		pushStringBuilderStr(sb, code->chunk.filename->chars, code->chunk.filename->length);
+		pushStringBuilder(sb, ')');
+	}
+}
+
+static int compareLines(const void * a, const void * b) {
+	KrkString * x = AS_STRING(((KrkTableEntry*)a)->key);
+	KrkString * y = AS_STRING(((KrkTableEntry*)b)->key);
+	size_t length = x->length < y->length ? x->length : y->length;
+	int result = memcmp(x->chars, y->chars, length);
+	if (result) return result;
+	return (x->length > y->length) - (x->length < y->length);
+}
+
+KRK_Function(dump) {
+	int threads = 0;
+	if (!krk_parseArgs("|p", (const char*[]){"threads"}, &threads)) return NONE_VAL();
+
+	/*
+	 * Take a copy so that threads still sampling can keep writing. Building the
+	 * names below can collect, and another thread may start the profiler again
+	 * and discard the buffer meanwhile, so the copy is kept marked until we are done.
+	 */
+	_obtain_lock(_profilerLock);
+	size_t total = profiler.count;
+	size_t capacity = profiler.capacity;
+	size_t count = total < capacity ? total : capacity;
+	struct ProfilerSample * samples = count ? malloc(sizeof(struct ProfilerSample) * count) : NULL;
+	if (count) memcpy(samples, profiler.samples, sizeof(struct ProfilerSample) * count);
+	struct ProfilerCopy copy = {samples, count, profiler.copies};
+	profiler.copies = &copy;
+	_release_lock(_profilerLock);
+
+	/* Other threads are numbered in order of their first sample. */
+	KrkThreadState ** seen = count ? calloc(count, sizeof(KrkThreadState*)) : NULL;
+	size_t seenCount = 0;
+
+	KrkValue stacks = krk_dict_of(0,NULL,0);
+	krk_push(stacks);
+
+	for (size_t i = 0; i < count; ++i) {
+		struct ProfilerSample * sample = &samples[(total - count + i) % capacity];
+		struct StringBuilder sb = {0};
+
+		if (threads) {
+			char tmp[32];
+			size_t len;
+			if (sample->thread == vm.threads) {
+				len = snprintf(tmp, 32, "MainThread");
+			} else {
+				size_t index = 0;
+				while (index < seenCount && seen[index] != sample->thread) index++;
+				if (index == seenCount) seen[seenCount++] = sample->thread;
+				len = snprintf(tmp, 32, "Thread-%zu", index + 1);
+			}
+			pushStringBuilderStr(&sb, tmp, len);
+			pushStringBuilder(&sb, ';');
+		}
+
+		if (sample->truncated) pushStringBuilderStr(&sb, "...;", 4);
+
+		for (size_t j = 0; j < sample->depth; ++j) {
+			if (j) pushStringBuilder(&sb, ';');
+			pushFrameName(&sb, sample->frames[j]);
+		}
+
+		krk_push(finishStringBuilder(&sb));
+		KrkValue previous = INTEGER_VAL(0);
+		krk_tableGet(AS_DICT(stacks), krk_peek(0), &previous);
+		krk_tableSet(AS_DICT(stacks), krk_peek(0), INTEGER_VAL(AS_INTEGER(previous) + 1));
+		krk_pop();
+	}
+
+	_obtain_lock(_profilerLock);
+	struct ProfilerCopy ** link = &profiler.copies;
+	while (*link != &copy) link = &(*link)->next;
+	*link = copy.next;
+	_release_lock(_profilerLock);
+
+	free(samples);
+	free(seen);
+
+	/* One line per stack, sorted so the output is stable. */
+	KrkTable * table = AS_DICT(stacks);
+	KrkTableEntry * lines = table->count ? malloc(sizeof(KrkTableEntry) * table->count) : NULL;
+	size_t lineCount = 0;
+	for (size_t i = 0; i < table->capacity; ++i) {
+		if (IS_KWARGS(table->entries[i].key)) continue;
+		lines[lineCount++] = table->entries[i];
+	}
+	if (lineCount) qsort(lines, lineCount, sizeof(KrkTableEntry), compareLines);
+
+	struct StringBuilder sb = {0};
+	for (size_t i = 0; i < lineCount; ++i) {
+		KrkString * stack = AS_STRING(lines[i].key);
+		char tmp[32];
+		size_t len = snprintf(tmp, 32, " %zu\n", (size_t)AS_INTEGER(lines[i].value));
+		pushStringBuilderStr(&sb, stack->chars, stack->length);
+		pushStringBuilderStr(&sb, tmp, len);
+	}
+	free(lines);
+
+	krk_pop(); /* stacks */
+	return finishStringBuilder(&sb);
+}
+
+void krk_module_init_profiler(void) {
+	KrkInstance * module = krk_newInstance(vm.baseClasses->moduleClass);
+	krk_attachNamedObject(&vm.modules, "kuroko.profiler", (KrkObj*)module);
+	krk_attachNamedObject(&vm.system->fields, "profiler", (KrkObj*)module);
+	krk_attachNamedValue(&vm.system->fields, "__ispackage__", BOOLEAN_VAL(1));
+	krk_attachNamedObject(&module->fields, "__name__", (KrkObj*)S("kuroko.profiler"));
+	krk_attachNamedValue(&module->fields, "__file__", NONE_VAL());
+	KRK_DOC(module, "@brief Sampling profiler.\n\n"
+		"Periodically records the call stack of running threads, with low enough "
+		"overhead to leave on in long-running programs, and produces collapsed "
+		"stack text for flame graph tools.");
+	KRK_DOC(BIND_FUNC(module,start), "@brief Start sampling.\n"
+		"@arguments interval=0.001,samples=8192\n\n"
+		"Records the stack of whichever thread is running every @p interval seconds "
+		"of CPU time. The last @p samples samples are kept; older ones are overwritten. "
+		"Any samples from a previous run are discarded.");
+	KRK_DOC(BIND_FUNC(module,stop), "@brief Stop sampling.\n\n"
+		"Samples are kept until the profiler is started again. "
+		"Returns the number of samples taken, including any that were overwritten.");
+	KRK_DOC(BIND_FUNC(module,running), "@brief Whether the profiler is sampling.");
+	KRK_DOC(BIND_FUNC(module,dump), "@brief Get the recorded samples as collapsed stacks.\n"
+		"@arguments threads=False\n\n"
+		"Returns a string with one line for each distinct stack that was sampled, "
+		"outermost frame first with frames separated by semicolons, followed by the "
+		"number of times it was sampled. If @p threads is set, each stack starts "
+		"with the name of the thread it was sampled from.");
+}
+
+#else
+void krk_profilerSample(void) { }
+void krk_markProfilerSamples(void) { }
+void krk_module_init_profiler(void) { }
+#endif
@@ -3,6 +3,8 @@
 #include <kuroko/object.h>
 #include <kuroko/util.h>
 
+#include "private.h"
+
 #define KRK_VERSION_MAJOR  1
 #define KRK_VERSION_MINOR  4
 #define KRK_VERSION_PATCH  0
@@ -100,13 +102,17 @@ KRK_Function(getsizeof) {
 		case KRK_OBJ_CLASS: {
 			KrkClass * self = AS_CLASS(argv[0]);
 			mySize += sizeof(KrkClass);
-			mySize += sizeof(KrkTableEntry) * self->methods.capacity;
-			mySize += sizeof(KrkTableEntry) * self->subclasses.capacity;
+			mySize += krk_tableAllocationSize(&self->methods);
+			mySize += krk_tableAllocationSize(&self->subclasses);
 			break;
 		}
 		case KRK_OBJ_INSTANCE: {
 			KrkInstance * self = AS_INSTANCE(argv[0]);
-			mySize += sizeof(KrkTableEntry) * self->fields.capacity;
+			if (self->fields.shape) {
+				mySize += sizeof(KrkValue) * self->fields.count;
+			} else {
+				mySize += krk_tableAllocationSize(&self->fields);
+			}
 			KrkClass * type = krk_getType(argv[0]);
 			mySize += type->allocSize; /* All instance types have an allocSize set */
 
@@ -114,7 +120,7 @@ KRK_Function(getsizeof) {
 			if (krk_isInstanceOf(argv[0], vm.baseClasses->listClass)) {
 				mySize += sizeof(KrkValue) * AS_LIST(argv[0])->capacity;
 			} else if (krk_isInstanceOf(argv[0], vm.baseClasses->dictClass)) {
-				mySize += sizeof(KrkTableEntry) * AS_DICT(argv[0])->capacity;
+				mySize += krk_tableAllocationSize(AS_DICT(argv[0]));
 			}
 			break;
 		}
@@ -174,11 +180,22 @@ KRK_Function(unload) {
 	return NONE_VAL();
 }
 
+KRK_Function(intern) {
+	FUNCTION_TAKES_EXACTLY(1);
+	if (!IS_STRING(argv[0])) return TYPE_ERROR(str,argv[0]);
+	return OBJECT_VAL(krk_internString(AS_STRING(argv[0])));
+}
+
 KRK_Function(inspect_value) {
 	FUNCTION_TAKES_EXACTLY(1);
 	return OBJECT_VAL(krk_newBytes(sizeof(KrkValue),(uint8_t*)&argv[0]));
 }
 
+KRK_Function(quickening_stats) {
+	FUNCTION_TAKES_NONE();
+	return krk_quickeningStats();
+}
+
 void krk_module_init_kuroko(void) {
 	/**
 	 * kuroko = module()
@@ -224,8 +241,20 @@ void krk_module_init_kuroko(void) {
 		"Get the list of valid names from the module table");
 	KRK_DOC(BIND_FUNC(vm.system,unload),
 		"Removes a module from the module table. It is not necessarily garbage collected if other references to it exist.");
+	KRK_DOC(BIND_FUNC(vm.system,intern),
+		"@brief Get the interned string equal to a string.\n"
+		"@arguments string\n\n"
+		"Strings built at runtime by joining or repeating other strings, and long strings, are not "
+		"interned until they are used as a key, so equal strings may be different objects. "
+		"Interned strings are equal only if they are the same object.\n\n"
+		"@param string String to intern.");
 	KRK_DOC(BIND_FUNC(vm.system,inspect_value),
 		"Obtain the memory representation of a stack value.");
+	KRK_DOC(BIND_FUNC(vm.system,quickening_stats),
+		"@brief Count instructions rewritten to type-specialized variants.\n\n"
+		"Returns a dict mapping the name of each specialized opcode to a tuple of how many "
+		"instructions were rewritten to it after repeatedly seeing its operand types, and how "
+		"many were rewritten back after seeing other types.");
 	krk_attachNamedObject(&vm.system->fields, "module", (KrkObj*)vm.baseClasses->moduleClass);
 	krk_attachNamedObject(&vm.system->fields, "path_sep", (KrkObj*)S(PATH_SEP));
 	KrkValue module_paths = krk_list_of(0,NULL,0);
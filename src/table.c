@@ -9,19 +9,640 @@
 #include <kuroko/threads.h>
 #include <kuroko/util.h>
 
-#define TABLE_MAX_LOAD 3 / 4
+#include "private.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 void krk_initTable(KrkTable * table) {
 	table->count = 0;
+	table->used = 0;
 	table->capacity = 0;
 	table->entries = NULL;
+	table->shape = NULL;
+	table->version = 0;
+}
+
+/**
+ * Versions
+ *
+ * Shape ids and the versions of dictionary-mode tables are drawn from
+ * one counter, so a version identifies a key layout regardless of which
+ * kind of table it came from. A dictionary-mode table only gets a version
+ * once something asks for one; after that, any change that can move an
+ * entry or change the set of keys replaces it with a fresh one.
+ */
+static size_t nextVersion = 2;
+
+static inline size_t freshVersion(void) {
+	return __atomic_fetch_add(&nextVersion, 1, __ATOMIC_RELAXED);
+}
+
+static inline void tableTouch(KrkTable * table) {
+	if (table->version) table->version = freshVersion();
+}
+
+/**
+ * Shapes
+ *
+ * Instance attribute tables start out pointing at a shape shared with
+ * every other table that added the same keys in the same order, and
+ * store only a dense array of values indexed by slot. Adding a key moves
+ * the table to the child of its current shape for that key.
+ *
+ * The shape tree is shared between threads, so changes to it are made
+ * under _shapeLock. Nothing that can trigger a garbage collection is done
+ * while holding the lock, as the collector takes it to walk the tree.
+ * Shapes are not heap objects; each keeps a count of the tables using it
+ * and unused leaves are released after each collection.
+ */
+#define SHAPE_MAX_SLOTS    32 /* Tables with more keys go to dictionary mode */
+#define SHAPE_MAX_CHILDREN 32 /* Transitions from one shape before new keys go to dictionary mode */
+#define SHAPE_LINEAR_SCAN   8 /* Shapes with more keys than this get a lookup table */
+
+static volatile int _shapeLock = 0;
+static KrkShape rootShape = { .id = 1 };
+
+#define shapeLock()   do { if (vm.globalFlags & KRK_GLOBAL_THREADS) { _obtain_lock(_shapeLock); } } while (0)
+#define shapeUnlock() do { if (vm.globalFlags & KRK_GLOBAL_THREADS) { _release_lock(_shapeLock); } } while (0)
+
+static inline void shapeRef(KrkShape * shape) {
+	__atomic_add_fetch(&shape->refs, 1, __ATOMIC_RELAXED);
+}
+
+static inline void shapeUnref(KrkShape * shape) {
+	__atomic_sub_fetch(&shape->refs, 1, __ATOMIC_RELAXED);
+}
+
+/* Value arrays grow 2, 4, 6, 8, 16, 32 */
+static inline size_t shapeSlotCapacity(size_t count) {
+	if (!count) return 0;
+	size_t capacity = 2;
+	while (capacity < count) capacity = capacity < 8 ? capacity + 2 : capacity * 2;
+	return capacity;
+}
+
+void krk_initShapedTable(KrkTable * table) {
+	krk_initTable(table);
+	table->shape = &rootShape;
+	shapeRef(&rootShape);
+}
+
+static ssize_t shapeIndex(KrkShape * shape, KrkString * key) {
+	if (shape->count > SHAPE_LINEAR_SCAN) {
+		KrkValue slot;
+		if (krk_tableGet_fast(&shape->lookup, key, &slot)) return AS_INTEGER(slot);
+		return -1;
+	}
+	for (; shape->parent; shape = shape->parent) {
+		if (shape->key == key) return shape->count - 1;
+	}
+	return -1;
+}
+
+static KrkShape * shapeFindChild(KrkShape * shape, KrkString * key) {
+	for (size_t i = 0; i < shape->childCount; ++i) {
+		if (shape->children[i]->key == key) return shape->children[i];
+	}
+	return NULL;
+}
+
+static void shapeFree(KrkShape * shape) {
+	for (size_t i = 0; i < shape->childCount; ++i) {
+		shapeFree(shape->children[i]);
+	}
+	free(shape->children);
+	krk_freeTable(&shape->lookup);
+	free(shape);
+}
+
+/**
+ * Find or create the shape reached from @p shape by adding @p key,
+ * or return NULL if the table should switch to dictionary mode instead.
+ */
+static KrkShape * shapeTransition(KrkShape * shape, KrkString * key) {
+	shapeLock();
+	KrkShape * child = shapeFindChild(shape, key);
+	shapeUnlock();
+	if (child) return child;
+
+	if (shape->count >= SHAPE_MAX_SLOTS || shape->childCount >= SHAPE_MAX_CHILDREN) return NULL;
+
+	/* Build the new shape without holding the lock, as filling its lookup table may collect. */
+	KrkShape * newShape = calloc(1, sizeof(KrkShape));
+	newShape->parent = shape;
+	newShape->key = key;
+	newShape->count = shape->count + 1;
+	krk_initTable(&newShape->lookup);
+	if (newShape->count > SHAPE_LINEAR_SCAN) {
+		krk_push(OBJECT_VAL(key));
+		for (KrkShape * s = newShape; s->parent; s = s->parent) {
+			krk_tableSet(&newShape->lookup, OBJECT_VAL(s->key), INTEGER_VAL(s->count - 1));
+		}
+		krk_pop();
+	}
+
+	shapeLock();
+	child = shapeFindChild(shape, key);
+	if (child) {
+		shapeUnlock();
+		shapeFree(newShape);
+		return child;
+	}
+	if (shape->childCount == shape->childCapacity) {
+		shape->childCapacity = GROW_CAPACITY(shape->childCapacity);
+		shape->children = realloc(shape->children, sizeof(KrkShape*) * shape->childCapacity);
+	}
+	newShape->id = freshVersion();
+	shape->children[shape->childCount++] = newShape;
+	shapeUnlock();
+	return newShape;
+}
+
+static void shapeMarkKeys(KrkShape * shape) {
+	krk_markObject((KrkObj*)shape->key);
+	for (size_t i = 0; i < shape->childCount; ++i) {
+		shapeMarkKeys(shape->children[i]);
+	}
+}
+
+void krk_markShapes(void) {
+	shapeLock();
+	shapeMarkKeys(&rootShape);
+	shapeUnlock();
+}
+
+/* Returns 1 if @p shape was released */
+static int shapeSweep(KrkShape * shape) {
+	for (size_t i = 0; i < shape->childCount;) {
+		if (shapeSweep(shape->children[i])) {
+			shape->children[i] = shape->children[--shape->childCount];
+		} else {
+			i++;
+		}
+	}
+	if (shape->parent && !shape->childCount && !shape->refs) {
+		shapeFree(shape);
+		return 1;
+	}
+	return 0;
+}
+
+void krk_sweepShapes(void) {
+	shapeLock();
+	shapeSweep(&rootShape);
+	shapeUnlock();
+}
+
+void krk_freeShapes(void) {
+	for (size_t i = 0; i < rootShape.childCount; ++i) {
+		shapeFree(rootShape.children[i]);
+	}
+	free(rootShape.children);
+	rootShape.children = NULL;
+	rootShape.childCount = 0;
+	rootShape.childCapacity = 0;
+	rootShape.refs = 0;
+}
+
+static void shapeAddAll(KrkShape * shape, KrkValue * values, KrkTable * to) {
+	if (!shape->parent) return;
+	shapeAddAll(shape->parent, values, to);
+	krk_tableSet(to, OBJECT_VAL(shape->key), values[shape->count-1]);
+}
+
+void krk_tableDictionaryMode(KrkTable * table) {
+	if (!table->shape) return;
+	KrkTable out;
+	krk_initTable(&out);
+	krk_tableAdjustCapacity(&out, table->count);
+	shapeAddAll(table->shape, table->values, &out);
+	FREE_ARRAY(KrkValue, table->values, shapeSlotCapacity(table->count));
+	shapeUnref(table->shape);
+	*table = out;
+}
+
+/* Add a new key to a shaped table; returns 0 if the table needs to use dictionary mode instead. */
+static int shapedTableAdd(KrkTable * table, KrkString * key, KrkValue value) {
+	size_t capacity = shapeSlotCapacity(table->count);
+	/* The value may not be reachable from anywhere else while we allocate. */
+	krk_push(value);
+	KrkShape * shape = shapeTransition(table->shape, key);
+	if (!shape) {
+		krk_pop();
+		return 0;
+	}
+	shapeRef(shape);
+	if (table->count == capacity) {
+		table->values = GROW_ARRAY(KrkValue, table->values, capacity, shapeSlotCapacity(table->count + 1));
+	}
+	krk_pop();
+	shapeUnref(table->shape);
+	table->values[table->count++] = value;
+	table->shape = shape;
+	return 1;
+}
+
+/**
+ * Compact tables
+ *
+ * Outside of shape mode, @c entries is a dense array kept in the order
+ * keys were added, so walking it visits keys in insertion order. Lookups
+ * go through an open-addressed index that sits in front of the entries,
+ * in the same allocation. The index has a power of two number of slots,
+ * at most three quarters of which can be in use, and is made of two
+ * parallel arrays: a control byte per slot, and the number of the entry
+ * the slot refers to, one, two, four or eight bytes wide depending on
+ * the capacity of the table.
+ *
+ * A control byte is either CTRL_EMPTY, CTRL_DELETED, or seven bits of
+ * the hash of the key in that slot. Slots are probed sixteen at a time:
+ * the control bytes of an aligned group are compared against the tag
+ * for the key being looked for all at once, and only the slots whose
+ * tags match have their keys compared. A lookup that reaches a group
+ * with an empty slot in it is done. Groups are visited in triangular
+ * order, which reaches every group of a power of two sized index.
+ * Tables with fewer than sixteen slots still have a full group of
+ * control bytes, with the extra ones left empty.
+ *
+ * New entries are appended at @c used. Deleting a key leaves a tombstone
+ * key, KWARGS_VAL(1), in its entry and frees its index slot; entries past
+ * @c used have KWARGS_VAL(0) as their key. Either way, code that walks
+ * @c entries only has to skip keyword-argument keys. When the entry array
+ * fills up the table is rebuilt without its tombstones, at twice the
+ * size unless at least half of the entries had been deleted.
+ *
+ * Lookups and iteration take no locks, so that dicts and sets shared
+ * between threads can be read while another thread changes them. Each
+ * allocation stores its own capacity just in front of the entries, so a
+ * reader needs only one load of @c entries to find everything else, and
+ * writers fill in an entry before the index slot and control byte that
+ * publish it, and clear the control byte before removing the entry.
+ * A reader that has matched a slot may still find that its entry has
+ * been removed, with a keyword-argument key or value. When threads are
+ * running, the allocation a table outgrows is not freed until the next
+ * collection, as another thread may still be probing it; the collector
+ * frees those once every thread is stopped, and no thread can be in
+ * the middle of a lookup then except inside a call to an @c __eq__,
+ * after which the lookup starts over if the table has moved.
+ */
+#define CTRL_EMPTY   0x80
+#define CTRL_DELETED 0xFE /* Anything with the high bit set is free */
+#define GROUP_SIZE   16
+
+#define TABLE_MIN_SLOTS 8
+
+#if defined(__SSE2__)
+static inline unsigned int groupMatch(const uint8_t * group, uint8_t tag) {
+	__m128i ctrl = _mm_loadu_si128((const __m128i*)group);
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8((char)tag)));
+}
+
+static inline unsigned int groupFree(const uint8_t * group) {
+	return _mm_movemask_epi8(_mm_loadu_si128((const __m128i*)group));
+}
+#else
+static inline unsigned int groupMatch(const uint8_t * group, uint8_t tag) {
+	unsigned int mask = 0;
+	for (unsigned int i = 0; i < GROUP_SIZE; ++i) mask |= (unsigned int)(group[i] == tag) << i;
+	return mask;
+}
+
+static inline unsigned int groupFree(const uint8_t * group) {
+	unsigned int mask = 0;
+	for (unsigned int i = 0; i < GROUP_SIZE; ++i) mask |= (unsigned int)(group[i] >> 7) << i;
+	return mask;
+}
+#endif
+
+#ifdef __TINYC__
+static int __builtin_ctz(unsigned int x) {
+	int i = 0;
+	while (!(x & (1U << i))) i++;
+	return i;
+}
+#endif
+
+/* The index has a third more slots than there are entries */
+static inline size_t indexSlots(size_t capacity) {
+	return capacity / 3 * 4;
+}
+
+static inline size_t ctrlSize(size_t slots) {
+	return slots < GROUP_SIZE ? GROUP_SIZE : slots;
+}
+
+static inline size_t indexWidth(size_t capacity) {
+	if (capacity <= 0x100UL) return 1;
+	if (capacity <= 0x10000UL) return 2;
+	if (capacity <= 0x100000000UL) return 4;
+	return 8;
+}
+
+/* Bytes of index in front of the entries, always a multiple of eight */
+static inline size_t indexSize(size_t capacity) {
+	size_t slots = indexSlots(capacity);
+	return ctrlSize(slots) + slots * indexWidth(capacity);
+}
+
+/* Bytes in front of the entries: the index, then the capacity */
+static inline size_t blockHeader(size_t capacity) {
+	return indexSize(capacity) + sizeof(size_t);
+}
+
+static inline size_t blockCapacity(const KrkTableEntry * entries) {
+	return ((const size_t*)entries)[-1];
+}
+
+/* Readers load the entries once and find everything else from there */
+static inline KrkTableEntry * tableEntries(KrkTable * table) {
+	return __atomic_load_n(&table->entries, __ATOMIC_ACQUIRE);
+}
+
+static inline size_t indexGet(const void * index, size_t width, size_t slot) {
+	switch (width) {
+		case 1: return ((const uint8_t*)index)[slot];
+		case 2: return ((const uint16_t*)index)[slot];
+		case 4: return ((const uint32_t*)index)[slot];
+		default: return ((const uint64_t*)index)[slot];
+	}
+}
+
+static inline void indexSet(void * index, size_t width, size_t slot, size_t value) {
+	switch (width) {
+		case 1: ((uint8_t*)index)[slot] = value; break;
+		case 2: ((uint16_t*)index)[slot] = value; break;
+		case 4: ((uint32_t*)index)[slot] = value; break;
+		default: ((uint64_t*)index)[slot] = value; break;
+	}
+}
+
+/**
+ * Where a probe is in the index of a table. Hashes are spread with a
+ * multiplication first, so that runs of consecutive hashes, like those
+ * of small integers, neither share a tag nor pile up in one group; the
+ * top seven bits become the tag and the bits below them pick the group.
+ */
+typedef struct {
+	uint8_t * ctrl;
+	void * index;
+	size_t width;
+	size_t groupMask;
+	size_t group;
+	size_t stride;
+	unsigned int valid;
+	uint8_t tag;
+} TableProbe;
+
+static inline TableProbe probeStart(KrkTableEntry * entries, uint32_t hash) {
+	size_t capacity = blockCapacity(entries);
+	size_t slots = indexSlots(capacity);
+	size_t ctrl = ctrlSize(slots);
+	uint64_t mixed = (uint64_t)hash * 0x9E3779B97F4A7C15ULL;
+	TableProbe probe;
+	probe.ctrl = (uint8_t*)entries - blockHeader(capacity);
+	probe.index = probe.ctrl + ctrl;
+	probe.width = indexWidth(capacity);
+	probe.groupMask = ctrl / GROUP_SIZE - 1;
+	probe.group = (mixed >> 32) & probe.groupMask;
+	probe.stride = 0;
+	probe.valid = slots < GROUP_SIZE ? (1U << slots) - 1 : 0xFFFF;
+	probe.tag = mixed >> 57;
+	return probe;
+}
+
+static inline uint8_t * probeGroup(TableProbe * probe) {
+	return probe->ctrl + probe->group * GROUP_SIZE;
+}
+
+/*
+ * Returns 0 once every group has been visited, which only happens to
+ * a reader racing with writers that keep filling the groups it has seen.
+ */
+static inline int probeNext(TableProbe * probe) {
+	probe->stride++;
+	probe->group = (probe->group + probe->stride) & probe->groupMask;
+	return probe->stride <= probe->groupMask;
+}
+
+/* Get the entry number in a slot of the current group */
+static inline size_t probeEntry(TableProbe * probe, unsigned int bit) {
+	return indexGet(probe->index, probe->width, probe->group * GROUP_SIZE + bit);
+}
+
+/* Entries a table needs room for to hold @p count keys */
+static inline size_t tableCapacityFor(size_t count) {
+	size_t slots = TABLE_MIN_SLOTS;
+	while (slots / 4 * 3 < count) slots *= 2;
+	return slots / 4 * 3;
+}
+
+size_t krk_tableAllocationSize(KrkTable * table) {
+	if (!table->capacity) return 0;
+	return blockHeader(table->capacity) + sizeof(KrkTableEntry) * table->capacity;
+}
+
+static void freeEntries(KrkTableEntry * entries, size_t capacity) {
+	if (!capacity) return;
+	size_t size = blockHeader(capacity);
+	FREE_ARRAY(char, (char*)entries - size, size + sizeof(KrkTableEntry) * capacity);
+}
+
+struct RetiredEntries {
+	struct RetiredEntries * next;
+	KrkTableEntry * entries;
+	size_t capacity;
+};
+
+static struct RetiredEntries * retiredEntries = NULL;
+
+/* Free the entries of a table that is still in use, once no thread can be reading them. */
+static void retireEntries(KrkTableEntry * entries, size_t capacity) {
+	if (!capacity) return;
+	if (!(vm.globalFlags & KRK_GLOBAL_THREADS)) {
+		freeEntries(entries, capacity);
+		return;
+	}
+	struct RetiredEntries * retired = malloc(sizeof(struct RetiredEntries));
+	retired->entries = entries;
+	retired->capacity = capacity;
+	retired->next = __atomic_load_n(&retiredEntries, __ATOMIC_RELAXED);
+	while (!__atomic_compare_exchange_n(&retiredEntries, &retired->next, retired, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+void krk_tableReclaim(void) {
+	struct RetiredEntries * retired = __atomic_exchange_n(&retiredEntries, NULL, __ATOMIC_ACQUIRE);
+	while (retired) {
+		struct RetiredEntries * next = retired->next;
+		freeEntries(retired->entries, retired->capacity);
+		free(retired);
+		retired = next;
+	}
+}
+
+/**
+ * Find @p key in the index of @p table, using identity if @p exact is
+ * set and equality otherwise. Returns its entry, or NULL if the key is
+ * not present; the control byte for its slot goes in @p ctrlOut.
+ */
+static KrkTableEntry * findSlot(KrkTable * table, KrkValue key, uint32_t hash, int exact, uint8_t ** ctrlOut) {
+_restart: ;
+	KrkTableEntry * entries = tableEntries(table);
+	if (!entries) return NULL;
+	TableProbe probe = probeStart(entries, hash);
+	do {
+		uint8_t * group = probeGroup(&probe);
+		for (unsigned int match = groupMatch(group, probe.tag); match; match &= match - 1) {
+			unsigned int bit = __builtin_ctz(match);
+			KrkTableEntry * entry = &entries[probeEntry(&probe, bit)];
+			KrkValue entryKey = entry->key;
+			if (!krk_valuesSame(entryKey, key)) {
+				if (exact || IS_KWARGS(entryKey)) continue;
+				int equal = krk_valuesEqual(entryKey, key);
+				/* Comparing may have run code that changed the table */
+				if (unlikely(tableEntries(table) != entries)) goto _restart;
+				if (!equal) continue;
+			}
+			if (ctrlOut) *ctrlOut = &group[bit];
+			return entry;
+		}
+		if (groupMatch(group, CTRL_EMPTY)) return NULL;
+	} while (probeNext(&probe));
+	return NULL;
+}
+
+/* Append a key known not to be in the table; there must be room for it. */
+static void appendEntry(KrkTable * table, KrkValue key, KrkValue value, uint32_t hash) {
+	TableProbe probe = probeStart(table->entries, hash);
+	unsigned int free;
+	while (!(free = groupFree(probeGroup(&probe)) & probe.valid)) probeNext(&probe);
+	unsigned int bit = __builtin_ctz(free);
+	KrkTableEntry * entry = &table->entries[table->used];
+	entry->key = key;
+	entry->value = value;
+	indexSet(probe.index, probe.width, probe.group * GROUP_SIZE + bit, table->used);
+	__atomic_store_n(&probeGroup(&probe)[bit], probe.tag, __ATOMIC_RELEASE);
+	__atomic_store_n(&table->used, table->used + 1, __ATOMIC_RELEASE);
+	table->count++;
+}
+
+/* Rebuild the table with room for @p capacity entries, dropping deleted ones. */
+static void tableRebuild(KrkTable * table, size_t capacity) {
+	size_t size = blockHeader(capacity);
+	char * block = ALLOCATE(char, size + sizeof(KrkTableEntry) * capacity);
+	/* Entry numbers start out valid, for readers that see a slot before it is filled. */
+	memset(block, CTRL_EMPTY, ctrlSize(indexSlots(capacity)));
+	memset(block + ctrlSize(indexSlots(capacity)), 0, size - ctrlSize(indexSlots(capacity)));
+	KrkTableEntry * entries = (KrkTableEntry*)(block + size);
+	((size_t*)entries)[-1] = capacity;
+	for (size_t i = 0; i < capacity; ++i) {
+		entries[i].key = KWARGS_VAL(0);
+		entries[i].value = KWARGS_VAL(0);
+	}
+
+	KrkTable out = *table;
+	out.entries = entries;
+	out.capacity = capacity;
+	out.count = 0;
+	out.used = 0;
+	for (size_t i = 0; i < table->used; ++i) {
+		KrkTableEntry * entry = &table->entries[i];
+		if (IS_KWARGS(entry->key)) continue;
+		uint32_t hash = 0;
+		krk_hashValue(entry->key, &hash);
+		appendEntry(&out, entry->key, entry->value, hash);
+	}
+
+	retireEntries(table->entries, table->capacity);
+	__atomic_store_n(&table->entries, out.entries, __ATOMIC_RELEASE);
+	table->capacity = out.capacity;
+	table->count = out.count;
+	__atomic_store_n(&table->used, out.used, __ATOMIC_RELEASE);
+	tableTouch(table);
+}
+
+/* Make room to append one more entry */
+static void tableGrow(KrkTable * table) {
+	size_t needed = table->count * 2 >= table->used ? table->capacity * 2 : table->count + 1;
+	tableRebuild(table, tableCapacityFor(needed ? needed : 1));
 }
 
 void krk_freeTable(KrkTable * table) {
-	FREE_ARRAY(KrkTableEntry, table->entries, table->capacity);
+	if (table->shape) {
+		FREE_ARRAY(KrkValue, table->values, shapeSlotCapacity(table->count));
+		shapeUnref(table->shape);
+	}
+	freeEntries(table->entries, table->capacity);
 	krk_initTable(table);
 }
 
+void krk_tableClear(KrkTable * table) {
+	if (table->shape) {
+		krk_freeTable(table);
+		return;
+	}
+	KrkTableEntry * entries = table->entries;
+	size_t capacity = table->capacity;
+	table->count = 0;
+	__atomic_store_n(&table->entries, NULL, __ATOMIC_RELEASE);
+	table->capacity = 0;
+	table->used = 0;
+	tableTouch(table);
+	retireEntries(entries, capacity);
+}
+
+#ifndef KRK_DISABLE_THREADS
+/*
+ * Writers hold the lock for as long as a whole operation, which may call
+ * an @c __eq__ or @c __hash__ that comes back to change the same table;
+ * the thread holding it can take it again. Waiting for it counts as a
+ * blocking call, as the thread holding it may be stopped for a collection.
+ */
+void krk_tableLock(KrkTableLock * lock) {
+	void * me = &krk_currentThread;
+	if (__atomic_load_n(&lock->owner, __ATOMIC_RELAXED) == me) {
+		lock->depth++;
+		return;
+	}
+	void * expected = NULL;
+	if (!__atomic_compare_exchange_n(&lock->owner, &expected, me, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+		krk_gcBlockingBegin();
+		do {
+			sched_yield();
+			expected = NULL;
+		} while (!__atomic_compare_exchange_n(&lock->owner, &expected, me, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED));
+		krk_gcBlockingEnd();
+	}
+	lock->depth = 1;
+}
+
+void krk_tableUnlock(KrkTableLock * lock) {
+	/* Threads may have started while the lock was not being taken. */
+	if (__atomic_load_n(&lock->owner, __ATOMIC_RELAXED) != &krk_currentThread) return;
+	if (--lock->depth) return;
+	__atomic_store_n(&lock->owner, NULL, __ATOMIC_RELEASE);
+}
+#endif
+
+int krk_tableNextEntry(KrkTable * table, size_t * index, KrkTableEntry * out) {
+	KrkTableEntry * entries = tableEntries(table);
+	if (!entries) return 0;
+	size_t used = __atomic_load_n(&table->used, __ATOMIC_ACQUIRE);
+	size_t capacity = blockCapacity(entries);
+	if (used > capacity) used = capacity;
+	for (size_t i = *index; i < used; ++i) {
+		KrkValue key = entries[i].key;
+		KrkValue value = entries[i].value;
+		if (IS_KWARGS(key) || IS_KWARGS(value)) continue;
+		out->key = key;
+		out->value = value;
+		*index = i + 1;
+		return 1;
+	}
+	return 0;
+}
+
 inline int krk_hashValue(KrkValue value, uint32_t *hashOut) {
 	switch (KRK_VAL_TYPE(value)) {
 		case KRK_VAL_BOOLEAN:
@@ -29,17 +650,21 @@ inline int krk_hashValue(KrkValue value, uint32_t *hashOut) {
 		case KRK_VAL_NONE:
 		case KRK_VAL_HANDLER:
 		case KRK_VAL_KWARGS:
-			*hashOut = (uint32_t)AS_INTEGER(value);
+			*hashOut = krk_hashInteger(AS_INTEGER(value));
 			return 0;
 		case KRK_VAL_OBJECT:
 			if (AS_OBJECT(value)->flags & KRK_OBJ_FLAGS_VALID_HASH) {
 				*hashOut = AS_OBJECT(value)->hash;
 				return 0;
 			}
+			if (AS_OBJECT(value)->type == KRK_OBJ_STRING) {
+				*hashOut = krk_stringHash(AS_STRING(value));
+				return 0;
+			}
 			break;
 		default:
 #ifndef KRK_NO_FLOAT
-			*hashOut = (uint32_t)AS_FLOATING(value);
+			*hashOut = krk_hashFloat(AS_FLOATING(value));
 			return 0;
 #else
 			break;
@@ -63,189 +688,215 @@ _unhashable:
 	return 1;
 }
 
-KrkTableEntry * krk_findEntry(KrkTableEntry * entries, size_t capacity, KrkValue key) {
-	uint32_t index;
-	if (krk_hashValue(key, &index)) {
-		return NULL;
-	}
-	index &= (capacity-1);
-	KrkTableEntry * tombstone = NULL;
-	for (;;) {
-		KrkTableEntry * entry = &entries[index];
-		if (entry->key == KWARGS_VAL(0)) {
-			return tombstone != NULL ? tombstone : entry;
-		} else if (entry->key == KWARGS_VAL(1)) {
-			if (tombstone == entry) return tombstone;
-			if (tombstone == NULL) tombstone = entry;
-		} else if (krk_valuesSameOrEqual(entry->key, key)) {
-			return entry;
-		}
-		index = (index + 1) & (capacity-1);
-	}
-}
-
-KrkTableEntry * krk_findEntryExact(KrkTableEntry * entries, size_t capacity, KrkValue key) {
-	uint32_t index;
-	if (krk_hashValue(key, &index)) {
-		return NULL;
-	}
-	index &= (capacity-1);
-	KrkTableEntry * tombstone = NULL;
-	for (;;) {
-		KrkTableEntry * entry = &entries[index];
-		if (entry->key == KWARGS_VAL(0)) {
-			return tombstone != NULL ? tombstone : entry;
-		} else if (entry->key == KWARGS_VAL(1)) {
-			if (tombstone == entry) return tombstone;
-			if (tombstone == NULL) tombstone = entry;
-		} else if (krk_valuesSame(entry->key, key)) {
-			return entry;
-		}
-		index = (index + 1) & (capacity-1);
-	}
+KrkTableEntry * krk_findEntry(KrkTable * table, KrkValue key) {
+	uint32_t hash;
+	if (krk_hashValue(key, &hash)) return NULL;
+	if (!table->count) return NULL;
+	return findSlot(table, key, hash, 0, NULL);
 }
 
-#ifdef __TINYC__
-int __builtin_clz(unsigned int x) {
-	int i = 31;
-	while (!(x & (1 << i)) && i >= 0) i--;
-	return 31-i;
+KrkTableEntry * krk_findEntryExact(KrkTable * table, KrkValue key) {
+	uint32_t hash;
+	if (krk_hashValue(key, &hash)) return NULL;
+	if (!table->count) return NULL;
+	return findSlot(table, key, hash, 1, NULL);
 }
-#endif
 
 void krk_tableAdjustCapacity(KrkTable * table, size_t capacity) {
-	if (capacity) {
-		/* Fast power-of-two calculation */
-		size_t powerOfTwoCapacity = __builtin_clz(1) - __builtin_clz(capacity);
-		if ((1UL << powerOfTwoCapacity) != capacity) powerOfTwoCapacity++;
-		capacity = (1UL << powerOfTwoCapacity);
-	}
+	krk_tableDictionaryMode(table);
+	if (capacity < table->count) capacity = table->count;
+	tableRebuild(table, tableCapacityFor(capacity));
+}
 
-	KrkTableEntry * entries = ALLOCATE(KrkTableEntry, capacity);
-	for (size_t i = 0; i < capacity; ++i) {
-		entries[i].key = KWARGS_VAL(0);
-		entries[i].value = KWARGS_VAL(0);
-	}
+/**
+ * String keys are always interned, so they can be compared by identity.
+ * Strings that skipped the string table are interned when they are added
+ * as keys, and looked up by their interned twin, if there is one.
+ */
+#define IS_UNINTERNED(key) (IS_STRING(key) && (AS_OBJECT(key)->flags & KRK_OBJ_FLAGS_STRING_UNINTERNED))
 
-	table->count = 0;
-	for (size_t i = 0; i < table->capacity; ++i) {
-		KrkTableEntry * entry = &table->entries[i];
-		if (IS_KWARGS(entry->key)) continue;
-		KrkTableEntry * dest = krk_findEntry(entries, capacity, entry->key);
-		dest->key = entry->key;
-		dest->value = entry->value;
-		table->count++;
-	}
+static inline KrkValue internKey(KrkValue key) {
+	if (likely(!IS_UNINTERNED(key))) return key;
+	return OBJECT_VAL(krk_internString(AS_STRING(key)));
+}
 
-	FREE_ARRAY(KrkTableEntry, table->entries, table->capacity);
-	table->entries = entries;
-	table->capacity = capacity;
+static inline int findKey(KrkValue * key) {
+	if (likely(!IS_UNINTERNED(*key))) return 1;
+	KrkString * interned = krk_internedString(AS_STRING(*key));
+	if (!interned) return 0;
+	*key = OBJECT_VAL(interned);
+	return 1;
 }
 
 int krk_tableSet(KrkTable * table, KrkValue key, KrkValue value) {
-	if (table->count + 1 > table->capacity * TABLE_MAX_LOAD) {
-		size_t capacity = GROW_CAPACITY(table->capacity);
-		krk_tableAdjustCapacity(table, capacity);
+	key = internKey(key);
+	if (table->shape) {
+		if (IS_STRING(key)) {
+			ssize_t slot = shapeIndex(table->shape, AS_STRING(key));
+			if (slot >= 0) {
+				table->values[slot] = value;
+				return 0;
+			}
+			if (shapedTableAdd(table, AS_STRING(key), value)) return 1;
+		}
+		krk_tableDictionaryMode(table);
 	}
-	KrkTableEntry * entry = krk_findEntry(table->entries, table->capacity, key);
-	if (!entry) return 0;
-	int isNewKey = IS_KWARGS(entry->key);
-	if (isNewKey) table->count++;
-	entry->key = key;
-	entry->value = value;
-	return isNewKey;
+	uint32_t hash;
+	if (krk_hashValue(key, &hash)) return 0;
+	if (table->count) {
+		KrkTableEntry * entry = findSlot(table, key, hash, 0, NULL);
+		if (entry) {
+			entry->key = key;
+			entry->value = value;
+			return 0;
+		}
+	}
+	if (table->used == table->capacity) tableGrow(table);
+	appendEntry(table, key, value, hash);
+	tableTouch(table);
+	return 1;
 }
 
 int krk_tableSetIfExists(KrkTable * table, KrkValue key, KrkValue value) {
 	if (table->count == 0) return 0;
-	KrkTableEntry * entry = krk_findEntry(table->entries, table->capacity, key);
+	if (!findKey(&key)) return 0;
+	if (table->shape) {
+		ssize_t slot = IS_STRING(key) ? shapeIndex(table->shape, AS_STRING(key)) : -1;
+		if (slot < 0) return 0;
+		table->values[slot] = value;
+		return 1;
+	}
+	KrkTableEntry * entry = krk_findEntry(table, key);
 	if (!entry) return 0;
-	if (IS_KWARGS(entry->key)) return 0; /* Not found */
 	entry->key = key;
 	entry->value = value;
 	return 1;
 }
 
 void krk_tableAddAll(KrkTable * from, KrkTable * to) {
-	for (size_t i = 0; i < from->capacity; ++i) {
-		KrkTableEntry * entry = &from->entries[i];
-		if (!IS_KWARGS(entry->key)) {
-			krk_tableSet(to, entry->key, entry->value);
-		}
+	if (from->shape) {
+		shapeAddAll(from->shape, from->values, to);
+		return;
+	}
+	/* Setting can run code that changes @p from, so go through it by index. */
+	KrkTableEntry entry;
+	for (size_t i = 0; krk_tableNextEntry(from, &i, &entry);) {
+		krk_tableSet(to, entry.key, entry.value);
 	}
 }
 
 int krk_tableGet(KrkTable * table, KrkValue key, KrkValue * value) {
 	if (table->count == 0) return 0;
-	KrkTableEntry * entry = krk_findEntry(table->entries, table->capacity, key);
-	if (!entry || IS_KWARGS(entry->key)) {
-		return 0;
-	} else {
-		*value = entry->value;
+	if (!findKey(&key)) return 0;
+	if (table->shape) {
+		ssize_t slot = IS_STRING(key) ? shapeIndex(table->shape, AS_STRING(key)) : -1;
+		if (slot < 0) return 0;
+		*value = table->values[slot];
 		return 1;
 	}
+	KrkTableEntry * entry = krk_findEntry(table, key);
+	if (!entry) return 0;
+	KrkValue found = entry->value;
+	/* Removed by another thread after we found it */
+	if (unlikely(IS_KWARGS(found))) return 0;
+	*value = found;
+	return 1;
+}
+
+/* Identity lookup of an interned string in the entries of a dictionary-mode table */
+static inline ssize_t findString(KrkTableEntry * entries, KrkString * str) {
+	if (!entries) return -1;
+	TableProbe probe = probeStart(entries, str->obj.hash);
+	do {
+		uint8_t * group = probeGroup(&probe);
+		for (unsigned int match = groupMatch(group, probe.tag); match; match &= match - 1) {
+			size_t n = probeEntry(&probe, __builtin_ctz(match));
+			if (entries[n].key == OBJECT_VAL(str)) return n;
+		}
+		if (groupMatch(group, CTRL_EMPTY)) return -1;
+	} while (probeNext(&probe));
+	return -1;
 }
 
 int krk_tableGet_fast(KrkTable * table, KrkString * str, KrkValue * value) {
 	if (unlikely(table->count == 0)) return 0;
-	uint32_t index = str->obj.hash & (table->capacity-1);
-	KrkTableEntry * tombstone = NULL;
-	for (;;) {
-		KrkTableEntry * entry = &table->entries[index];
-		if (entry->key == KWARGS_VAL(0)) {
-			return 0;
-		} else if (entry->key == KWARGS_VAL(1)) {
-			if (tombstone == entry) return 0;
-			if (tombstone == NULL) tombstone = entry;
-		} else if (entry->key == OBJECT_VAL(str)) {
-			*value = entry->value;
-			return 1;
-		}
-		index = (index + 1) & (table->capacity-1);
+	if (unlikely(str->obj.flags & KRK_OBJ_FLAGS_STRING_UNINTERNED) && !(str = krk_internedString(str))) return 0;
+	if (table->shape) {
+		ssize_t slot = shapeIndex(table->shape, str);
+		if (slot < 0) return 0;
+		*value = table->values[slot];
+		return 1;
 	}
+	KrkTableEntry * entries = tableEntries(table);
+	ssize_t n = findString(entries, str);
+	if (n < 0) return 0;
+	KrkValue found = entries[n].value;
+	if (unlikely(IS_KWARGS(found))) return 0;
+	*value = found;
+	return 1;
 }
 
-int krk_tableDelete(KrkTable * table, KrkValue key) {
-	if (table->count == 0) return 0;
-	KrkTableEntry * entry = krk_findEntry(table->entries, table->capacity, key);
-	if (!entry || IS_KWARGS(entry->key)) {
-		return 0;
+size_t krk_tableVersion(KrkTable * table) {
+	if (table->shape) return table->shape->id;
+	if (!table->version) table->version = freshVersion();
+	return table->version;
+}
+
+ssize_t krk_tableSlot(KrkTable * table, KrkString * key) {
+	if (table->count == 0) return -1;
+	if (unlikely(key->obj.flags & KRK_OBJ_FLAGS_STRING_UNINTERNED) && !(key = krk_internedString(key))) return -1;
+	if (table->shape) return shapeIndex(table->shape, key);
+	return findString(table->entries, key);
+}
+
+static int tableDelete(KrkTable * table, KrkValue key, int exact) {
+	if (table->shape) {
+		if (!IS_STRING(key) || shapeIndex(table->shape, AS_STRING(key)) < 0) return 0;
+		krk_tableDictionaryMode(table);
 	}
+	uint32_t hash;
+	uint8_t * ctrl;
+	if (krk_hashValue(key, &hash)) return 0;
+	KrkTableEntry * entry = findSlot(table, key, hash, exact, &ctrl);
+	if (!entry) return 0;
+	/* A slot can only go back to being empty if no probe has ever gone past its group. */
+	uint8_t * group = (uint8_t*)table->entries - blockHeader(table->capacity);
+	group += (ctrl - group) / GROUP_SIZE * GROUP_SIZE;
+	__atomic_store_n(ctrl, groupMatch(group, CTRL_EMPTY) ? CTRL_EMPTY : CTRL_DELETED, __ATOMIC_RELEASE);
 	table->count--;
 	entry->key = KWARGS_VAL(1);
 	entry->value = KWARGS_VAL(0);
+	tableTouch(table);
 	return 1;
 }
 
+int krk_tableDelete(KrkTable * table, KrkValue key) {
+	if (table->count == 0) return 0;
+	if (!findKey(&key)) return 0;
+	return tableDelete(table, key, 0);
+}
+
 int krk_tableDeleteExact(KrkTable * table, KrkValue key) {
 	if (table->count == 0) return 0;
-	KrkTableEntry * entry = krk_findEntryExact(table->entries, table->capacity, key);
-	if (!entry || IS_KWARGS(entry->key)) {
-		return 0;
-	}
-	table->count--;
-	entry->key = KWARGS_VAL(1);
-	entry->value = KWARGS_VAL(0);
-	return 1;
+	return tableDelete(table, key, 1);
 }
 
 KrkString * krk_tableFindString(KrkTable * table, const char * chars, size_t length, uint32_t hash) {
-	if (table->count == 0) return NULL;
-
-	uint32_t index = hash & (table->capacity-1);
-	KrkTableEntry * tombstone = NULL;
-	for (;;) {
-		KrkTableEntry * entry = &table->entries[index];
-		if (entry->key == KWARGS_VAL(0)) {
-			return NULL;
-		} else if (entry->key == KWARGS_VAL(1)) {
-			if (tombstone == entry) return NULL;
-			if (tombstone == NULL) tombstone = entry;
-		} else if (AS_STRING(entry->key)->length == length &&
-		           AS_OBJECT(entry->key)->hash == hash &&
-		           memcmp(AS_STRING(entry->key)->chars, chars, length) == 0) {
-			return AS_STRING(entry->key);
+	KrkTableEntry * entries = tableEntries(table);
+	if (table->count == 0 || !entries) return NULL;
+
+	TableProbe probe = probeStart(entries, hash);
+	do {
+		uint8_t * group = probeGroup(&probe);
+		for (unsigned int match = groupMatch(group, probe.tag); match; match &= match - 1) {
+			KrkValue key = entries[probeEntry(&probe, __builtin_ctz(match))].key;
+			if (IS_STRING(key) && AS_STRING(key)->length == length &&
+			    AS_OBJECT(key)->hash == hash &&
+			    memcmp(AS_STRING(key)->chars, chars, length) == 0) {
+				return AS_STRING(key);
+			}
 		}
-		index = (index + 1) & (table->capacity-1);
-	}
+		if (groupMatch(group, CTRL_EMPTY)) return NULL;
+	} while (probeNext(&probe));
+	return NULL;
 }
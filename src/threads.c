@@ -5,6 +5,8 @@
 #ifndef KRK_DISABLE_THREADS
 #include <kuroko/util.h>
 
+#include "private.h"
+
 #include <unistd.h>
 #include <pthread.h>
 
@@ -59,20 +61,14 @@ KRK_Function(current_thread) {
 #define CURRENT_CTYPE struct Thread *
 #define CURRENT_NAME  self
 
-static volatile int _threadLock = 0;
 static void * _startthread(void * _threadObj) {
 #if defined(__APPLE__) && defined(__aarch64__)
 	krk_forceThreadData();
 #endif
 	memset(&krk_currentThread, 0, sizeof(KrkThreadState));
 	krk_currentThread.frames = calloc(vm.maximumCallDepth,sizeof(KrkCallFrame));
-	vm.globalFlags |= KRK_GLOBAL_THREADS;
-	_obtain_lock(_threadLock);
-	if (vm.threads->next) {
-		krk_currentThread.next = vm.threads->next;
-	}
-	vm.threads->next = &krk_currentThread;
-	_release_lock(_threadLock);
+	krk_resetStack();
+	krk_gcAttachThread();
 
 	/* Get our run function */
 	struct Thread * self = _threadObj;
@@ -92,20 +88,11 @@ static void * _startthread(void * _threadObj) {
 	self->alive = 0;
 
 	/* Remove this thread from the thread pool, its stack is garbage anyway */
-	_obtain_lock(_threadLock);
 	krk_resetStack();
-	KrkThreadState * previous = vm.threads;
-	while (previous) {
-		if (previous->next == &krk_currentThread) {
-			previous->next = krk_currentThread.next;
-			break;
-		}
-		previous = previous->next;
-	}
-	_release_lock(_threadLock);
+	krk_gcDetachThread();
 
-	FREE_ARRAY(size_t, krk_currentThread.stack, krk_currentThread.stackSize);
 	free(krk_currentThread.frames);
+	krk_slabReleaseThread();
 
 	return NULL;
 }
@@ -121,7 +108,10 @@ KRK_Method(Thread,join) {
 	if (!self->started)
 		return krk_runtimeError(KRK_EXC(ThreadError), "Thread has not been started.");
 
-	pthread_join(self->nativeRef, NULL);
+	pthread_t nativeRef = self->nativeRef;
+	krk_gcBlockingBegin();
+	pthread_join(nativeRef, NULL);
+	krk_gcBlockingEnd();
 	return NONE_VAL();
 }
 
@@ -133,6 +123,9 @@ KRK_Method(Thread,start) {
 
 	self->started = 1;
 	self->alive   = 1;
+	/* Set before the thread exists, so that collections from here on stop it */
+	krk_gcFinishSweep();
+	vm.globalFlags |= KRK_GLOBAL_THREADS;
 	pthread_create(&self->nativeRef, NULL, _startthread, (void*)self);
 
 	return argv[0];
@@ -190,7 +183,12 @@ KRK_Method(Lock,__repr__) {
 
 KRK_Method(Lock,__enter__) {
 	METHOD_TAKES_NONE();
-	pthread_mutex_lock(&self->mutex);
+	if (pthread_mutex_trylock(&self->mutex)) {
+		pthread_mutex_t * mutex = &self->mutex;
+		krk_gcBlockingBegin();
+		pthread_mutex_lock(mutex);
+		krk_gcBlockingEnd();
+	}
 	return NONE_VAL();
 }
 
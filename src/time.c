@@ -9,6 +9,7 @@
 #include <kuroko/vm.h>
 #include <kuroko/value.h>
 #include <kuroko/object.h>
+#include <kuroko/memory.h>
 #include <kuroko/util.h>
 
 KRK_Function(sleep) {
@@ -22,7 +23,9 @@ KRK_Function(sleep) {
 	                      (IS_FLOATING(argv[0]) ? AS_FLOATING(argv[0]) : 0)) *
 	                      1000000;
 
+	krk_gcBlockingBegin();
 	usleep(usecs);
+	krk_gcBlockingEnd();
 
 	return BOOLEAN_VAL(1);
 }
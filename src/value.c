@@ -175,6 +175,18 @@ static inline int _krk_method_equivalence(KrkValue a, KrkValue b) {
 	return 0;
 }
 
+/**
+ * Interned strings with the same contents are the same object, so two
+ * strings need to be compared only if one of them skipped the string table.
+ */
+static inline int _krk_string_equivalence(KrkString * a, KrkString * b) {
+	if (a == b) return 1;
+	if (!((a->obj.flags | b->obj.flags) & KRK_OBJ_FLAGS_STRING_UNINTERNED)) return 0;
+	if (a->length != b->length) return 0;
+	if ((a->obj.flags & b->obj.flags & KRK_OBJ_FLAGS_VALID_HASH) && a->obj.hash != b->obj.hash) return 0;
+	return !memcmp(a->chars, b->chars, a->length);
+}
+
 static inline int _krk_same_type_equivalence(uint16_t valtype, KrkValue a, KrkValue b) {
 	switch (valtype) {
 		case KRK_VAL_BOOLEAN:
@@ -185,6 +197,8 @@ static inline int _krk_same_type_equivalence(uint16_t valtype, KrkValue a, KrkVa
 		case KRK_VAL_HANDLER:
 			return a == b;
 		case KRK_VAL_OBJECT:
+			if (IS_STRING(a) && IS_STRING(b)) return _krk_string_equivalence(AS_STRING(a), AS_STRING(b));
+			/* fallthrough */
 		default:
 			return _krk_method_equivalence(a,b);
 	}
@@ -200,6 +214,8 @@ static inline int _krk_same_type_equivalence_b(uint16_t valtype, KrkValue a, Krk
 		case KRK_VAL_HANDLER:
 			return 0;
 		case KRK_VAL_OBJECT:
+			if (IS_STRING(a) && IS_STRING(b)) return _krk_string_equivalence(AS_STRING(a), AS_STRING(b));
+			/* fallthrough */
 		default:
 			return _krk_method_equivalence(a,b);
 	}
@@ -126,6 +126,10 @@ void krk_resetStack(void) {
 	krk_currentThread.stackMax = krk_currentThread.stack + krk_currentThread.stackSize;
 	krk_currentThread.frameCount = 0;
 	krk_currentThread.openUpvalues = NULL;
+	krk_currentThread.ownStack = krk_currentThread.stack;
+	krk_currentThread.stackHome = &krk_currentThread.ownStack;
+	krk_currentThread.stackOwner = NULL;
+	krk_currentThread.outerStacks = NULL;
 	krk_currentThread.flags &= ~KRK_THREAD_HAS_EXCEPTION;
 	krk_currentThread.currentException = NONE_VAL();
 }
@@ -143,10 +147,19 @@ void krk_growStack(void) {
 		krk_currentThread.stack = GROW_ARRAY(KrkValue, krk_currentThread.stack, old, newsize);
 	}
 	krk_currentThread.stackSize = newsize;
+	*krk_currentThread.stackHome = krk_currentThread.stack;
 	krk_currentThread.stackTop = krk_currentThread.stack + old_offset;
 	krk_currentThread.stackMax = krk_currentThread.stack + krk_currentThread.stackSize;
 }
 
+KrkValue * krk_stackOfFrame(size_t frame) {
+	KrkValue * stack = krk_currentThread.stack;
+	for (KrkStackSegment * segment = krk_currentThread.outerStacks; segment && frame < segment->frames; segment = segment->prev) {
+		stack = segment->stack;
+	}
+	return stack;
+}
+
 /**
  * Push a value onto the stack, and grow the stack if necessary.
  * Note that growing the stack can involve the stack _moving_, so
@@ -399,17 +412,15 @@ int krk_processComplexArguments(int argCount, KrkValueArray * positionals, KrkTa
 					krk_runtimeError(vm.exceptions->typeError, "%s(): **expression value is not a dict.", name);
 					return 0;
 				}
-				for (size_t i = 0; i < AS_DICT(value)->capacity; ++i) {
-					KrkTableEntry * entry = &AS_DICT(value)->entries[i];
-					if (!IS_KWARGS(entry->key)) {
-						if (!IS_STRING(entry->key)) {
-							krk_runtimeError(vm.exceptions->typeError, "%s(): **expression contains non-string key", name);
-							return 0;
-						}
-						if (!krk_tableSet(keywords, entry->key, entry->value)) {
-							krk_runtimeError(vm.exceptions->typeError, "%s() got multiple values for argument '%S'", name, AS_STRING(entry->key));
-							return 0;
-						}
+				KrkTableEntry entry;
+				for (size_t i = 0; krk_tableNextEntry(AS_DICT(value), &i, &entry);) {
+					if (!IS_STRING(entry.key)) {
+						krk_runtimeError(vm.exceptions->typeError, "%s(): **expression contains non-string key", name);
+						return 0;
+					}
+					if (!krk_tableSet(keywords, entry.key, entry.value)) {
+						krk_runtimeError(vm.exceptions->typeError, "%s() got multiple values for argument '%S'", name, AS_STRING(entry.key));
+						return 0;
 					}
 				}
 			} else if (AS_INTEGER(key) == KWARGS_SINGLE) { /* single value */
@@ -436,6 +447,11 @@ int krk_processComplexArguments(int argCount, KrkValueArray * positionals, KrkTa
  * where we need to restore the stack to when we return from this call.
  */
 static inline int _callManaged(KrkClosure * closure, int argCount, int returnDepth) {
+#ifndef KRK_NO_FILESYSTEM
+	if (unlikely(__atomic_load_n(&closure->function->obj.flags, __ATOMIC_ACQUIRE) & KRK_OBJ_FLAGS_CODEOBJECT_UNVERIFIED)) {
+		if (!krk_verifyBytecode(closure->function)) return 0;
+	}
+#endif
 	size_t potentialPositionalArgs = closure->function->potentialPositionals;
 	size_t totalArguments = closure->function->totalArguments;
 	size_t offsetOfExtraArgs = potentialPositionalArgs;
@@ -459,7 +475,7 @@ static inline int _callManaged(KrkClosure * closure, int argCount, int returnDep
 		/* Store scratch while we adjust; we can not make calls while using these scratch
 		 * registers as they may be clobbered by a nested call to _callManaged. */
 		krk_currentThread.scratchSpace[0] = myList;
-		krk_currentThread.scratchSpace[1] = myList;
+		krk_currentThread.scratchSpace[1] = myDict;
 
 		/* Pop three things, including the kwargs count */
 		krk_pop(); /* dict */
@@ -672,6 +688,12 @@ static inline int _callNative(KrkNative* callee, int argCount, int returnDepth)
 	NativeFn native = (NativeFn)callee->function;
 	size_t stackOffsetAfterCall = (krk_currentThread.stackTop - krk_currentThread.stack) - argCount - returnDepth;
 	KrkValue result;
+	if (unlikely(vm.globalFlags & KRK_GLOBAL_GENERATIONAL_GC)) {
+		/* Natives may store into any of their arguments. */
+		for (KrkValue * arg = krk_currentThread.stackTop - argCount; arg < krk_currentThread.stackTop; ++arg) {
+			krk_gcWriteBarrierValue(*arg);
+		}
+	}
 	if (unlikely(argCount && IS_KWARGS(krk_currentThread.stackTop[-1]))) {
 		/* Prep space for our list + dictionary */
 		KrkValue myList = krk_list_of(0,NULL,0);
@@ -804,7 +826,7 @@ static KrkUpvalue * captureUpvalue(int index) {
 	return createdUpvalue;
 }
 
-#define UPVALUE_LOCATION(upvalue) (upvalue->location == -1 ? &upvalue->closed : &upvalue->owner->stack[upvalue->location])
+#define UPVALUE_LOCATION(upvalue) (upvalue->location == -1 ? &upvalue->closed : &(*upvalue->stack)[upvalue->location])
 
 /**
  * Close upvalues by moving them out of the stack and into the heap.
@@ -815,6 +837,7 @@ static void closeUpvalues(int last) {
 		KrkUpvalue * upvalue = krk_currentThread.openUpvalues;
 		upvalue->closed = krk_currentThread.stack[upvalue->location];
 		upvalue->location = -1;
+		krk_gcWriteBarrier((KrkObj*)upvalue);
 		krk_currentThread.openUpvalues = upvalue->next;
 	}
 }
@@ -906,7 +929,8 @@ void krk_initVM(int flags) {
 	krk_forceThreadData();
 #endif
 
-	vm.globalFlags = flags & 0xFF00;
+	vm.globalFlags = flags & (0xFF00 | KRK_GLOBAL_NO_BYTECODE_CACHE);
+	krk_initHashKey();
 	vm.maximumCallDepth = KRK_CALL_FRAMES_MAX;
 
 	/* Reset current thread */
@@ -924,12 +948,16 @@ void krk_initVM(int flags) {
 	vm.grayCount = 0;
 	vm.grayCapacity = 0;
 	vm.grayStack = NULL;
+	vm.oldObjects = NULL;
+	vm.nextMinorGC = KRK_NURSERY_SIZE;
+	vm.rememberedCount = 0;
+	vm.rememberedCapacity = 0;
+	vm.remembered = NULL;
 
 	/* Global objects */
 	vm.exceptions = calloc(1,sizeof(struct Exceptions));
 	vm.baseClasses = calloc(1,sizeof(struct BaseClasses));
 	vm.specialMethodNames = calloc(METHOD__MAX,sizeof(KrkValue));
-	krk_initTable(&vm.strings);
 	krk_initTable(&vm.modules);
 
 	/*
@@ -968,6 +996,7 @@ void krk_initVM(int flags) {
 	if (!(vm.globalFlags & KRK_GLOBAL_NO_DEFAULT_MODULES)) {
 #ifndef KRK_NO_SYSTEM_MODULES
 		krk_module_init_kuroko();
+		krk_module_init_profiler();
 		krk_module_init_gc();
 		krk_module_init_time();
 		krk_module_init_os();
@@ -990,12 +1019,18 @@ void krk_initVM(int flags) {
  * Reclaim resources used by the VM.
  */
 void krk_freeVM(void) {
-	krk_freeTable(&vm.strings);
+	krk_internFree();
+	krk_tableReclaim();
 	krk_freeTable(&vm.modules);
 	if (vm.specialMethodNames) free(vm.specialMethodNames);
+	krk_freeObjects();
 	if (vm.exceptions) free(vm.exceptions);
 	if (vm.baseClasses) free(vm.baseClasses);
-	krk_freeObjects();
+	krk_freeShapes();
+	krk_freeSlabs();
+#ifndef KRK_NO_FILESYSTEM
+	krk_freeBytecodeImages();
+#endif
 
 	if (vm.binpath) free(vm.binpath);
 	if (vm.dbgState) free(vm.dbgState);
@@ -1134,7 +1169,7 @@ static int handleException(void) {
 		!IS_HANDLER_TYPE(krk_currentThread.stack[stackOffset], OP_FILTER_EXCEPT)
 		; stackOffset--);
 	if (stackOffset < exitSlot) {
-		if (exitSlot == 0) {
+		if (exitSlot == 0 && !krk_currentThread.outerStacks) {
 			/*
 			 * No exception was found and we have reached the top of the call stack.
 			 * Call dumpTraceback to present the exception to the user and reset the
@@ -1171,6 +1206,10 @@ static int handleException(void) {
 	return 0;
 }
 
+#ifndef KRK_NO_FILESYSTEM
+static KrkValue runModuleFile(const char * fileName);
+#endif
+
 /**
  * Load a module.
  *
@@ -1315,7 +1354,7 @@ int krk_loadModule(KrkString * path, KrkValue * moduleOut, KrkString * runAs, Kr
 				krk_attachNamedValue(&krk_currentThread.module->fields, "__package__", NONE_VAL());
 			}
 		}
-		krk_runfile(fileName,fileName);
+		runModuleFile(fileName);
 		*moduleOut = OBJECT_VAL(krk_currentThread.module);
 		krk_currentThread.module = enclosing;
 		if (!IS_OBJECT(*moduleOut)) {
@@ -1573,6 +1612,7 @@ int krk_importModule(KrkString * name, KrkString * runAs) {
 			krk_pop(); /* slash-separated */
 			krk_push(current);
 			/* last must be something if we got here, because single-level import happens elsewhere */
+			krk_gcWriteBarrier(AS_OBJECT(krk_currentThread.stack[argBase-1]));
 			krk_tableSet(&AS_INSTANCE(krk_currentThread.stack[argBase-1])->fields, krk_currentThread.stack[argBase+0], krk_peek(0));
 			krk_currentThread.stackTop = krk_currentThread.stack + argBase;
 			krk_currentThread.stackTop[-1] = current;
@@ -1582,6 +1622,7 @@ int krk_importModule(KrkString * name, KrkString * runAs) {
 			if (!krk_loadModule(AS_STRING(krk_currentThread.stack[argBase+1]), &current, AS_STRING(krk_currentThread.stack[argBase+2]),NONE_VAL())) return 0;
 			krk_push(current);
 			if (!IS_NONE(krk_currentThread.stack[argBase-1])) {
+				krk_gcWriteBarrier(AS_OBJECT(krk_currentThread.stack[argBase-1]));
 				krk_tableSet(&AS_INSTANCE(krk_currentThread.stack[argBase-1])->fields, krk_currentThread.stack[argBase+0], krk_peek(0));
 			}
 			/* Is this a package? */
@@ -1647,9 +1688,9 @@ static KrkClass * checkCache(KrkClass * type, KrkString * name, KrkValue * metho
 static void clearCache(KrkClass * type) {
 	if (type->cacheIndex) {
 		type->cacheIndex = 0;
-		for (size_t i = 0; i < type->subclasses.capacity; ++i) {
+		for (size_t i = 0; i < type->subclasses.used; ++i) {
 			KrkTableEntry * entry = &type->subclasses.entries[i];
-			if (entry->key == KWARGS_VAL(0)) continue;
+			if (IS_KWARGS(entry->key)) continue;
 			clearCache(AS_CLASS(entry->key));
 		}
 	}
@@ -1796,8 +1837,180 @@ static int valueGetProperty(KrkString * name) {
 	}
 }
 
+/**
+ * Per-instruction inline caches for GET_PROPERTY and GET_METHOD.
+ *
+ * The common cases - a field read from an instance, or a plain function
+ * found on the receiver's type - are remembered by the instruction, keyed
+ * on the receiver's type and that type's cacheIndex. Anything involving
+ * descriptors, class or static methods, class receivers or __getattr__
+ * is left to valueGetMethod.
+ *
+ * Other threads may be running the same instruction, so entries are built
+ * on the side and published whole by inlineCachePublish, and read through
+ * inlineCacheRead, which gives up on an entry that is being written.
+ */
+static void inlineCachePublish(KrkInlineCache * ic, KrkInlineCache * entry) {
+	size_t sequence = __atomic_load_n(&ic->sequence, __ATOMIC_RELAXED);
+	/* If another thread is already writing this entry, let it. */
+	if ((sequence & 1) || !__atomic_compare_exchange_n(&ic->sequence, &sequence, sequence + 1, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) return;
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	ic->type     = entry->type;
+	ic->version  = entry->version;
+	ic->kind     = entry->kind;
+	ic->layout   = entry->layout;
+	ic->builtins = entry->builtins;
+	ic->slot     = entry->slot;
+	ic->value    = entry->value;
+	__atomic_store_n(&ic->sequence, sequence + 2, __ATOMIC_RELEASE);
+}
+
+static inline int inlineCacheRead(KrkInlineCache * ic, KrkInlineCache * entry) {
+	size_t sequence = __atomic_load_n(&ic->sequence, __ATOMIC_ACQUIRE);
+	if (sequence & 1) return 0;
+	*entry = *ic;
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	return __atomic_load_n(&ic->sequence, __ATOMIC_RELAXED) == sequence;
+}
+
+static int inlineCacheFill(KrkInlineCache * ic, KrkValue this, KrkString * name) {
+	KrkClass * myClass = krk_getType(this);
+	KrkValue method;
+	KrkClass * _class = checkCache(myClass, name, &method);
+	KrkInlineCache entry = {0};
+
+	/* Data descriptors take priority over everything, don't try to cache them. */
+	if (_class) {
+		KrkClass * valtype = krk_getType(method);
+		if (valtype->_descget && valtype->_descset) goto _empty;
+	}
+
+	if (IS_INSTANCE(this)) {
+		KrkTable * fields = &AS_INSTANCE(this)->fields;
+		ssize_t slot = krk_tableSlot(fields, name);
+		entry.layout = krk_tableVersion(fields);
+		if (slot >= 0) {
+			entry.kind = KRK_INLINE_CACHE_FIELD;
+			entry.slot = slot;
+			goto _filled;
+		}
+	} else if (IS_CLASS(this) || IS_CLOSURE(this)) {
+		goto _empty;
+	}
+
+	if (_class && (IS_NATIVE(method) || IS_CLOSURE(method)) && !(AS_OBJECT(method)->flags & KRK_OBJ_FLAGS_FUNCTION_MASK)) {
+		entry.kind  = KRK_INLINE_CACHE_METHOD;
+		entry.value = method;
+		goto _filled;
+	}
+
+_empty:
+	entry.kind = KRK_INLINE_CACHE_EMPTY;
+	inlineCachePublish(ic, &entry);
+	return 0;
+
+_filled:
+	entry.type    = myClass;
+	entry.version = myClass->cacheIndex;
+	inlineCachePublish(ic, &entry);
+	return 1;
+}
+
+/**
+ * Returns 2 with a plain value in @p out, 1 with an unbound method,
+ * or 0 if the cache entry does not apply to this receiver.
+ */
+static inline int inlineCacheGet(KrkInlineCache * ic, KrkValue this, KrkString * name, KrkValue * out) {
+	KrkClass * myClass = krk_getType(this);
+	KrkInlineCache entry;
+	if (!inlineCacheRead(ic, &entry)) return 0;
+	if (entry.type != myClass || entry.version != myClass->cacheIndex) return 0;
+	switch (entry.kind) {
+		case KRK_INLINE_CACHE_FIELD: {
+			KrkTable * fields = &AS_INSTANCE(this)->fields;
+			if (krk_tableCurrentVersion(fields) != entry.layout) return 0;
+			*out = *krk_tableSlotValue(fields, entry.slot);
+			return 2;
+		}
+		case KRK_INLINE_CACHE_METHOD:
+			/* Fields on the instance would shadow the method. */
+			if (IS_INSTANCE(this)) {
+				KrkTable * fields = &AS_INSTANCE(this)->fields;
+				KrkValue unused;
+				if (krk_tableCurrentVersion(fields) != entry.layout && krk_tableGet_fast(fields, name, &unused)) return 0;
+			}
+			*out = entry.value;
+			return 1;
+	}
+	return 0;
+}
+
+static inline KrkInlineCache * inlineCacheFor(KrkCodeObject * function, size_t slot) {
+	if (slot >= function->cacheCount || !function->caches) return NULL;
+	return &function->caches[slot];
+}
+
+static inline int inlineCacheLookup(KrkInlineCache * ic, KrkString * name, KrkValue * out) {
+	if (!ic) return 0;
+	KrkValue this = krk_peek(0);
+	int result = inlineCacheGet(ic, this, name, out);
+	if (!result && inlineCacheFill(ic, this, name)) result = inlineCacheGet(ic, this, name, out);
+	return result;
+}
+
+/**
+ * Look up a global for GET_GLOBAL, falling back to builtins.
+ *
+ * The cache records the slot the name was found in along with the version
+ * of the globals table, and for builtins also the version of the builtins
+ * table, so a hit is still correct after a global is added that shadows a
+ * builtin or a builtin is replaced.
+ */
+static inline int globalLookup(KrkInlineCache * ic, KrkTable * globals, KrkString * name, KrkValue * out) {
+	KrkTable * builtins = &vm.builtins->fields;
+	if (!ic) {
+		return krk_tableGet_fast(globals, name, out) || krk_tableGet_fast(builtins, name, out);
+	}
+
+	KrkInlineCache entry;
+	if (inlineCacheRead(ic, &entry) && krk_tableCurrentVersion(globals) == entry.layout) {
+		if (entry.kind == KRK_INLINE_CACHE_GLOBAL) {
+			*out = *krk_tableSlotValue(globals, entry.slot);
+			return 1;
+		} else if (entry.kind == KRK_INLINE_CACHE_BUILTIN && krk_tableCurrentVersion(builtins) == entry.builtins) {
+			*out = *krk_tableSlotValue(builtins, entry.slot);
+			return 1;
+		}
+	}
+
+	memset(&entry, 0, sizeof(entry));
+	ssize_t slot = krk_tableSlot(globals, name);
+	entry.layout = krk_tableVersion(globals);
+	if (slot >= 0) {
+		entry.kind = KRK_INLINE_CACHE_GLOBAL;
+		entry.slot = slot;
+		inlineCachePublish(ic, &entry);
+		*out = *krk_tableSlotValue(globals, slot);
+		return 1;
+	}
+
+	slot = krk_tableSlot(builtins, name);
+	if (slot >= 0) {
+		entry.kind = KRK_INLINE_CACHE_BUILTIN;
+		entry.builtins = krk_tableVersion(builtins);
+		entry.slot = slot;
+		inlineCachePublish(ic, &entry);
+		*out = *krk_tableSlotValue(builtins, slot);
+		return 1;
+	}
+
+	entry.kind = KRK_INLINE_CACHE_EMPTY;
+	inlineCachePublish(ic, &entry);
+	return 0;
+}
+
 int krk_getAttribute(KrkString * name) {
-	return valueGetProperty(name);
+	return valueGetProperty(krk_internString(name));
 }
 
 KrkValue krk_valueGetAttribute(KrkValue value, char * name) {
@@ -1857,7 +2070,7 @@ static int valueDelProperty(KrkString * name) {
 }
 
 int krk_delAttribute(KrkString * name) {
-	return valueDelProperty(name);
+	return valueDelProperty(krk_internString(name));
 }
 
 KrkValue krk_valueDelAttribute(KrkValue owner, char * name) {
@@ -1888,6 +2101,7 @@ static int _setDescriptor(KrkValue owner, KrkClass * _class, KrkString * name, K
 
 static KrkValue setAttr_wrapper(KrkValue owner, KrkClass * _class, KrkTable * fields, KrkString * name, KrkValue to) {
 	if (_setDescriptor(owner,_class,name,to)) return krk_pop();
+	krk_gcWriteBarrier(AS_OBJECT(owner));
 	krk_tableSet(fields, OBJECT_VAL(name), to);
 	return to;
 }
@@ -1932,7 +2146,7 @@ static int valueSetProperty(KrkString * name) {
 }
 
 int krk_setAttribute(KrkString * name) {
-	return valueSetProperty(name);
+	return valueSetProperty(krk_internString(name));
 }
 
 KrkValue krk_valueSetAttribute(KrkValue owner, char * name, KrkValue to) {
@@ -1949,10 +2163,10 @@ KrkValue krk_valueSetAttribute(KrkValue owner, char * name, KrkValue to) {
 
 #define BINARY_OP(op) { KrkValue b = krk_peek(0); KrkValue a = krk_peek(1); \
 	a = krk_operator_ ## op (a,b); \
-	krk_currentThread.stackTop[-2] = a; krk_pop(); break; }
+	krk_currentThread.stackTop[-2] = a; krk_pop(); DISPATCH(); }
 #define INPLACE_BINARY_OP(op) { KrkValue b = krk_peek(0); KrkValue a = krk_peek(1); \
 	a = krk_operator_i ## op (a,b); \
-	krk_currentThread.stackTop[-2] = a; krk_pop(); break; }
+	krk_currentThread.stackTop[-2] = a; krk_pop(); DISPATCH(); }
 
 extern KrkValue krk_int_op_add(krk_integer_type a, krk_integer_type b);
 extern KrkValue krk_int_op_sub(krk_integer_type a, krk_integer_type b);
@@ -1960,26 +2174,84 @@ extern KrkValue krk_int_op_sub(krk_integer_type a, krk_integer_type b);
 /* These operations are most likely to occur on integers, so we special case them */
 #define LIKELY_INT_BINARY_OP(op) { KrkValue b = krk_peek(0); KrkValue a = krk_peek(1); \
 	if (likely(IS_INTEGER(a) && IS_INTEGER(b))) a = krk_int_op_ ## op (AS_INTEGER(a), AS_INTEGER(b)); \
-	else a = krk_operator_ ## op (a,b); \
-	krk_currentThread.stackTop[-2] = a; krk_pop(); break; }
+	else { quicken(frame, opcode, a, b); a = krk_operator_ ## op (a,b); } \
+	krk_currentThread.stackTop[-2] = a; krk_pop(); DISPATCH(); }
+
+#define QUICKENING_BINARY_OP(op) { KrkValue b = krk_peek(0); KrkValue a = krk_peek(1); \
+	quicken(frame, opcode, a, b); \
+	a = krk_operator_ ## op (a,b); \
+	krk_currentThread.stackTop[-2] = a; krk_pop(); DISPATCH(); }
+
+/* Specialized variants written over generic instructions by quicken() */
+#define SPECIALIZED_BINARY_OP(generic,op,check,result) { KrkValue b = krk_peek(0); KrkValue a = krk_peek(1); \
+	if (likely(check)) a = result; \
+	else { dequicken(frame, generic); a = krk_operator_ ## op (a,b); } \
+	krk_currentThread.stackTop[-2] = a; krk_pop(); DISPATCH(); }
+#define FLOAT_OPERANDS (IS_FLOATING(a) && IS_FLOATING(b))
 
 /* Comparators like these are almost definitely going to happen on integers. */
 #define LIKELY_INT_COMPARE_OP(op,operator) { KrkValue b = krk_peek(0); KrkValue a = krk_peek(1); \
 	if (likely(IS_INTEGER(a) && IS_INTEGER(b))) a = BOOLEAN_VAL(AS_INTEGER(a) operator AS_INTEGER(b)); \
 	else a = krk_operator_ ## op (a,b); \
-	krk_currentThread.stackTop[-2] = a; krk_pop(); break; }
+	krk_currentThread.stackTop[-2] = a; krk_pop(); DISPATCH(); }
 
 #define LIKELY_INT_UNARY_OP(op,operator) { KrkValue a = krk_peek(0); \
 	if (likely(IS_INTEGER(a))) a = INTEGER_VAL(operator AS_INTEGER(a)); \
 	else a = krk_operator_ ## op (a); \
-	krk_currentThread.stackTop[-1] = a; break; }
+	krk_currentThread.stackTop[-1] = a; DISPATCH(); }
+
+/* Arithmetic fused with a following SET_LOCAL and POP */
+#define BINARY_OP_SET_LOCAL_POP(intop,op) { KrkValue b = krk_peek(0); KrkValue a = krk_peek(1); \
+	if (likely(IS_INTEGER(a) && IS_INTEGER(b))) a = krk_int_op_ ## intop (AS_INTEGER(a), AS_INTEGER(b)); \
+	else { \
+		a = krk_operator_ ## op (a,b); \
+		if (unlikely(krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION)) { krk_currentThread.stackTop[-2] = a; krk_pop(); goto _finishException; } \
+	} \
+	krk_currentThread.stackTop -= 2; \
+	krk_currentThread.stack[frame->slots + frame->ip[1]] = a; \
+	frame->ip += 3; DISPATCH(); }
+
+extern KrkValue krk_int_op_mul(krk_integer_type a, krk_integer_type b);
+
+/* Operations on two locals, with their slots as one-byte operands */
+#define LOCAL_OPERANDS KrkValue a = krk_currentThread.stack[frame->slots + frame->ip[0]]; \
+	KrkValue b = krk_currentThread.stack[frame->slots + frame->ip[1]]; \
+	frame->ip += 2;
+
+#define LOCALS_BINARY_OP(op,operator) { LOCAL_OPERANDS \
+	if (likely(IS_INTEGER(a) && IS_INTEGER(b))) krk_push(krk_int_op_ ## op (AS_INTEGER(a), AS_INTEGER(b))); \
+	else if (IS_FLOATING(a) && IS_FLOATING(b)) krk_push(FLOATING_VAL(AS_FLOATING(a) operator AS_FLOATING(b))); \
+	else krk_push(krk_operator_ ## op (a,b)); \
+	DISPATCH(); }
+
+#define LOCALS_COMPARE_OP(op,operator) { LOCAL_OPERANDS \
+	if (likely(IS_INTEGER(a) && IS_INTEGER(b))) krk_push(BOOLEAN_VAL(AS_INTEGER(a) operator AS_INTEGER(b))); \
+	else krk_push(krk_operator_ ## op (a,b)); \
+	DISPATCH(); }
+
+/* Fused with a following SET_LOCAL and POP */
+#define LOCALS_BINARY_OP_SET_LOCAL_POP(op) { LOCAL_OPERANDS \
+	if (likely(IS_INTEGER(a) && IS_INTEGER(b))) a = krk_int_op_ ## op (AS_INTEGER(a), AS_INTEGER(b)); \
+	else { \
+		a = krk_operator_ ## op (a,b); \
+		if (unlikely(krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION)) { krk_push(a); goto _finishException; } \
+	} \
+	krk_currentThread.stack[frame->slots + frame->ip[1]] = a; \
+	frame->ip += 3; DISPATCH(); }
+
+/* Fused with a following POP_JUMP_IF_FALSE or JUMP_IF_FALSE_OR_POP */
+#define LOCALS_COMPARE_JUMP(compare) { LOCAL_OPERANDS \
+	if (unlikely(!fusedCompareJump(frame, compare, a, b))) goto _finishException; \
+	DISPATCH(); }
 
 #define READ_BYTE() (*frame->ip++)
 #define READ_CONSTANT(s) (frame->closure->function->chunk.constants.values[OPERAND])
 #define READ_STRING(s) AS_STRING(READ_CONSTANT(s))
+#define READ_CACHE_SLOT() (frame->ip += 2, (size_t)((frame->ip[-2] << 8) | frame->ip[-1]))
 
 extern FUNC_SIG(list,append);
 extern FUNC_SIG(dict,__setitem__);
+extern FUNC_SIG(str,__add__);
 extern FUNC_SIG(set,add);
 extern FUNC_SIG(list,extend);
 extern FUNC_SIG(dict,update);
@@ -2105,14 +2377,200 @@ int krk_isSubClass(const KrkClass * cls, const KrkClass * base) {
 	return 0;
 }
 
+/**
+ * Quickening
+ *
+ * Generic arithmetic and subscript instructions that keep seeing the same
+ * operand types are rewritten in place to a variant specialized for those
+ * types, which skips the method lookup and call. Each specialized variant
+ * checks its operand types first; if they don't match, it writes the generic
+ * opcode back and does the generic operation.
+ *
+ * Sites are counted in the code object's @c counters array, by instruction
+ * offset. The high byte of a counter holds the specialized opcode the last
+ * execution at that site could have used, the low byte counts how many
+ * executions in a row could have used it.
+ */
+#define QUICKEN_THRESHOLD 8
+
+static size_t quickenedCount[256];
+static size_t dequickenedCount[256];
+
+static uint8_t specializedOpcode(uint8_t opcode, KrkValue a, KrkValue b) {
+#ifndef KRK_NO_FLOAT
+	int floats = IS_FLOATING(a) && IS_FLOATING(b);
+#else
+	int floats = 0;
+#endif
+	switch (opcode) {
+		case OP_ADD:
+			if (floats) return OP_ADD_FLOAT;
+			if (IS_STRING(a) && IS_STRING(b)) return OP_ADD_STR;
+			break;
+		case OP_SUBTRACT: if (floats) return OP_SUBTRACT_FLOAT; break;
+		case OP_MULTIPLY: if (floats) return OP_MULTIPLY_FLOAT; break;
+		case OP_INVOKE_GETTER:
+			if (!IS_INSTANCE(a)) break;
+			if (AS_INSTANCE(a)->_class == vm.baseClasses->listClass && IS_INTEGER(b)) return OP_INVOKE_GETTER_LIST_INT;
+			if (AS_INSTANCE(a)->_class == vm.baseClasses->dictClass && IS_STRING(b)) return OP_INVOKE_GETTER_DICT_STR;
+			break;
+	}
+	return 0;
+}
+
+/**
+ * Called by a generic instruction before it does the generic operation
+ * on @p a and @p b, which it couldn't do more cheaply itself.
+ */
+static void quicken(KrkCallFrame * frame, uint8_t opcode, KrkValue a, KrkValue b) {
+	KrkCodeObject * function = frame->closure->function;
+	uint8_t specialized = specializedOpcode(opcode, a, b);
+	uint16_t * counters = __atomic_load_n(&function->counters, __ATOMIC_ACQUIRE);
+
+	if (!counters) {
+		if (!specialized) return;
+		uint16_t * fresh = calloc(function->chunk.count, sizeof(uint16_t));
+		if (!fresh) return;
+		if (__atomic_compare_exchange_n(&function->counters, &counters, fresh, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+			counters = fresh;
+		} else {
+			free(fresh);
+		}
+	}
+
+	size_t offset = frame->ip - function->chunk.code - 1;
+	uint16_t counter = counters[offset];
+
+	if (!specialized || (counter >> 8) != specialized) {
+		counters[offset] = specialized << 8 | 1;
+	} else if ((counter & 0xFF) + 1 >= QUICKEN_THRESHOLD) {
+		counters[offset] = 0;
+		function->chunk.code[offset] = specialized;
+		__atomic_add_fetch(&quickenedCount[specialized], 1, __ATOMIC_RELAXED);
+	} else {
+		counters[offset] = counter + 1;
+	}
+}
+
+/**
+ * Called by a specialized instruction whose operands did not have the
+ * types it expects, before it does the operation of @p generic instead.
+ */
+static void dequicken(KrkCallFrame * frame, uint8_t generic) {
+	__atomic_add_fetch(&dequickenedCount[frame->ip[-1]], 1, __ATOMIC_RELAXED);
+	frame->ip[-1] = generic;
+}
+
+KrkValue krk_quickeningStats(void) {
+	static const struct { uint8_t opcode; const char * name; } specialized[] = {
+		{OP_ADD_FLOAT, "ADD_FLOAT"},
+		{OP_SUBTRACT_FLOAT, "SUBTRACT_FLOAT"},
+		{OP_MULTIPLY_FLOAT, "MULTIPLY_FLOAT"},
+		{OP_ADD_STR, "ADD_STR"},
+		{OP_INVOKE_GETTER_LIST_INT, "INVOKE_GETTER_LIST_INT"},
+		{OP_INVOKE_GETTER_DICT_STR, "INVOKE_GETTER_DICT_STR"},
+	};
+
+	KrkValue result = krk_dict_of(0,NULL,0);
+	krk_push(result);
+	for (size_t i = 0; i < sizeof(specialized) / sizeof(*specialized); ++i) {
+		KrkTuple * counts = krk_newTuple(2);
+		krk_push(OBJECT_VAL(counts));
+		counts->values.values[counts->values.count++] = INTEGER_VAL(quickenedCount[specialized[i].opcode]);
+		counts->values.values[counts->values.count++] = INTEGER_VAL(dequickenedCount[specialized[i].opcode]);
+		krk_attachNamedValue(AS_DICT(result), specialized[i].name, krk_peek(0));
+		krk_pop();
+	}
+	return krk_pop();
+}
+
+#ifdef KRK_THREADED_DISPATCH
+/* Label addresses and computed gotos are GNU extensions. */
+# pragma GCC diagnostic push
+# pragma GCC diagnostic ignored "-Wpedantic"
+#endif
+
+/**
+ * Comparison @p compare fused with the POP_JUMP_IF_FALSE or
+ * JUMP_IF_FALSE_OR_POP after it. The instruction pointer should
+ * be on the branch, so that exceptions come from the comparison
+ * as they would have without fusing. Returns 0 if the comparison raised.
+ */
+static inline int fusedCompareJump(KrkCallFrame * frame, uint8_t compare, KrkValue a, KrkValue b) {
+	uint8_t branch  = frame->ip[0];
+	uint16_t jump   = (frame->ip[1] << 8) | frame->ip[2];
+	KrkValue result;
+
+	if (likely(IS_INTEGER(a) && IS_INTEGER(b))) {
+		krk_integer_type x = AS_INTEGER(a), y = AS_INTEGER(b);
+		switch (compare) {
+			case OP_LESS:          result = BOOLEAN_VAL(x <  y); break;
+			case OP_LESS_EQUAL:    result = BOOLEAN_VAL(x <= y); break;
+			case OP_GREATER:       result = BOOLEAN_VAL(x >  y); break;
+			case OP_GREATER_EQUAL: result = BOOLEAN_VAL(x >= y); break;
+			default:               result = BOOLEAN_VAL(x == y); break;
+		}
+	} else {
+		switch (compare) {
+			case OP_LESS:          result = krk_operator_lt(a,b); break;
+			case OP_LESS_EQUAL:    result = krk_operator_le(a,b); break;
+			case OP_GREATER:       result = krk_operator_gt(a,b); break;
+			case OP_GREATER_EQUAL: result = krk_operator_ge(a,b); break;
+			default:               result = krk_operator_eq(a,b); break;
+		}
+		if (unlikely(krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION)) return 0;
+	}
+	frame->ip += 3;
+
+	krk_push(result);
+	if (krk_peek(0) == BOOLEAN_VAL(0) || krk_isFalsey(krk_peek(0))) {
+		frame->ip += jump;
+		if (branch == OP_POP_JUMP_IF_FALSE) krk_pop();
+	} else {
+		krk_pop();
+	}
+	return 1;
+}
+
+/**
+ * Hooks that other threads or signal handlers ask for, and that
+ * leave the instruction stream alone, so they can also run in the
+ * middle of an instruction.
+ */
+static void runPendingHooks(void) {
+	if (krk_currentThread.flags & KRK_THREAD_GC_REQUESTED) {
+		krk_gcSafepoint();
+	}
+
+	if (krk_currentThread.flags & KRK_THREAD_PROFILE_SAMPLE) {
+		krk_currentThread.flags &= ~(KRK_THREAD_PROFILE_SAMPLE);
+		krk_profilerSample();
+	}
+}
+
 /**
  * VM main loop.
  */
 static KrkValue run(void) {
 	KrkCallFrame* frame = &krk_currentThread.frames[krk_currentThread.frameCount - 1];
+	KrkOpCode opcode;
+	unsigned int OPERAND;
+
+#ifdef KRK_THREADED_DISPATCH
+	static void * dispatchTable[256] = {
+#include "opcode_dispatch.h"
+	};
+#endif
 
 	while (1) {
-		if (unlikely(krk_currentThread.flags & (KRK_THREAD_ENABLE_TRACING | KRK_THREAD_SINGLE_STEP | KRK_THREAD_SIGNALLED))) {
+#ifdef KRK_THREADED_DISPATCH
+_checkHooks: (void)0;
+#endif
+		if (unlikely(krk_currentThread.flags & (KRK_THREAD_ENABLE_TRACING | KRK_THREAD_SINGLE_STEP | KRK_THREAD_SIGNALLED | KRK_THREAD_PROFILE_SAMPLE | KRK_THREAD_GC_REQUESTED))) {
+			if (krk_currentThread.flags & (KRK_THREAD_PROFILE_SAMPLE | KRK_THREAD_GC_REQUESTED)) {
+				runPendingHooks();
+			}
+
 #ifndef KRK_NO_TRACING
 			if (krk_currentThread.flags & KRK_THREAD_ENABLE_TRACING) {
 				krk_debug_dumpStack(stderr, frame);
@@ -2138,8 +2596,8 @@ _resumeHook: (void)0;
 #endif
 
 		/* Each instruction begins with one opcode byte */
-		KrkOpCode opcode = READ_BYTE();
-		unsigned int OPERAND = 0;
+		opcode = READ_BYTE();
+		OPERAND = 0;
 
 /* Only GCC lets us put these on empty statements; just hope clang doesn't start complaining */
 #ifndef __clang__
@@ -2152,8 +2610,32 @@ _resumeHook: (void)0;
 #define THREE_BYTE_OPERAND { OPERAND = (frame->ip[0] << 16) | (frame->ip[1] << 8); frame->ip += 2; } FALLTHROUGH
 #define ONE_BYTE_OPERAND { OPERAND = (OPERAND & ~0xFF) | READ_BYTE(); }
 
+/*
+ * With threaded dispatch, each handler is also a label whose address is in
+ * dispatchTable, and instructions that complete without raising jump straight
+ * to the next handler instead of going back around the loop. The hooks at the
+ * top of the loop are then only run when tracing or single-stepping is on, or
+ * from the checks for signals and profiler samples at backward jumps and calls -
+ * which is enough to interrupt any loop or recursion.
+ */
+#ifdef KRK_THREADED_DISPATCH
+# define TARGET(opc) case opc: _op_ ## opc:
+# define NEXT_INSTRUCTION() do { if (likely(!(krk_currentThread.flags & (KRK_THREAD_HAS_EXCEPTION | KRK_THREAD_ENABLE_TRACING | KRK_THREAD_SINGLE_STEP)))) { \
+	opcode = READ_BYTE(); OPERAND = 0; goto *dispatchTable[opcode]; } } while (0)
+# define DISPATCH() NEXT_INSTRUCTION(); break
+/* Called partway through an instruction, so only a signal, which abandons it, goes back to the top of the loop */
+# define CHECK_SIGNALS() do { if (unlikely(krk_currentThread.flags & (KRK_THREAD_SIGNALLED | KRK_THREAD_PROFILE_SAMPLE | KRK_THREAD_GC_REQUESTED))) { \
+	if (krk_currentThread.flags & KRK_THREAD_SIGNALLED) goto _checkHooks; \
+	runPendingHooks(); } } while (0)
+		goto *dispatchTable[opcode];
+#else
+# define TARGET(opc) case opc:
+# define DISPATCH() break
+# define CHECK_SIGNALS() do { } while (0)
+#endif
+
 		switch (opcode) {
-			case OP_CLEANUP_WITH: {
+			TARGET(OP_CLEANUP_WITH) {
 				/* Top of stack is a HANDLER that should have had something loaded into it if it was still valid */
 				KrkValue handler = krk_peek(0);
 				KrkValue exceptionObject = krk_peek(1);
@@ -2189,8 +2671,8 @@ _resumeHook: (void)0;
 				}
 				if (AS_HANDLER_TYPE(handler) != OP_RETURN) break;
 				krk_pop(); /* handler */
-			} /* fallthrough */
-			case OP_RETURN: {
+			} FALLTHROUGH
+			TARGET(OP_RETURN) {
 _finishReturn: (void)0;
 				KrkValue result = krk_pop();
 				closeUpvalues(frame->slots);
@@ -2225,93 +2707,94 @@ _finishReturn: (void)0;
 				}
 				krk_push(result);
 				frame = &krk_currentThread.frames[krk_currentThread.frameCount - 1];
-				break;
-			}
-			case OP_LESS:          LIKELY_INT_COMPARE_OP(lt,<)
-			case OP_GREATER:       LIKELY_INT_COMPARE_OP(gt,>)
-			case OP_LESS_EQUAL:    LIKELY_INT_COMPARE_OP(le,<=)
-			case OP_GREATER_EQUAL: LIKELY_INT_COMPARE_OP(ge,>=)
-			case OP_ADD:           LIKELY_INT_BINARY_OP(add)
-			case OP_SUBTRACT:      LIKELY_INT_BINARY_OP(sub)
-			case OP_MULTIPLY:      BINARY_OP(mul)
-			case OP_DIVIDE:        BINARY_OP(truediv)
-			case OP_FLOORDIV:      BINARY_OP(floordiv)
-			case OP_MODULO:        BINARY_OP(mod)
-			case OP_BITOR:         BINARY_OP(or)
-			case OP_BITXOR:        BINARY_OP(xor)
-			case OP_BITAND:        BINARY_OP(and)
-			case OP_SHIFTLEFT:     BINARY_OP(lshift)
-			case OP_SHIFTRIGHT:    BINARY_OP(rshift)
-			case OP_POW:           BINARY_OP(pow)
-			case OP_MATMUL:        BINARY_OP(matmul)
-			case OP_EQUAL:         BINARY_OP(eq);
-			case OP_IS:            BINARY_OP(is);
-			case OP_BITNEGATE:     LIKELY_INT_UNARY_OP(invert,~)
-			case OP_NEGATE:        LIKELY_INT_UNARY_OP(neg,-)
-			case OP_POS:           LIKELY_INT_UNARY_OP(pos,+)
-			case OP_NONE:  krk_push(NONE_VAL()); break;
-			case OP_TRUE:  krk_push(BOOLEAN_VAL(1)); break;
-			case OP_FALSE: krk_push(BOOLEAN_VAL(0)); break;
-			case OP_UNSET: krk_push(KWARGS_VAL(0)); break;
-			case OP_NOT:   krk_currentThread.stackTop[-1] = BOOLEAN_VAL(krk_isFalsey(krk_peek(0))); break;
-			case OP_POP:   krk_pop(); break;
-
-			case OP_INPLACE_ADD:        INPLACE_BINARY_OP(add)
-			case OP_INPLACE_SUBTRACT:   INPLACE_BINARY_OP(sub)
-			case OP_INPLACE_MULTIPLY:   INPLACE_BINARY_OP(mul)
-			case OP_INPLACE_DIVIDE:     INPLACE_BINARY_OP(truediv)
-			case OP_INPLACE_FLOORDIV:   INPLACE_BINARY_OP(floordiv)
-			case OP_INPLACE_MODULO:     INPLACE_BINARY_OP(mod)
-			case OP_INPLACE_BITOR:      INPLACE_BINARY_OP(or)
-			case OP_INPLACE_BITXOR:     INPLACE_BINARY_OP(xor)
-			case OP_INPLACE_BITAND:     INPLACE_BINARY_OP(and)
-			case OP_INPLACE_SHIFTLEFT:  INPLACE_BINARY_OP(lshift)
-			case OP_INPLACE_SHIFTRIGHT: INPLACE_BINARY_OP(rshift)
-			case OP_INPLACE_POW:        INPLACE_BINARY_OP(pow)
-			case OP_INPLACE_MATMUL:     INPLACE_BINARY_OP(matmul)
-
-			case OP_RAISE: {
+				DISPATCH();
+			}
+			TARGET(OP_LESS)          LIKELY_INT_COMPARE_OP(lt,<)
+			TARGET(OP_GREATER)       LIKELY_INT_COMPARE_OP(gt,>)
+			TARGET(OP_LESS_EQUAL)    LIKELY_INT_COMPARE_OP(le,<=)
+			TARGET(OP_GREATER_EQUAL) LIKELY_INT_COMPARE_OP(ge,>=)
+			TARGET(OP_ADD)           LIKELY_INT_BINARY_OP(add)
+			TARGET(OP_SUBTRACT)      LIKELY_INT_BINARY_OP(sub)
+			TARGET(OP_MULTIPLY)      QUICKENING_BINARY_OP(mul)
+			TARGET(OP_DIVIDE)        BINARY_OP(truediv)
+			TARGET(OP_FLOORDIV)      BINARY_OP(floordiv)
+			TARGET(OP_MODULO)        BINARY_OP(mod)
+			TARGET(OP_BITOR)         BINARY_OP(or)
+			TARGET(OP_BITXOR)        BINARY_OP(xor)
+			TARGET(OP_BITAND)        BINARY_OP(and)
+			TARGET(OP_SHIFTLEFT)     BINARY_OP(lshift)
+			TARGET(OP_SHIFTRIGHT)    BINARY_OP(rshift)
+			TARGET(OP_POW)           BINARY_OP(pow)
+			TARGET(OP_MATMUL)        BINARY_OP(matmul)
+			TARGET(OP_EQUAL)         BINARY_OP(eq);
+			TARGET(OP_IS)            BINARY_OP(is);
+			TARGET(OP_BITNEGATE)     LIKELY_INT_UNARY_OP(invert,~)
+			TARGET(OP_NEGATE)        LIKELY_INT_UNARY_OP(neg,-)
+			TARGET(OP_POS)           LIKELY_INT_UNARY_OP(pos,+)
+			TARGET(OP_NONE)  krk_push(NONE_VAL()); DISPATCH();
+			TARGET(OP_TRUE)  krk_push(BOOLEAN_VAL(1)); DISPATCH();
+			TARGET(OP_FALSE) krk_push(BOOLEAN_VAL(0)); DISPATCH();
+			TARGET(OP_UNSET) krk_push(KWARGS_VAL(0)); DISPATCH();
+			TARGET(OP_NOT)   krk_currentThread.stackTop[-1] = BOOLEAN_VAL(krk_isFalsey(krk_peek(0))); DISPATCH();
+			TARGET(OP_POP)   krk_pop(); DISPATCH();
+
+			TARGET(OP_INPLACE_ADD)        INPLACE_BINARY_OP(add)
+			TARGET(OP_INPLACE_SUBTRACT)   INPLACE_BINARY_OP(sub)
+			TARGET(OP_INPLACE_MULTIPLY)   INPLACE_BINARY_OP(mul)
+			TARGET(OP_INPLACE_DIVIDE)     INPLACE_BINARY_OP(truediv)
+			TARGET(OP_INPLACE_FLOORDIV)   INPLACE_BINARY_OP(floordiv)
+			TARGET(OP_INPLACE_MODULO)     INPLACE_BINARY_OP(mod)
+			TARGET(OP_INPLACE_BITOR)      INPLACE_BINARY_OP(or)
+			TARGET(OP_INPLACE_BITXOR)     INPLACE_BINARY_OP(xor)
+			TARGET(OP_INPLACE_BITAND)     INPLACE_BINARY_OP(and)
+			TARGET(OP_INPLACE_SHIFTLEFT)  INPLACE_BINARY_OP(lshift)
+			TARGET(OP_INPLACE_SHIFTRIGHT) INPLACE_BINARY_OP(rshift)
+			TARGET(OP_INPLACE_POW)        INPLACE_BINARY_OP(pow)
+			TARGET(OP_INPLACE_MATMUL)     INPLACE_BINARY_OP(matmul)
+
+			TARGET(OP_RAISE) {
 				krk_raiseException(krk_peek(0), NONE_VAL());
 				goto _finishException;
 			}
-			case OP_RAISE_FROM: {
+			TARGET(OP_RAISE_FROM) {
 				krk_raiseException(krk_peek(1), krk_peek(0));
 				goto _finishException;
 			}
-			case OP_CLOSE_UPVALUE:
+			TARGET(OP_CLOSE_UPVALUE)
 				closeUpvalues((krk_currentThread.stackTop - krk_currentThread.stack)-1);
 				krk_pop();
-				break;
-			case OP_INVOKE_GETTER: {
+				DISPATCH();
+			TARGET(OP_INVOKE_GETTER) {
+				quicken(frame, opcode, krk_peek(1), krk_peek(0));
 				commonMethodInvoke(offsetof(KrkClass,_getter), 2, "'%T' object is not subscriptable");
-				break;
+				DISPATCH();
 			}
-			case OP_INVOKE_SETTER: {
+			TARGET(OP_INVOKE_SETTER) {
 				commonMethodInvoke(offsetof(KrkClass,_setter), 3, "'%T' object doesn't support item assignment");
-				break;
+				DISPATCH();
 			}
-			case OP_INVOKE_DELETE: {
+			TARGET(OP_INVOKE_DELETE) {
 				commonMethodInvoke(offsetof(KrkClass,_delitem), 2, "'%T' object doesn't support item deletion");
 				krk_pop(); /* unused result */
-				break;
+				DISPATCH();
 			}
-			case OP_INVOKE_ITER: {
+			TARGET(OP_INVOKE_ITER) {
 				commonMethodInvoke(offsetof(KrkClass,_iter), 1, "'%T' object is not iterable");
-				break;
+				DISPATCH();
 			}
-			case OP_INVOKE_CONTAINS: {
+			TARGET(OP_INVOKE_CONTAINS) {
 				krk_swap(1); /* operands are backwards */
 				commonMethodInvoke(offsetof(KrkClass,_contains), 2, "'%T' object can not be tested for membership");
-				break;
+				DISPATCH();
 			}
-			case OP_INVOKE_AWAIT: {
+			TARGET(OP_INVOKE_AWAIT) {
 				if (!krk_getAwaitable()) goto _finishException;
-				break;
+				DISPATCH();
 			}
-			case OP_SWAP:
+			TARGET(OP_SWAP)
 				krk_swap(1);
-				break;
-			case OP_FILTER_EXCEPT: {
+				DISPATCH();
+			TARGET(OP_FILTER_EXCEPT) {
 				int isMatch = 0;
 				if (AS_HANDLER_TYPE(krk_peek(1)) == OP_RETURN) {
 					isMatch = 0;
@@ -2336,15 +2819,15 @@ _finishReturn: (void)0;
 				}
 				krk_pop();
 				krk_push(BOOLEAN_VAL(isMatch));
-				break;
+				DISPATCH();
 			}
-			case OP_TRY_ELSE: {
+			TARGET(OP_TRY_ELSE) {
 				if (IS_HANDLER(krk_peek(0))) {
 					krk_currentThread.stackTop[-1] = HANDLER_VAL(OP_FILTER_EXCEPT,AS_HANDLER_TARGET(krk_peek(0)));
 				}
-				break;
+				DISPATCH();
 			}
-			case OP_BEGIN_FINALLY: {
+			TARGET(OP_BEGIN_FINALLY) {
 				if (IS_HANDLER(krk_peek(0))) {
 					if (AS_HANDLER_TYPE(krk_peek(0)) == OP_PUSH_TRY) {
 						krk_currentThread.stackTop[-1] = HANDLER_VAL(OP_BEGIN_FINALLY,AS_HANDLER_TARGET(krk_peek(0)));
@@ -2352,9 +2835,9 @@ _finishReturn: (void)0;
 						krk_currentThread.stackTop[-1] = HANDLER_VAL(OP_BEGIN_FINALLY,AS_HANDLER_TARGET(krk_peek(0)));
 					}
 				}
-				break;
+				DISPATCH();
 			}
-			case OP_END_FINALLY: {
+			TARGET(OP_END_FINALLY) {
 				KrkValue handler = krk_peek(0);
 				if (IS_HANDLER(handler)) {
 					if (AS_HANDLER_TYPE(handler) == OP_RAISE || AS_HANDLER_TYPE(handler) == OP_END_FINALLY) {
@@ -2371,9 +2854,9 @@ _finishReturn: (void)0;
 						goto _finishReturn;
 					}
 				}
-				break;
+				DISPATCH();
 			}
-			case OP_BREAKPOINT: {
+			TARGET(OP_BREAKPOINT) {
 #ifndef KRK_DISABLE_DEBUG
 				/* First off, halt execution. */
 				krk_debugBreakpointHandler();
@@ -2384,14 +2867,14 @@ _finishReturn: (void)0;
 				goto _finishException;
 #endif
 			}
-			case OP_YIELD: {
+			TARGET(OP_YIELD) {
 				KrkValue result = krk_peek(0);
 				krk_currentThread.frameCount--;
 				assert(krk_currentThread.frameCount == (size_t)krk_currentThread.exitOnFrame);
 				/* Do NOT restore the stack */
 				return result;
 			}
-			case OP_ANNOTATE: {
+			TARGET(OP_ANNOTATE) {
 				if (IS_CLOSURE(krk_peek(0))) {
 					krk_swap(1);
 					AS_CLOSURE(krk_peek(1))->annotations = krk_peek(0);
@@ -2403,49 +2886,49 @@ _finishReturn: (void)0;
 					krk_runtimeError(vm.exceptions->typeError, "Can not annotate '%T'.", krk_peek(0));
 					goto _finishException;
 				}
-				break;
+				DISPATCH();
 			}
 
-			case OP_LIST_APPEND_TOP: {
+			TARGET(OP_LIST_APPEND_TOP) {
 				KrkValue list = krk_peek(1);
 				FUNC_NAME(list,append)(2,(KrkValue[]){list,krk_peek(0)},0);
 				krk_pop();
-				break;
+				DISPATCH();
 			}
-			case OP_DICT_SET_TOP: {
+			TARGET(OP_DICT_SET_TOP) {
 				KrkValue dict = krk_peek(2);
 				FUNC_NAME(dict,__setitem__)(3,(KrkValue[]){dict,krk_peek(1),krk_peek(0)},0);
 				krk_pop();
 				krk_pop();
-				break;
+				DISPATCH();
 			}
-			case OP_SET_ADD_TOP: {
+			TARGET(OP_SET_ADD_TOP) {
 				KrkValue set = krk_peek(1);
 				FUNC_NAME(set,add)(2,(KrkValue[]){set,krk_peek(0)},0);
 				krk_pop();
-				break;
+				DISPATCH();
 			}
 
-			case OP_LIST_EXTEND_TOP: {
+			TARGET(OP_LIST_EXTEND_TOP) {
 				KrkValue list = krk_peek(1);
 				FUNC_NAME(list,extend)(2,(KrkValue[]){list,krk_peek(0)},0);
 				krk_pop();
-				break;
+				DISPATCH();
 			}
-			case OP_DICT_UPDATE_TOP: {
+			TARGET(OP_DICT_UPDATE_TOP) {
 				KrkValue dict = krk_peek(1);
 				FUNC_NAME(dict,update)(2,(KrkValue[]){dict,krk_peek(0)},0);
 				krk_pop();
-				break;
+				DISPATCH();
 			}
-			case OP_SET_UPDATE_TOP: {
+			TARGET(OP_SET_UPDATE_TOP) {
 				KrkValue set = krk_peek(1);
 				FUNC_NAME(set,update)(2,(KrkValue[]){set,krk_peek(0)},0);
 				krk_pop();
-				break;
+				DISPATCH();
 			}
 
-			case OP_TUPLE_FROM_LIST: {
+			TARGET(OP_TUPLE_FROM_LIST) {
 				KrkValue list = krk_peek(0);
 				size_t count = AS_LIST(list)->count;
 				KrkValue tuple = OBJECT_VAL(krk_newTuple(count));
@@ -2455,49 +2938,50 @@ _finishReturn: (void)0;
 				}
 				krk_swap(1);
 				krk_pop();
-				break;
+				DISPATCH();
 			}
 
 			/*
 			 * Two-byte operands
 			 */
-			case OP_JUMP_IF_FALSE_OR_POP: {
+			TARGET(OP_JUMP_IF_FALSE_OR_POP) {
 				TWO_BYTE_OPERAND;
 				if (krk_peek(0) == BOOLEAN_VAL(0) || krk_isFalsey(krk_peek(0))) frame->ip += OPERAND;
 				else krk_pop();
-				break;
+				DISPATCH();
 			}
-			case OP_POP_JUMP_IF_FALSE: {
+			TARGET(OP_POP_JUMP_IF_FALSE) {
 				TWO_BYTE_OPERAND;
 				if (krk_peek(0) == BOOLEAN_VAL(0) || krk_isFalsey(krk_peek(0))) frame->ip += OPERAND;
 				krk_pop();
-				break;
+				DISPATCH();
 			}
-			case OP_JUMP_IF_TRUE_OR_POP: {
+			TARGET(OP_JUMP_IF_TRUE_OR_POP) {
 				TWO_BYTE_OPERAND;
 				if (!krk_isFalsey(krk_peek(0))) frame->ip += OPERAND;
 				else krk_pop();
-				break;
+				DISPATCH();
 			}
-			case OP_JUMP: {
+			TARGET(OP_JUMP) {
 				TWO_BYTE_OPERAND;
 				frame->ip += OPERAND;
-				break;
+				DISPATCH();
 			}
-			case OP_LOOP: {
+			TARGET(OP_LOOP) {
 				TWO_BYTE_OPERAND;
 				frame->ip -= OPERAND;
-				break;
+				CHECK_SIGNALS();
+				DISPATCH();
 			}
-			case OP_PUSH_TRY: {
+			TARGET(OP_PUSH_TRY) {
 				TWO_BYTE_OPERAND;
 				uint16_t tryTarget = OPERAND + (frame->ip - frame->closure->function->chunk.code);
 				krk_push(NONE_VAL());
 				KrkValue handler = HANDLER_VAL(OP_PUSH_TRY, tryTarget);
 				krk_push(handler);
-				break;
+				DISPATCH();
 			}
-			case OP_PUSH_WITH: {
+			TARGET(OP_PUSH_WITH) {
 				TWO_BYTE_OPERAND;
 				uint16_t cleanupTarget = OPERAND + (frame->ip - frame->closure->function->chunk.code);
 				KrkValue contextManager = krk_peek(0);
@@ -2513,9 +2997,9 @@ _finishReturn: (void)0;
 				krk_push(NONE_VAL());
 				KrkValue handler = HANDLER_VAL(OP_PUSH_WITH, cleanupTarget);
 				krk_push(handler);
-				break;
+				DISPATCH();
 			}
-			case OP_YIELD_FROM: {
+			TARGET(OP_YIELD_FROM) {
 				TWO_BYTE_OPERAND;
 				uint8_t * exitIp = frame->ip + OPERAND;
 				/* Stack has [iterator] [sent value] */
@@ -2549,146 +3033,235 @@ _finishReturn: (void)0;
 					krk_push(NONE_VAL());
 				}
 				frame->ip = exitIp;
-				break;
+				DISPATCH();
 			}
-			case OP_CALL_ITER: {
+			TARGET(OP_CALL_ITER) {
 				TWO_BYTE_OPERAND;
 				KrkValue iter = krk_peek(0);
 				krk_push(iter);
 				krk_push(krk_callStack(0));
 				/* krk_valuesSame() */
 				if (iter == krk_peek(0)) frame->ip += OPERAND;
-				break;
+				DISPATCH();
 			}
-			case OP_LOOP_ITER: {
+			TARGET(OP_LOOP_ITER) {
 				TWO_BYTE_OPERAND;
+				CHECK_SIGNALS();
 				KrkValue iter = krk_peek(0);
 				krk_push(iter);
 				krk_push(krk_callStack(0));
 				if (iter != krk_peek(0)) frame->ip -= OPERAND;
-				break;
+				DISPATCH();
 			}
-			case OP_TEST_ARG: {
+			TARGET(OP_TEST_ARG) {
 				TWO_BYTE_OPERAND;
 				if (krk_pop() != KWARGS_VAL(0)) frame->ip += OPERAND;
-				break;
+				DISPATCH();
 			}
 
-			case OP_CONSTANT_LONG:
+			TARGET(OP_CONSTANT_LONG)
 				THREE_BYTE_OPERAND;
-			case OP_CONSTANT: {
+			TARGET(OP_CONSTANT) {
 				ONE_BYTE_OPERAND;
 				KrkValue constant = frame->closure->function->chunk.constants.values[OPERAND];
 				krk_push(constant);
-				break;
+				DISPATCH();
 			}
-			case OP_DEFINE_GLOBAL_LONG:
+			TARGET(OP_DEFINE_GLOBAL_LONG)
 				THREE_BYTE_OPERAND;
-			case OP_DEFINE_GLOBAL: {
+			TARGET(OP_DEFINE_GLOBAL) {
 				ONE_BYTE_OPERAND;
 				KrkString * name = READ_STRING(OPERAND);
+				krk_gcWriteBarrierValue(frame->globalsOwner);
 				krk_tableSet(frame->globals, OBJECT_VAL(name), krk_peek(0));
 				krk_pop();
-				break;
+				DISPATCH();
 			}
-			case OP_GET_GLOBAL_LONG:
+			TARGET(OP_GET_GLOBAL_LONG)
 				THREE_BYTE_OPERAND;
-			case OP_GET_GLOBAL: {
+			TARGET(OP_GET_GLOBAL) {
 				ONE_BYTE_OPERAND;
 				KrkString * name = READ_STRING(OPERAND);
+				KrkInlineCache * ic = inlineCacheFor(frame->closure->function, READ_CACHE_SLOT());
 				KrkValue value;
-				if (!krk_tableGet_fast(frame->globals, name, &value)) {
-					if (!krk_tableGet_fast(&vm.builtins->fields, name, &value)) {
-						krk_runtimeError(vm.exceptions->nameError, "Undefined variable '%S'.", name);
-						goto _finishException;
-					}
+				if (!globalLookup(ic, frame->globals, name, &value)) {
+					krk_runtimeError(vm.exceptions->nameError, "Undefined variable '%S'.", name);
+					goto _finishException;
 				}
 				krk_push(value);
-				break;
+				DISPATCH();
 			}
-			case OP_SET_GLOBAL_LONG:
+			TARGET(OP_SET_GLOBAL_LONG)
 				THREE_BYTE_OPERAND;
-			case OP_SET_GLOBAL: {
+			TARGET(OP_SET_GLOBAL) {
 				ONE_BYTE_OPERAND;
 				KrkString * name = READ_STRING(OPERAND);
+				krk_gcWriteBarrierValue(frame->globalsOwner);
 				if (!krk_tableSetIfExists(frame->globals, OBJECT_VAL(name), krk_peek(0))) {
 					krk_runtimeError(vm.exceptions->nameError, "Undefined variable '%S'.", name);
 					goto _finishException;
 				}
-				break;
+				DISPATCH();
 			}
-			case OP_DEL_GLOBAL_LONG:
+			TARGET(OP_DEL_GLOBAL_LONG)
 				THREE_BYTE_OPERAND;
-			case OP_DEL_GLOBAL: {
+			TARGET(OP_DEL_GLOBAL) {
 				ONE_BYTE_OPERAND;
 				KrkString * name = READ_STRING(OPERAND);
 				if (!krk_tableDelete(frame->globals, OBJECT_VAL(name))) {
 					krk_runtimeError(vm.exceptions->nameError, "Undefined variable '%S'.", name);
 					goto _finishException;
 				}
-				break;
+				DISPATCH();
 			}
-			case OP_IMPORT_LONG:
+			TARGET(OP_IMPORT_LONG)
 				THREE_BYTE_OPERAND;
-			case OP_IMPORT: {
+			TARGET(OP_IMPORT) {
 				ONE_BYTE_OPERAND;
 				KrkString * name = READ_STRING(OPERAND);
 				if (!krk_doRecursiveModuleLoad(name)) {
 					goto _finishException;
 				}
-				break;
+				DISPATCH();
 			}
-			case OP_GET_LOCAL_LONG:
+			TARGET(OP_GET_LOCAL_LONG)
 				THREE_BYTE_OPERAND;
-			case OP_GET_LOCAL: {
+			TARGET(OP_GET_LOCAL) {
 				ONE_BYTE_OPERAND;
 				krk_push(krk_currentThread.stack[frame->slots + OPERAND]);
-				break;
+				DISPATCH();
 			}
-			case OP_SET_LOCAL_LONG:
+			TARGET(OP_SET_LOCAL_LONG)
 				THREE_BYTE_OPERAND;
-			case OP_SET_LOCAL: {
+			TARGET(OP_SET_LOCAL) {
 				ONE_BYTE_OPERAND;
 				krk_currentThread.stack[frame->slots + OPERAND] = krk_peek(0);
-				break;
+				DISPATCH();
 			}
-			case OP_SET_LOCAL_POP_LONG:
+			TARGET(OP_SET_LOCAL_POP_LONG)
 				THREE_BYTE_OPERAND;
-			case OP_SET_LOCAL_POP: {
+			TARGET(OP_SET_LOCAL_POP) {
 				ONE_BYTE_OPERAND;
 				krk_currentThread.stack[frame->slots + OPERAND] = krk_pop();
-				break;
+				DISPATCH();
+			}
+			/* Superinstructions; see fuseInstructions in the compiler for their layouts. */
+			TARGET(OP_GET_LOCAL_GET_LOCAL) {
+				krk_push(krk_currentThread.stack[frame->slots + frame->ip[0]]);
+				krk_push(krk_currentThread.stack[frame->slots + frame->ip[2]]);
+				frame->ip += 3;
+				DISPATCH();
+			}
+			TARGET(OP_GET_LOCAL_CONSTANT) {
+				krk_push(krk_currentThread.stack[frame->slots + frame->ip[0]]);
+				krk_push(frame->closure->function->chunk.constants.values[frame->ip[2]]);
+				frame->ip += 3;
+				DISPATCH();
+			}
+			TARGET(OP_GET_LOCAL_CONSTANT_COMPARE_JUMP) {
+				KrkValue a = krk_currentThread.stack[frame->slots + frame->ip[0]];
+				KrkValue b = frame->closure->function->chunk.constants.values[frame->ip[2]];
+				uint8_t compare = frame->ip[3];
+				frame->ip += 4;
+				if (unlikely(!fusedCompareJump(frame, compare, a, b))) goto _finishException;
+				DISPATCH();
+			}
+			TARGET(OP_ADD_SET_LOCAL_POP)              BINARY_OP_SET_LOCAL_POP(add,add)
+			TARGET(OP_SUBTRACT_SET_LOCAL_POP)         BINARY_OP_SET_LOCAL_POP(sub,sub)
+			TARGET(OP_INPLACE_ADD_SET_LOCAL_POP)      BINARY_OP_SET_LOCAL_POP(add,iadd)
+			TARGET(OP_INPLACE_SUBTRACT_SET_LOCAL_POP) BINARY_OP_SET_LOCAL_POP(sub,isub)
+			TARGET(OP_ADD_LOCALS)           LOCALS_BINARY_OP(add,+)
+			TARGET(OP_SUBTRACT_LOCALS)      LOCALS_BINARY_OP(sub,-)
+			TARGET(OP_MULTIPLY_LOCALS)      LOCALS_BINARY_OP(mul,*)
+			TARGET(OP_LESS_LOCALS)          LOCALS_COMPARE_OP(lt,<)
+			TARGET(OP_LESS_EQUAL_LOCALS)    LOCALS_COMPARE_OP(le,<=)
+			TARGET(OP_GREATER_LOCALS)       LOCALS_COMPARE_OP(gt,>)
+			TARGET(OP_GREATER_EQUAL_LOCALS) LOCALS_COMPARE_OP(ge,>=)
+			TARGET(OP_EQUAL_LOCALS)         LOCALS_COMPARE_OP(eq,==)
+			TARGET(OP_ADD_LOCALS_SET_LOCAL_POP)      LOCALS_BINARY_OP_SET_LOCAL_POP(add)
+			TARGET(OP_SUBTRACT_LOCALS_SET_LOCAL_POP) LOCALS_BINARY_OP_SET_LOCAL_POP(sub)
+			TARGET(OP_MULTIPLY_LOCALS_SET_LOCAL_POP) LOCALS_BINARY_OP_SET_LOCAL_POP(mul)
+			TARGET(OP_LESS_LOCALS_JUMP)          LOCALS_COMPARE_JUMP(OP_LESS)
+			TARGET(OP_LESS_EQUAL_LOCALS_JUMP)    LOCALS_COMPARE_JUMP(OP_LESS_EQUAL)
+			TARGET(OP_GREATER_LOCALS_JUMP)       LOCALS_COMPARE_JUMP(OP_GREATER)
+			TARGET(OP_GREATER_EQUAL_LOCALS_JUMP) LOCALS_COMPARE_JUMP(OP_GREATER_EQUAL)
+			TARGET(OP_EQUAL_LOCALS_JUMP)         LOCALS_COMPARE_JUMP(OP_EQUAL)
+			/* Quickened instructions; see quicken() */
+			TARGET(OP_ADD_FLOAT)      SPECIALIZED_BINARY_OP(OP_ADD,add,FLOAT_OPERANDS,FLOATING_VAL(AS_FLOATING(a) + AS_FLOATING(b)))
+			TARGET(OP_SUBTRACT_FLOAT) SPECIALIZED_BINARY_OP(OP_SUBTRACT,sub,FLOAT_OPERANDS,FLOATING_VAL(AS_FLOATING(a) - AS_FLOATING(b)))
+			TARGET(OP_MULTIPLY_FLOAT) SPECIALIZED_BINARY_OP(OP_MULTIPLY,mul,FLOAT_OPERANDS,FLOATING_VAL(AS_FLOATING(a) * AS_FLOATING(b)))
+			TARGET(OP_ADD_STR)        SPECIALIZED_BINARY_OP(OP_ADD,add,IS_STRING(a) && IS_STRING(b),FUNC_NAME(str,__add__)(2,(KrkValue[]){a,b},0))
+			TARGET(OP_INVOKE_GETTER_LIST_INT) {
+				KrkValue b = krk_peek(0);
+				KrkValue a = krk_peek(1);
+				if (likely(IS_INSTANCE(a) && AS_INSTANCE(a)->_class == vm.baseClasses->listClass && IS_INTEGER(b))) {
+					KrkList * list = (KrkList*)AS_OBJECT(a);
+					krk_integer_type index = AS_INTEGER(b);
+					if (vm.globalFlags & KRK_GLOBAL_THREADS) _obtain_read_lock(&list->rwlock);
+					if (index < 0) index += list->values.count;
+					int found = index >= 0 && index < (krk_integer_type)list->values.count;
+					if (likely(found)) a = list->values.values[index];
+					if (vm.globalFlags & KRK_GLOBAL_THREADS) pthread_rwlock_unlock(&list->rwlock);
+					if (likely(found)) {
+						krk_currentThread.stackTop[-2] = a;
+						krk_pop();
+						DISPATCH();
+					}
+				} else {
+					dequicken(frame, OP_INVOKE_GETTER);
+				}
+				/* Let the generic path raise the IndexError */
+				commonMethodInvoke(offsetof(KrkClass,_getter), 2, "'%T' object is not subscriptable");
+				DISPATCH();
+			}
+			TARGET(OP_INVOKE_GETTER_DICT_STR) {
+				KrkValue b = krk_peek(0);
+				KrkValue a = krk_peek(1);
+				if (likely(IS_INSTANCE(a) && AS_INSTANCE(a)->_class == vm.baseClasses->dictClass && IS_STRING(b))) {
+					KrkValue value;
+					if (likely(krk_tableGet(AS_DICT(a), b, &value))) {
+						krk_currentThread.stackTop[-2] = value;
+						krk_pop();
+						DISPATCH();
+					}
+				} else {
+					dequicken(frame, OP_INVOKE_GETTER);
+				}
+				commonMethodInvoke(offsetof(KrkClass,_getter), 2, "'%T' object is not subscriptable");
+				DISPATCH();
 			}
-			case OP_CALL_LONG:
+			TARGET(OP_CALL_LONG)
 				THREE_BYTE_OPERAND;
-			case OP_CALL: {
+			TARGET(OP_CALL) {
 				ONE_BYTE_OPERAND;
+				CHECK_SIGNALS();
 				if (unlikely(!krk_callValue(krk_peek(OPERAND), OPERAND, 1))) goto _finishException;
 				frame = &krk_currentThread.frames[krk_currentThread.frameCount - 1];
-				break;
+				DISPATCH();
 			}
-			case OP_CALL_METHOD_LONG:
+			TARGET(OP_CALL_METHOD_LONG)
 				THREE_BYTE_OPERAND;
-			case OP_CALL_METHOD: {
+			TARGET(OP_CALL_METHOD) {
 				ONE_BYTE_OPERAND;
+				CHECK_SIGNALS();
 				if (IS_NONE(krk_peek(OPERAND+1))) {
 					if (unlikely(!krk_callValue(krk_peek(OPERAND), OPERAND, 2))) goto _finishException;
 				} else {
 					if (unlikely(!krk_callValue(krk_peek(OPERAND+1), OPERAND+1, 1))) goto _finishException;
 				}
 				frame = &krk_currentThread.frames[krk_currentThread.frameCount - 1];
-				break;
+				DISPATCH();
 			}
-			case OP_EXPAND_ARGS_LONG:
+			TARGET(OP_EXPAND_ARGS_LONG)
 				THREE_BYTE_OPERAND;
-			case OP_EXPAND_ARGS: {
+			TARGET(OP_EXPAND_ARGS) {
 				ONE_BYTE_OPERAND;
 				krk_push(KWARGS_VAL(KWARGS_SINGLE-OPERAND));
-				break;
+				DISPATCH();
 			}
-			case OP_CLOSURE_LONG:
+			TARGET(OP_CLOSURE_LONG)
 				THREE_BYTE_OPERAND;
-			case OP_CLOSURE: {
+			TARGET(OP_CLOSURE) {
 				ONE_BYTE_OPERAND;
 				KrkCodeObject * function = AS_codeobject(READ_CONSTANT(OPERAND));
 				KrkClosure * closure = krk_newClosure(function, frame->globalsOwner);
@@ -2710,25 +3283,28 @@ _finishReturn: (void)0;
 						closure->upvalues[i] = frame->closure->upvalues[index];
 					}
 				}
-				break;
+				DISPATCH();
 			}
-			case OP_GET_UPVALUE_LONG:
+			TARGET(OP_GET_UPVALUE_LONG)
 				THREE_BYTE_OPERAND;
-			case OP_GET_UPVALUE: {
+			TARGET(OP_GET_UPVALUE) {
 				ONE_BYTE_OPERAND;
 				krk_push(*UPVALUE_LOCATION(frame->closure->upvalues[OPERAND]));
-				break;
+				DISPATCH();
 			}
-			case OP_SET_UPVALUE_LONG:
+			TARGET(OP_SET_UPVALUE_LONG)
 				THREE_BYTE_OPERAND;
-			case OP_SET_UPVALUE: {
+			TARGET(OP_SET_UPVALUE) {
 				ONE_BYTE_OPERAND;
-				*UPVALUE_LOCATION(frame->closure->upvalues[OPERAND]) = krk_peek(0);
-				break;
+				KrkUpvalue * upvalue = frame->closure->upvalues[OPERAND];
+				*UPVALUE_LOCATION(upvalue) = krk_peek(0);
+				krk_gcWriteBarrier((KrkObj*)upvalue);
+				if (upvalue->location != -1 && upvalue->segmentOwner) krk_gcWriteBarrier(upvalue->segmentOwner);
+				DISPATCH();
 			}
-			case OP_IMPORT_FROM_LONG:
+			TARGET(OP_IMPORT_FROM_LONG)
 				THREE_BYTE_OPERAND;
-			case OP_IMPORT_FROM: {
+			TARGET(OP_IMPORT_FROM) {
 				ONE_BYTE_OPERAND;
 				KrkString * name = READ_STRING(OPERAND);
 				if (unlikely(!valueGetProperty(name))) {
@@ -2751,63 +3327,73 @@ _finishReturn: (void)0;
 					krk_currentThread.stackTop[-3] = krk_currentThread.stackTop[-1];
 					krk_currentThread.stackTop -= 2;
 				}
-			} break;
-			case OP_GET_PROPERTY_LONG:
+			} DISPATCH();
+			TARGET(OP_GET_PROPERTY_LONG)
 				THREE_BYTE_OPERAND;
-			case OP_GET_PROPERTY: {
+			TARGET(OP_GET_PROPERTY) {
 				ONE_BYTE_OPERAND;
 				KrkString * name = READ_STRING(OPERAND);
+				KrkInlineCache * ic = inlineCacheFor(frame->closure->function, READ_CACHE_SLOT());
+				KrkValue value;
+				int cached = inlineCacheLookup(ic, name, &value);
+				if (cached == 2) {
+					krk_currentThread.stackTop[-1] = value;
+					break;
+				} else if (cached == 1) {
+					krk_currentThread.stackTop[-1] = OBJECT_VAL(krk_newBoundMethod(krk_currentThread.stackTop[-1], AS_OBJECT(value)));
+					break;
+				}
 				if (unlikely(!valueGetProperty(name))) {
 					krk_runtimeError(vm.exceptions->attributeError, "'%T' object has no attribute '%S'", krk_peek(0), name);
 					goto _finishException;
 				}
-				break;
+				DISPATCH();
 			}
-			case OP_DEL_PROPERTY_LONG:
+			TARGET(OP_DEL_PROPERTY_LONG)
 				THREE_BYTE_OPERAND;
-			case OP_DEL_PROPERTY: {
+			TARGET(OP_DEL_PROPERTY) {
 				ONE_BYTE_OPERAND;
 				KrkString * name = READ_STRING(OPERAND);
 				if (unlikely(!valueDelProperty(name))) {
 					krk_runtimeError(vm.exceptions->attributeError, "'%T' object has no attribute '%S'", krk_peek(0), name);
 					goto _finishException;
 				}
-				break;
+				DISPATCH();
 			}
-			case OP_SET_PROPERTY_LONG:
+			TARGET(OP_SET_PROPERTY_LONG)
 				THREE_BYTE_OPERAND;
-			case OP_SET_PROPERTY: {
+			TARGET(OP_SET_PROPERTY) {
 				ONE_BYTE_OPERAND;
 				KrkString * name = READ_STRING(OPERAND);
 				if (unlikely(!valueSetProperty(name))) {
 					krk_runtimeError(vm.exceptions->attributeError, "'%T' object has no attribute '%S'", krk_peek(1), name);
 					goto _finishException;
 				}
-				break;
+				DISPATCH();
 			}
-			case OP_SET_NAME_LONG:
+			TARGET(OP_SET_NAME_LONG)
 				THREE_BYTE_OPERAND;
-			case OP_SET_NAME: {
+			TARGET(OP_SET_NAME) {
 				ONE_BYTE_OPERAND;
 				krk_push(krk_currentThread.stack[frame->slots]);
 				krk_swap(1);
 				krk_push(OBJECT_VAL(READ_STRING(OPERAND)));
 				krk_swap(1);
 				commonMethodInvoke(offsetof(KrkClass,_setter), 3, "'%T' object doesn't support item assignment");
-				break;
+				DISPATCH();
 			}
-			case OP_GET_NAME_LONG:
+			TARGET(OP_GET_NAME_LONG)
 				THREE_BYTE_OPERAND;
-			case OP_GET_NAME: {
+			TARGET(OP_GET_NAME) {
 				ONE_BYTE_OPERAND;
 				krk_push(krk_currentThread.stack[frame->slots]);
 				krk_push(OBJECT_VAL(READ_STRING(OPERAND)));
 				commonMethodInvoke(offsetof(KrkClass,_getter), 2, "'%T' object doesn't support item assignment");
-				break;
+				DISPATCH();
 			}
-			case OP_GET_SUPER_LONG:
+			TARGET(OP_GET_SUPER_LONG)
 				THREE_BYTE_OPERAND;
-			case OP_GET_SUPER: {
+			TARGET(OP_GET_SUPER) {
 				ONE_BYTE_OPERAND;
 				KrkString * name = READ_STRING(OPERAND);
 				KrkValue baseClass = krk_peek(1);
@@ -2849,13 +3435,25 @@ _finishReturn: (void)0;
 				krk_swap(1);
 				/* Pop super class */
 				krk_pop();
-				break;
+				DISPATCH();
 			}
-			case OP_GET_METHOD_LONG:
+			TARGET(OP_GET_METHOD_LONG)
 				THREE_BYTE_OPERAND;
-			case OP_GET_METHOD: {
+			TARGET(OP_GET_METHOD) {
 				ONE_BYTE_OPERAND;
 				KrkString * name = READ_STRING(OPERAND);
+				KrkInlineCache * ic = inlineCacheFor(frame->closure->function, READ_CACHE_SLOT());
+				KrkValue value;
+				int cached = inlineCacheLookup(ic, name, &value);
+				if (cached == 2) {
+					krk_currentThread.stackTop[-1] = NONE_VAL();
+					krk_push(value);
+					break;
+				} else if (cached == 1) {
+					krk_push(value);
+					krk_swap(1);
+					break;
+				}
 				int result = valueGetMethod(name);
 				if (result == 2) {
 					krk_push(NONE_VAL());
@@ -2867,35 +3465,35 @@ _finishReturn: (void)0;
 				} else {
 					krk_swap(1); /* unbound-method object */
 				}
-				break;
+				DISPATCH();
 			}
-			case OP_DUP_LONG:
+			TARGET(OP_DUP_LONG)
 				THREE_BYTE_OPERAND;
-			case OP_DUP:
+			TARGET(OP_DUP)
 				ONE_BYTE_OPERAND;
 				krk_push(krk_peek(OPERAND));
-				break;
-			case OP_KWARGS_LONG:
+				DISPATCH();
+			TARGET(OP_KWARGS_LONG)
 				THREE_BYTE_OPERAND;
-			case OP_KWARGS: {
+			TARGET(OP_KWARGS) {
 				ONE_BYTE_OPERAND;
 				krk_push(KWARGS_VAL(OPERAND));
-				break;
+				DISPATCH();
 			}
-			case OP_CLOSE_MANY_LONG:
+			TARGET(OP_CLOSE_MANY_LONG)
 				THREE_BYTE_OPERAND;
-			case OP_CLOSE_MANY: {
+			TARGET(OP_CLOSE_MANY) {
 				ONE_BYTE_OPERAND;
 				closeUpvalues((krk_currentThread.stackTop - krk_currentThread.stack) - OPERAND);
 				for (unsigned int i = 0; i < OPERAND; ++i) {
 					krk_pop();
 				}
-				break;
+				DISPATCH();
 			}
 
-			case OP_EXIT_LOOP_LONG:
+			TARGET(OP_EXIT_LOOP_LONG)
 				THREE_BYTE_OPERAND;
-			case OP_EXIT_LOOP: {
+			TARGET(OP_EXIT_LOOP) {
 				ONE_BYTE_OPERAND;
 _finishPopBlock:
 				closeUpvalues(frame->slots + OPERAND);
@@ -2917,84 +3515,84 @@ _finishPopBlock:
 				}
 
 				/* Continue normally */
-				break;
+				DISPATCH();
 			}
 
-			case OP_POP_MANY_LONG:
+			TARGET(OP_POP_MANY_LONG)
 				THREE_BYTE_OPERAND;
-			case OP_POP_MANY: {
+			TARGET(OP_POP_MANY) {
 				ONE_BYTE_OPERAND;
 				for (unsigned int i = 0; i < OPERAND; ++i) {
 					krk_pop();
 				}
-				break;
+				DISPATCH();
 			}
-			case OP_TUPLE_LONG:
+			TARGET(OP_TUPLE_LONG)
 				THREE_BYTE_OPERAND;
-			case OP_TUPLE: {
+			TARGET(OP_TUPLE) {
 				ONE_BYTE_OPERAND;
 				makeCollection(krk_tuple_of, OPERAND);
-				break;
+				DISPATCH();
 			}
-			case OP_MAKE_LIST_LONG:
+			TARGET(OP_MAKE_LIST_LONG)
 				THREE_BYTE_OPERAND;
-			case OP_MAKE_LIST: {
+			TARGET(OP_MAKE_LIST) {
 				ONE_BYTE_OPERAND;
 				makeCollection(krk_list_of, OPERAND);
-				break;
+				DISPATCH();
 			}
-			case OP_MAKE_DICT_LONG:
+			TARGET(OP_MAKE_DICT_LONG)
 				THREE_BYTE_OPERAND;
-			case OP_MAKE_DICT: {
+			TARGET(OP_MAKE_DICT) {
 				ONE_BYTE_OPERAND;
 				makeCollection(krk_dict_of, OPERAND);
-				break;
+				DISPATCH();
 			}
-			case OP_MAKE_SET_LONG:
+			TARGET(OP_MAKE_SET_LONG)
 				THREE_BYTE_OPERAND;
-			case OP_MAKE_SET: {
+			TARGET(OP_MAKE_SET) {
 				ONE_BYTE_OPERAND;
 				makeCollection(krk_set_of, OPERAND);
-				break;
+				DISPATCH();
 			}
-			case OP_SLICE_LONG:
+			TARGET(OP_SLICE_LONG)
 				THREE_BYTE_OPERAND;
-			case OP_SLICE: {
+			TARGET(OP_SLICE) {
 				ONE_BYTE_OPERAND;
 				makeCollection(krk_slice_of, OPERAND);
-				break;
+				DISPATCH();
 			}
-			case OP_LIST_APPEND_LONG:
+			TARGET(OP_LIST_APPEND_LONG)
 				THREE_BYTE_OPERAND;
-			case OP_LIST_APPEND: {
+			TARGET(OP_LIST_APPEND) {
 				ONE_BYTE_OPERAND;
 				KrkValue list = krk_currentThread.stack[frame->slots + OPERAND];
 				FUNC_NAME(list,append)(2,(KrkValue[]){list,krk_peek(0)},0);
 				krk_pop();
-				break;
+				DISPATCH();
 			}
-			case OP_DICT_SET_LONG:
+			TARGET(OP_DICT_SET_LONG)
 				THREE_BYTE_OPERAND;
-			case OP_DICT_SET: {
+			TARGET(OP_DICT_SET) {
 				ONE_BYTE_OPERAND;
 				KrkValue dict = krk_currentThread.stack[frame->slots + OPERAND];
 				FUNC_NAME(dict,__setitem__)(3,(KrkValue[]){dict,krk_peek(1),krk_peek(0)},0);
 				krk_pop();
 				krk_pop();
-				break;
+				DISPATCH();
 			}
-			case OP_SET_ADD_LONG:
+			TARGET(OP_SET_ADD_LONG)
 				THREE_BYTE_OPERAND;
-			case OP_SET_ADD: {
+			TARGET(OP_SET_ADD) {
 				ONE_BYTE_OPERAND;
 				KrkValue set = krk_currentThread.stack[frame->slots + OPERAND];
 				FUNC_NAME(set,add)(2,(KrkValue[]){set,krk_peek(0)},0);
 				krk_pop();
-				break;
+				DISPATCH();
 			}
-			case OP_REVERSE_LONG:
+			TARGET(OP_REVERSE_LONG)
 				THREE_BYTE_OPERAND;
-			case OP_REVERSE: {
+			TARGET(OP_REVERSE) {
 				ONE_BYTE_OPERAND;
 				krk_push(NONE_VAL()); /* Storage space */
 				for (ssize_t i = 0; i < (ssize_t)OPERAND / 2; ++i) {
@@ -3003,11 +3601,11 @@ _finishPopBlock:
 					krk_currentThread.stackTop[-(OPERAND-i)-1] = krk_currentThread.stackTop[-1];
 				}
 				krk_pop();
-				break;
+				DISPATCH();
 			}
-			case OP_UNPACK_LONG:
+			TARGET(OP_UNPACK_LONG)
 				THREE_BYTE_OPERAND;
-			case OP_UNPACK: {
+			TARGET(OP_UNPACK) {
 				ONE_BYTE_OPERAND;
 				KrkValue sequence = krk_peek(0);
 				KrkTuple * values = krk_newTuple(OPERAND);
@@ -3031,20 +3629,20 @@ _finishPopBlock:
 					krk_push(values->values.values[i]);
 				}
 				krk_currentThread.stackTop[-(ssize_t)OPERAND] = values->values.values[0];
-				break;
+				DISPATCH();
 			}
 
-			case OP_FORMAT_VALUE_LONG:
+			TARGET(OP_FORMAT_VALUE_LONG)
 				THREE_BYTE_OPERAND;
-			case OP_FORMAT_VALUE: {
+			TARGET(OP_FORMAT_VALUE) {
 				ONE_BYTE_OPERAND;
 				if (doFormatString(OPERAND)) goto _finishException;
-				break;
+				DISPATCH();
 			}
 
-			case OP_MAKE_STRING_LONG:
+			TARGET(OP_MAKE_STRING_LONG)
 				THREE_BYTE_OPERAND;
-			case OP_MAKE_STRING: {
+			TARGET(OP_MAKE_STRING) {
 				ONE_BYTE_OPERAND;
 
 				struct StringBuilder sb = {0};
@@ -3064,22 +3662,22 @@ _finishPopBlock:
 				}
 
 				krk_push(finishStringBuilder(&sb));
-				break;
+				DISPATCH();
 			}
 
-			case OP_MISSING_KW_LONG:
+			TARGET(OP_MISSING_KW_LONG)
 				THREE_BYTE_OPERAND;
-			case OP_MISSING_KW: {
+			TARGET(OP_MISSING_KW) {
 				ONE_BYTE_OPERAND;
 				krk_runtimeError(vm.exceptions->typeError, "%s() missing required keyword-only argument: %R",
 					frame->closure->function->name ? frame->closure->function->name->chars : "<unnamed>",
 					frame->closure->function->keywordArgNames.values[OPERAND]);
-				break;
+				DISPATCH();
 			}
 
-			case OP_UNPACK_EX_LONG:
+			TARGET(OP_UNPACK_EX_LONG)
 				THREE_BYTE_OPERAND;
-			case OP_UNPACK_EX: {
+			TARGET(OP_UNPACK_EX) {
 				ONE_BYTE_OPERAND;
 				unsigned char before = OPERAND >> 8;
 				unsigned char after = OPERAND;
@@ -3129,13 +3727,16 @@ _finishPopBlock:
 					krk_push(values->values.values[i]);
 				}
 				krk_currentThread.stackTop[-(ssize_t)(before + after + 1)] = values->values.values[0];
-				break;
+				DISPATCH();
 			}
 
 
 			default:
 				__builtin_unreachable();
 		}
+#ifdef KRK_THREADED_DISPATCH
+		NEXT_INSTRUCTION();
+#endif
 		if (unlikely(krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION)) {
 _finishException:
 			if (!handleException()) {
@@ -3159,8 +3760,16 @@ _finishException:
 	}
 #undef BINARY_OP
 #undef READ_BYTE
+#undef TARGET
+#undef DISPATCH
+#undef NEXT_INSTRUCTION
+#undef CHECK_SIGNALS
 }
 
+#ifdef KRK_THREADED_DISPATCH
+# pragma GCC diagnostic pop
+#endif
+
 /**
  * Run the VM until it returns from the current call frame;
  * used by native methods to call into managed methods.
@@ -3187,13 +3796,7 @@ KrkInstance * krk_startModule(const char * name) {
 	return module;
 }
 
-KrkValue krk_interpret(const char * src, char * fromFile) {
-	KrkCodeObject * function = krk_compile(src, fromFile);
-	if (!function) {
-		if (!krk_currentThread.frameCount) handleException();
-		return NONE_VAL();
-	}
-
+static KrkValue runModuleCode(KrkCodeObject * function) {
 	krk_push(OBJECT_VAL(function));
 	krk_attachNamedObject(&krk_currentThread.module->fields, "__file__", (KrkObj*)function->chunk.filename);
 	KrkClosure * closure = krk_newClosure(function, OBJECT_VAL(krk_currentThread.module));
@@ -3203,12 +3806,22 @@ KrkValue krk_interpret(const char * src, char * fromFile) {
 	return krk_callStack(0);
 }
 
+KrkValue krk_interpret(const char * src, char * fromFile) {
+	KrkCodeObject * function = krk_compile(src, fromFile);
+	if (!function) {
+		if (!krk_currentThread.frameCount) handleException();
+		return NONE_VAL();
+	}
+
+	return runModuleCode(function);
+}
+
 #ifndef KRK_NO_FILESYSTEM
-KrkValue krk_runfile(const char * fileName, char * fromFile) {
+static char * readSourceFile(const char * fileName, size_t * sizeOut) {
 	FILE * f = fopen(fileName,"r");
 	if (!f) {
 		fprintf(stderr, "%s: could not open file '%s': %s\n", "kuroko", fileName, strerror(errno));
-		return INTEGER_VAL(errno);
+		return NULL;
 	}
 
 	fseek(f, 0, SEEK_END);
@@ -3218,10 +3831,20 @@ KrkValue krk_runfile(const char * fileName, char * fromFile) {
 	char * buf = malloc(size+1);
 	if (fread(buf, 1, size, f) == 0 && size != 0) {
 		fprintf(stderr, "%s: could not read file '%s': %s\n", "kuroko", fileName, strerror(errno));
-		return INTEGER_VAL(errno);
+		free(buf);
+		fclose(f);
+		return NULL;
 	}
 	fclose(f);
 	buf[size] = '\0';
+	*sizeOut = size;
+	return buf;
+}
+
+KrkValue krk_runfile(const char * fileName, char * fromFile) {
+	size_t size;
+	char * buf = readSourceFile(fileName, &size);
+	if (!buf) return INTEGER_VAL(errno);
 
 	KrkValue result = krk_interpret(buf, fromFile);
 	free(buf);
@@ -3229,4 +3852,32 @@ KrkValue krk_runfile(const char * fileName, char * fromFile) {
 	return result;
 }
 
+/**
+ * Run a module's source file, from its cached bytecode if that is
+ * up to date, otherwise compiling it and writing a new cache.
+ */
+static KrkValue runModuleFile(const char * fileName) {
+	KrkCodeObject * function = krk_loadBytecode(fileName);
+	if (!function) {
+		size_t size;
+		char * buf = readSourceFile(fileName, &size);
+		if (!buf) return INTEGER_VAL(errno);
+
+		function = krk_compile(buf, (char*)fileName);
+		if (function) {
+			krk_push(OBJECT_VAL(function));
+			krk_saveBytecode(function, fileName, buf, size);
+			krk_pop();
+		}
+		free(buf);
+
+		if (!function) {
+			if (!krk_currentThread.frameCount) handleException();
+			return NONE_VAL();
+		}
+	}
+
+	return runModuleCode(function);
+}
+
 #endif